@@ -20,7 +20,11 @@ namespace mongo {
            the QueryOption_AwaitData option. if it doesn't, a repl slave client should sleep 
         a little between getMore's.
         */
-        ResultFlag_AwaitCapable = 8
+        ResultFlag_AwaitCapable = 8,
+
+        /* the documents are compressed, as asked for with QueryOption_CompressReply: the data
+           section is their uncompressed length then their compress::block() form. */
+        ResultFlag_Compressed = 16
     };
 
 }
@@ -69,8 +69,14 @@ namespace mongo {
             method, and it will take care of all the details for you.
         */
         QueryOption_Exhaust = 1 << 6,
+
+        /** Ask the server to compress the replies for this query and its getMores.  Worth it for large
+            replies over slow links, e.g. a secondary tailing the oplog across regions.  The cursor
+            decompresses transparently; servers that do not know the option ignore it and reply as usual.
+        */
+        QueryOption_CompressReply = 1 << 7,
         
-        QueryOption_AllSupported = QueryOption_CursorTailable | QueryOption_SlaveOk | QueryOption_OplogReplay | QueryOption_NoCursorTimeout | QueryOption_AwaitData | QueryOption_Exhaust
+        QueryOption_AllSupported = QueryOption_CursorTailable | QueryOption_SlaveOk | QueryOption_OplogReplay | QueryOption_NoCursorTimeout | QueryOption_AwaitData | QueryOption_Exhaust | QueryOption_CompressReply
 
     };
 
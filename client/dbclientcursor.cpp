@@ -19,6 +19,7 @@
 #include "dbclient.h"
 #include "../db/dbmessage.h"
 #include "../db/cmdline.h"
+#include "../util/compress.h"
 #include "connpool.h"
 #include "../s/shard.h"
 
@@ -102,8 +103,31 @@ namespace mongo {
         dataReceived();
     }
 
+    /* a ResultFlag_Compressed reply's data section is the documents' length then their
+       compress::block() form; returns the reply with the documents in place, in a new buffer */
+    static QueryResult* expandReply( QueryResult *z ) {
+        const char *p = z->data();
+        int dataLen = *(const int *) p;
+        int zLen = z->len - sizeof(QueryResult) - 4;
+        uassert( 13641 , "bad compressed reply from server" , dataLen >= 0 && zLen >= 0 );
+
+        QueryResult *qr = (QueryResult *) malloc( sizeof(QueryResult) + dataLen );
+        memcpy( qr , z , sizeof(QueryResult) );
+        qr->len = sizeof(QueryResult) + dataLen;
+        qr->_resultFlags() &= ~ResultFlag_Compressed;
+        if ( !compress::unblock( p + 4 , zLen , (char *) qr->data() , dataLen ) ) {
+            free( qr );
+            uasserted( 13642 , "corrupt compressed reply from server" );
+        }
+        return qr;
+    }
+
     void DBClientCursor::dataReceived() {
         QueryResult *qr = (QueryResult *) m->singleData();
+        if ( qr->resultFlags() & ResultFlag_Compressed ) {
+            qr = expandReply( qr );
+            m.reset( new Message( qr , true ) );
+        }
         resultFlags = qr->resultFlags();
         
         if ( qr->resultFlags() & ResultFlag_CursorNotFound ) {
@@ -23,6 +23,7 @@
 #include "../db/dbmessage.h"
 #include "../s/util.h"
 #include "../s/shard.h"
+#include "../util/timer.h"
 
 namespace mongo {
     
@@ -194,6 +195,8 @@ namespace mongo {
         b.append( "numQueries" , (int)numExplains );
         b.append( "numShards" , (int)out.size() );
 
+        _explainStats( b );
+
         return b.obj();
     }
     
@@ -259,6 +262,229 @@ namespace mongo {
         _done = true;
     }
     
+    // --------  PrefetchingClientCursor -----------
+
+    /* the threads PrefetchingClientCursor reads on.  work never queues behind other work: when no
+       thread is idle a new one starts, so every server of every query is read at once however many
+       queries there are.  an idle thread waits a while for more, keeping its shard connections,
+       and ends once it has been idle for IdleSecs -- so there are about as many as the load needs
+    */
+    class PrefetchWorkers : boost::noncopyable {
+    public:
+        PrefetchWorkers() : _mutex( "PrefetchWorkers" ) , _threads(0) , _idle(0){}
+
+        void schedule( const boost::function<void()>& work ){
+            scoped_lock lk( _mutex );
+            _work.push_back( work );
+            if ( _idle >= (int)_work.size() ){
+                _workCond.notify_one();
+                return;
+            }
+            try {
+                boost::thread thr( boost::bind( &PrefetchWorkers::_loop , this ) );
+                _threads++;
+            }
+            catch ( boost::thread_resource_error& ){
+                if ( _threads == 0 ){
+                    _work.pop_back();
+                    throw;
+                }
+                log() << "couldn't start a prefetch thread, waiting for one of the " << _threads << " running" << endl;
+            }
+        }
+
+    private:
+        static const int IdleSecs = 60;
+
+        void _loop(){
+            setThreadName( "parallelPrefetch" );
+            boost::function<void()> work;
+            while ( _take( work ) ){
+                work();
+                work.clear();
+            }
+        }
+
+        // @return false when this thread has been idle long enough to end
+        bool _take( boost::function<void()>& work ){
+            scoped_lock lk( _mutex );
+            _idle++;
+            while ( _work.empty() ){
+                boost::xtime xt;
+                boost::xtime_get( &xt , boost::TIME_UTC );
+                xt.sec += IdleSecs;
+                if ( ! _workCond.timed_wait( lk.boost() , xt ) && _work.empty() ){
+                    _idle--;
+                    _threads--;
+                    return false;
+                }
+            }
+            _idle--;
+            work = _work.front();
+            _work.pop_front();
+            return true;
+        }
+
+        mongo::mutex _mutex;
+        boost::condition _workCond;
+        list< boost::function<void()> > _work;
+        int _threads;
+        int _idle; // threads waiting for work
+    };
+
+    static PrefetchWorkers& prefetchWorkers(){
+        static mongo::mutex m( "prefetchWorkers" );
+        static PrefetchWorkers *w = 0; // never deleted: idle threads may outlive static destruction
+        scoped_lock lk( m );
+        if ( ! w )
+            w = new PrefetchWorkers();
+        return *w;
+    }
+
+    PrefetchingClientCursor::PrefetchingClientCursor()
+        : _busy(false) , _mutex( "PrefetchingClientCursor" ) ,
+          _pos(0) , _exhausted(false) , _errCode(0) , _batches(0) , _microsWaiting(0){
+    }
+
+    PrefetchingClientCursor::~PrefetchingClientCursor(){
+        // the worker uses this object, so it has to finish first
+        _wait();
+    }
+
+    void PrefetchingClientCursor::open( const Opener& opener ){
+        assert( ! _cursor.get() && ! _busy );
+        _start( boost::bind( &PrefetchingClientCursor::_open , this , opener ) );
+    }
+
+    bool PrefetchingClientCursor::more(){
+        _refill();
+        return _pos < _ready.size();
+    }
+
+    BSONObj PrefetchingClientCursor::next(){
+        assert( more() );
+        return _ready[_pos++];
+    }
+
+    BSONObj PrefetchingClientCursor::peek(){
+        if ( ! more() )
+            return BSONObj();
+        return _ready[_pos];
+    }
+
+    void PrefetchingClientCursor::_start( const boost::function<void()>& work ){
+        {
+            scoped_lock lk( _mutex );
+            assert( ! _busy );
+            _busy = true;
+        }
+        try {
+            prefetchWorkers().schedule( boost::bind( &PrefetchingClientCursor::_run , this , work ) );
+        }
+        catch ( ... ){
+            scoped_lock lk( _mutex );
+            _busy = false;
+            throw;
+        }
+    }
+
+    void PrefetchingClientCursor::_run( boost::function<void()> work ){
+        work();
+        scoped_lock lk( _mutex );
+        _busy = false;
+        _doneCond.notify_all();
+    }
+
+    void PrefetchingClientCursor::_wait(){
+        scoped_lock lk( _mutex );
+        while ( _busy )
+            _doneCond.wait( lk.boost() );
+    }
+
+    void PrefetchingClientCursor::_join(){
+        Timer t;
+        _wait();
+        _microsWaiting += t.micros();
+
+        if ( _stale ){
+            shared_ptr<StaleConfigException> e = _stale;
+            _stale.reset();
+            throw *e;
+        }
+
+        if ( _errMsg.size() ){
+            string msg = _errMsg;
+            _errMsg.clear();
+            throw UserException( _errCode , msg );
+        }
+    }
+
+    void PrefetchingClientCursor::_refill(){
+        if ( _pos < _ready.size() )
+            return;
+
+        _join();
+
+        _ready.clear();
+        _ready.swap( _pending );
+        _pos = 0;
+
+        if ( _ready.empty() || _exhausted )
+            return;
+
+        // read the next batch while this one is consumed
+        _start( boost::bind( &PrefetchingClientCursor::_fetch , this ) );
+    }
+
+    void PrefetchingClientCursor::_open( Opener opener ){
+        try {
+            _cursor = opener();
+            _fill();
+        }
+        catch ( StaleConfigException& e ){
+            _stale.reset( new StaleConfigException( e ) );
+        }
+        catch ( DBException& e ){
+            _errCode = e.getCode();
+            _errMsg = e.what();
+        }
+        catch ( std::exception& e ){
+            _errCode = 13647;
+            _errMsg = e.what();
+        }
+    }
+
+    void PrefetchingClientCursor::_fetch(){
+        try {
+            _fill();
+        }
+        catch ( DBException& e ){
+            _errCode = e.getCode();
+            _errMsg = e.what();
+        }
+        catch ( std::exception& e ){
+            _errCode = 13647;
+            _errMsg = e.what();
+        }
+    }
+
+    void PrefetchingClientCursor::_fill(){
+        assert( _pending.empty() );
+
+        if ( ! _cursor.get() || ! _cursor->more() ){
+            _exhausted = true;
+            return;
+        }
+
+        // owned copies, as the cursor reuses its buffer for the next batch
+        _pending.reserve( _cursor->objsLeftInBatch() );
+        while ( _cursor->moreInCurrentBatch() )
+            _pending.push_back( _cursor->next().getOwned() );
+
+        _exhausted = _cursor->isDead();
+        _batches++;
+    }
+    
     // --------  SerialServerClusteredCursor -----------
     
     SerialServerClusteredCursor::SerialServerClusteredCursor( const set<ServerAndQuery>& servers , QueryMessage& q , int sortOrder) : ClusteredCursor( q ){
@@ -333,6 +559,9 @@ namespace mongo {
     void ParallelSortClusteredCursor::_finishCons(){
         _numServers = _servers.size();
         _cursors = 0;
+        _millisToFirst = 0;
+        _nMerged = 0;
+        _microsMerging = 0;
 
         if ( ! _sortKey.isEmpty() && ! _fields.isEmpty() ){
             // we need to make sure the sort key is in the project
@@ -378,15 +607,20 @@ namespace mongo {
     
     void ParallelSortClusteredCursor::_init(){
         assert( ! _cursors );
-        _cursors = new FilteringClientCursor[_numServers];
+        _cursors = new PrefetchingClientCursor[_numServers];
             
-        // TODO: parellize
+        // all at once, so the first result waits on the slowest server rather than on the sum of them
+        Timer t;
         int num = 0;
         for ( set<ServerAndQuery>::iterator i = _servers.begin(); i!=_servers.end(); ++i ){
             const ServerAndQuery& sq = *i;
-            _cursors[num++].reset( query( sq._server , 0 , sq._extra , _needToSkip ) );
+            _cursors[num++].open( boost::bind( &ParallelSortClusteredCursor::query , this , sq._server , 0 , sq._extra , _needToSkip ) );
         }
-            
+
+        // waits for the first batches and throws anything opening them did
+        for ( int i=0; i<_numServers; i++ )
+            _cursors[i].more();
+        _millisToFirst = t.millis();
     }
     
     ParallelSortClusteredCursor::~ParallelSortClusteredCursor(){
@@ -416,6 +650,7 @@ namespace mongo {
     }
         
     BSONObj ParallelSortClusteredCursor::next(){
+        Timer t;
         BSONObj best = BSONObj();
         int bestFrom = -1;
             
@@ -441,7 +676,9 @@ namespace mongo {
         
         uassert( 10019 ,  "no more elements" , ! best.isEmpty() );
         _cursors[bestFrom].next();
-            
+
+        _nMerged++;
+        _microsMerging += t.micros();
         return best;
     }
 
@@ -454,6 +691,26 @@ namespace mongo {
 
     }
 
+    void ParallelSortClusteredCursor::_explainStats( BSONObjBuilder& b ){
+        if ( ! _cursors )
+            return;
+
+        int batches = 0;
+        long long microsWaiting = 0;
+        for ( int i=0; i<_numServers; i++ ){
+            batches += _cursors[i].batches();
+            microsWaiting += _cursors[i].microsWaiting();
+        }
+
+        BSONObjBuilder x( b.subobjStart( "parallel" ) );
+        x.append( "millisToFirst" , _millisToFirst );
+        x.appendNumber( "nBatches" , batches );
+        x.appendNumber( "nMerged" , _nMerged );
+        x.appendNumber( "millisMerging" , _microsMerging / 1000 );
+        x.appendNumber( "millisWaitingOnServers" , microsWaiting / 1000 );
+        x.done();
+    }
+
     // -----------------
     // ---- Future -----
     // -----------------
@@ -96,6 +96,9 @@ namespace mongo {
         
         virtual void _explain( map< string,list<BSONObj> >& out ) = 0;
 
+        /** for anything the cursor itself measured */
+        virtual void _explainStats( BSONObjBuilder& b ){}
+
         string _ns;
         BSONObj _query;
         int _options;
@@ -131,6 +134,68 @@ namespace mongo {
     };
 
 
+    class StaleConfigException;
+
+    /**
+     * a cursor to one server that reads its batches on another thread
+     * while one batch is being consumed, the next is already on its way
+     *
+     * the reading is done by worker threads shared by all these cursors, started when none is
+     * idle and kept while there is work for them.  a thread's shard connections are its own, so a
+     * new thread would set the shard version on a connection to every shard first and unset them
+     * all when it ended
+     */
+    class PrefetchingClientCursor : boost::noncopyable {
+    public:
+        typedef boost::function< auto_ptr<DBClientCursor>() > Opener;
+
+        PrefetchingClientCursor();
+        ~PrefetchingClientCursor();
+
+        /** starts opening the cursor in the background; more() waits for it */
+        void open( const Opener& opener );
+
+        bool more();
+        BSONObj next();
+        BSONObj peek();
+
+        int batches() const { return _batches; }
+        long long microsWaiting() const { return _microsWaiting; }
+
+    private:
+        void _start( const boost::function<void()>& work );
+        void _wait();
+        void _join();
+        void _refill();
+
+        // these run on a worker thread
+        void _run( boost::function<void()> work );
+        void _open( Opener opener );
+        void _fetch();
+        void _fill();
+        
+        auto_ptr<DBClientCursor> _cursor;
+
+        // true from _start() until the work is done
+        bool _busy;
+        mongo::mutex _mutex;
+        boost::condition _doneCond;
+
+        vector<BSONObj> _ready;
+        unsigned _pos;
+
+        // written by the worker thread, read after _join()
+        vector<BSONObj> _pending;
+        bool _exhausted;
+        shared_ptr<StaleConfigException> _stale;
+        int _errCode;
+        string _errMsg;
+
+        int _batches;
+        long long _microsWaiting;
+    };
+
+
     class Servers {
     public:
         Servers(){
@@ -213,6 +278,7 @@ namespace mongo {
     /**
      * runs a query in parellel across N servers
      * sots
+     * every server's cursor is opened at once and read ahead by a batch while merging
      */        
     class ParallelSortClusteredCursor : public ClusteredCursor {
     public:
@@ -228,13 +294,18 @@ namespace mongo {
         void _init();
 
         virtual void _explain( map< string,list<BSONObj> >& out );
+        virtual void _explainStats( BSONObjBuilder& b );
 
         int _numServers;
         set<ServerAndQuery> _servers;
         BSONObj _sortKey;
         
-        FilteringClientCursor * _cursors;
+        PrefetchingClientCursor * _cursors;
         int _needToSkip;
+
+        int _millisToFirst;
+        long long _nMerged;
+        long long _microsMerging;
     };
 
     /**
@@ -48,6 +48,7 @@ namespace mongo {
 
     private:
         NamespaceString _ns;
+        static mongo::mutex m; // with --perDbLocking the write lock alone doesn't protect these
         static map<string, unsigned> dbsInProg;
         static set<string> nsInProg;
     };
@@ -26,6 +26,7 @@
 #include "dbhelpers.h"
 #include "curop.h"
 #include "stats/counters.h"
+#include "key.h"
 
 namespace mongo {
 
@@ -33,11 +34,97 @@ namespace mongo {
 
     KeyNode::KeyNode(const BucketBasics& bb, const _KeyNode &k) :
             prevChildBucket(k.prevChildBucket),
-            recordLoc(k.recordLoc), key(bb.data+k.keyDataOfs())
+            recordLoc(k.recordLoc), key(bb.storedKey(k.keyDataOfs()))
     { }
 
     const int KeyMax = BucketSize / 10;
 
+    /* v1 buckets keep each key's CompactKey form behind a KeyV1Header.  A key may take the first
+       'prefix' bytes of that form from an "anchor" -- a key of the bucket stored whole, found
+       through a neighbour when the key went in.  The anchor's bytes stay where they are as long as
+       a key refers to them, even once the anchor itself has been deleted from the bucket; pack()
+       moves them with the keys and lets them go when nothing refers to them any more.
+    */
+#pragma pack(1)
+    struct KeyV1Header {
+        enum { Prefixed = 0x8000 };
+        unsigned short _len; // of the CompactKey form.  | Prefixed when a KeyV1Prefix follows
+        int len() const { return _len & ~Prefixed; }
+        bool prefixed() const { return ( _len & Prefixed ) != 0; }
+    };
+    struct KeyV1Prefix {
+        short anchorOfs;
+        unsigned short prefix;
+    };
+#pragma pack()
+
+    /* sharing fewer bytes than this doesn't pay for the KeyV1Prefix */
+    const int MinPrefix = sizeof(KeyV1Prefix) + 2;
+
+    /* a key as a bucket stores it: its BSON in v0 buckets, or its compact form in v1 ones */
+    class StoredKey : boost::noncopyable {
+    public:
+        /* for the key going in at keypos, before the keys from there on are shifted over */
+        StoredKey(const BucketBasics& b, const BSONObj& key, int keypos) :
+            _key(key), _v1(b._version != 0), _compact(0), _anchorOfs(0), _prefix(0) {
+            if ( _v1 ) {
+                CompactKey::encode(key, _compact);
+                findAnchor(b, keypos);
+            }
+        }
+
+        /* share what we can with the anchor of the key before or after keypos */
+        void findAnchor(const BucketBasics& b, int keypos) {
+            _prefix = 0;
+            if ( !_v1 )
+                return;
+            for ( int i = keypos - 1; i <= keypos; i++ ) {
+                if ( i < 0 || i >= b.n )
+                    continue;
+                short a = b.anchorOf(b.k(i).keyDataOfs());
+                const KeyV1Header *h = (const KeyV1Header *) (b.data + a);
+                int p = CompactKey::commonPrefix((const char *) (h + 1), h->len(), _compact.buf(), _compact.len());
+                if ( p > _prefix ) {
+                    _prefix = p;
+                    _anchorOfs = a;
+                }
+            }
+            if ( _prefix < MinPrefix )
+                _prefix = 0;
+        }
+
+        int size() const {
+            if ( !_v1 )
+                return _key.objsize();
+            return sizeof(KeyV1Header) + (_prefix ? sizeof(KeyV1Prefix) : 0) + _compact.len() - _prefix;
+        }
+
+        void writeTo(char *p) const {
+            if ( !_v1 ) {
+                memcpy(p, _key.objdata(), _key.objsize());
+                return;
+            }
+            KeyV1Header *h = (KeyV1Header *) p;
+            h->_len = (unsigned short) _compact.len();
+            p += sizeof(KeyV1Header);
+            if ( _prefix ) {
+                h->_len |= KeyV1Header::Prefixed;
+                KeyV1Prefix *x = (KeyV1Prefix *) p;
+                x->anchorOfs = _anchorOfs;
+                x->prefix = (unsigned short) _prefix;
+                p += sizeof(KeyV1Prefix);
+            }
+            memcpy(p, _compact.buf() + _prefix, _compact.len() - _prefix);
+        }
+
+    private:
+        const BSONObj& _key;
+        bool _v1;
+        BufBuilder _compact;
+        short _anchorOfs;
+        int _prefix;
+    };
+
     extern int otherTraceLevel;
     const int split_debug = 0;
     const int insert_debug = 0;
@@ -200,11 +287,11 @@ namespace mongo {
         return (int) (Size() - (data-(char*)this));
     }
 
-    void BucketBasics::init() {
+    void BucketBasics::init( int version ) {
         parent.Null();
         nextChild.Null();
         _wasSize = BucketSize;
-        _reserved1 = 0;
+        _version = version;
         flags = Packed;
         n = 0;
         emptySize = totalDataSize();
@@ -212,6 +299,55 @@ namespace mongo {
         reserved = 0;
     }
 
+    const char* BucketBasics::compactForm( short ofs, char *buf, int& len ) const {
+        const KeyV1Header *h = (const KeyV1Header *) (data + ofs);
+        len = h->len();
+        if ( !h->prefixed() )
+            return (const char *) (h + 1);
+
+        const KeyV1Prefix *x = (const KeyV1Prefix *) (h + 1);
+        const KeyV1Header *a = (const KeyV1Header *) (data + x->anchorOfs);
+        dassert( !a->prefixed() && a->len() >= x->prefix );
+        memcpy(buf, a + 1, x->prefix);
+        memcpy(buf + x->prefix, x + 1, h->len() - x->prefix);
+        return buf;
+    }
+
+    BSONObj BucketBasics::compactKey( short ofs ) const {
+        char buf[BucketSize];
+        int len;
+        const char *p = compactForm(ofs, buf, len);
+        return CompactKey::decode(p, len);
+    }
+
+    /* find() compares against a key of each bucket it descends through, so for v1 buckets the key
+       is decoded into a buffer on the stack rather than an allocated object */
+    int BucketBasics::compareKey( const BSONObj& key, int i, const Ordering& order ) const {
+        short ofs = k(i).keyDataOfs();
+        if ( _version == 0 )
+            return key.woCompare(BSONObj(data + ofs), order);
+        char buf[BucketSize];
+        char decoded[BucketSize];
+        int len;
+        const char *p = compactForm(ofs, buf, len);
+        return key.woCompare(CompactKey::decode(p, len, decoded, sizeof(decoded)), order);
+    }
+
+    int BucketBasics::keyDataSize( short ofs ) const {
+        if ( _version == 0 )
+            return BSONObj(data + ofs).objsize();
+        const KeyV1Header *h = (const KeyV1Header *) (data + ofs);
+        if ( !h->prefixed() )
+            return sizeof(KeyV1Header) + h->len();
+        const KeyV1Prefix *x = (const KeyV1Prefix *) (h + 1);
+        return sizeof(KeyV1Header) + sizeof(KeyV1Prefix) + h->len() - x->prefix;
+    }
+
+    short BucketBasics::anchorOf( short ofs ) const {
+        const KeyV1Header *h = (const KeyV1Header *) (data + ofs);
+        return h->prefixed() ? ((const KeyV1Prefix *) (h + 1))->anchorOfs : ofs;
+    }
+
     /* see _alloc */
     inline void BucketBasics::_unalloc(int bytes) {
         topSize -= bytes;
@@ -249,7 +385,7 @@ namespace mongo {
         KeyNode kn = keyNode(n-1);
         recLoc = kn.recordLoc;
         key = kn.key;
-        int keysize = kn.key.objsize();
+        int keysize = keyDataSize(k(n-1).keyDataOfs()); // the last pushed, so its data is on top
 
 		massert( 10283 , "rchild not null in btree popBack()", nextChild.isNull());
 
@@ -263,7 +399,8 @@ namespace mongo {
 
     /* add a key.  must be > all existing.  be careful to set next ptr right. */
     bool BucketBasics::_pushBack(const DiskLoc& recordLoc, BSONObj& key, const Ordering &order, DiskLoc prevChild) {
-        int bytesNeeded = key.objsize() + sizeof(_KeyNode);
+        StoredKey sk(*this, key, n);
+        int bytesNeeded = sk.size() + sizeof(_KeyNode);
         if ( bytesNeeded > emptySize )
             return false;
         assert( bytesNeeded <= emptySize );
@@ -272,9 +409,8 @@ namespace mongo {
         _KeyNode& kn = k(n++);
         kn.prevChildBucket = prevChild;
         kn.recordLoc = recordLoc;
-        kn.setKeyDataOfs( (short) _alloc(key.objsize()) );
-        char *p = dataAt(kn.keyDataOfs());
-        memcpy(p, key.objdata(), key.objsize());
+        kn.setKeyDataOfs( (short) _alloc(sk.size()) );
+        sk.writeTo(dataAt(kn.keyDataOfs()));
         return true;
     }
     /*void BucketBasics::pushBack(const DiskLoc& recordLoc, BSONObj& key, const BSONObj &order, DiskLoc prevChild, DiskLoc nextChild) { 
@@ -286,9 +422,12 @@ namespace mongo {
     bool BucketBasics::basicInsert(const DiskLoc& thisLoc, int &keypos, const DiskLoc& recordLoc, const BSONObj& key, const Ordering &order) {
         modified(thisLoc);
         assert( keypos >= 0 && keypos <= n );
-        int bytesNeeded = key.objsize() + sizeof(_KeyNode);
+        StoredKey sk(*this, key, keypos);
+        int bytesNeeded = sk.size() + sizeof(_KeyNode);
         if ( bytesNeeded > emptySize ) {
             pack( order, keypos );
+            sk.findAnchor(*this, keypos); // pack moved the anchors
+            bytesNeeded = sk.size() + sizeof(_KeyNode);
             if ( bytesNeeded > emptySize )
                 return false;
         }
@@ -299,12 +438,20 @@ namespace mongo {
         _KeyNode& kn = k(keypos);
         kn.prevChildBucket.Null();
         kn.recordLoc = recordLoc;
-        kn.setKeyDataOfs((short) _alloc(key.objsize()) );
-        char *p = dataAt(kn.keyDataOfs());
-        memcpy(p, key.objdata(), key.objsize());
+        kn.setKeyDataOfs((short) _alloc(sk.size()) );
+        sk.writeTo(dataAt(kn.keyDataOfs()));
         return true;
     }
 
+    /* pack() helper: copy the key data at 'from' to just below ofs in temp.  @return its new offset */
+    inline short BucketBasics::packCopy( char *temp, int &ofs, short from ) {
+        int sz = keyDataSize(from);
+        ofs -= sz;
+        topSize += sz;
+        memcpy(temp+ofs, dataAt(from), sz);
+        return (short) ofs;
+    }
+
     /* when we delete things we just leave empty space until the node is
        full and then we repack it.
     */
@@ -316,6 +463,7 @@ namespace mongo {
         char temp[BucketSize];
         int ofs = tdz;
         topSize = 0;
+        map<short, short> anchors; // v1: old offset -> new of the anchors copied so far
         int i = 0;
         for ( int j = 0; j < n; j++ ) {
             if( j > 0 && ( j != refPos ) && k( j ).isUnused() && k( j ).prevChildBucket.isNull() ) {
@@ -328,11 +476,25 @@ namespace mongo {
                 k( i ) = k( j );
             }
             short ofsold = k(i).keyDataOfs();
-            int sz = keyNode(i).key.objsize();
-            ofs -= sz;
-            topSize += sz;
-            memcpy(temp+ofs, dataAt(ofsold), sz);
-            k(i).setKeyDataOfsSavingUse( ofs );
+            short ofsnew;
+            if ( _version == 0 ) {
+                ofsnew = packCopy(temp, ofs, ofsold);
+            }
+            else {
+                // an anchor is copied once, whether for itself or for a key sharing its prefix.
+                // nothing grows, so the keys still fit.
+                short a = anchorOf(ofsold);
+                map<short, short>::iterator it = anchors.find(a);
+                short anew = it != anchors.end() ? it->second : (anchors[a] = packCopy(temp, ofs, a));
+                if ( a == ofsold ) {
+                    ofsnew = anew;
+                }
+                else {
+                    ofsnew = packCopy(temp, ofs, ofsold);
+                    ((KeyV1Prefix *) (temp + ofsnew + sizeof(KeyV1Header)))->anchorOfs = anew;
+                }
+            }
+            k(i).setKeyDataOfsSavingUse( ofsnew );
             ++i;
         }
         if ( refPos == n ) {
@@ -501,8 +663,8 @@ namespace mongo {
         int h=n-1;
         while ( l <= h ) {
             int m = (l+h)/2;
-            KeyNode M = keyNode(m);
-            int x = key.woCompare(M.key, order);
+            const _KeyNode& M = k(m);
+            int x = compareKey(key, m, order);
             if ( x == 0 ) { 
                 if( assertIfDup ) {
                     if( k(m).isUnused() ) { 
@@ -544,10 +706,9 @@ namespace mongo {
         // not found
         pos = l;
         if ( pos != n ) {
-            BSONObj keyatpos = keyNode(pos).key;
-            wassert( key.woCompare(keyatpos, order) <= 0 );
+            wassert( compareKey(key, pos, order) <= 0 );
             if ( pos > 0 ) {
-                wassert( keyNode(pos-1).key.woCompare(key, order) <= 0 );
+                wassert( compareKey(key, pos-1, order) >= 0 );
             }
         }
 
@@ -589,6 +750,7 @@ found:
         modified(thisLoc);
 #else
         //defensive:
+        modified(thisLoc);
         n = -1;
         parent.Null();
         string ns = id.indexNamespace();
@@ -770,7 +932,7 @@ found:
                 p->pushBack(splitkey.recordLoc, splitkey.key, order, thisLoc);
                 p->nextChild = rLoc;
                 p->assertValid( order );
-                parent = idx.head = L;
+                parent = dur::writingDiskLoc(idx.head) = L;
                 if ( split_debug )
                     out() << "    we were root, making new root:" << hex << parent.getOfs() << dec << endl;
                 rLoc.btreemod()->parent = parent;
@@ -810,7 +972,7 @@ found:
     DiskLoc BtreeBucket::addBucket(IndexDetails& id) {
         DiskLoc loc = btreeStore->insert(id.indexNamespace().c_str(), 0, BucketSize, true);
         BtreeBucket *b = loc.btreemod();
-        b->init();
+        b->init( id.version() );
         return loc;
     }
 
@@ -1054,6 +1216,7 @@ found:
                 log(4) << "btree _insert: reusing unused key" << endl;
                 massert( 10285 , "_insert: reuse key but lchild is not null", lChild.isNull());
                 massert( 10286 , "_insert: reuse key but rchild is not null", rChild.isNull());
+                modified(thisLoc);
                 kn.setUsed();
                 return 0;
             }
@@ -1209,6 +1372,10 @@ namespace mongo {
     }
 
     void BtreeBuilder::newBucket() { 
+        /* a good point to commit if the build has written a lot: the buckets so far are complete. */
+        dur::commitIfNeeded();
+        b = cur.btreemod();
+
         DiskLoc L = BtreeBucket::addBucket(idx);
         b->tempNext() = L;
         cur = L;
@@ -1247,7 +1414,7 @@ namespace mongo {
         while( 1 ) { 
             if( loc.btree()->tempNext().isNull() ) { 
                 // only 1 bucket at this level. we are done.
-                idx.head = loc;
+                dur::writingDiskLoc(idx.head) = loc;
                 break;
             }
             levels++;
@@ -1258,6 +1425,9 @@ namespace mongo {
 
             DiskLoc xloc = loc;
             while( !xloc.isNull() ) { 
+                dur::commitIfNeeded();
+                up = upLoc.btreemod(); // must declare again as we may have just committed
+
                 BtreeBucket *x = xloc.btreemod();
                 BSONObj k; 
                 DiskLoc r;
@@ -62,6 +62,7 @@ namespace mongo {
 #pragma pack()
 
     class BucketBasics;
+    class StoredKey;
 
     /* wrapper - this is our in memory representation of the key.  _KeyNode is the disk representation. */
     class KeyNode {
@@ -77,6 +78,8 @@ namespace mongo {
     class BucketBasics {
         friend class BtreeBuilder;
         friend class KeyNode;
+        friend class IndexStats;
+        friend class StoredKey;
     public:
         void dumpTree(DiskLoc thisLoc, const BSONObj &order);
         bool isHead() { return parent.isNull(); }
@@ -101,7 +104,23 @@ namespace mongo {
             return data + ofs;
         }
 
-        void init(); // initialize a new node
+        void init( int version = 0 ); // initialize a new node
+
+        /* the key whose data is at ofs.  v1 keys are decoded from their compact form, so the
+           object is a copy rather than a pointer into the bucket. */
+        BSONObj storedKey( short ofs ) const {
+            return _version == 0 ? BSONObj( data + ofs ) : compactKey( ofs );
+        }
+        BSONObj compactKey( short ofs ) const;
+        /* v1: the compact form of the key at ofs, put together in buf if it shares an anchor's bytes */
+        const char* compactForm( short ofs , char *buf , int& len ) const;
+        /* key.woCompare( key i ) without building key i as an owned object */
+        int compareKey( const BSONObj& key , int i , const Ordering& order ) const;
+        /* bytes the key at ofs takes in the data area */
+        int keyDataSize( short ofs ) const;
+        /* v1: the key stored whole whose leading bytes the key at ofs shares -- ofs itself if none */
+        short anchorOf( short ofs ) const;
+        short packCopy( char *temp, int &ofs, short from );
 
         /* returns false if node is full and must be split
            keypos is where to insert -- inserted after that key #.  so keypos=0 is the leftmost one.
@@ -153,6 +172,7 @@ namespace mongo {
             ss << "    parent: " << parent.toString() << endl;
             ss << "    nextChild: " << parent.toString() << endl;
             ss << "    flags:" << flags << endl;
+            ss << "    version: " << _version << endl;
             ss << "    emptySize: " << emptySize << " topSize: " << topSize << endl;
             return ss.str();
         }
@@ -167,7 +187,7 @@ namespace mongo {
 
     private:
         unsigned short _wasSize; // can be reused, value is 8192 in current pdfile version Apr2010
-        unsigned short _reserved1; // zero
+        unsigned short _version; // key format.  0: BSON.  1: CompactKey, see StoredKey.  from the index spec's v
 
     protected:
         int Size() const;
@@ -58,6 +58,7 @@ namespace mongo {
         assert(capped);
 
         list<DiskLoc> drecs;
+        dur::writing(this);
 
         // Pull out capExtent's DRs from deletedList
         DiskLoc i = cappedFirstDeletedInCurExtent();
@@ -81,7 +82,7 @@ namespace mongo {
             DiskLoc b = *j;
             while ( a.a() == b.a() && a.getOfs() + a.drec()->lengthWithHeaders == b.getOfs() ) {
                 // a & b are adjacent.  merge.
-                a.drec()->lengthWithHeaders += b.drec()->lengthWithHeaders;
+                dur::writingInt(a.drec()->lengthWithHeaders) += b.drec()->lengthWithHeaders;
                 j++;
                 if ( j == drecs.end() ) {
                     DEBUGGING out() << "temp: compact adddelrec2\n";
@@ -179,8 +180,8 @@ namespace mongo {
             if ( prev.isNull() )
                 cappedListOfAllDeletedRecords() = ret.drec()->nextDeleted;
             else
-                prev.drec()->nextDeleted = ret.drec()->nextDeleted;
-            ret.drec()->nextDeleted.setInvalid(); // defensive.
+                dur::writingDiskLoc(prev.drec()->nextDeleted) = ret.drec()->nextDeleted;
+            dur::writingDiskLoc(ret.drec()->nextDeleted).setInvalid(); // defensive.
             assert( ret.drec()->extentOfs < ret.getOfs() );
         }
 
@@ -188,6 +189,7 @@ namespace mongo {
     }
 
     DiskLoc NamespaceDetails::cappedAlloc(const char *ns, int len) { 
+        dur::writing(this);
         // signal done allocating new extents.
         if ( !cappedLastDelRecLastExtent().isValid() )
             cappedLastDelRecLastExtent() = DiskLoc();
@@ -285,6 +287,7 @@ namespace mongo {
     void NamespaceDetails::cappedTruncateAfter(const char *ns, DiskLoc end, bool inclusive) {
         DEV assert( this == nsdetails(ns) );
         assert( cappedLastDelRecLastExtent().isValid() );
+        dur::writing(this);
         
         bool foundLast = false;
         while( 1 ) {
@@ -358,6 +361,8 @@ namespace mongo {
         ClientCursor::invalidate( ns );
 		NamespaceDetailsTransient::clearForPrefix( ns );
 
+        dur::writing(this);
+
         cappedLastDelRecLastExtent() = DiskLoc();
         cappedListOfAllDeletedRecords() = DiskLoc();
         
@@ -385,8 +390,8 @@ namespace mongo {
             DiskLoc prev = ext.ext()->xprev;
             DiskLoc next = ext.ext()->xnext;
             DiskLoc empty = ext.ext()->reuse( ns );
-            ext.ext()->xprev = prev;
-            ext.ext()->xnext = next;
+            dur::writingDiskLoc(ext.ext()->xprev) = prev;
+            dur::writingDiskLoc(ext.ext()->xnext) = next;
             addDeletedRec( empty.drec(), empty );
         }
     }
@@ -158,6 +158,13 @@ namespace mongo {
     void Client::Context::_finishInit( bool doauth ){
         int lockState = dbMutex.getState();
         assert( lockState );
+
+        if ( DBLock * l = dbMutex.lockedDB() ) {
+            // with --perDbLocking we may only touch the database we locked (and local, for the oplog)
+            string db = nsToDatabase( _ns.c_str() );
+            massert( 13629 , (string)"can't use database " + db + " while holding a lock on database " + l->name() , 
+                     db == l->name() || db == "local" );
+        }
         
         _db = dbHolder.get( _ns , _path );
         if ( _db ){
@@ -270,7 +270,7 @@ namespace mongo {
 
             _writelock = true;
             dbMutex.unlock_shared();
-            dbMutex.lock();
+            dbMutex.lock(_ns);
 
             if ( cc().getContext() )
                 cc().getContext()->unlocked();
@@ -277,14 +277,27 @@ namespace mongo {
         if ( ! _yieldSometimesTracker.ping() )
             return true;
 
+        // the residency check is a system call, so only made when we might yield anyway
+        if ( Record * rec = c->recordToLoad() )
+            return yield( 0 , rec );
+
         int micros = yieldSuggest();
         return ( micros > 0 ) ? yield( micros ) : true;
     }
 
-    void ClientCursor::staticYield( int micros ) {
+    bool ClientCursor::yieldIfPageFaultLikely(){
+        if ( ! _yieldSometimesTracker.ping() )
+            return true;
+        Record * rec = c->recordToLoad();
+        return rec ? yield( 0 , rec ) : true;
+    }
+
+    void ClientCursor::staticYield( int micros , Record * rec ) {
         {
             dbtempreleasecond unlock;
             if ( unlock.unlocked() ){
+                if ( rec )
+                    rec->touch();
                 if ( micros == -1 )
                     micros = Client::recommendedYieldMicros();
                 if ( micros > 0 )
@@ -343,13 +356,13 @@ namespace mongo {
         return true;        
     }
     
-    bool ClientCursor::yield( int micros ) {
+    bool ClientCursor::yield( int micros , Record * recordToLoad ) {
         if ( ! c->supportYields() )
             return true;
         YieldData data; 
         prepareToYield( data );
         
-        staticYield( micros );
+        staticYield( micros , recordToLoad );
 
         return ClientCursor::recoverFromYield( data );
     }
@@ -443,6 +456,16 @@ namespace mongo {
         }
     }
 
+    bool ClientCursor::naturalScanOpen( const string& ns ){
+        recursive_scoped_lock lock(ccmutex);
+        
+        for ( CCById::iterator i=clientCursorsById.begin(); i!=clientCursorsById.end(); ++i ){
+            if ( i->second->ns == ns && dynamic_cast<BasicCursor*>( i->second->c.get() ) )
+                return true;
+        }
+        return false;
+    }
+
 
     ClientCursorMonitor clientCursorMonitor;
 
@@ -181,15 +181,27 @@ namespace mongo {
          *         if false is returned, then this ClientCursor should be considered deleted - 
          *         in fact, the whole database could be gone.
          */
-        bool yield( int microsToSleep = -1 );
+        bool yield( int microsToSleep = -1 , Record * recordToLoad = 0 );
 
         /**
+         * every so often, yields if the record we are on is likely to page fault (see
+         * yieldIfPageFaultLikely), or if others are waiting for the lock.
          * @return same as yield()
          */
         bool yieldSometimes();
+
+        /**
+         * if the record the cursor is on is likely not in physical memory, yield and take the page
+         * fault while unlocked, so other operations don't wait on the disk.  as the check is a
+         * system call it is only made every so often, like yieldSometimes()'s.
+         * same caveats as yield() re atomic.
+         * @return same as yield()
+         */
+        bool yieldIfPageFaultLikely();
         
         static int yieldSuggest();
-        static void staticYield( int micros );
+        /** @param rec if set, touched while unlocked to fault it in */
+        static void staticYield( int micros , Record * rec = 0 );
         
         struct YieldData { CursorId _id; bool _doingDeletes; };
         bool prepareToYield( YieldData &data );
@@ -320,6 +332,9 @@ public:
         static void aboutToDelete(const DiskLoc& dl);
 
         static void find( const string& ns , set<CursorId>& all );
+
+        /** @return true if a cursor on ns is scanning it in natural order */
+        static bool naturalScanOpen( const string& ns );
     };
 
     class ClientCursorMonitor : public BackgroundJob {
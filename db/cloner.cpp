@@ -50,8 +50,30 @@ namespace mongo {
         bool go(const char *masterHost, string& errmsg, const string& fromdb, bool logForRepl, bool slaveOk, bool useReplAuth, bool snapshot);
 
         bool copyCollection( const string& from , const string& ns , const BSONObj& query , string& errmsg , bool copyIndexes = true, bool logForRepl = true );
+
+        /* copy ns's documents, but not its indexes, from the connection's server into ns.  not logged */
+        void copyData( const char *ns , bool slaveOk ) {
+            copy( ns , ns , /*isindex*/false , /*logForRepl*/false , /*masterSameProcess*/false , slaveOk );
+        }
     };
 
+    /* is collection from_name, as listed in <db>.system.namespaces, one a clone copies? */
+    static bool clonable( const char *from_name ) {
+        if( strstr(from_name, ".system.") ) { 
+            /* system.users and s.js is cloned -- but nothing else from system.
+             * system.indexes is handled specially at the end*/
+            if( legalClientSystemNS( from_name , true ) == 0 ){
+                log(2) << "\t\t not cloning because system collection" << endl;
+                return false;
+            }
+        }
+        if( ! nsDollarCheck( from_name ) ){
+            log(2) << "\t\t not cloning because has $ " << endl;
+            return false;
+        }            
+        return true;
+    }
+
     /* for index info object:
          { "name" : "name_1" , "ns" : "foo.index3" , "key" :  { "name" : 1.0 } }
        we need to fix up the value in the "ns" parameter so that the name prefix is correct on a
@@ -88,7 +110,7 @@ namespace mongo {
 
     struct Cloner::Fun {
         void operator()( DBClientCursorBatchIterator &i ) {
-            mongolock l( true );
+            mongolock l( true , to_collection );
             if ( context ) {
                 context->relocked();
             }
@@ -305,19 +327,8 @@ namespace mongo {
                 assert( e.type() == String );
                 const char *from_name = e.valuestr();
 
-                if( strstr(from_name, ".system.") ) { 
-                    /* system.users and s.js is cloned -- but nothing else from system.
-                     * system.indexes is handled specially at the end*/
-                    if( legalClientSystemNS( from_name , true ) == 0 ){
-                        log(2) << "\t\t not cloning because system collection" << endl;
-                        continue;
-                    }
-                }
-                if( ! nsDollarCheck( from_name ) ){
-                    log(2) << "\t\t not cloning because has $ " << endl;
-                    continue;
-                }            
-                toClone.push_back( collection.getOwned() );
+                if( clonable( from_name ) )
+                    toClone.push_back( collection.getOwned() );
             }
         }
 
@@ -389,6 +400,209 @@ namespace mongo {
         Cloner c;
         return c.go(masterHost, errmsg, fromdb, logForReplication, slaveOk, useReplAuth, snapshot);
     }
+
+    /* For initial sync: all the collections of several databases, copied nConns at a time, each
+       connection on its own thread.  Documents are copied first, with no indexes at all; then each
+       collection gets its _id index and, from one more scan, all its other indexes.  Not logged.
+    */
+    class ParallelClone : boost::noncopyable {
+    public:
+        ParallelClone( const string& host ) : _host( host ) , _m( "parallelClone" ) , _next( 0 ) { }
+        bool go( const list<string>& dbs , int nConns , string& errmsg );
+    private:
+        struct Coll {
+            string ns;
+            bool wantIdIndex;
+        };
+        DBClientBase* connect( string& errmsg );
+        bool prepare( const string& db , string& errmsg );
+        void copyData();
+        void buildIndexes( const string& db );
+
+        const string _host;
+        auto_ptr<DBClientBase> _conn; // for listing the collections and indexes
+        vector<Coll> _colls;
+        map< string , list<BSONObj> > _indexes; // by db, all but the _id indexes
+
+        mongo::mutex _m; // protects below
+        unsigned _next;  // the next of _colls to copy
+        string _error;   // the first copyData() failure
+    };
+
+    DBClientBase* ParallelClone::connect( string& errmsg ) {
+        ConnectionString cs = ConnectionString::parse( _host , errmsg );
+        auto_ptr<DBClientBase> c( cs.connect( errmsg ) );
+        if ( !c.get() )
+            return 0;
+        if ( !replAuthenticate( c.get() ) ) {
+            errmsg = "couldn't authenticate to " + _host;
+            return 0;
+        }
+        return c.release();
+    }
+
+    /* list db's collections and their indexes, and create the collections */
+    bool ParallelClone::prepare( const string& db , string& errmsg ) {
+        list<BSONObj> toCreate;
+        {
+            string ns = db + ".system.namespaces";
+            auto_ptr<DBClientCursor> c = _conn->query( ns , BSONObj() );
+            if ( c.get() == 0 ) {
+                errmsg = "query failed " + ns;
+                return false;
+            }
+            while ( c->more() ) {
+                BSONObj collection = c->next();
+                BSONElement e = collection.getField( "name" );
+                massert( 13639 , "bad system.namespaces object " + collection.toString() , e.type() == String );
+                if ( clonable( e.valuestr() ) )
+                    toCreate.push_back( collection.getOwned() );
+            }
+        }
+        {
+            string ns = db + ".system.indexes";
+            auto_ptr<DBClientCursor> c = _conn->query( ns , BSON( "name" << NE << "_id_" ) );
+            if ( c.get() == 0 ) {
+                errmsg = "query failed " + ns;
+                return false;
+            }
+            list<BSONObj>& indexes = _indexes[ db ];
+            while ( c->more() )
+                indexes.push_back( c->next().getOwned() );
+        }
+
+        writelock lk( db );
+        Client::Context ctx( db );
+        for ( list<BSONObj>::iterator i = toCreate.begin(); i != toCreate.end(); i++ ) {
+            Coll c;
+            c.ns = i->getStringField( "name" );
+            c.wantIdIndex = false;
+            string err;
+            /* the _id index too is built after the copy */
+            userCreateNS( c.ns.c_str() , i->getObjectField( "options" ) , err , false , &c.wantIdIndex );
+            _colls.push_back( c );
+        }
+        return true;
+    }
+
+    /* on each connection's thread: copy collections until there are none left */
+    void ParallelClone::copyData() {
+        Client::initThread( "initialSyncClone" );
+        try {
+            string errmsg;
+            Cloner cloner;
+            DBClientBase *conn = connect( errmsg );
+            uassert( 13640 , errmsg , conn );
+            cloner.setConnection( conn );
+            while ( 1 ) {
+                string ns;
+                {
+                    scoped_lock lk( _m );
+                    if ( _next == _colls.size() || !_error.empty() )
+                        break;
+                    ns = _colls[ _next++ ].ns;
+                }
+                log(1) << "\t\t cloning " << ns << endl;
+                writelock lk( ns );
+                Client::Context ctx( ns );
+                cloner.copyData( ns.c_str() , /*slaveOk*/false );
+            }
+        }
+        catch ( DBException& e ) {
+            scoped_lock lk( _m );
+            if ( _error.empty() )
+                _error = e.toString();
+        }
+        cc().shutdown();
+    }
+
+    void ParallelClone::buildIndexes( const string& db ) {
+        writelock lk( db );
+        Client::Context ctx( db );
+
+        for ( unsigned i = 0; i < _colls.size(); i++ ) {
+            const Coll& c = _colls[i];
+            if ( !c.wantIdIndex || nsToDatabase( c.ns.c_str() ) != db )
+                continue;
+            /* dropDups, as in Cloner::go() */
+            bool old = inDBRepair;
+            try {
+                inDBRepair = true;
+                ensureIdIndexForNewNs( c.ns.c_str() );
+                inDBRepair = old;
+            }
+            catch(...) { 
+                inDBRepair = old;
+                throw;
+            }
+        }
+
+        map< string , list<BSONObj> > byNs;
+        list<BSONObj>& indexes = _indexes[ db ];
+        for ( list<BSONObj>::iterator i = indexes.begin(); i != indexes.end(); i++ ) {
+            BSONObj js = fixindex( *i );
+            byNs[ js.getStringField( "ns" ) ].push_back( js );
+        }
+
+        string system_indexes = db + ".system.indexes";
+        for ( map< string , list<BSONObj> >::iterator i = byNs.begin(); i != byNs.end(); i++ ) {
+            list<BSONObj>& specs = i->second;
+            log(1) << "\t\t building " << specs.size() << " indexes on " << i->first << endl;
+            try {
+                MultiIndexBuild multi;
+                for ( list<BSONObj>::iterator j = specs.begin(); j != specs.end(); j++ )
+                    theDataFileMgr.insertWithObjMod( system_indexes.c_str() , *j );
+                multi.done();
+            }
+            catch ( DBException& e ) {
+                // one bad index shouldn't cost us the others -- whether it failed a uassert (a
+                // duplicate key, say) or a massert (a key too large, a bad spec)
+                log() << "warning: couldn't build the indexes on " << i->first << " together, building them singly: " << e.toString() << endl;
+                for ( list<BSONObj>::iterator j = specs.begin(); j != specs.end(); j++ ) {
+                    try { 
+                        theDataFileMgr.insertWithObjMod( system_indexes.c_str() , *j );
+                    }
+                    catch ( DBException& e ) { 
+                        log() << "warning: exception building index on " << i->first << ' ' << e.toString() << " spec:" << j->toString() << endl;
+                    }
+                }
+            }
+        }
+    }
+
+    bool ParallelClone::go( const list<string>& dbs , int nConns , string& errmsg ) {
+        _conn.reset( connect( errmsg ) );
+        if ( !_conn.get() )
+            return false;
+        for ( list<string>::const_iterator i = dbs.begin(); i != dbs.end(); i++ ) {
+            if ( !prepare( *i , errmsg ) )
+                return false;
+        }
+
+        log() << "cloning " << _colls.size() << " collections from " << _host << " over " << nConns << " connections" << endl;
+        {
+            boost::thread_group threads;
+            for ( int i = 0; i < nConns && i < (int) _colls.size(); i++ )
+                threads.create_thread( boost::bind( &ParallelClone::copyData , this ) );
+            threads.join_all();
+        }
+        if ( !_error.empty() ) {
+            errmsg = _error;
+            return false;
+        }
+
+        for ( list<string>::const_iterator i = dbs.begin(); i != dbs.end(); i++ ) {
+            log() << "building indexes for " << *i << endl;
+            buildIndexes( *i );
+        }
+        return true;
+    }
+
+    /* call with no lock held */
+    bool cloneParallel(const string& masterHost, const list<string>& dbs, int nConns, string& errmsg) {
+        ParallelClone c( masterHost );
+        return c.go( dbs , nConns , errmsg );
+    }
     
     /* Usage:
        mydb.$cmd.findOne( { clone: "fromhost" } );
@@ -58,6 +58,18 @@ namespace mongo {
 
         int pretouch;          // --pretouch for replication application (experimental)
         bool moveParanoia;     // for move chunk paranoia 
+        int moveBandwidth;     // --moveBandwidth MB/s a chunk migration may send from this shard, 0=no limit
+        int rangeDeleteRate;   // --rangeDeleteRate docs/s removed from chunks that migrated off this shard, 0=no limit
+
+        bool dur;                  // --dur write ahead journaling (experimental)
+        int durCommitIntervalMs;   // --durCommitInterval group commit interval
+        bool perDbLocking;         // --perDbLocking lock per database rather than globally (experimental)
+        int indexBuildThreads;     // --indexBuildThreads key extraction/sort threads for foreground index builds, 0=auto
+        int replApplyThreads;      // --replApplyThreads threads prefetching for, and with --perDbLocking applying, a replica set sync batch, 0=auto
+
+        enum ReplIndexPrefetch { PrefetchNone, PrefetchIdOnly, PrefetchAll };
+        ReplIndexPrefetch replIndexPrefetch; // --replIndexPrefetch what to page in before applying a replica set sync batch
+        bool replCompress;         // --replCompress ask the sync source to compress the oplog as it sends it
         
         enum { 
             DefaultDBPort = 27017,
@@ -67,7 +79,9 @@ namespace mongo {
 
         CmdLine() : 
             port(DefaultDBPort), rest(false), jsonp(false), quiet(false), notablescan(false), prealloc(true), smallfiles(false),
-            quota(false), quotaFiles(8), cpu(false), oplogSize(0), defaultProfile(0), slowMS(100), pretouch(0), moveParanoia( true )
+            quota(false), quotaFiles(8), cpu(false), oplogSize(0), defaultProfile(0), slowMS(100), pretouch(0), moveParanoia( true ), moveBandwidth(0), rangeDeleteRate(0),
+            dur(false), durCommitIntervalMs(30), perDbLocking(false), indexBuildThreads(0), replApplyThreads(0),
+            replIndexPrefetch(PrefetchAll), replCompress(false)
         { } 
         
 
@@ -17,6 +17,8 @@
 
 #include "pch.h"
 #include "concurrency.h"
+#include "cmdline.h"
+#include "jsobj.h"
 
 /**
  * this just has globals
@@ -26,4 +28,164 @@ namespace mongo {
     /* we use new here so we don't have to worry about destructor orders at program shutdown */
     MongoMutex &dbMutex( *(new MongoMutex("rw:dbMutex")) );
 
+    bool MongoMutex::usesDBLock(const string& ns) {
+        if ( !cmdLine.perDbLocking )
+            return false;
+        if ( ns.find( ".$cmd" ) != string::npos )
+            return false;
+        string db = ns.substr( 0 , ns.find( '.' ) );
+        // commands on these may touch anything, and local is only ever nested (see class comment)
+        return !db.empty() && db != "admin" && db != "local" && db != "config";
+    }
+
+    DBLock* MongoMutex::dbLock(const string& db) {
+        if ( db == "local" )
+            return _localLock;
+        scoped_lock lk( _dbLocksMutex );
+        DBLock*& l = _dbLocks[db];
+        if ( !l )
+            l = new DBLock(db);
+        return l;
+    }
+
+    static void appendLockStats(BSONObjBuilder& b, DBLock *l) {
+        BSONObjBuilder x( b.subobjStart( l->name() ) );
+        x.append( "lockTime" , (double) l->info().getTimeLocked() );
+        BSONObjBuilder q( x.subobjStart( "currentQueue" ) );
+        unsigned r = l->waitingReaders, w = l->waitingWriters;
+        q.append( "total" , (int) (r + w) );
+        q.append( "readers" , (int) r );
+        q.append( "writers" , (int) w );
+        q.done();
+        x.done();
+    }
+
+    void MongoMutex::appendDBLockStats(BSONObjBuilder& b) {
+        scoped_lock lk( _dbLocksMutex );
+        for ( map<string,DBLock*>::iterator i = _dbLocks.begin(); i != _dbLocks.end(); ++i )
+            appendLockStats( b , i->second );
+        appendLockStats( b , _localLock );
+    }
+
+    void MongoMutex::fileWriterEntering() {
+#if defined(_DEBUG)
+        scoped_lock lk( _fileWritersMutex );
+        if ( _fileWriters++ == 0 )
+            MongoFile::lockAll();
+#endif
+    }
+
+    void MongoMutex::fileWriterLeaving() {
+#if defined(_DEBUG)
+        scoped_lock lk( _fileWritersMutex );
+        if ( --_fileWriters == 0 )
+            MongoFile::unlockAll();
+#endif
+    }
+
+    void MongoMutex::lockDB(const string& ns, bool write) {
+        string db = ns.substr( 0 , ns.find( '.' ) );
+        int s = _state.get();
+
+        if ( s ) {
+            DBLock *cur = _db.get();
+            assert( cur );
+            massert( 13649 , (string)"internal error: database locks are not upgradeable: " + sayClientState() , !write || s > 0 );
+
+            int n = _nestedState.get();
+            if ( n ) {
+                // already nested on local: everything recurses there
+                massert( 13627 , (string)"internal error: locks are not upgradeable: " + sayClientState() , !write || n > 0 );
+                _nestedState.set( n > 0 ? n + 1 : n - 1 );
+                return;
+            }
+
+            if ( db == cur->name() ) {
+                _state.set( s > 0 ? s + 1 : s - 1 );
+                return;
+            }
+
+            massert( 13628 , (string)"can't lock database " + db + " while holding a lock on database " + cur->name() , db == "local" );
+            if ( write ) {
+                _localLock->waitingWriters++;
+                _localLock->rw().lock();
+                _localLock->waitingWriters--;
+                _localLock->info().entered();
+                _nestedState.set(1);
+            }
+            else {
+                _localLock->waitingReaders++;
+                _localLock->rw().lock_shared();
+                _localLock->waitingReaders--;
+                _nestedState.set(-1);
+            }
+            return;
+        }
+
+        DBLock *l = dbLock(db);
+        curopWaitingForLock( write ? 1 : -1 );
+        if ( write ) {
+            _q.lock_w();
+            l->waitingWriters++;
+            l->rw().lock();
+            l->waitingWriters--;
+            l->info().entered();
+            fileWriterEntering();
+        }
+        else {
+            _q.lock_r();
+            l->waitingReaders++;
+            l->rw().lock_shared();
+            l->waitingReaders--;
+        }
+        curopGotLock();
+        _db.set(l);
+        _state.set( write ? 1 : -1 );
+    }
+
+    void MongoMutex::unlockDB() {
+        int n = _nestedState.get();
+        if ( n ) {
+            if ( n > 1 )
+                _nestedState.set( n - 1 );
+            else if ( n < -1 )
+                _nestedState.set( n + 1 );
+            else {
+                _nestedState.set(0);
+                if ( n == 1 ) {
+                    _localLock->info().leaving();
+                    _localLock->rw().unlock();
+                }
+                else {
+                    _localLock->rw().unlock_shared();
+                }
+            }
+            return;
+        }
+
+        int s = _state.get();
+        if ( s > 1 ) {
+            _state.set( s - 1 );
+            return;
+        }
+        if ( s < -1 ) {
+            _state.set( s + 1 );
+            return;
+        }
+
+        DBLock *l = _db.get();
+        _state.set(0);
+        _db.set(0);
+        if ( s == 1 ) {
+            fileWriterLeaving();
+            l->info().leaving();
+            l->rw().unlock();
+            _q.unlock_w();
+        }
+        else {
+            l->rw().unlock_shared();
+            _q.unlock_r();
+        }
+    }
+
 }
@@ -0,0 +1,225 @@
+// compact.cpp
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "pdfile.h"
+#include "namespace.h"
+#include "commands.h"
+#include "curop.h"
+#include "background.h"
+#include "clientcursor.h"
+#include "../util/timer.h"
+
+namespace mongo {
+
+    class ExtentCompactor;
+
+    /* the extents being compacted, by collection and location -- a DiskLoc alone names a spot in
+       every database's files.  a compactor's orphans are only touched under its database's write
+       lock, but with --perDbLocking other databases' deletes look here at once */
+    typedef pair< string , DiskLoc > CompactingKey;
+    static mongo::mutex compactingMutex( "compacting" );
+    static map< CompactingKey , ExtentCompactor* > compacting;
+    static volatile int nCompacting = 0; // so deletes needn't lock when no compact is running
+
+    /* An extent compact is emptying.  Its free space is kept off the deleted lists so nothing is
+       allocated there -- not the records we move, nor other writers' while we yield: what is on
+       the lists is taken off once, and what is freed in it after that never goes on them (see
+       compactTakesFreedRecord).  If we stop before it is empty that space goes back on the lists.
+    */
+    class ExtentCompactor : boost::noncopyable {
+    public:
+        ExtentCompactor( const char *ns , const DiskLoc& ext ) : _ns( ns ), _ext( ext ), _freed( false ) {
+            scoped_lock lk( compactingMutex );
+            compacting[ CompactingKey( _ns , _ext ) ] = this;
+            nCompacting++;
+        }
+
+        ~ExtentCompactor() {
+            unregister();
+            if ( _freed )
+                return;
+            NamespaceDetails *d = nsdetails( _ns );
+            for ( unsigned i = 0; i < _orphans.size(); i++ )
+                d->addDeletedRec( _orphans[i].drec() , _orphans[i] );
+        }
+
+        /* take the extent's deleted records off the lists */
+        void orphanDeleted( NamespaceDetails *d ) {
+            for ( int b = 0; b < Buckets; b++ ) {
+                DiskLoc *prev = &d->deletedList[b];
+                while ( !prev->isNull() ) {
+                    DiskLoc cur = *prev;
+                    DeletedRecord *r = cur.drec();
+                    if ( cur.a() == _ext.a() && r->extentOfs == _ext.getOfs() ) {
+                        dur::writingDiskLoc( *prev ) = r->nextDeleted;
+                        _orphans.push_back( cur );
+                    }
+                    else {
+                        prev = &r->nextDeleted;
+                    }
+                }
+            }
+        }
+
+        /* a record of the extent was just deleted, by us or another writer */
+        void orphanFreed( const DiskLoc& dl ) { _orphans.push_back( dl ); }
+
+        /* the extent is empty: give it to the database's free list */
+        void release( NamespaceDetails *d ) {
+            unregister();
+            freeExtent( d , _ext );
+            _freed = true;
+        }
+
+    private:
+        void unregister() {
+            scoped_lock lk( compactingMutex );
+            if ( compacting.erase( CompactingKey( _ns , _ext ) ) )
+                nCompacting--;
+        }
+
+        const char *_ns;
+        DiskLoc _ext;
+        vector<DiskLoc> _orphans;
+        bool _freed;
+    };
+
+    bool compactTakesFreedRecord( const char *ns , const DiskLoc& dl , DeletedRecord *r ) {
+        if ( nCompacting == 0 )
+            return false;
+        scoped_lock lk( compactingMutex );
+        map< CompactingKey , ExtentCompactor* >::iterator i = compacting.find( CompactingKey( ns , DiskLoc( dl.a() , r->extentOfs ) ) );
+        if ( i == compacting.end() )
+            return false;
+        i->second->orphanFreed( dl );
+        return true;
+    }
+
+    /* Moves the records of the collection's last extent into free space in its other extents and
+       frees the extent, then the new last one, and so on until the first extent is reached or the
+       free space runs out.  Records move in batches of about BatchMillis and the lock is yielded
+       between batches.
+
+       A record moved from the last extent into an earlier one would be skipped by a forward scan
+       in natural order that had already passed that spot, and seen twice by a reverse one, so we
+       stop early rather than move records while such a scan is open.
+    */
+    static void compactCollection( const char *ns , BSONObjBuilder& result ) {
+        const int BatchMillis = 50;
+
+        NamespaceDetails *d = nsdetails( ns );
+        int nExtents = 0;
+        for ( DiskLoc e = d->firstExtent; !e.isNull(); e = e.ext()->xnext )
+            nExtents++;
+        ProgressMeterHolder pm( cc().curop()->setMessage( "compact extents" , nExtents - 1 ) );
+
+        long long moved = 0;
+        long long bytesFreed = 0;
+        int extentsFreed = 0;
+        bool outOfSpace = false;
+        bool scanOpen = false;
+        while ( !outOfSpace && !scanOpen ) {
+            d = nsdetails( ns );
+            DiskLoc ext = d->lastExtent;
+            if ( ext == d->firstExtent )
+                break;
+
+            ExtentCompactor c( ns , ext );
+            c.orphanDeleted( d );
+            while ( 1 ) {
+                if ( ClientCursor::naturalScanOpen( ns ) ) {
+                    scanOpen = true;
+                    break;
+                }
+                Timer t;
+                DiskLoc dl;
+                while ( !( dl = ext.ext()->firstRecord ).isNull() && t.millis() < BatchMillis ) {
+                    killCurrentOp.checkForInterrupt();
+                    if ( theDataFileMgr.relocateRecord( ns , d , dl ).isNull() ) {
+                        outOfSpace = true;
+                        break;
+                    }
+                    moved++;
+                }
+                if ( outOfSpace || ext.ext()->firstRecord.isNull() )
+                    break;
+
+                ClientCursor::staticYield( -1 );
+                d = nsdetails( ns );
+            }
+            if ( outOfSpace || scanOpen )
+                break;
+
+            bytesFreed += ext.ext()->length;
+            c.release( d );
+            extentsFreed++;
+            pm.hit();
+            log(1) << "compact " << ns << " freed extent " << ext.toString() << endl;
+
+            ClientCursor::staticYield( -1 );
+        }
+
+        result.appendNumber( "recordsMoved" , moved );
+        result.append( "extentsFreed" , extentsFreed );
+        result.appendNumber( "bytesFreed" , bytesFreed );
+        if ( outOfSpace )
+            result.append( "note" , "stopped early: no free space before the last extent for its records" );
+        else if ( scanOpen )
+            result.append( "note" , "stopped early: a cursor is scanning the collection in natural order" );
+    }
+
+    /* { compact : "collectionname" } */
+    class CompactCmd : public Command {
+    public:
+        CompactCmd() : Command( "compact" ) {}
+        virtual bool slaveOk() const { return true; }
+        virtual LockType locktype() const { return WRITE; }
+        virtual void help( stringstream& help ) const {
+            help << "{ compact : \"collection\" }\n"
+                    "moves records out of the collection's last extents into its free space and releases the emptied\n"
+                    "extents for reuse within the database.  yields as it goes; killOp to stop.  not replicated.";
+        }
+        bool run(const string& dbname, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
+            string ns = dbname + "." + cmdObj.firstElement().valuestrsafe();
+            NamespaceDetails *d = nsdetails( ns.c_str() );
+            if ( !d ) {
+                errmsg = "ns not found";
+                return false;
+            }
+            if ( d->capped ) {
+                errmsg = "cannot compact a capped collection";
+                return false;
+            }
+            if ( NamespaceString( ns ).isSystem() || ns.find( '$' ) != string::npos ) {
+                errmsg = "cannot compact a system collection";
+                return false;
+            }
+            if ( BackgroundOperation::inProgForNs( ns.c_str() ) ) {
+                errmsg = "background operation in progress for this collection";
+                return false;
+            }
+
+            tlog() << "CMD: compact " << ns << endl;
+            BackgroundOperation op( ns.c_str() ); // no drop while we yield
+            compactCollection( ns.c_str() , result );
+            return true;
+        }
+    } compactCmd;
+
+}
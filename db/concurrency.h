@@ -23,6 +23,7 @@
      Logstream::mutex       1
      ClientCursor::ccmutex  2
      dblock                 3
+       (with --perDbLocking: the global QLock, then the database's DBLock, then local's DBLock)
 
      End func name with _inlock to indicate "caller must lock before calling".
 */
@@ -30,6 +31,8 @@
 #pragma once
 
 #include "../util/concurrency/rwlock.h"
+#include "../util/concurrency/qlock.h"
+#include "../bson/util/atomic_int.h"
 #include "../util/mmap.h"
 #include "../util/time_support.h"
 
@@ -74,17 +77,64 @@ namespace mongo {
         }
     };
 
+    /** the lock for one database, used when --perDbLocking.  created on first use and never
+        deleted, so a pointer to one stays valid for the life of the process.
+    */
+    class DBLock : boost::noncopyable {
+    public:
+        DBLock(const string& db) : _name(db), _rwname("rw:" + db), _m(_rwname.c_str()) { }
+        const string& name() const { return _name; }
+        RWLock& rw() { return _m; }
+        MutexInfo& info() { return _minfo; }
+        AtomicUInt waitingReaders;
+        AtomicUInt waitingWriters;
+    private:
+        const string _name;
+        const string _rwname;
+        RWLock _m;
+        MutexInfo _minfo;
+    };
+
+    /* the "global" lock.
+
+       By default every operation takes it in shared (read) or exclusive (write) mode.
+
+       With --perDbLocking, an operation on a single ordinary database instead takes the global lock
+       in an intent mode (see QLock) plus that database's own DBLock.  So writers to different
+       databases proceed in parallel, while anything that takes the global lock outright (commands,
+       admin/local/config, closing a database, the dur group commit) still excludes them all.
+
+       The only nesting allowed under a database lock is the local database -- logOp() writes the
+       oplog while the operation's database is locked.  local is always taken last so this can't
+       deadlock.  Anything else (another database, or the global lock) asserts.
+    */
     class MongoMutex {
         MutexInfo _minfo;
-        RWLock _m;
+        QLock _q;
         ThreadLocalValue<int> _state;
 
         /* we use a separate TLS value for releasedEarly - that is ok as 
            our normal/common code path, we never even touch it.
         */
         ThreadLocalValue<bool> _releasedEarly;
+
+        /* set when what this thread holds is a database lock rather than the global lock */
+        ThreadLocalValue<DBLock*> _db;
+        /* recursion count for a nested lock on local under _db. >0 write, <0 read */
+        ThreadLocalValue<int> _nestedState;
+
+        mongo::mutex _dbLocksMutex;
+        map<string,DBLock*> _dbLocks;
+        DBLock *_localLock; // not in _dbLocks as it is only ever nested
+
+        /* MongoFile::lockAll() is per process (_DEBUG builds only), so count database level writers */
+        mongo::mutex _fileWritersMutex;
+        int _fileWriters;
+
     public:
-        MongoMutex(const char * name) : _m(name) { }
+        MongoMutex(const char * name) : _dbLocksMutex("dbLocks"), _fileWritersMutex("fileWriters"), _fileWriters(0) { 
+            _localLock = new DBLock("local");
+        }
 
         /**
          * @return
@@ -101,12 +151,34 @@ namespace mongo {
         bool atLeastReadLocked() { return _state.get() != 0; }
         void assertAtLeastReadLocked() { assert(atLeastReadLocked()); }
 
+        /** @return the database this thread has locked, or 0 if it holds the global lock (or no lock) */
+        DBLock* lockedDB() { return _db.get(); }
+
+        /** true if we hold local nested under our database lock */
+        bool inNestedDBLock() { return _nestedState.get() != 0; }
+
+        /** true if we hold the global write lock, i.e. no other operation of any kind is running */
+        bool isGlobalWriteLocked() { return getState() > 0 && _db.get() == 0; }
+        void assertGlobalWriteLocked() { 
+            massert( 13624 , "operation requires the global write lock, not a database lock" , isGlobalWriteLocked() );
+        }
+
+        /** true if ns should get a database lock rather than the global lock */
+        static bool usesDBLock(const string& ns);
+
+        /** the lock for database db, created if needed */
+        DBLock* dbLock(const string& db);
+
+        /** per database lock time and queue, for serverStatus */
+        void appendDBLockStats(BSONObjBuilder& b);
+
         bool _checkWriteLockAlready(){
             //DEV cout << "LOCK" << endl;
             DEV assert( haveClient() );
                 
             int s = _state.get();
             if( s > 0 ) {
+                massert( 13625 , (string)"can't take the global lock while holding a database lock: " + sayClientState() , _db.get() == 0 );
                 _state.set(s+1);
                 return true;
             }
@@ -123,7 +195,7 @@ namespace mongo {
             _state.set(1);
 
             curopWaitingForLock( 1 );
-            _m.lock(); 
+            _q.lock_W(); 
             curopGotLock();
 
             _minfo.entered();
@@ -136,7 +208,7 @@ namespace mongo {
                 return true;
 
             curopWaitingForLock( 1 );
-            bool got = _m.lock_try( millis ); 
+            bool got = _q.lock_W_try( millis ); 
             curopGotLock();
             
             if ( got ){
@@ -148,9 +220,30 @@ namespace mongo {
             return got;
         }
 
+        /** write lock for an operation on ns: the database lock if usesDBLock(ns), else global */
+        void lock(const string& ns) {
+            if ( _db.get() || ( _state.get() == 0 && usesDBLock(ns) ) )
+                lockDB(ns, true);
+            else
+                lock();
+        }
+
+        /** read lock for an operation on ns: the database lock if usesDBLock(ns), else global */
+        void lock_shared(const string& ns) {
+            if ( _db.get() || ( _state.get() == 0 && usesDBLock(ns) ) )
+                lockDB(ns, false);
+            else
+                lock_shared();
+        }
+
+        void lockDB(const string& ns, bool write);
 
         void unlock() { 
             //DEV cout << "UNLOCK" << endl;
+            if ( _db.get() ) {
+                unlockDB();
+                return;
+            }
             int s = _state.get();
             if( s > 1 ) { 
                 _state.set(s-1);
@@ -168,7 +261,7 @@ namespace mongo {
 
             _state.set(0);
             _minfo.leaving();
-            _m.unlock(); 
+            _q.unlock_W(); 
         }
 
         /* unlock (write lock), and when unlock() is called later, 
@@ -177,6 +270,7 @@ namespace mongo {
         void releaseEarly() {
             assert( getState() == 1 ); // must not be recursive
             assert( !_releasedEarly.get() );
+            assert( _db.get() == 0 );
             _releasedEarly.set(true);
             unlock();
         }
@@ -185,6 +279,7 @@ namespace mongo {
             //DEV cout << " LOCKSHARED" << endl;
             int s = _state.get();
             if( s ) {
+                massert( 13626 , (string)"can't take the global lock while holding a database lock: " + sayClientState() , _db.get() == 0 );
                 if( s > 0 ) { 
                     // already in write lock - just be recursive and stay write locked
                     _state.set(s+1);
@@ -198,7 +293,7 @@ namespace mongo {
             }
             _state.set(-1);
             curopWaitingForLock( -1 );
-            _m.lock_shared(); 
+            _q.lock_R(); 
             curopGotLock();
         }
         
@@ -210,7 +305,7 @@ namespace mongo {
                 return true;
             }
 
-            bool got = _m.lock_shared_try( millis );
+            bool got = _q.lock_R_try( millis );
             if ( got )
                 _state.set(-1);
             return got;
@@ -218,6 +313,10 @@ namespace mongo {
         
         void unlock_shared() { 
             //DEV cout << " UNLOCKSHARED" << endl;
+            if ( _db.get() ) {
+                unlockDB();
+                return;
+            }
             int s = _state.get();
             if( s > 0 ) { 
                 assert( s > 1 ); /* we must have done a lock write first to have s > 1 */
@@ -230,10 +329,15 @@ namespace mongo {
             }
             assert( s == -1 );
             _state.set(0);
-            _m.unlock_shared(); 
+            _q.unlock_R(); 
         }
         
         MutexInfo& info() { return _minfo; }
+
+    private:
+        void unlockDB();
+        void fileWriterEntering();
+        void fileWriterLeaving();
     };
 
     extern MongoMutex &dbMutex;
@@ -241,9 +345,11 @@ namespace mongo {
     inline void dbunlocking_write() { }
     inline void dbunlocking_read() { }
 
+    /* with --perDbLocking, writelock and readlock lock just the database of ns (see MongoMutex).
+       pass "" for the global lock. */
     struct writelock {
         writelock(const string& ns) {
-            dbMutex.lock();
+            dbMutex.lock(ns);
         }
         ~writelock() { 
             DESTRUCTOR_GUARD(
@@ -255,7 +361,7 @@ namespace mongo {
     
     struct readlock {
         readlock(const string& ns) {
-            dbMutex.lock_shared();
+            dbMutex.lock_shared(ns);
         }
         ~readlock() { 
             DESTRUCTOR_GUARD(
@@ -309,7 +415,7 @@ namespace mongo {
         atleastreadlock( const string& ns ){
             _prev = dbMutex.getState();
             if ( _prev == 0 )
-                dbMutex.lock_shared();
+                dbMutex.lock_shared(ns);
         }
         ~atleastreadlock(){
             if ( _prev == 0 )
@@ -321,13 +427,15 @@ namespace mongo {
 
     class mongolock {
         bool _writelock;
+        string _ns;
     public:
-        mongolock(bool write) : _writelock(write) {
+        /** @param ns the namespace operated on, "" for the global lock */
+        mongolock(bool write, const string& ns = "") : _writelock(write), _ns(ns) {
             if( _writelock ) {
-                dbMutex.lock();
+                dbMutex.lock(ns);
             }
             else
-                dbMutex.lock_shared();
+                dbMutex.lock_shared(ns);
         }
         ~mongolock() { 
             DESTRUCTOR_GUARD(
@@ -346,7 +454,7 @@ namespace mongo {
     
     /* use writelock and readlock instead */
     struct dblock : public writelock {
-        dblock() : writelock("") { }
+        dblock(const string& ns = "") : writelock(ns) { }
     };
 
     // eliminate
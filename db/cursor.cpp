@@ -20,6 +20,16 @@
 
 namespace mongo {
 
+    Record* Cursor::recordToLoad() {
+        if ( !ok() )
+            return 0;
+        DiskLoc l = currLoc();
+        if ( l.isNull() )
+            return 0;
+        Record *r = l.rec();
+        return r->likelyInPhysicalMemory() ? 0 : r;
+    }
+
     bool BasicCursor::advance() {
         killCurrentOp.checkForInterrupt();
         if ( eof() ) {
@@ -42,6 +42,10 @@ namespace mongo {
         virtual BSONObj current() = 0;
         virtual DiskLoc currLoc() = 0;
         virtual bool advance() = 0; /*true=ok*/
+
+        /** @return the current record if reading it would likely page fault, else 0.  
+            see ClientCursor::yieldIfPageFaultLikely() */
+        virtual Record* recordToLoad();
         virtual BSONObj currKey() const { return BSONObj(); }
 
         // DiskLoc the cursor requires for continued operation.  Before this
@@ -38,6 +38,9 @@
 #include "../util/version.h"
 #include "client.h"
 #include "dbwebserver.h"
+#include "dur.h"
+#include "../util/message_server.h"
+#include "../s/d_logic.h"
 
 #if defined(_WIN32)
 # include "../util/ntservice.h"
@@ -69,6 +72,7 @@ namespace mongo {
     CmdLine cmdLine;
     bool useJNI = true;
     bool noHttpInterface = false;
+    int workerThreads = 0; // --workers
     bool shouldRepairDatabases = 0;
     bool forceRepair = 0;
     Timer startupSrandTimer;
@@ -160,21 +164,6 @@ namespace mongo {
     };
 #endif
 
-    void listen(int port) {
-        //testTheDb();
-        log() << "waiting for connections on port " << port << endl;
-        OurListener l(cmdLine.bind_ip, port);
-        l.setAsTimeTracker();
-        startReplication();
-        if ( !noHttpInterface )
-            boost::thread thr(webServerThread);
-
-#if(TESTEXHAUST)
-        boost::thread thr(testExhaust);
-#endif
-        l.initAndListen();
-    }
-
     void sysRuntimeInfo() {
         out() << "sysinfo:\n";
 #if defined(_SC_PAGE_SIZE)
@@ -193,6 +182,64 @@ namespace mongo {
         sleepmicros( Client::recommendedYieldMicros() );
     }
 
+    /* run one request from a client and send the reply.  for an exhaust query, keeps sending
+       getMore replies until the cursor is done.
+       @return false if the connection should be closed
+    */
+    static bool processRequest( Message& m , MessagingPort& port , LastError * le ) {
+        while ( 1 ) {
+            if ( inShutdown() ) {
+                log() << "got request after shutdown()" << endl;
+                return false;
+            }
+            
+            lastError.startRequest( m , le );
+
+            DbResponse dbresponse;
+            if ( !assembleResponse( m, dbresponse, port.farEnd ) ) {
+                log() << curTimeMillis() % 10000 << "   end msg " << port.farEnd.toString() << endl;
+                /* todo: we may not wish to allow this, even on localhost: very low priv accounts could stop us. */
+                if ( port.farEnd.isLocalHost() ) {
+                    port.shutdown();
+                    sleepmillis(50);
+                    problem() << "exiting end msg" << endl;
+                    dbexit(EXIT_CLEAN);
+                }
+                else {
+                    log() << "  (not from localhost, ignoring end msg)" << endl;
+                }
+            }
+
+            if ( !dbresponse.response )
+                return true;
+            port.reply(m, *dbresponse.response, dbresponse.responseTo);
+            if( !dbresponse.exhaust )
+                return true;
+
+            MsgData *header = dbresponse.response->header();
+            QueryResult *qr = (QueryResult *) header;
+            long long cursorid = qr->cursorId;
+            if( !cursorid )
+                return true;
+            assert( dbresponse.exhaust && *dbresponse.exhaust != 0 );
+            string ns = dbresponse.exhaust; // before reset() free's it...
+            m.reset();
+            BufBuilder b(512);
+            b.appendNum((int) 0 /*size set later in appendData()*/);
+            b.appendNum(header->id);
+            b.appendNum(header->responseTo);
+            b.appendNum((int) dbGetMore);
+            b.appendNum((int) 0);
+            b.appendStr(ns);
+            b.appendNum((int) 0); // ntoreturn
+            b.appendNum(cursorid);
+            m.appendData(b.buf(), b.len());
+            b.decouple();
+            DEV log() << "exhaust=true sending more" << endl;
+            beNice();
+        }
+    }
+
     /* we create one thread for each connection from an app server database.
        app server will open a pool of threads.
        todo: one day, asio...
@@ -222,56 +269,9 @@ namespace mongo {
                     dbMsgPort->shutdown();
                     break;
                 }
-sendmore:
-                if ( inShutdown() ) {
-                    log() << "got request after shutdown()" << endl;
-                    break;
-                }
-                
-                lastError.startRequest( m , le );
-
-                DbResponse dbresponse;
-                if ( !assembleResponse( m, dbresponse, dbMsgPort->farEnd ) ) {
-                    log() << curTimeMillis() % 10000 << "   end msg " << dbMsgPort->farEnd.toString() << endl;
-                    /* todo: we may not wish to allow this, even on localhost: very low priv accounts could stop us. */
-                    if ( dbMsgPort->farEnd.isLocalHost() ) {
-                        dbMsgPort->shutdown();
-                        sleepmillis(50);
-                        problem() << "exiting end msg" << endl;
-                        dbexit(EXIT_CLEAN);
-                    }
-                    else {
-                        log() << "  (not from localhost, ignoring end msg)" << endl;
-                    }
-                }
 
-                if ( dbresponse.response ) {
-                    dbMsgPort->reply(m, *dbresponse.response, dbresponse.responseTo);
-                    if( dbresponse.exhaust ) { 
-                        MsgData *header = dbresponse.response->header();
-                        QueryResult *qr = (QueryResult *) header;
-                        long long cursorid = qr->cursorId;
-                        if( cursorid ) {
-                            assert( dbresponse.exhaust && *dbresponse.exhaust != 0 );
-                            string ns = dbresponse.exhaust; // before reset() free's it...
-                            m.reset();
-                            BufBuilder b(512);
-                            b.appendNum((int) 0 /*size set later in appendData()*/);
-                            b.appendNum(header->id);
-                            b.appendNum(header->responseTo);
-                            b.appendNum((int) dbGetMore);
-                            b.appendNum((int) 0);
-                            b.appendStr(ns);
-                            b.appendNum((int) 0); // ntoreturn
-                            b.appendNum(cursorid);
-                            m.appendData(b.buf(), b.len());
-                            b.decouple();
-                            DEV log() << "exhaust=true sending more" << endl;
-                            beNice();
-                            goto sendmore;
-                        }
-                    }
-                }
+                if ( !processRequest( m , *dbMsgPort , le ) )
+                    break;
 
                 m.reset();
             }
@@ -306,6 +306,139 @@ sendmore:
         globalScriptEngine->threadDone();
     }
 
+    /* for --workers: connections are served by the event driven MessageServer, so one worker thread
+       handles requests from many connections.  what connThread() keeps in thread locals -- the
+       Client, its LastError and the sharding state -- is kept per connection here instead, and
+       attached to the worker for the duration of each request.
+    */
+    class DbMessageHandler : public MessageHandler {
+    public:
+        DbMessageHandler() : _mutex("DbMessageHandler") { }
+
+        virtual void process( Message& m , AbstractMessagingPort* p ) {
+            MessagingPort *port = dynamic_cast<MessagingPort*>( p );
+            assert( port );
+            Conn *c = conn( port );
+            Attach a( c );
+            try {
+                if ( !processRequest( m , *port , c->le ) )
+                    throw SocketException( SocketException::CLOSED );
+            }
+            catch ( AssertionException& e ) {
+                log() << "AssertionException in DbMessageHandler, closing client connection" << endl;
+                log() << ' ' << e.what() << endl;
+                throw;
+            }
+            catch ( SocketException& ) {
+                throw;
+            }
+            catch ( const ClockSkewException & ) {
+                exitCleanly( EXIT_CLOCK_SKEW );
+            }        
+            catch ( std::exception &e ) {
+                problem() << "Uncaught std::exception: " << e.what() << ", terminating" << endl;
+                dbexit( EXIT_UNCAUGHT );
+            }
+            catch ( ... ) {
+                problem() << "Uncaught exception, terminating" << endl;
+                dbexit( EXIT_UNCAUGHT );
+            }
+        }
+
+        virtual void disconnected( AbstractMessagingPort* p ) {
+            Conn *c = 0;
+            {
+                scoped_lock lk( _mutex );
+                map<AbstractMessagingPort*,Conn*>::iterator i = _conns.find( p );
+                if ( i == _conns.end() )
+                    return; // never sent a request
+                c = i->second;
+                _conns.erase( i );
+            }
+            {
+                Attach a( c );
+                c->client->shutdown();
+            }
+            delete c->client;
+            delete c->le;
+            delete c->sharded;
+            delete c;
+        }
+
+    private:
+        struct Conn {
+            Client *client;
+            LastError *le;
+            ShardedConnectionInfo *sharded; // 0 until the connection sets a shard version
+        };
+
+        /** puts c's state in this thread's locals, and takes it back out when done */
+        class Attach : boost::noncopyable {
+        public:
+            Attach( Conn *c ) : _c( c ) {
+                assert( currentClient.get() == 0 );
+                currentClient.reset( c->client );
+                lastError.reset( c->le );
+                ShardedConnectionInfo::set( c->sharded );
+            }
+            ~Attach() {
+                _c->sharded = ShardedConnectionInfo::release();
+                lastError.release();
+                currentClient.release();
+            }
+        private:
+            Conn *_c;
+        };
+
+        Conn* conn( MessagingPort *port ) {
+            scoped_lock lk( _mutex );
+            Conn*& c = _conns[port];
+            if ( !c ) {
+                port->_logLevel = 1;
+                c = new Conn();
+                c->client = new Client( "conn" , port );
+                c->client->getAuthenticationInfo()->isLocalHost = port->farEnd.isLocalHost();
+                c->le = new LastError();
+                c->sharded = 0;
+            }
+            return c;
+        }
+
+        mongo::mutex _mutex; // protects _conns
+        map<AbstractMessagingPort*,Conn*> _conns;
+    };
+
+    void listen(int port) {
+        //testTheDb();
+        log() << "waiting for connections on port " << port << endl;
+        auto_ptr<Listener> l;
+        auto_ptr<MessageServer> server;
+        if ( workerThreads > 0 ) {
+            MessageServer::Options opts;
+            opts.port = port;
+            opts.ipList = cmdLine.bind_ip;
+            opts.workerThreads = workerThreads;
+            static DbMessageHandler handler;
+            server.reset( createServer( opts , &handler ) );
+            server->setAsTimeTracker();
+        }
+        else {
+            l.reset( new OurListener(cmdLine.bind_ip, port) );
+            l->setAsTimeTracker();
+        }
+        startReplication();
+        if ( !noHttpInterface )
+            boost::thread thr(webServerThread);
+
+#if(TESTEXHAUST)
+        boost::thread thr(testExhaust);
+#endif
+        if ( server.get() )
+            server->run();
+        else
+            l->initAndListen();
+    }
+
     void msg(const char *m, const char *address, int port, int extras = 0) {
         SockAddr db(address, port);
 
@@ -489,7 +622,9 @@ sendmore:
                 }
                 
                 Date_t start = jsTime();
+                unsigned journalToken = dur::prepareDataFlush();
                 int numFiles = MemoryMappedFile::flushAll( true );
+                dur::dataFilesFlushed( journalToken );
                 time_flushing = (int) (jsTime() - start);
 
                 globalFlushCounters.flushed(time_flushing);
@@ -545,6 +680,8 @@ sendmore:
         acquirePathLock();
         remove_all( dbpath + "/_tmp/" );
 
+        dur::startup();
+
         theFileAllocator().start();
 
         BOOST_CHECK_EXCEPTION( clearTmpFiles() );
@@ -699,10 +836,18 @@ int main(int argc, char* argv[], char *envp[] )
         ("upgrade", "upgrade db if needed")
         ("repair", "run repair on all dbs")
         ("notablescan", "do not allow table scans")
+        ("dur", "enable journaling (experimental)")
+        ("durCommitInterval", po::value<int>(&cmdLine.durCommitIntervalMs)->default_value(30), "ms between journal group commits when --dur (2-300)")
+        ("perDbLocking", "lock each database separately for inserts, updates, deletes and queries (experimental)")
+        ("indexBuildThreads", po::value<int>(&cmdLine.indexBuildThreads)->default_value(0), "threads extracting and sorting keys in foreground index builds (0=one per core, up to 8)")
+        ("replApplyThreads", po::value<int>(&cmdLine.replApplyThreads)->default_value(0), "threads paging in for replicated operations and, with --perDbLocking, applying them to different databases (0=one per core, up to 8)")
+        ("replIndexPrefetch", po::value<string>()->default_value("all"), "on replica set secondaries, the indexes to page in before applying operations: none, _id_only or all")
+        ("replCompress", "have the sync source compress the oplog it sends this slave or secondary")
         ("syncdelay",po::value<double>(&dataFileSync._sleepsecs)->default_value(60), "seconds between disk syncs (0=never, but not recommended)")
         ("profile",po::value<int>(), "0=off 1=slow, 2=all")
         ("slowms",po::value<int>(&cmdLine.slowMS)->default_value(100), "value of slow for profile and console log" )
         ("maxConns",po::value<int>(), "max number of simultaneous connections")
+        ("workers", po::value<int>(), "serve connections with an event loop and this many worker threads, rather than a thread per connection (linux only)")
 		#if !defined(_WIN32)
         ("nounixsocket", "disable listening on unix sockets")
 		#endif
@@ -731,6 +876,8 @@ int main(int argc, char* argv[], char *envp[] )
 		("configsvr", "declare this is a config db of a cluster")
 		("shardsvr", "declare this is a shard db of a cluster")
         ("noMoveParanoia" , "turn off paranoid saving of data for moveChunk.  this is on by default for now, but default will switch" )
+        ("moveBandwidth", po::value<int>(&cmdLine.moveBandwidth)->default_value(0), "MB/s a chunk migration may send from this shard (0=no limit)")
+        ("rangeDeleteRate", po::value<int>(&cmdLine.rangeDeleteRate)->default_value(0), "documents/s deleted from chunks that migrated off this shard (0=no limit)")
 		;
 
     hidden_options.add_options()
@@ -877,6 +1024,53 @@ int main(int argc, char* argv[], char *envp[] )
         if (params.count("notablescan")) {
             cmdLine.notablescan = true;
         }
+        if (params.count("dur")) {
+            cmdLine.dur = true;
+        }
+        if ( cmdLine.durCommitIntervalMs < 2 || cmdLine.durCommitIntervalMs > 300 ) {
+            out() << "--durCommitInterval must be between 2 and 300" << endl;
+            dbexit( EXIT_BADOPTIONS );
+        }
+        if (params.count("perDbLocking")) {
+            cmdLine.perDbLocking = true;
+        }
+        if ( cmdLine.dur && cmdLine.perDbLocking ) {
+            // a commit needs every database quiescent, which a database lock holder can't arrange
+            out() << "--dur and --perDbLocking can't be used together" << endl;
+            dbexit( EXIT_BADOPTIONS );
+        }
+        if (params.count("replCompress")) {
+            cmdLine.replCompress = true;
+        }
+        if ( cmdLine.indexBuildThreads < 0 || cmdLine.indexBuildThreads > 64 ) {
+            out() << "--indexBuildThreads must be between 0 and 64" << endl;
+            dbexit( EXIT_BADOPTIONS );
+        }
+        if ( cmdLine.replApplyThreads < 0 || cmdLine.replApplyThreads > 64 ) {
+            out() << "--replApplyThreads must be between 0 and 64" << endl;
+            dbexit( EXIT_BADOPTIONS );
+        }
+        if ( cmdLine.moveBandwidth < 0 ) {
+            out() << "--moveBandwidth can't be negative" << endl;
+            dbexit( EXIT_BADOPTIONS );
+        }
+        if ( cmdLine.rangeDeleteRate < 0 ) {
+            out() << "--rangeDeleteRate can't be negative" << endl;
+            dbexit( EXIT_BADOPTIONS );
+        }
+        {
+            string prefetch = params["replIndexPrefetch"].as<string>();
+            if ( prefetch == "none" )
+                cmdLine.replIndexPrefetch = CmdLine::PrefetchNone;
+            else if ( prefetch == "_id_only" )
+                cmdLine.replIndexPrefetch = CmdLine::PrefetchIdOnly;
+            else if ( prefetch == "all" )
+                cmdLine.replIndexPrefetch = CmdLine::PrefetchAll;
+            else {
+                out() << "--replIndexPrefetch must be none, _id_only or all" << endl;
+                dbexit( EXIT_BADOPTIONS );
+            }
+        }
         if (params.count("master")) {
             replSettings.master = true;
         }
@@ -981,6 +1175,13 @@ int main(int argc, char* argv[], char *envp[] )
             uassert( 12508 , "maxConns can't be greater than 10000000" , newSize < 10000000 );
             connTicketHolder.resize( newSize );
         }
+        if ( params.count( "workers" ) ){
+            workerThreads = params["workers"].as<int>();
+            if ( workerThreads < 1 || workerThreads > 10000 ){
+                out() << "--workers must be between 1 and 10000" << endl;
+                dbexit( EXIT_BADOPTIONS );
+            }
+        }
         if (params.count("nounixsocket")){
             noUnixSocket = true;
         }
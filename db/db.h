@@ -48,11 +48,12 @@ namespace mongo {
         typedef map<string,Database*> DBs;
         typedef map<string,DBs> Paths;
 
-        DatabaseHolder() : _size(0){
+        DatabaseHolder() : _mutex("DatabaseHolder"), _size(0){
         }
 
         bool isLoaded( const string& ns , const string& path ) const {
             dbMutex.assertAtLeastReadLocked();
+            scoped_lock lk( _mutex );
             Paths::const_iterator x = _paths.find( path );
             if ( x == _paths.end() )
                 return false;
@@ -66,6 +67,7 @@ namespace mongo {
         
         Database * get( const string& ns , const string& path ) const {
             dbMutex.assertAtLeastReadLocked();
+            scoped_lock lk( _mutex );
             Paths::const_iterator x = _paths.find( path );
             if ( x == _paths.end() )
                 return 0;
@@ -81,6 +83,7 @@ namespace mongo {
         
         void put( const string& ns , const string& path , Database * db ){
             dbMutex.assertWriteLocked();
+            scoped_lock lk( _mutex );
             DBs& m = _paths[path];
             Database*& d = m[_todb(ns)];
             if ( ! d )
@@ -90,24 +93,25 @@ namespace mongo {
         
         Database* getOrCreate( const string& ns , const string& path , bool& justCreated ){
             dbMutex.assertWriteLocked();
-            DBs& m = _paths[path];
-            
             string dbname = _todb( ns );
-
-            Database* & db = m[dbname];
-            if ( db ){
-                justCreated = false;
-                return db;
+            {
+                scoped_lock lk( _mutex );
+                DBs& m = _paths[path];
+                DBs::iterator i = m.find( dbname );
+                if ( i != m.end() ){
+                    justCreated = false;
+                    return i->second;
+                }
             }
             
+            // opening the files can take a while, so don't hold _mutex for it.  with --perDbLocking
+            // other databases are in use meanwhile, but nobody else can be opening this one as we
+            // hold its write lock.
             log(1) << "Accessing: " << dbname << " for the first time" << endl;
-            try {
-                db = new Database( dbname.c_str() , justCreated , path );
-            }
-            catch ( ... ){
-                m.erase( dbname );
-                throw;
-            }
+            Database * db = new Database( dbname.c_str() , justCreated , path );
+
+            scoped_lock lk( _mutex );
+            _paths[path][dbname] = db;
             _size++;
             return db;
         }
@@ -116,7 +120,8 @@ namespace mongo {
 
 
         void erase( const string& ns , const string& path ){
-            dbMutex.assertWriteLocked();
+            dbMutex.assertGlobalWriteLocked();
+            scoped_lock lk( _mutex );
             DBs& m = _paths[path];
             _size -= (int)m.erase( _todb( ns ) );
         }
@@ -130,12 +135,18 @@ namespace mongo {
                 
         void forEach(boost::function<void(Database *)> f) const {
             dbMutex.assertAtLeastReadLocked();
-            for ( Paths::const_iterator i=_paths.begin(); i!=_paths.end(); i++ ){
-                DBs m = i->second;
-                for( DBs::const_iterator j=m.begin(); j!=m.end(); j++ ){
-                    f(j->second);
+            vector<Database*> all;
+            {
+                scoped_lock lk( _mutex );
+                for ( Paths::const_iterator i=_paths.begin(); i!=_paths.end(); i++ ){
+                    const DBs& m = i->second;
+                    for( DBs::const_iterator j=m.begin(); j!=m.end(); j++ ){
+                        all.push_back( j->second );
+                    }
                 }
             }
+            for ( unsigned i = 0; i < all.size(); i++ )
+                f( all[i] );
         }         
 
         /**
@@ -143,6 +154,7 @@ namespace mongo {
          */
         void getAllShortNames( set<string>& all ) const {
             dbMutex.assertAtLeastReadLocked();
+            scoped_lock lk( _mutex );
             for ( Paths::const_iterator i=_paths.begin(); i!=_paths.end(); i++ ){
                 DBs m = i->second;
                 for( DBs::const_iterator j=m.begin(); j!=m.end(); j++ ){
@@ -169,6 +181,9 @@ namespace mongo {
             return ns.substr( 0 , i );
         }
         
+        /* with --perDbLocking, operations on different databases look up and open databases
+           concurrently.  closing a database requires the global write lock. */
+        mutable mongo::mutex _mutex;
         Paths _paths;
         int _size;
         
@@ -179,11 +194,16 @@ namespace mongo {
     struct dbtemprelease {
         Client::Context * _context;
         int _locktype;
+        string _db; // non-empty if we held a database lock rather than the global lock
         
         dbtemprelease() {
             _context = cc().getContext();
             _locktype = dbMutex.getState();
             assert( _locktype );
+            if ( DBLock * l = dbMutex.lockedDB() ) {
+                massert( 13630 , "can't temprelease a nested database lock" , !dbMutex.inNestedDBLock() );
+                _db = l->name();
+            }
             
             if ( _locktype > 0 ) {
 				massert( 10298 , "can't temprelease nested write lock", _locktype == 1);
@@ -198,7 +218,9 @@ namespace mongo {
 
         }
         ~dbtemprelease() {
-            if ( _locktype > 0 )
+            if ( !_db.empty() )
+                dbMutex.lockDB( _db , _locktype > 0 );
+            else if ( _locktype > 0 )
                 dbMutex.lock();
             else
                 dbMutex.lock_shared();
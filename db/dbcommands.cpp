@@ -41,6 +41,9 @@
 #include "background.h"
 #include "../util/version.h"
 #include "../s/d_writeback.h"
+#include "../s/d_rangedeleter.h"
+#include "dur.h"
+#include "indexstats.h"
 
 namespace mongo {
 
@@ -123,6 +126,13 @@ namespace mongo {
                 log() << "fsync from getlasterror" << endl;
                 result.append( "fsyncFiles" , MemoryMappedFile::flushAll( true ) );
             }
+            else if ( cmdObj["j"].trueValue() ){
+                // cheaper than fsync: wait for the next group commit to reach the journal
+                if ( cmdLine.dur )
+                    dur::awaitCommit();
+                else
+                    result.append( "jnote" , "journaling not enabled on this server" );
+            }
             
             BSONElement e = cmdObj["w"];
             if ( e.isNumber() ){
@@ -320,6 +330,12 @@ namespace mongo {
                 ttt.append( "writers" , w );
                 ttt.done();
 
+                if ( cmdLine.perDbLocking ) {
+                    BSONObjBuilder dbs( t.subobjStart( "databases" ) );
+                    dbMutex.appendDBLockStats( dbs );
+                    dbs.done();
+                }
+
                 result.append( "globalLock" , t.obj() );
             }
             timeBuilder.appendNumber( "after basic" , Listener::getElapsedTimeMillis() - start );
@@ -377,6 +393,12 @@ namespace mongo {
                 globalFlushCounters.append( bb );
                 bb.done();
             }
+
+            if ( cmdLine.dur ) {
+                BSONObjBuilder bb( result.subobjStart( "dur" ) );
+                dur::appendStats( bb );
+                bb.done();
+            }
             
             {
                 BSONObjBuilder bb( result.subobjStart( "cursors" ) );
@@ -410,6 +432,12 @@ namespace mongo {
 
             result.append( "writeBacksQueued" , ! writeBackManager.queuesEmpty() );
 
+            {
+                BSONObjBuilder bb( result.subobjStart( "rangeDeleter" ) );
+                rangeDeleter.appendStats( bb );
+                bb.done();
+            }
+
             if ( ! authed )
                 result.append( "note" , "run against admin for more info" );
             
@@ -519,14 +547,14 @@ namespace mongo {
                         d->idx(i).kill_idx();
                     }
                 }
-                d->nIndexes = 0;
+                dur::writingInt(d->nIndexes) = 0;
             }
             if ( idIndex ) {
                 d->addIndex(ns) = *idIndex;
                 wassert( d->nIndexes == 1 );
             }
             /* assuming here that id index is not multikey: */
-            d->multiKeyIndexBits = 0;
+            *dur::writing(&d->multiKeyIndexBits) = 0;
             assureSysIndexesEmptied(ns, idIndex);
             anObjBuilder.append("msg", mayDeleteIdIndex ? 
                 "indexes dropped for collection" : 
@@ -549,10 +577,10 @@ namespace mongo {
                     return false;
                 }
                 id->kill_idx();
-                d->multiKeyIndexBits = removeBit(d->multiKeyIndexBits, x);
-                d->nIndexes--;
+                *dur::writing(&d->multiKeyIndexBits) = removeBit(d->multiKeyIndexBits, x);
+                dur::writingInt(d->nIndexes)--;
                 for ( int i = x; i < d->nIndexes; i++ )
-                    d->idx(i) = d->idx(i+1);
+                    *dur::writing(&d->idx(i)) = d->idx(i+1);
             } else {
                 int n = removeFromSysIndexes(ns, name); // just in case an orphaned listing there - i.e. should have been repaired but wasn't
                 if( n ) { 
@@ -752,10 +780,13 @@ namespace mongo {
                 return false;
             }
 
+            // all from one scan of the collection
+            MultiIndexBuild multi;
             for ( list<BSONObj>::iterator i=all.begin(); i!=all.end(); i++ ){
                 BSONObj o = *i;
                 theDataFileMgr.insertWithObjMod( Namespace( toDeleteNs.c_str() ).getSisterNS( "system.indexes" ).c_str() , o , true );
             }
+            multi.done();
 
             result.append( "ok" , 1 );
             result.append( "nIndexes" , (int)all.size() );
@@ -764,6 +795,34 @@ namespace mongo {
         }
     } cmdReIndex;
 
+    /* { analyze : "collection" }
+       samples each index's btree and saves statistics on its key distribution in
+       system.indexstats, for the query optimizer to cost plans with.  see indexstats.h */
+    class CmdAnalyze : public Command {
+    public:
+        // run on the primary only, as its writes to system.indexstats aren't logged; the command
+        // itself is, so each secondary then samples its own indexes when it replays it
+        virtual bool logTheOp() { return true; }
+        virtual bool slaveOk() const { return false; }
+        virtual LockType locktype() const { return WRITE; } 
+        virtual void help( stringstream& help ) const {
+            help << "compute and save index statistics for the query optimizer\n"
+                    "{ analyze : <collection> }";
+        }
+        CmdAnalyze() : Command("analyze") { }
+        bool run(const string& dbname , BSONObj& jsobj, string& errmsg, BSONObjBuilder& result, bool /*fromRepl*/) {
+            string ns = dbname + '.' + jsobj.firstElement().valuestr();
+            if ( ! nsdetails( ns.c_str() ) ){
+                errmsg = "ns not found";
+                return false;
+            }
+            tlog() << "CMD: analyze " << ns << endl;
+            result.append( "ns" , ns );
+            analyzeIndexes( ns.c_str() , result );
+            return true;
+        }
+    } cmdAnalyze;
+
     class CmdListDatabases : public Command {
     public:
         virtual bool slaveOk() const {
@@ -1057,7 +1116,8 @@ namespace mongo {
         virtual bool slaveOk() const { return true; }
         virtual LockType locktype() const { return READ; } 
         virtual void help( stringstream &help ) const {
-            help << "{ collStats:\"blog.posts\" , scale : 1 } scale divides sizes e.g. for KB use 1024";
+            help << "{ collStats:\"blog.posts\" , scale : 1 } scale divides sizes e.g. for KB use 1024\n"
+                    "  freeSpace : true  also reports the deleted records by size, which walks every free list";
         }
         bool run(const string& dbname, BSONObj& jsobj, string& errmsg, BSONObjBuilder& result, bool fromRepl ){
             string ns = dbname + "." + jsobj.firstElement().valuestr();
@@ -1105,6 +1165,26 @@ namespace mongo {
                 result.append( "capped" , nsd->capped );
                 result.append( "max" , nsd->max );
             }
+            else if ( jsobj["freeSpace"].trueValue() ){
+                // capped collections use deletedList differently
+                BSONArrayBuilder freeSpace;
+                for ( int i = 0; i < Buckets; i++ ){
+                    long long n = 0;
+                    long long bytes = 0;
+                    for ( DiskLoc dl = nsd->deletedList[i]; !dl.isNull(); dl = dl.drec()->nextDeleted ){
+                        n++;
+                        bytes += dl.drec()->lengthWithHeaders;
+                    }
+                    if ( n == 0 )
+                        continue;
+                    BSONObjBuilder b;
+                    b.append( "minSize" , i ? bucketSizes[i-1] : 0 );
+                    b.appendNumber( "count" , n );
+                    b.appendNumber( "size" , bytes / scale );
+                    freeSpace.append( b.obj() );
+                }
+                result.append( "freeSpace" , freeSpace.arr() );
+            }
 
             return true;
         }
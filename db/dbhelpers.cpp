@@ -267,7 +267,8 @@ namespace mongo {
         return me.obj();
     }
     
-    long long Helpers::removeRange( const string& ns , const BSONObj& min , const BSONObj& max , bool yield , bool maxInclusive , RemoveCallback * callback ){
+    long long Helpers::removeRange( const string& ns , const BSONObj& min , const BSONObj& max , bool yield , bool maxInclusive , RemoveCallback * callback ,
+                                    long long limit , BSONObj * resumeFrom ){
         BSONObj keya , keyb;
         BSONObj minClean = toKeyFormat( min , keya );
         BSONObj maxClean = toKeyFormat( max , keyb );
@@ -282,6 +283,8 @@ namespace mongo {
         assert( ii >= 0 );
         
         long long num = 0;
+        if ( resumeFrom )
+            *resumeFrom = BSONObj();
         
         IndexDetails& i = nsd->idx( ii );
 
@@ -305,6 +308,19 @@ namespace mongo {
 
             c->checkLocation();
 
+            if ( limit && num >= limit ){
+                if ( c->ok() && resumeFrom ){
+                    // back to field names, the form min is given in
+                    BSONObjBuilder b;
+                    BSONObjIterator k( c->currKey() );
+                    BSONObjIterator f( keya );
+                    while ( f.more() )
+                        b.appendAs( k.next() , f.next().fieldName() );
+                    *resumeFrom = b.obj();
+                }
+                break;
+            }
+
             if ( yield && ! cc->yieldSometimes() ){
                 // cursor got finished by someone else, so we're done
                 break;
@@ -125,8 +125,12 @@ namespace mongo {
             virtual ~RemoveCallback(){}
             virtual void goingToDelete( const BSONObj& o ) = 0;
         };
-        /* removeRange: operation is oplog'd */
-        static long long removeRange( const string& ns , const BSONObj& min , const BSONObj& max , bool yield = false , bool maxInclusive = false , RemoveCallback * callback = 0 );
+        /* removeRange: operation is oplog'd
+           limit: if non-zero, stop after this many and set *resumeFrom to the key to continue from
+                  (empty once the range is gone), so a range can be removed a batch at a time
+        */
+        static long long removeRange( const string& ns , const BSONObj& min , const BSONObj& max , bool yield = false , bool maxInclusive = false , RemoveCallback * callback = 0 ,
+                                      long long limit = 0 , BSONObj * resumeFrom = 0 );
 
         /* Remove all objects from a collection.
         You do not need to set the database before calling.
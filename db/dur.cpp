@@ -0,0 +1,598 @@
+// @file dur.cpp durability in the storage engine (crash-safeness / write ahead journaling)
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* see dur.h for an overview.
+
+   phases of a group commit:
+     1) with at least the read lock held (so that no write operation is partially complete), sort and
+        coalesce the declared intents, and copy the current bytes of each range from the private views
+        into a section buffer.
+     2) release the db lock.  append the section to the current journal file and fsync it.
+     3) copy the journaled bytes into the shared views, from which the OS writes them to the data files.
+     4) wake anyone waiting in awaitCommit().
+
+   every so often the group commit thread also takes the write lock, commits, and remaps the private
+   views, so that the pages they have copied on write are given back.
+
+   the commit mutex serializes commits and journal file rotation.  lock order is dbMutex then
+   commitMutex -- never acquire dbMutex while holding commitMutex.
+*/
+
+#include "pch.h"
+#include "dur.h"
+#include "dur_journalformat.h"
+#include "concurrency.h"
+#include "client.h"
+#include "../util/mmap.h"
+#include "../util/file.h"
+#include "../util/md5.hpp"
+#include "../util/timer.h"
+#include "../util/background.h"
+#include "../util/mongoutils/str.h"
+
+namespace mongo {
+
+    using namespace mongoutils;
+
+    extern string dbpath;
+
+    namespace dur {
+
+        struct WriteIntent {
+            WriteIntent() : p(0), len(0) { }
+            WriteIntent(char *_p, unsigned _len) : p(_p), len(_len) { }
+            char *p;
+            unsigned len;
+            char* end() const { return p + len; }
+            bool operator<(const WriteIntent& r) const { return p < r.p; }
+        };
+
+        /* intents declared since the last commit.  appended to under the write lock.  the committer
+           swaps the vector out while holding at least the read lock, which excludes all writers.
+           (--perDbLocking, where writers to different databases would run at once, is refused with --dur.)
+        */
+        static vector<WriteIntent> intents;
+        static unsigned long long bytesDeclared = 0;
+
+        /* a commit from within the write lock is done via commitIfNeeded() once this much has been declared */
+        const unsigned long long CommitIfNeededBytes = 64 * 1024 * 1024;
+        const unsigned CommitIfNeededIntents = 500000;
+
+        /* switch to a new journal file once this large, even if a data flush hasn't happened yet */
+        const unsigned long long JournalFileMax = 1024 * 1024 * 1024;
+
+        /* remap the private views about this often, if anything was committed since */
+        const unsigned RemapPrivateViewMillis = 1000;
+
+        static mongo::mutex commitMutex("dur.commit");
+
+        /* for awaitCommit() and for waking the group commit thread early */
+        static mongo::mutex notifyMutex("dur.notify");
+        static boost::condition commitDone;
+        static boost::condition commitRequested;
+        static unsigned long long nBuildsStarted = 0;   // protected by notifyMutex
+        static unsigned long long nCommitsDone = 0;     // protected by notifyMutex
+        static bool earlyCommitRequested = false;       // protected by notifyMutex
+        static bool shuttingDown = false;
+
+        static struct Stats {
+            Stats() { memset(this, 0, sizeof(*this)); }
+            unsigned long long commits;
+            unsigned long long commitsInWriteLock;
+            unsigned long long journaledBytes;
+            unsigned long long writeToJournalMicros;
+            unsigned long long writeToDataFilesMicros;
+            unsigned long long remaps;
+            unsigned long long remapMicros;
+            unsigned long long prepMicros;
+            unsigned long long lastCommitMicros;
+        } stats;
+
+        boost::filesystem::path getJournalDir() {
+            boost::filesystem::path p(dbpath);
+            p /= "journal";
+            return p;
+        }
+
+        static unsigned fileIdFromName(const boost::filesystem::path& p) {
+            string fn = p.leaf();
+            return (unsigned) strtoul(fn.c_str() + strlen(JournalFilePrefix), 0, 10);
+        }
+
+        void getJournalFiles(vector<boost::filesystem::path>& files) {
+            boost::filesystem::path dir = getJournalDir();
+            if ( !boost::filesystem::exists(dir) )
+                return;
+            map<unsigned, boost::filesystem::path> m;
+            for ( boost::filesystem::directory_iterator i( dir ); i != boost::filesystem::directory_iterator(); ++i ) {
+                boost::filesystem::path filepath = *i;
+                string fn = filepath.leaf();
+                if ( str::startsWith(fn, JournalFilePrefix) )
+                    m[fileIdFromName(filepath)] = filepath;
+            }
+            for ( map<unsigned, boost::filesystem::path>::iterator i = m.begin(); i != m.end(); ++i )
+                files.push_back(i->second);
+        }
+
+        /** the journal file we are appending to */
+        class Journal : boost::noncopyable {
+        public:
+            Journal() : _curFileId(0), _written(0) { }
+
+            bool isOpen() const { return _file.get() != 0; }
+
+            /** start a new journal file.  caller holds commitMutex (or we are starting up). */
+            void open() {
+                _curFileId++;
+                boost::filesystem::path p = getJournalDir() / fileName(_curFileId);
+                uassert( 13609 , str::stream() << "journal file already exists " << p.string() , !boost::filesystem::exists(p) );
+                _file.reset( new File() );
+                _file->open( p.string().c_str() );
+                uassert( 13610 , str::stream() << "couldn't open journal file " << p.string() , !_file->bad() );
+
+                JHeader h;
+                memset(&h, 0, sizeof(h));
+                h.magic[0] = 'j'; h.magic[1] = h.n1 = h.n2 = h.n3 = h.n4 = '\n';
+                h.version = JHeader::CurrentVersion;
+                time_t t = time(0);
+                strncpy(h.ts, time_t_to_String_short(t).c_str(), sizeof(h.ts)-1);
+                strncpy(h.dbpath, dbpath.c_str(), sizeof(h.dbpath)-1);
+                h.fileId = _curFileId;
+                _file->write(0, (const char *) &h, sizeof(h));
+                _file->fsync();
+                uassert( 13611 , "couldn't write journal file header" , !_file->bad() );
+                _written = sizeof(h);
+
+                /* the directory entry for the new file must be durable too */
+                flushJournalDir();
+            }
+
+            /** append a section and fsync. */
+            void journal(const BufBuilder& b) {
+                assert( isOpen() );
+                _file->write(_written, b.buf(), b.len());
+                _file->fsync();
+                uassert( 13612 , "error writing to journal file" , !_file->bad() );
+                _written += b.len();
+                if ( _written > JournalFileMax )
+                    rotate();
+            }
+
+            /** close the current file and start another.
+                @return the id of the last file which will no longer be appended to
+            */
+            unsigned rotate() {
+                unsigned last = _curFileId;
+                open();
+                return last;
+            }
+
+            /** @return true if nothing but the header has been written to the current file */
+            bool curFileEmpty() const { return _written <= sizeof(JHeader); }
+            unsigned curFileId() const { return _curFileId; }
+
+            /** remove files j._n for all n <= upTo */
+            void removeFilesThrough(unsigned upTo) {
+                vector<boost::filesystem::path> files;
+                getJournalFiles(files);
+                for ( unsigned i = 0; i < files.size(); i++ ) {
+                    unsigned id = fileIdFromName(files[i]);
+                    if ( id <= upTo ) {
+                        log(1) << "dur removing journal file " << files[i].string() << endl;
+                        boost::filesystem::remove(files[i]);
+                    }
+                }
+            }
+
+            void close() {
+                _file.reset();
+            }
+
+            static string fileName(unsigned id) {
+                stringstream ss;
+                ss << JournalFilePrefix << id;
+                return ss.str();
+            }
+
+        private:
+            void flushJournalDir() {
+#if !defined(_WIN32)
+                int fd = ::open(getJournalDir().string().c_str(), O_RDONLY);
+                if ( fd >= 0 ) {
+                    ::fsync(fd);
+                    ::close(fd);
+                }
+#endif
+            }
+
+            unsigned _curFileId;
+            unsigned long long _written;
+            boost::scoped_ptr<File> _file;
+        } j;
+
+        void* _writingPtr(void *p, unsigned len) {
+            DEV assert( dbMutex.isWriteLocked() );
+            char *x = (char *) p;
+            if ( !intents.empty() ) {
+                // cheap dedup of the very common back to back declaration of the same thing
+                const WriteIntent& last = intents.back();
+                if ( last.p == x && last.len >= len )
+                    return p;
+            }
+            intents.push_back( WriteIntent(x, len) );
+            bytesDeclared += len;
+            return p;
+        }
+
+        /** sort and merge overlapping / adjacent ranges */
+        static void coalesce(vector<WriteIntent>& v) {
+            if ( v.empty() )
+                return;
+            sort(v.begin(), v.end());
+            unsigned out = 0;
+            for ( unsigned i = 1; i < v.size(); i++ ) {
+                WriteIntent& cur = v[out];
+                const WriteIntent& next = v[i];
+                if ( next.p <= cur.end() ) {
+                    if ( next.end() > cur.end() )
+                        cur.len = (unsigned) (next.end() - cur.p);
+                }
+                else {
+                    v[++out] = next;
+                }
+            }
+            v.resize(out + 1);
+        }
+
+        /** the name of a data file as stored in the journal: relative to dbpath */
+        static string relativeName(const string& filename) {
+            string p = dbpath;
+            if ( str::startsWith(filename, p) ) {
+                string r = filename.substr(p.size());
+                while ( !r.empty() && ( r[0] == '/' || r[0] == '\\' ) )
+                    r = r.substr(1);
+                return r;
+            }
+            return filename;
+        }
+
+        /** where the bytes of a journal entry go in the shared view */
+        struct DataFileWrite {
+            DataFileWrite(MemoryMappedFile *_f, unsigned long long _ofs, unsigned _len, unsigned _bufOfs) :
+                f(_f), ofs(_ofs), len(_len), bufOfs(_bufOfs) { }
+            MemoryMappedFile *f;
+            unsigned long long ofs;
+            unsigned len;
+            unsigned bufOfs; // of the bytes in the section
+        };
+
+        /** phase 1: build the section.  caller has at least the read lock, and commitMutex.
+            @param writes set to where each entry is to be copied in phase 3
+            @return false if there was nothing to journal
+        */
+        static bool buildSection(BufBuilder& bb, vector<DataFileWrite>& writes) {
+            dbMutex.assertAtLeastReadLocked();
+
+            vector<WriteIntent> v;
+            v.swap(intents);
+            bytesDeclared = 0;
+            if ( v.empty() )
+                return false;
+            coalesce(v);
+
+            JSectHeader h;
+            h.len = 0; // filled in below
+            h.seqNumber = stats.commits + 1;
+            bb.appendBuf(&h, sizeof(h));
+
+            MemoryMappedFile *lastFile = 0;
+            for ( unsigned i = 0; i < v.size(); i++ ) {
+                const WriteIntent& w = v[i];
+                unsigned long long ofs;
+                MemoryMappedFile *f = MemoryMappedFile::fileContaining(w.p, ofs);
+                if ( f == 0 ) {
+                    // e.g. a NamespaceDetails temporary on the stack.  nothing to journal.
+                    DEV log() << "dur: write intent not within a data file, ignoring" << endl;
+                    continue;
+                }
+                unsigned len = w.len;
+                if ( ofs + len > f->length() )
+                    len = (unsigned) (f->length() - ofs);
+
+                JEntry e;
+                e.len = len;
+                e.ofs = ofs;
+                string name;
+                if ( f != lastFile ) {
+                    name = relativeName(f->filename());
+                    massert( 13613 , "dur: data file name too long", name.size() < 0xffff );
+                    lastFile = f;
+                }
+                e.fileNameLen = (unsigned short) name.size();
+                bb.appendBuf(&e, sizeof(e));
+                if ( e.fileNameLen )
+                    bb.appendBuf(name.c_str(), e.fileNameLen);
+                writes.push_back( DataFileWrite(f, ofs, len, bb.len()) );
+                bb.appendBuf(w.p, len);
+            }
+
+            ((JSectHeader*) bb.buf())->len = bb.len() + sizeof(JSectFooter);
+
+            JSectFooter f;
+            md5( bb.buf() , bb.len() , (md5_byte_t *) f.hash );
+            memset(f.magic, '\n', sizeof(f.magic));
+            bb.appendBuf(&f, sizeof(f));
+            return true;
+        }
+
+        /** phase 3: copy what was just journaled into the shared views.  the caller's
+            LockMongoFilesShared, taken while it still held the db lock, keeps the files mapped.
+        */
+        static void writeToDataFiles(const BufBuilder& bb, const vector<DataFileWrite>& writes) {
+            Timer t;
+            for ( unsigned i = 0; i < writes.size(); i++ ) {
+                const DataFileWrite& w = writes[i];
+                char *shared = w.f->sharedView();
+                if ( shared == 0 )
+                    continue;
+                memcpy(shared + w.ofs, bb.buf() + w.bufOfs, w.len);
+            }
+            stats.writeToDataFilesMicros += t.micros();
+        }
+
+        static void noteBuildStarting() {
+            scoped_lock lk(notifyMutex);
+            nBuildsStarted++;
+        }
+
+        static void noteCommitDone() {
+            scoped_lock lk(notifyMutex);
+            nCommitsDone++;
+            commitDone.notify_all();
+        }
+
+        /** commit while holding the write lock (or the read lock, if the caller already has it) */
+        static void commitInLock() {
+            dbMutex.assertAtLeastReadLocked();
+            scoped_lock lk(commitMutex);
+            noteBuildStarting();
+            Timer t;
+            BufBuilder bb(1024 * 1024);
+            vector<DataFileWrite> writes;
+            if ( buildSection(bb, writes) ) {
+                stats.prepMicros += t.micros();
+                LockMongoFilesShared lf;
+                Timer w;
+                j.journal(bb);
+                stats.writeToJournalMicros += w.micros();
+                writeToDataFiles(bb, writes);
+                stats.journaledBytes += bb.len();
+                stats.commits++;
+                if ( dbMutex.isWriteLocked() )
+                    stats.commitsInWriteLock++;
+            }
+            stats.lastCommitMicros = t.micros();
+            noteCommitDone();
+        }
+
+        /** the normal group commit: only hold the read lock while copying */
+        static void groupCommit() {
+            auto_ptr<readlock> lk( new readlock("") );
+            scoped_lock cl(commitMutex);
+            noteBuildStarting();
+            Timer t;
+            BufBuilder bb(1024 * 1024);
+            vector<DataFileWrite> writes;
+            bool any = buildSection(bb, writes);
+            auto_ptr<LockMongoFilesShared> lf;
+            if ( any )
+                lf.reset( new LockMongoFilesShared() );
+            lk.reset();
+            if ( any ) {
+                stats.prepMicros += t.micros();
+                Timer w;
+                j.journal(bb);
+                stats.writeToJournalMicros += w.micros();
+                writeToDataFiles(bb, writes);
+                lf.reset();
+                stats.journaledBytes += bb.len();
+                stats.commits++;
+            }
+            stats.lastCommitMicros = t.micros();
+            noteCommitDone();
+        }
+
+        /** commit in the write lock, after which the private views match the shared views, and remap
+            them to drop their copied pages */
+        static void remapPrivateViews() {
+            writelock lk("");
+            Timer t;
+            commitInLock();
+            MemoryMappedFile::remapPrivateViews();
+            stats.remaps++;
+            stats.remapMicros += t.micros();
+        }
+
+        void commitIfNeeded() {
+            if ( !cmdLine.dur )
+                return;
+            dbMutex.assertWriteLocked();
+            if ( bytesDeclared < CommitIfNeededBytes && intents.size() < CommitIfNeededIntents )
+                return;
+            log(1) << "dur commitIfNeeded " << bytesDeclared / 1024 / 1024 << "MB declared" << endl;
+            commitInLock();
+        }
+
+        void awaitCommit() {
+            if ( !cmdLine.dur )
+                return;
+            assert( !dbMutex.atLeastReadLocked() );
+            scoped_lock lk(notifyMutex);
+            unsigned long long want = nBuildsStarted + 1;
+            earlyCommitRequested = true;
+            commitRequested.notify_one();
+            while ( nCommitsDone < want && !shuttingDown )
+                commitDone.wait( lk.boost() );
+        }
+
+        void syncDataAndTruncateJournal() {
+            if ( !cmdLine.dur )
+                return;
+            dbMutex.assertWriteLocked();
+            commitInLock();
+            MemoryMappedFile::flushAll(true);
+            scoped_lock lk(commitMutex);
+            unsigned last = j.rotate();
+            j.removeFilesThrough(last);
+        }
+
+        unsigned prepareDataFlush() {
+            if ( !cmdLine.dur )
+                return 0;
+            scoped_lock lk(commitMutex);
+            if ( j.curFileEmpty() ) {
+                // nothing new since the last rotation; older files were handled by the previous flush
+                return j.curFileId() - 1;
+            }
+            return j.rotate();
+        }
+
+        void dataFilesFlushed(unsigned upTo) {
+            if ( !cmdLine.dur || upTo == 0 )
+                return;
+            scoped_lock lk(commitMutex);
+            j.removeFilesThrough(upTo);
+        }
+
+        class GroupCommitThread : public BackgroundJob {
+        public:
+            string name() { return "dur"; }
+            void run() {
+                Client::initThread("dur");
+                log(1) << "dur group commit thread started, interval " << cmdLine.durCommitIntervalMs << "ms" << endl;
+                Timer sinceRemap;
+                unsigned long long commitsAtRemap = 0;
+                while ( 1 ) {
+                    {
+                        scoped_lock lk(notifyMutex);
+                        if ( shuttingDown )
+                            break;
+                        if ( !earlyCommitRequested ) {
+                            boost::xtime xt;
+                            boost::xtime_get(&xt, boost::TIME_UTC);
+                            xt.nsec += cmdLine.durCommitIntervalMs * 1000000;
+                            while ( xt.nsec >= 1000000000 ) {
+                                xt.nsec -= 1000000000;
+                                xt.sec++;
+                            }
+                            commitRequested.timed_wait( lk.boost() , xt );
+                        }
+                        earlyCommitRequested = false;
+                        if ( shuttingDown )
+                            break;
+                    }
+                    try {
+                        groupCommit();
+                        if ( sinceRemap.millis() >= RemapPrivateViewMillis && stats.commits != commitsAtRemap ) {
+                            remapPrivateViews();
+                            commitsAtRemap = stats.commits;
+                            sinceRemap.reset();
+                        }
+                    }
+                    catch ( std::exception& e ) {
+                        log() << "dur: exception during group commit, terminating: " << e.what() << endl;
+                        dbexit( EXIT_FS );
+                    }
+                }
+                cc().shutdown();
+            }
+        } groupCommitThread;
+
+        bool haveJournalFiles() {
+            vector<boost::filesystem::path> files;
+            getJournalFiles(files);
+            return !files.empty();
+        }
+
+        void startup() {
+            if ( !cmdLine.dur )
+                return;
+
+            if ( haveJournalFiles() )
+                recover();
+
+            MemoryMappedFile::usePrivateViews(true);
+
+            boost::filesystem::path dir = getJournalDir();
+            if ( !boost::filesystem::exists(dir) ) {
+                log(1) << "dur creating journal dir " << dir.string() << endl;
+                boost::filesystem::create_directory(dir);
+            }
+
+            // anything left here was fully applied by recover()
+            j.removeFilesThrough(0xffffffff);
+            j.open();
+
+            groupCommitThread.go();
+        }
+
+        void shutdown() {
+            if ( !cmdLine.dur || !j.isOpen() )
+                return;
+
+            log() << "shutdown: final commit..." << endl;
+            {
+                scoped_lock lk(notifyMutex);
+                shuttingDown = true;
+                commitRequested.notify_all();
+                commitDone.notify_all();
+            }
+
+            {
+                auto_ptr<readlock> lk;
+                if ( !dbMutex.atLeastReadLocked() )
+                    lk.reset( new readlock("") );
+                commitInLock();
+            }
+
+            log() << "shutdown: flushing data files before removing the journal..." << endl;
+            MemoryMappedFile::flushAll(true);
+
+            scoped_lock lk(commitMutex);
+            j.close();
+            j.removeFilesThrough(0xffffffff);
+        }
+
+        void appendStats(BSONObjBuilder& b) {
+            b.appendNumber( "commits" , (long long) stats.commits );
+            b.appendNumber( "commitsInWriteLock" , (long long) stats.commitsInWriteLock );
+            b.appendNumber( "remaps" , (long long) stats.remaps );
+            b.append( "journaledMB" , stats.journaledBytes / 1024.0 / 1024.0 );
+            b.appendNumber( "pendingIntents" , (long long) intents.size() );
+            BSONObjBuilder t( b.subobjStart( "timeMs" ) );
+            t.append( "prepLogBuffer" , stats.prepMicros / 1000.0 );
+            t.append( "writeToJournal" , stats.writeToJournalMicros / 1000.0 );
+            t.append( "writeToDataFiles" , stats.writeToDataFilesMicros / 1000.0 );
+            t.append( "remapPrivateView" , stats.remapMicros / 1000.0 );
+            t.append( "lastCommit" , stats.lastCommitMicros / 1000.0 );
+            t.done();
+        }
+
+    } // namespace dur
+
+} // namespace mongo
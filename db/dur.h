@@ -0,0 +1,127 @@
+// @file dur.h durability support (write ahead journaling)
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* dur - durability via a write ahead journal.  enabled with --dur.
+
+   Every write to a memory mapped data file (.ns or .<n>) made under the write lock must first be
+   declared with one of the writing*() functions below.  The declaration records an "intent" --
+   an address range.  Periodically (every --durCommitInterval ms) the group commit thread takes
+   the read lock, which guarantees no write operation is half done, copies the current bytes of
+   every declared range into a journal section, releases the lock and appends the section to
+   <dbpath>/journal/j._<n> followed by an fsync.
+
+   On startup, if journal files are present (i.e. we did not shut down cleanly), the sections are
+   replayed onto the data files before anything is mapped.  Thus recovery is proportional to the
+   journal size, not the data size, and no repairDatabase() is needed.
+
+   Journal files are removed once the DataFileSync thread has msync'd all data files past the
+   point they cover, so the journal only holds the last --syncdelay seconds of writes.
+
+   Usage:
+     Record *r = ...;
+     dur::writing(r)->nextOfs = x;
+     memcpy(dur::writingPtr(r->data, len), buf, len);
+
+   Note the declaration must happen in the same write lock acquisition as the write itself.  The
+   pointer returned is the pointer passed in; the return value is just a convenience.
+
+   Data files are mapped twice.  All reads and writes go through a private copy-on-write view, so
+   a write never reaches the file by itself.  After a section is in the journal, its bytes are
+   copied into the shared view, which is the one the OS writes back.  Thus the data files only ever
+   hold committed operations, and recovery never sees half an operation.  The group commit thread
+   periodically remaps the private views, in the write lock, to release their copied pages.  A
+   write that was not declared is lost at the next remap.
+*/
+
+#pragma once
+
+#include "cmdline.h"
+#include "diskloc.h"
+
+namespace mongo {
+
+    namespace dur {
+
+        /** recover from the journal if there is one, then start the group commit thread.
+            call at startup before any data files are opened. */
+        void startup();
+
+        /** commit everything outstanding, flush the data files and remove the journal.
+            call at clean shutdown before the data files are closed. */
+        void shutdown();
+
+        /** @return true if journal files from a previous (unclean) run are present */
+        bool haveJournalFiles();
+
+        /** replay journal files onto the data files. called by startup(). */
+        void recover();
+
+        void* _writingPtr(void *p, unsigned len);
+
+        /** declare intent to write to [p, p+len).  must be in the write lock.
+            @return p
+        */
+        inline void* writingPtr(void *p, unsigned len) {
+            if ( !cmdLine.dur )
+                return p;
+            return _writingPtr(p, len);
+        }
+
+        /** declare intent to write to the whole of *x */
+        template <typename T>
+        inline T* writing(T *x) {
+            return (T*) writingPtr(x, sizeof(T));
+        }
+
+        inline DiskLoc& writingDiskLoc(DiskLoc& d) {
+            return *writing(&d);
+        }
+
+        inline int& writingInt(int& d) {
+            return *writing(&d);
+        }
+
+        /** a long running operation holding the write lock (index builds, repair) should call this
+            periodically.  if enough has been declared since the last commit, commits now, while
+            still in the write lock.
+            important: pointers declared before this call must be declared again before further writes.
+        */
+        void commitIfNeeded();
+
+        /** block until everything declared so far is in the journal on disk.  must not be in a lock.
+            used for getLastError { j : true }. */
+        void awaitCommit();
+
+        /** commit, fsync the data files and empty the journal.  call in the write lock before
+            removing data files (dropDatabase, repair) so that a later replay can't resurrect them. */
+        void syncDataAndTruncateJournal();
+
+        /** the DataFileSync thread calls this before MemoryMappedFile::flushAll(true).
+            @return a token to pass to dataFilesFlushed() */
+        unsigned prepareDataFlush();
+
+        /** the DataFileSync thread calls this after flushAll(true) has completed.  removes journal
+            files that only describe writes now on disk. */
+        void dataFilesFlushed(unsigned token);
+
+        /** for serverStatus */
+        void appendStats(BSONObjBuilder& b);
+
+    } // namespace dur
+
+} // namespace mongo
@@ -0,0 +1,91 @@
+// @file dur_journalformat.h the on disk format for the journal files
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* a journal file is
+
+     JHeader
+     section*
+
+   and a section (one group commit) is
+
+     JSectHeader
+     ( JEntry [file name] data )*
+     JSectFooter
+
+   a section is only applied at recovery if its footer is present and the hash matches, so a
+   section torn by a crash mid-write is simply ignored.
+*/
+
+#pragma once
+
+namespace mongo {
+
+    namespace dur {
+
+#pragma pack(1)
+        struct JHeader {
+            enum { CurrentVersion = 0x4143 };
+
+            char magic[2];              // "j\n"
+            unsigned short version;
+            char n1;                    // '\n'
+            char ts[20];                // ascii time the file was started, for humans
+            char n2;                    // '\n'
+            char dbpath[128];           // for humans
+            char n3;                    // '\n'
+            unsigned long long fileId;  // the n in j._n
+            char reserved[92];
+            char n4;                    // '\n'
+
+            bool valid() const { return magic[0] == 'j' && magic[1] == '\n' && version == CurrentVersion; }
+        };
+
+        struct JSectHeader {
+            unsigned len;               // length of the whole section, including this header and the footer
+            unsigned long long seqNumber;
+        };
+
+        struct JEntry {
+            unsigned len;               // length of the data that follows (after the file name if any)
+            unsigned long long ofs;     // offset of the data within the file
+            unsigned short fileNameLen; // 0 = same file as the previous entry in this section
+        };
+
+        struct JSectFooter {
+            enum { HashLen = 16 };
+            char hash[HashLen];         // md5 of the section from the start of JSectHeader through the last entry
+            char magic[4];              // "\n\n\n\n"
+
+            bool magicOk() const { return *((unsigned*) magic) == 0x0a0a0a0a; }
+        };
+#pragma pack()
+
+        BOOST_STATIC_ASSERT( sizeof(JHeader) == 256 );
+
+        /** @return the journal directory, <dbpath>/journal */
+        boost::filesystem::path getJournalDir();
+
+        /** journal file names are j._<n> */
+        const char * const JournalFilePrefix = "j._";
+
+        /** the journal files present, in the order they were written */
+        void getJournalFiles(vector<boost::filesystem::path>& files);
+
+    } // namespace dur
+
+} // namespace mongo
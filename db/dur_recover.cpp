@@ -0,0 +1,163 @@
+// @file dur_recover.cpp crash recovery via the journal
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "dur.h"
+#include "dur_journalformat.h"
+#include "../util/file.h"
+#include "../util/md5.hpp"
+#include "../util/mongoutils/str.h"
+
+namespace mongo {
+
+    using namespace mongoutils;
+
+    extern string dbpath;
+
+    namespace dur {
+
+        /** applies journal sections to the data files.  nothing is mapped yet so we use plain file i/o. */
+        class RecoveryJob : boost::noncopyable {
+        public:
+            RecoveryJob() : _sectionsApplied(0), _bytesApplied(0) { }
+
+            void go(const vector<boost::filesystem::path>& files) {
+                for ( unsigned i = 0; i < files.size(); i++ ) {
+                    if ( !processFile(files[i]) ) {
+                        // a torn section means we crashed while writing it.  anything after it can't be
+                        // trusted (and shouldn't exist) so we stop there.
+                        if ( i + 1 < files.size() )
+                            log() << "dur recover: ignoring " << files.size() - i - 1 << " journal file(s) after a partial section" << endl;
+                        break;
+                    }
+                }
+
+                log() << "dur recover: applied " << _sectionsApplied << " sections, " << _bytesApplied / 1024 << "KB" << endl;
+
+                for ( map<string, shared_ptr<File> >::iterator i = _files.begin(); i != _files.end(); ++i ) {
+                    i->second->fsync();
+                    uassert( 13615 , str::stream() << "dur recover: error writing data file " << i->first , !i->second->bad() );
+                }
+                _files.clear();
+            }
+
+        private:
+            /** @return false if we stopped at a partial section */
+            bool processFile(const boost::filesystem::path& p) {
+                log() << "dur recover: processing " << p.string() << endl;
+                File f;
+                f.open( p.string().c_str() , true );
+                uassert( 13616 , str::stream() << "dur recover: couldn't open journal file " << p.string() , !f.bad() );
+                fileofs fileLen = f.len();
+
+                if ( fileLen < sizeof(JHeader) ) {
+                    // crashed while creating the file; nothing in it was ever acknowledged
+                    log() << "dur recover: journal file has no header, skipping" << endl;
+                    return false;
+                }
+                JHeader h;
+                f.read(0, (char *) &h, sizeof(h));
+                uassert( 13617 , str::stream() << "dur recover: bad journal file header (wrong version?) " << p.string() , h.valid() );
+
+                fileofs pos = sizeof(JHeader);
+                vector<char> buf;
+                while ( 1 ) {
+                    if ( pos == fileLen )
+                        return true;
+                    if ( pos + sizeof(JSectHeader) + sizeof(JSectFooter) > fileLen )
+                        return false;
+
+                    JSectHeader sh;
+                    f.read(pos, (char *) &sh, sizeof(sh));
+                    if ( sh.len < sizeof(JSectHeader) + sizeof(JSectFooter) || pos + sh.len > fileLen ) {
+                        log() << "dur recover: partial section at offset " << pos << endl;
+                        return false;
+                    }
+
+                    buf.resize(sh.len);
+                    f.read(pos, &buf[0], sh.len);
+                    uassert( 13618 , "dur recover: error reading journal file" , !f.bad() );
+
+                    unsigned dataLen = sh.len - sizeof(JSectFooter);
+                    const JSectFooter *footer = (const JSectFooter *) &buf[dataLen];
+                    md5digest d;
+                    md5( &buf[0] , dataLen , d );
+                    if ( !footer->magicOk() || memcmp(d, footer->hash, sizeof(d)) != 0 ) {
+                        log() << "dur recover: section at offset " << pos << " failed checksum, stopping" << endl;
+                        return false;
+                    }
+
+                    applySection(&buf[0] + sizeof(JSectHeader), &buf[0] + dataLen);
+                    pos += sh.len;
+                }
+            }
+
+            void applySection(const char *p, const char *end) {
+                File *cur = 0;
+                while ( p < end ) {
+                    massert( 13619 , "dur recover: truncated entry in journal section" , p + sizeof(JEntry) <= end );
+                    const JEntry *e = (const JEntry *) p;
+                    p += sizeof(JEntry);
+                    if ( e->fileNameLen ) {
+                        massert( 13620 , "dur recover: bad file name length in journal" , p + e->fileNameLen <= end );
+                        cur = dataFile( string(p, e->fileNameLen) );
+                        p += e->fileNameLen;
+                    }
+                    massert( 13621 , "dur recover: journal entry without a file name" , cur != 0 );
+                    massert( 13622 , "dur recover: bad entry length in journal" , p + e->len <= end );
+                    cur->write(e->ofs, p, e->len);
+                    p += e->len;
+                    _bytesApplied += e->len;
+                }
+                _sectionsApplied++;
+            }
+
+            File* dataFile(const string& relativeName) {
+                shared_ptr<File>& f = _files[relativeName];
+                if ( !f ) {
+                    boost::filesystem::path p = boost::filesystem::path(dbpath) / relativeName;
+                    // the file may be in a --directoryperdb subdirectory
+                    boost::filesystem::create_directories( p.branch_path() );
+                    f.reset( new File() );
+                    f->open( p.string().c_str() );
+                    uassert( 13623 , str::stream() << "dur recover: couldn't open data file " << p.string() , !f->bad() );
+                }
+                return f.get();
+            }
+
+            map<string, shared_ptr<File> > _files;
+            unsigned long long _sectionsApplied;
+            unsigned long long _bytesApplied;
+        };
+
+        void recover() {
+            assert( cmdLine.dur );
+
+            vector<boost::filesystem::path> files;
+            getJournalFiles(files);
+            if ( files.empty() )
+                return;
+
+            log() << "dur recover: " << files.size() << " journal file(s) found, recovering" << endl;
+            RecoveryJob().go(files);
+            // the caller (startup) removes the journal files now that the data files are fsync'd
+        }
+
+    } // namespace dur
+
+} // namespace mongo
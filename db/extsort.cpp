@@ -20,6 +20,7 @@
 
 #include "extsort.h"
 #include "namespace.h"
+#include "cmdline.h"
 #include "../util/file.h"
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -27,12 +28,11 @@
 
 namespace mongo {
     
-    BSONObj BSONObjExternalSorter::extSortOrder;
-    unsigned long long BSONObjExternalSorter::_compares = 0;
+    ThreadLocalValue<BSONObjExternalSorter*> BSONObjExternalSorter::extSortSorter;
     
     BSONObjExternalSorter::BSONObjExternalSorter( const BSONObj & order , long maxFileSize )
         : _order( order.getOwned() ) , _maxFilesize( maxFileSize ) , 
-          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0){
+          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0), _compares(0){
         
         stringstream rootpath;
         rootpath << dbpath;
@@ -44,7 +44,6 @@ namespace mongo {
         log(1) << "external sort root: " << _root.string() << endl;
 
         create_directories( _root );
-        _compares = 0;
     }
     
     BSONObjExternalSorter::~BSONObjExternalSorter(){
@@ -57,11 +56,45 @@ namespace mongo {
         wassert( removed == 1 + _files.size() );
     }
 
+    /* building each key's SortKey once beats walking both keys' elements on every compare */
+    bool BSONObjExternalSorter::_sortInMemBySortKey(){
+        const int MaxBytes = 32 * 1024 * 1024; // BufBuilder stops at 64MB
+
+        Ordering o = Ordering::make( _order );
+        int n = _cur->size();
+        BufBuilder keys( 16 * n + 16 );
+        vector<SortEntry> entries( n );
+        for ( int i=0; i<n; i++ ){
+            RARELY if ( haveClient() ) killCurrentOp.checkForInterrupt();
+            Data& d = (*_cur)[i];
+            SortEntry& e = entries[i];
+            e.ofs = keys.len();
+            if ( ! SortKey::encode( d.first , o , keys ) || keys.len() > MaxBytes )
+                return false;
+            e.len = keys.len() - e.ofs;
+            e.i = i;
+            e.loc = d.second;
+        }
+
+        std::sort( entries.begin() , entries.end() , SortEntryLess( keys.buf() ) );
+
+        vector<Data> sorted;
+        sorted.reserve( n );
+        for ( int i=0; i<n; i++ )
+            sorted.push_back( (*_cur)[ entries[i].i ] );
+        for ( int i=0; i<n; i++ )
+            (*_cur)[i] = sorted[i];
+        return true;
+    }
+
     void BSONObjExternalSorter::_sortInMem(){
+        if ( _sortInMemBySortKey() )
+            return;
+
+        // some key has no SortKey
         // extSortComp needs to use glbals
         // qsort_r only seems available on bsd, which is what i really want to use
-        dblock l;
-        extSortOrder = _order;
+        extSortSorter.set( this );
         _cur->sort( BSONObjExternalSorter::extSortComp );
     }
     
@@ -147,72 +180,56 @@ namespace mongo {
     // ---------------------------------
 
     BSONObjExternalSorter::Iterator::Iterator( BSONObjExternalSorter * sorter ) :
-        _cmp( sorter->_order ) , _in( 0 ){
+        _heap( HeadCmp( sorter->_order ) ){
+        add( sorter );
+    }
+
+    BSONObjExternalSorter::Iterator::Iterator( const vector< BSONObjExternalSorter* >& sorters ) :
+        _heap( HeadCmp( sorters.empty() ? BSONObj() : sorters[0]->_order ) ){
+        for ( unsigned i=0; i<sorters.size(); i++ )
+            add( sorters[i] );
+    }
+
+    void BSONObjExternalSorter::Iterator::add( BSONObjExternalSorter * sorter ){
+        uassert( 13635 ,  "not sorted" , sorter->_sorted );
         
         for ( list<string>::iterator i=sorter->_files.begin(); i!=sorter->_files.end(); i++ ){
-            _files.push_back( new FileIterator( *i ) );
-            _stash.push_back( pair<Data,bool>( Data( BSONObj() , DiskLoc() ) , false ) );
+            _runs.push_back( Run( new FileIterator( *i ) ) );
+            advance( _runs.size() - 1 );
         }
         
-        if ( _files.size() == 0 && sorter->_cur ){
-            _in = sorter->_cur;
-            _it = sorter->_cur->begin();
+        if ( sorter->_files.size() == 0 && sorter->_cur ){
+            _runs.push_back( Run( sorter->_cur ) );
+            advance( _runs.size() - 1 );
         }
-
-        
     }
     
     BSONObjExternalSorter::Iterator::~Iterator(){
-        for ( vector<FileIterator*>::iterator i=_files.begin(); i!=_files.end(); i++ )
-            delete *i;
-        _files.clear();
+        for ( vector<Run>::iterator i=_runs.begin(); i!=_runs.end(); i++ )
+            delete i->file;
+        _runs.clear();
+    }
+
+    void BSONObjExternalSorter::Iterator::advance( int i ){
+        Run& r = _runs[i];
+        if ( r.file ){
+            if ( r.file->more() )
+                _heap.push( Head( r.file->next() , i ) );
+        }
+        else if ( r.pos < r.in->size() ){
+            _heap.push( Head( (*r.in)[r.pos++] , i ) );
+        }
     }
     
     bool BSONObjExternalSorter::Iterator::more(){
-
-        if ( _in )
-            return _it != _in->end();
-        
-        for ( vector<FileIterator*>::iterator i=_files.begin(); i!=_files.end(); i++ )
-            if ( (*i)->more() )
-                return true;
-        for ( vector< pair<Data,bool> >::iterator i=_stash.begin(); i!=_stash.end(); i++ )
-            if ( i->second )
-                return true;
-        return false;
+        return ! _heap.empty();
     }
         
     BSONObjExternalSorter::Data BSONObjExternalSorter::Iterator::next(){
-        
-        if ( _in ){
-            Data& d = *_it;
-            ++_it;
-            return d;
-        }
-        
-        Data best;
-        int slot = -1;
-        
-        for ( unsigned i=0; i<_stash.size(); i++ ){
-
-            if ( ! _stash[i].second ){
-                if ( _files[i]->more() )
-                    _stash[i] = pair<Data,bool>( _files[i]->next() , true );
-                else
-                    continue;
-            }
-            
-            if ( slot == -1 || _cmp( best , _stash[i].first ) == 0 ){
-                best = _stash[i].first;
-                slot = i;
-            }
-                
-        }
-        
-        assert( slot >= 0 );
-        _stash[slot].second = false;
-
-        return best;
+        Head h = _heap.top();
+        _heap.pop();
+        advance( h.second );
+        return h.first;
     }
 
     // -----------------------------------
@@ -238,4 +255,198 @@ namespace mongo {
         return Data( o , *l );
     }
     
+    // -----------------------------------
+
+    ParallelKeySorter::ParallelKeySorter( const vector< const IndexSpec* >& specs , int nThreads , long long nObjectsHint ) :
+        _specs( specs ) , _batch( new Batch() ) , _m( "ParallelKeySorter" ) , _done( false ) , _failed( false ){
+        
+        assert( nThreads > 0 && specs.size() > 0 );
+        
+        // about the memory one BSONObjExternalSorter would use, shared out
+        int nSorters = nThreads * specs.size();
+        long maxFileSize = max( 1024L * 1024 * 100 / nSorters , 1024L * 1024 * 16 );
+        long long arraySize = max( 1000000 / nSorters , 100000 );
+        
+        for ( int i=0; i<nThreads; i++ ){
+            Worker * w = new Worker();
+            for ( unsigned j=0; j<specs.size(); j++ ){
+                w->sorters.push_back( new BSONObjExternalSorter( specs[j]->keyPattern , maxFileSize ) );
+                w->sorters.back()->hintNumObjects( min( arraySize , nObjectsHint / nThreads + 1 ) );
+            }
+            w->nKeys.resize( specs.size() , 0 );
+            w->multikey.resize( specs.size() , false );
+            _workers.push_back( w );
+        }
+        for ( unsigned i=0; i<_workers.size(); i++ )
+            _workers[i]->thread = new boost::thread( boost::bind( &ParallelKeySorter::work , this , _workers[i] ) );
+    }
+
+    ParallelKeySorter::~ParallelKeySorter(){
+        {
+            // abandoned before finish(): let the workers drop what is queued
+            scoped_lock lk( _m );
+            if ( ! _done )
+                _failed = true;
+        }
+        stop();
+        for ( unsigned i=0; i<_workers.size(); i++ ){
+            for ( unsigned j=0; j<_workers[i]->sorters.size(); j++ )
+                delete _workers[i]->sorters[j];
+            delete _workers[i];
+        }
+        for ( deque<Batch*>::iterator i=_queue.begin(); i!=_queue.end(); i++ )
+            delete *i;
+    }
+
+    int ParallelKeySorter::defaultThreads(){
+        if ( cmdLine.indexBuildThreads > 0 )
+            return cmdLine.indexBuildThreads;
+        int n = boost::thread::hardware_concurrency();
+        return n < 1 ? 1 : min( n , 8 );
+    }
+
+    void ParallelKeySorter::add( const BSONObj& o , const DiskLoc& loc ){
+        _batch->push_back( make_pair( o , loc ) );
+        if ( _batch->size() >= 1000 ){
+            push( _batch.release() );
+            _batch.reset( new Batch() );
+        }
+    }
+
+    void ParallelKeySorter::push( Batch * b ){
+        auto_ptr<Batch> p( b );
+        scoped_lock lk( _m );
+        // don't get far ahead of the workers, we'd only be holding on to pages of the collection
+        while ( ! _failed && _queue.size() >= 2 * _workers.size() )
+            _changed.wait( lk.boost() );
+        if ( _failed )
+            uasserted( _error.code , _error.msg );
+        _queue.push_back( p.release() );
+        _changed.notify_all();
+    }
+
+    void ParallelKeySorter::finish(){
+        if ( _batch->size() ){
+            push( _batch.release() );
+            _batch.reset( new Batch() );
+        }
+        stop();
+        if ( _failed )
+            uasserted( _error.code , _error.msg );
+    }
+
+    void ParallelKeySorter::stop(){
+        {
+            scoped_lock lk( _m );
+            _done = true;
+            _changed.notify_all();
+        }
+        for ( unsigned i=0; i<_workers.size(); i++ ){
+            if ( _workers[i]->thread ){
+                _workers[i]->thread->join();
+                delete _workers[i]->thread;
+                _workers[i]->thread = 0;
+            }
+        }
+    }
+
+    void ParallelKeySorter::fail( const ExceptionInfo& e ){
+        scoped_lock lk( _m );
+        if ( ! _failed ){
+            _failed = true;
+            _error = e;
+        }
+        _changed.notify_all();
+    }
+
+    void ParallelKeySorter::work( Worker * w ){
+        setThreadName( "indexKeySorter" );
+        while ( 1 ){
+            auto_ptr<Batch> b;
+            bool failed;
+            {
+                scoped_lock lk( _m );
+                while ( _queue.empty() && ! _done )
+                    _changed.wait( lk.boost() );
+                if ( _queue.empty() )
+                    break;
+                b.reset( _queue.front() );
+                _queue.pop_front();
+                _changed.notify_all();
+                failed = _failed;
+            }
+            if ( ! failed )
+                extract( w , *b );
+        }
+
+        {
+            scoped_lock lk( _m );
+            if ( _failed )
+                return;
+        }
+
+        // the final in memory sort of each run, here rather than on the builder's thread
+        try {
+            for ( unsigned j=0; j<w->sorters.size(); j++ )
+                w->sorters[j]->sort();
+        }
+        catch ( DBException& e ){
+            fail( e.getInfo() );
+        }
+        catch ( std::exception& e ){
+            fail( ExceptionInfo( e.what() , 0 ) );
+        }
+    }
+
+    void ParallelKeySorter::extract( Worker * w , const Batch& b ){
+        try {
+            for ( Batch::const_iterator i=b.begin(); i!=b.end(); i++ ){
+                for ( unsigned j=0; j<_specs.size(); j++ ){
+                    BSONObjSetDefaultOrder keys;
+                    _specs[j]->getKeys( i->first , keys );
+                    if ( keys.size() > 1 )
+                        w->multikey[j] = true;
+                    for ( BSONObjSetDefaultOrder::iterator k=keys.begin(); k!=keys.end(); k++ )
+                        w->sorters[j]->add( *k , i->second );
+                    w->nKeys[j] += keys.size();
+                }
+            }
+        }
+        catch ( DBException& e ){
+            fail( e.getInfo() );
+        }
+        catch ( std::exception& e ){
+            fail( ExceptionInfo( e.what() , 0 ) );
+        }
+    }
+
+    auto_ptr<BSONObjExternalSorter::Iterator> ParallelKeySorter::iterator( int i ){
+        vector<BSONObjExternalSorter*> sorters;
+        for ( unsigned w=0; w<_workers.size(); w++ )
+            sorters.push_back( _workers[w]->sorters[i] );
+        return auto_ptr<BSONObjExternalSorter::Iterator>( new BSONObjExternalSorter::Iterator( sorters ) );
+    }
+
+    unsigned long long ParallelKeySorter::nKeys( int i ) const {
+        unsigned long long n = 0;
+        for ( unsigned w=0; w<_workers.size(); w++ )
+            n += _workers[w]->nKeys[i];
+        return n;
+    }
+
+    bool ParallelKeySorter::multikey( int i ) const {
+        for ( unsigned w=0; w<_workers.size(); w++ )
+            if ( _workers[w]->multikey[i] )
+                return true;
+        return false;
+    }
+
+    int ParallelKeySorter::numFiles() const {
+        int n = 0;
+        for ( unsigned w=0; w<_workers.size(); w++ )
+            for ( unsigned j=0; j<_workers[w]->sorters.size(); j++ )
+                n += _workers[w]->sorters[j]->numFiles();
+        return n;
+    }
+    
 }
@@ -23,6 +23,8 @@
 #include "namespace.h"
 #include "curop.h"
 #include "../util/array.h"
+#include "key.h"
+#include <queue>
 
 namespace mongo {
 
@@ -36,14 +38,18 @@ namespace mongo {
         typedef pair<BSONObj,DiskLoc> Data;
 
     private:
-        static BSONObj extSortOrder;
+        /* the sorter qsort's comparator is sorting for, giving its order and compare count.  per
+           thread, as sorters on several threads can be sorting at once (see ParallelKeySorter) */
+        static ThreadLocalValue<BSONObjExternalSorter*> extSortSorter;
 
         static int extSortComp( const void *lv, const void *rv ){
-            RARELY killCurrentOp.checkForInterrupt();
-            _compares++;
+            // no client on ParallelKeySorter's threads -- the index builder checks for them
+            RARELY if ( haveClient() ) killCurrentOp.checkForInterrupt();
+            BSONObjExternalSorter *sorter = extSortSorter.get();
+            sorter->_compares++;
             Data * l = (Data*)lv;
             Data * r = (Data*)rv;
-            int cmp = l->first.woCompare( r->first , extSortOrder );
+            int cmp = l->first.woCompare( r->first , sorter->_order );
             if ( cmp )
                 return cmp;
             return l->second.compare( r->second );
@@ -65,8 +71,7 @@ namespace mongo {
         public:
             MyCmp( const BSONObj & order = BSONObj() ) : _order( order ){}
             bool operator()( const Data &l, const Data &r ) const {
-                RARELY killCurrentOp.checkForInterrupt();
-                _compares++;
+                RARELY if ( haveClient() ) killCurrentOp.checkForInterrupt();
                 int x = l.first.woCompare( r.first , _order );
                 if ( x )
                     return x < 0;
@@ -81,22 +86,42 @@ namespace mongo {
         
         typedef FastArray<Data> InMemory;
 
+        /* merges the sorted runs -- files, or the in memory array if nothing was spilled */
         class Iterator : boost::noncopyable {
         public:
             
             Iterator( BSONObjExternalSorter * sorter );
+            /** merge the output of several sorters.  they must have the same order. */
+            Iterator( const vector< BSONObjExternalSorter* >& sorters );
             ~Iterator();
             bool more();
             Data next();
             
         private:
-            MyCmp _cmp;
-            vector<FileIterator*> _files;
-            vector< pair<Data,bool> > _stash;
-            
-            InMemory * _in;
-            InMemory::iterator _it;
+            void add( BSONObjExternalSorter * sorter );
+            /** put the next element of run i, if any, on the heap */
+            void advance( int i );
+
+            struct Run {
+                Run( FileIterator * f ) : file( f ), in( 0 ), pos( 0 ) {}
+                Run( InMemory * m ) : file( 0 ), in( m ), pos( 0 ) {}
+                FileIterator * file;
+                InMemory * in;
+                int pos;
+            };
+            typedef pair<Data,int> Head; // a run's next element, and the run
+
+            /* smallest on top of the priority_queue */
+            class HeadCmp {
+            public:
+                HeadCmp( const BSONObj& order ) : _cmp( order ) {}
+                bool operator()( const Head& l, const Head& r ) const { return _cmp( r.first , l.first ); }
+            private:
+                MyCmp _cmp;
+            };
             
+            vector<Run> _runs;
+            priority_queue< Head, vector<Head>, HeadCmp > _heap;
         };
         
         BSONObjExternalSorter( const BSONObj & order = BSONObj() , long maxFileSize = 1024 * 1024 * 100 );
@@ -129,6 +154,27 @@ namespace mongo {
     private:
 
         void _sortInMem();
+        bool _sortInMemBySortKey();
+
+        /* a key of the in memory array, by its SortKey */
+        struct SortEntry {
+            int ofs;        // of its SortKey in the buffer they were all built in
+            int len;
+            int i;          // in the array
+            DiskLoc loc;
+        };
+        class SortEntryLess {
+        public:
+            SortEntryLess( const char *base ) : _base( base ) {}
+            bool operator()( const SortEntry& l , const SortEntry& r ) const {
+                int x = SortKey::compare( _base + l.ofs , l.len , _base + r.ofs , r.len );
+                if ( x )
+                    return x < 0;
+                return l.loc.compare( r.loc ) < 0;
+            }
+        private:
+            const char *_base;
+        };
         
         void sort( string file );
         void finishMap();
@@ -144,6 +190,62 @@ namespace mongo {
         list<string> _files;
         bool _sorted;
 
-        static unsigned long long _compares;
+        // by the in memory sort; only ever touched by the thread sorting
+        unsigned long long _compares;
+    };
+
+    class IndexSpec;
+
+    /**
+       Extracts and sorts the keys of one or more indexes on several threads, for foreground index
+       builds.  The caller scans the collection and add()s each object; objects go to the workers in
+       batches and each worker feeds its own sorter per index, spilling runs to disk as usual.  The
+       batches point into the data files, so the caller must hold the write lock until finish()
+       returns.  iterator(i) then merges every worker's runs for index i in one pass.
+     */
+    class ParallelKeySorter : boost::noncopyable {
+    public:
+        /** @param specs the indexes, which must outlive us.  see also defaultThreads() */
+        ParallelKeySorter( const vector< const IndexSpec* >& specs , int nThreads , long long nObjectsHint );
+        ~ParallelKeySorter();
+
+        void add( const BSONObj& o , const DiskLoc& loc );
+
+        /** wait for the workers to extract and sort everything.  rethrows the first error one hit. */
+        void finish();
+
+        auto_ptr<BSONObjExternalSorter::Iterator> iterator( int i );
+        unsigned long long nKeys( int i ) const;
+        bool multikey( int i ) const;
+        int numFiles() const;
+
+        /** --indexBuildThreads, or one per core up to 8 */
+        static int defaultThreads();
+
+    private:
+        typedef vector< pair<BSONObj,DiskLoc> > Batch;
+        struct Worker {
+            Worker() : thread( 0 ) {}
+            vector< BSONObjExternalSorter* > sorters; // one per index
+            vector< unsigned long long > nKeys;
+            vector< bool > multikey;
+            boost::thread * thread;
+        };
+        void work( Worker * w );
+        void extract( Worker * w , const Batch& b );
+        void push( Batch * b );
+        void fail( const ExceptionInfo& e );
+        void stop();
+
+        vector< const IndexSpec* > _specs;
+        vector< Worker* > _workers;
+        auto_ptr<Batch> _batch; // being filled by add()
+
+        mongo::mutex _m;
+        boost::condition _changed;
+        deque< Batch* > _queue;
+        bool _done;             // no more batches are coming
+        bool _failed;
+        ExceptionInfo _error;   // the first worker error
     };
 }
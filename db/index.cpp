@@ -22,6 +22,7 @@
 #include "btree.h"
 #include "query.h"
 #include "background.h"
+#include "dur.h"
 
 namespace mongo {
 
@@ -77,6 +78,7 @@ namespace mongo {
         catch(DBException& ) { 
             log(2) << "IndexDetails::kill(): couldn't drop ns " << ns << endl;
         }
+        dur::writing(this);
         head.setInvalid();
         info.setInvalid();
 
@@ -180,6 +182,10 @@ namespace mongo {
             uasserted(10098 , s.c_str());
         }
 
+        BSONElement v = io["v"];
+        uassert(13636, "index version must be 0 or 1 (compact keys)",
+            v.eoo() || ( v.isNumber() && ( v.numberInt() == 0 || v.numberInt() == 1 ) ));
+
         if ( sourceNS.empty() || key.isEmpty() ) {
             log(2) << "bad add index attempt name:" << (name?name:"") << "\n  ns:" <<
                 sourceNS << "\n  idxobj:" << io.toString() << endl;
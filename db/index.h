@@ -38,7 +38,7 @@ namespace mongo {
         /* Location of index info object. Format:
 
              { name:"nameofindex", ns:"parentnsname", key: {keypattobject}
-               [, unique: <bool>, background: <bool>] 
+               [, unique: <bool>, background: <bool>, v: <0|1>] 
              }
 
            This object is in the system.indexes collection.  Note that since we
@@ -124,6 +124,13 @@ namespace mongo {
             return info.obj().getBoolField( "dropDups" );
         }
 
+        /* format of the index's btree buckets, the spec's v field: 0, or 1 for compact keys.
+           buckets record their own, so existing ones stay readable whatever this says.
+        */
+        int version() const {
+            return info.obj()["v"].numberInt();
+        }
+
         /* delete this index.  does NOT clean up the system catalog
            (system.indexes or system.namespaces) -- only NamespaceIndex.
         */
@@ -0,0 +1,286 @@
+// indexstats.cpp
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "indexstats.h"
+#include "btree.h"
+#include "pdfile.h"
+#include "queryutil.h"
+#include "query.h"
+
+namespace mongo {
+
+    /* we want about this many histogram buckets; more is fine, up to MaxBounds */
+    static const int TargetBounds = 100;
+    static const int MaxBounds = 200;
+    /* root to leaf paths sampled to estimate the fanout below the histogram level */
+    static const int SamplePaths = 8;
+
+    static bool elementLess( const BSONElement& a , const BSONElement& b ) {
+        return a.woCompare( b , false ) < 0;
+    }
+
+    static string indexStatsNs( const char *ns ) {
+        return nsToDatabase( ns ) + ".system.indexstats";
+    }
+
+    IndexStats IndexStats::compute( const IndexDetails& idx , int maxBuckets ) {
+        IndexStats s;
+        s._keyPattern = idx.keyPattern().getOwned();
+
+        // walk down a level at a time until one has enough keys for the histogram
+        vector< DiskLoc > level( 1 , idx.head );
+        vector< DiskLoc > children;
+        vector< BSONObj > keys;     // used keys of 'level', in order
+        long long keysAbove = 0;    // used keys of the levels above it
+        while( 1 ) {
+            keys.clear();
+            children.clear();
+            for( unsigned i = 0; i < level.size(); i++ ) {
+                const BtreeBucket *b = level[ i ].btree();
+                s._bucketsRead++;
+                for( int j = 0; j < b->n; j++ ) {
+                    const _KeyNode& kn = b->k( j );
+                    if ( !kn.prevChildBucket.isNull() )
+                        children.push_back( kn.prevChildBucket );
+                    if ( kn.isUsed() )
+                        keys.push_back( b->keyNode( j ).key );
+                }
+                if ( !b->nextChild.isNull() )
+                    children.push_back( b->nextChild );
+            }
+            if ( children.empty() || (int) keys.size() >= TargetBounds ||
+                 s._bucketsRead + (int) children.size() > maxBuckets )
+                break;
+            keysAbove += keys.size();
+            level.swap( children );
+        }
+
+        // sample a few paths through the levels below for their fanout, and the leaves for how
+        // often the first field changes value
+        vector< double > sumUsed;
+        vector< int > nSampled;
+        long long leafKeys = 0, leafDistinct = 0;
+        if ( children.empty() ) {
+            // 'level' is the leaf level
+            for( unsigned i = 0; i < keys.size(); i++ ) {
+                if ( i == 0 || keys[ i - 1 ].firstElement().woCompare( keys[ i ].firstElement() , false ) != 0 )
+                    leafDistinct++;
+            }
+            leafKeys = keys.size();
+        }
+        int nPaths = min( (int) children.size() , SamplePaths );
+        for( int p = 0; p < nPaths; p++ ) {
+            DiskLoc loc = children[ ( children.size() * ( 2 * p + 1 ) ) / ( 2 * nPaths ) ];
+            for( unsigned d = 0; !loc.isNull(); d++ ) {
+                const BtreeBucket *b = loc.btree();
+                s._bucketsRead++;
+                bool leaf = b->nextChild.isNull();
+                int used = 0;
+                BSONElement prev;
+                for( int j = 0; j < b->n; j++ ) {
+                    if ( !b->k( j ).isUsed() )
+                        continue;
+                    used++;
+                    if ( leaf ) {
+                        BSONElement e = b->keyNode( j ).key.firstElement();
+                        if ( prev.eoo() || prev.woCompare( e , false ) != 0 )
+                            leafDistinct++;
+                        prev = e;
+                    }
+                }
+                if ( sumUsed.size() <= d ) {
+                    sumUsed.push_back( 0 );
+                    nSampled.push_back( 0 );
+                }
+                sumUsed[ d ] += used;
+                nSampled[ d ]++;
+                if ( leaf ) {
+                    leafKeys += used;
+                    break;
+                }
+                loc = b->n > 0 ? b->k( b->n / 2 ).prevChildBucket : b->nextChild;
+            }
+        }
+
+        double below = 0;
+        double buckets = children.size();
+        for( unsigned d = 0; d < sumUsed.size(); d++ ) {
+            double avg = sumUsed[ d ] / nSampled[ d ];
+            below += buckets * avg;
+            buckets *= avg + 1;
+        }
+        s._nKeys = keysAbove + keys.size() + (long long) below;
+
+        // the histogram: first field of the level's keys, thinned to MaxBounds
+        vector< BSONElement > bounds;
+        int step = ( keys.size() + MaxBounds - 1 ) / MaxBounds;
+        for( unsigned i = 0; i < keys.size(); i += max( step , 1 ) )
+            bounds.push_back( keys[ i ].firstElement() );
+        // a descending first field stores them backwards
+        sort( bounds.begin() , bounds.end() , elementLess );
+        BSONArrayBuilder b;
+        int distinctBounds = 0;
+        for( unsigned i = 0; i < bounds.size(); i++ ) {
+            if ( i == 0 || bounds[ i - 1 ].woCompare( bounds[ i ] , false ) != 0 )
+                distinctBounds++;
+            b.append( bounds[ i ] );
+        }
+        s._boundsObj = b.arr();
+        BSONObjIterator i( s._boundsObj );
+        while( i.more() )
+            s._bounds.push_back( i.next() );
+
+        // when most bounds repeat, a handful of values cover nearly everything.  otherwise assume
+        // the sampled leaves are typical.
+        if ( distinctBounds * 2 <= (int) bounds.size() )
+            s._nDistinct = distinctBounds;
+        else if ( leafKeys > 0 )
+            s._nDistinct = max( (long long) distinctBounds , (long long) ( s._nKeys * ( (double) leafDistinct / leafKeys ) ) );
+        else
+            s._nDistinct = max( distinctBounds , 1 );
+        return s;
+    }
+
+    IndexStats IndexStats::fromBSON( const BSONObj& o ) {
+        IndexStats s;
+        BSONElement bounds = o[ "bounds" ];
+        uassert( 13632 , "bad index stats, bounds must be an array: " + o.toString() , bounds.type() == Array );
+        s._keyPattern = o.getObjectField( "key" ).getOwned();
+        s._nKeys = o[ "nKeys" ].numberLong();
+        s._nDistinct = o[ "nDistinct" ].numberLong();
+        s._bucketsRead = o[ "buckets" ].numberInt();
+        s._boundsObj = bounds.embeddedObject().getOwned();
+        BSONObjIterator i( s._boundsObj );
+        while( i.more() )
+            s._bounds.push_back( i.next() );
+        return s;
+    }
+
+    BSONObj IndexStats::toBSON( const string& ns , const string& indexName ) const {
+        BSONObjBuilder b;
+        b.append( "_id" , ns + ".$" + indexName );
+        b.append( "ns" , ns );
+        b.append( "name" , indexName );
+        b.append( "key" , _keyPattern );
+        b.append( "nKeys" , _nKeys );
+        b.append( "nDistinct" , _nDistinct );
+        b.append( "buckets" , _bucketsRead );
+        b.appendArray( "bounds" , _boundsObj );
+        b.appendDate( "ts" , jsTime() );
+        return b.obj();
+    }
+
+    int IndexStats::countBelow( const BSONElement& e , bool inclusive ) const {
+        vector< BSONElement >::const_iterator i = inclusive ?
+            upper_bound( _bounds.begin() , _bounds.end() , e , elementLess ) :
+            lower_bound( _bounds.begin() , _bounds.end() , e , elementLess );
+        return i - _bounds.begin();
+    }
+
+    long long IndexStats::estimateKeys( const FieldRange& fr ) const {
+        if ( _nKeys == 0 || fr.empty() )
+            return 0;
+        if ( _bounds.empty() )
+            return _nKeys;
+
+        double perBucket = (double) _nKeys / ( _bounds.size() + 1 );
+        double perValue = (double) _nKeys / max( _nDistinct , 1LL );
+        double total = 0;
+        const vector< FieldInterval >& intervals = fr.intervals();
+        for( vector< FieldInterval >::const_iterator i = intervals.begin(); i != intervals.end(); ++i ) {
+            int first = countBelow( i->_lower._bound , !i->_lower._inclusive );
+            int last = countBelow( i->_upper._bound , i->_upper._inclusive );
+            int inside = max( last - first , 0 );
+            if ( i->equality() )
+                total += inside ? inside * perBucket : min( perValue , perBucket );
+            else
+                total += ( inside + 1 ) * perBucket;
+        }
+        return min( (long long) total , _nKeys );
+    }
+
+    const IndexStats* NamespaceIndexStats::get( const IndexDetails& idx ) const {
+        map< string , IndexStats >::const_iterator i = byName.find( idx.indexName() );
+        if ( i == byName.end() || i->second.keyPattern().woCompare( idx.keyPattern() ) != 0 )
+            return 0;
+        return &i->second;
+    }
+
+    shared_ptr< const NamespaceIndexStats > indexStatsFor( const char *ns ) {
+        {
+            scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+            shared_ptr< const NamespaceIndexStats > s = NamespaceDetailsTransient::get_inlock( ns ).indexStats();
+            if ( s )
+                return s;
+        }
+
+        shared_ptr< NamespaceIndexStats > s( new NamespaceIndexStats() );
+        string statsNs = indexStatsNs( ns );
+        if ( strstr( ns , ".system." ) == 0 && nsdetails( statsNs.c_str() ) ) {
+            // a handful of documents per collection, so no index
+            shared_ptr< Cursor > c = findTableScan( statsNs.c_str() , BSONObj() );
+            for( ; c->ok(); c->advance() ) {
+                BSONObj o = c->current();
+                if ( strcmp( o.getStringField( "ns" ) , ns ) != 0 )
+                    continue;
+                try {
+                    s->byName[ o.getStringField( "name" ) ] = IndexStats::fromBSON( o );
+                }
+                catch ( DBException& e ) {
+                    log() << "ignoring index stats for " << ns << ": " << e.what() << endl;
+                }
+            }
+        }
+
+        scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+        NamespaceDetailsTransient& nsdt = NamespaceDetailsTransient::get_inlock( ns );
+        if ( !nsdt.indexStats() )
+            nsdt.setIndexStats( s );
+        return nsdt.indexStats();
+    }
+
+    void analyzeIndexes( const char *ns , BSONObjBuilder& result ) {
+        NamespaceDetails *d = nsdetails( ns );
+        uassert( 13633 , (string)"ns not found: " + ns , d );
+        removeIndexStats( ns );
+
+        string statsNs = indexStatsNs( ns );
+        BSONObjBuilder indexes( result.subobjStart( "indexes" ) );
+        NamespaceDetails::IndexIterator i = d->ii();
+        while( i.more() ) {
+            IndexDetails& idx = i.next();
+            if ( idx.getSpec().getType() )
+                continue; // e.g. geo -- keys aren't ordered by a field's value
+            IndexStats s = IndexStats::compute( idx );
+            BSONObj o = s.toBSON( ns , idx.indexName() );
+            theDataFileMgr.insertWithObjMod( statsNs.c_str() , o , true );
+            indexes.append( idx.indexName() , BSON( "nKeys" << s.nKeys() << "nDistinct" << s.nDistinct() << "nBounds" << s.nBounds() ) );
+        }
+        indexes.done();
+        NamespaceDetailsTransient::get_w( ns ).indexStatsChanged();
+    }
+
+    void removeIndexStats( const char *ns ) {
+        string statsNs = indexStatsNs( ns );
+        if ( nsdetails( statsNs.c_str() ) )
+            deleteObjects( statsNs.c_str() , BSON( "ns" << ns ) , false , false , true );
+        NamespaceDetailsTransient::get_w( ns ).indexStatsChanged();
+    }
+
+} // namespace mongo
@@ -0,0 +1,93 @@
+// indexstats.h
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../pch.h"
+#include "jsobj.h"
+
+namespace mongo {
+
+    class IndexDetails;
+    class FieldRange;
+
+    /* Statistics on the key distribution of an index, for the query optimizer to cost plans with
+       before it races them.
+
+       We don't scan the index to compute these, we sample its btree buckets.  The keys of any one
+       level of a btree, read left to right, are in order and split the keys below them into roughly
+       equal sized runs -- so they are an equi-depth histogram for free.  We use the shallowest level
+       with enough keys for that, and estimate the total key count from the fanout seen along a few
+       root to leaf paths.  Only the first field of the key pattern is described.
+
+       Stored in <db>.system.indexstats, one document per index, by the analyze command:
+
+         { _id: "test.foo.$a_1", ns: "test.foo", name: "a_1", key: { a: 1 },
+           nKeys: <est>, nDistinct: <est>, bounds: [ <first field values, ascending> ], ts: <date> }
+    */
+    class IndexStats {
+    public:
+        IndexStats() : _nKeys(0), _nDistinct(0), _bucketsRead(0) { }
+
+        /** sample idx's btree, reading at most maxBuckets buckets.  caller must hold a read lock. */
+        static IndexStats compute( const IndexDetails& idx , int maxBuckets = 256 );
+
+        static IndexStats fromBSON( const BSONObj& o );
+        /** the system.indexstats document for index indexName of collection ns */
+        BSONObj toBSON( const string& ns , const string& indexName ) const;
+
+        /** @return estimated number of keys whose first field is in fr */
+        long long estimateKeys( const FieldRange& fr ) const;
+
+        long long nKeys() const { return _nKeys; }
+        long long nDistinct() const { return _nDistinct; }
+        int nBounds() const { return _bounds.size(); }
+        const BSONObj& keyPattern() const { return _keyPattern; }
+
+    private:
+        /** number of bounds b with lo <= b (or lo < b if !inclusive) */
+        int countBelow( const BSONElement& e , bool inclusive ) const;
+
+        BSONObj _keyPattern;
+        long long _nKeys;
+        long long _nDistinct;
+        int _bucketsRead;
+        BSONObj _boundsObj;             // owns the data _bounds points into
+        vector< BSONElement > _bounds;  // ascending
+    };
+
+    /* the stats for all the indexes of one collection, by index name.  cached in
+       NamespaceDetailsTransient (see indexStatsFor()) */
+    class NamespaceIndexStats {
+    public:
+        /** @return 0 if none for that index, or if they are for an older index of the same name */
+        const IndexStats* get( const IndexDetails& idx ) const;
+        map< string , IndexStats > byName;
+    };
+
+    /** the persisted stats for ns's indexes -- loaded on first use.  never null.  caller must hold a
+        read lock, with the database of ns set. */
+    shared_ptr< const NamespaceIndexStats > indexStatsFor( const char *ns );
+
+    /** compute and persist stats for all of ns's indexes, replacing older ones.  write lock. */
+    void analyzeIndexes( const char *ns , BSONObjBuilder& result );
+
+    /** remove the persisted stats for ns, e.g. when it is dropped.  write lock. */
+    void removeIndexStats( const char *ns );
+
+} // namespace mongo
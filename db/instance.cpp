@@ -38,6 +38,7 @@
 #endif
 #include "stats/counters.h"
 #include "background.h"
+#include "dur.h"
 
 namespace mongo {
 
@@ -257,6 +258,7 @@ namespace mongo {
         globalOpCounters.gotOp( op , isCommand );
         
         Client& c = cc();
+        c.getAuthenticationInfo()->startRequest();
         
         auto_ptr<CurOp> nestedOp;
         CurOp* currentOpP = c.curop();
@@ -412,6 +414,10 @@ namespace mongo {
 
         NamespaceDetailsTransient::clearForPrefix( prefix.c_str() );
 
+        /* the journal must not refer to files which are about to be unmapped (and perhaps removed), 
+           otherwise a replay after a crash could resurrect them */
+        dur::syncDataAndTruncateJournal();
+
         dbHolder.erase( db, path );
         ctx->clear();
         delete database; // closes files
@@ -445,7 +451,7 @@ namespace mongo {
             op.setQuery(query);
         }        
 
-        mongolock lk(1);
+        mongolock lk(1, ns);
 
         // if this ever moves to outside of lock, need to adjust check Client::Context::_finishInit
         if ( ! broadcast && handlePossibleShardedMessage( m , 0 ) )
@@ -501,35 +507,37 @@ namespace mongo {
         if( ntoreturn ) 
             ss << " ntoreturn:" << ntoreturn;
 
-		time_t start = 0;
+        Timer waited;
         int pass = 0;        
         bool exhaust = false;
         QueryResult* msgdata;
+        /* an awaitData cursor at the end of a capped collection waits, without the lock, for an insert
+           into it.  the ticket is taken before we look so an insert while we look isn't missed. */
+        NotifyAll *inserts = 0;
+        NotifyAll::When lastInsert = 0;
         while( 1 ) {
             try {
-                mongolock lk(false);
+                if( inserts )
+                    lastInsert = inserts->now();
+                mongolock lk(false, ns);
                 Client::Context ctx(ns);
                 msgdata = processGetMore(ns, ntoreturn, cursorid, curop, pass, exhaust);
             }
             catch ( GetMoreWaitException& ) { 
                 exhaust = false;
                 massert(13073, "shutting down", !inShutdown() );
-				if( pass == 0 ) { 
-  				    start = time(0);
-				}
-				else { 
-				  if( time(0) - start >= 4 ) {
-					// after about 4 seconds, return.  this is a sanity check.  pass stops at 1000 normally 
-					// for DEV this helps and also if sleep is highly inaccurate on a platform.  we want to 
-					// return occasionally so slave can checkpoint.
-					pass = 10000;
-				  }
-				}
+                if( pass == 0 )
+                    waited.reset();
                 pass++;
-                DEV 
-                    sleepmillis(20);
-                else 
-                    sleepmillis(2);
+                if( inserts == 0 ) {
+                    // look again, this time holding a ticket
+                    inserts = &NamespaceDetailsTransient::cappedInsertNotifier(ns);
+                    continue;
+                }
+                // after about 4 seconds, return.  we want to return occasionally so slave can checkpoint.
+                int left = 4000 - waited.millis();
+                if( left <= 0 || !inserts->timedWaitFor(lastInsert, left) )
+                    pass = 10000;
                 continue;
             }
             catch ( AssertionException& e ) {
@@ -554,6 +562,23 @@ namespace mongo {
         return ok;
     }
 
+    /* the index specs of an insert into system.indexes.  foreground builds are deferred to one
+       MultiIndexBuild, and logged only once it succeeds -- if any fails, none of them are kept. */
+    static void receivedIndexInserts( DbMessage& d, const char *ns ) {
+        vector<BSONObj> specs;
+        MultiIndexBuild multi;
+        while ( d.moreJSObjs() ) {
+            BSONObj js = d.nextJsObj();
+            uassert( 10059 , "object to insert too large", js.objsize() <= MaxBSONObjectSize);
+            theDataFileMgr.insertWithObjMod(ns, js, false);
+            specs.push_back( js );
+            globalOpCounters.gotInsert();
+        }
+        multi.done();
+        for ( unsigned i = 0; i < specs.size(); i++ )
+            logOp("i", ns, specs[i]);
+    }
+
     void receivedInsert(Message& m, CurOp& op) {
         DbMessage d(m);
 		const char *ns = d.getns();
@@ -567,6 +592,14 @@ namespace mongo {
             return;
 
         Client::Context ctx(ns);		
+
+        if ( strstr( ns, ".system.indexes" ) ) {
+            // several index specs in one message are built from one scan of each collection
+            receivedIndexInserts( d, ns );
+            return;
+        }
+
+        BatchInsert batch(ns);
         while ( d.moreJSObjs() ) {
             BSONObj js = d.nextJsObj();
             uassert( 10059 , "object to insert too large", js.objsize() <= MaxBSONObjectSize);
@@ -574,6 +607,7 @@ namespace mongo {
             logOp("i", ns, js);
             globalOpCounters.gotInsert();
         }
+        batch.done();
     }
 
     class JniMessagingPort : public AbstractMessagingPort {
@@ -757,6 +791,8 @@ namespace mongo {
         // synchronous signal, which we don't expect
         log() << "shutdown: waiting for fs preallocator..." << endl;
         theFileAllocator().waitUntilFinished();
+
+        dur::shutdown();
         
         log() << "shutdown: closing all files..." << endl;
         stringstream ss3;
@@ -804,6 +840,16 @@ namespace mongo {
             uassert( 10310 ,  "Unable to acquire lock for lockfilepath: " + name,  0 );
         }
 
+        if ( dur::haveJournalFiles() ) {
+            if ( !cmdLine.dur ) {
+                close ( lockFile );
+                lockFile = 0;
+                uasserted( 13614 , "journal files are present in the dbpath journal directory; restart with --dur to recover from them" );
+            }
+            // recovery from the journal (dur::startup) replaces --repair
+            oldFile = false;
+        }
+
         if ( oldFile ){
             // we check this here because we want to see if we can get the lock
             // if we can't, then its probably just another mongod running
@@ -0,0 +1,343 @@
+// key.cpp
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "key.h"
+
+namespace mongo {
+
+    static bool fitsByte( long long x ) { return x >= -128 && x <= 127; }
+    static bool fitsShort( long long x ) { return x >= -32768 && x <= 32767; }
+    static bool fitsInt( long long x ) { return x >= -2147483647LL - 1 && x <= 2147483647LL; }
+
+    static bool isNegativeZero( double d ) {
+        if ( d != 0 )
+            return false;
+        long long bits;
+        memcpy( &bits , &d , sizeof( bits ) );
+        return bits != 0;
+    }
+
+    /* x must fit in an int.  tag is the 1 byte form, tag+1 the 2 byte and tag+2 the 4 byte one. */
+    void CompactKey::appendPacked( BufBuilder& b , int tag , long long x ) {
+        if ( fitsByte( x ) ) {
+            b.appendChar( (char) tag );
+            b.appendChar( (char) x );
+        }
+        else if ( fitsShort( x ) ) {
+            b.appendChar( (char) ( tag + 1 ) );
+            b.appendNum( (short) x );
+        }
+        else {
+            b.appendChar( (char) ( tag + 2 ) );
+            b.appendNum( (int) x );
+        }
+    }
+
+    void CompactKey::encode( const BSONObj& key , BufBuilder& b ) {
+        BSONObjIterator i( key );
+        while ( i.more() ) {
+            BSONElement e = i.next();
+            dassert( *e.fieldName() == 0 );
+            switch ( e.type() ) {
+            case NumberInt:
+                appendPacked( b , IntByte , e._numberInt() );
+                continue;
+            case NumberLong:
+                if ( fitsInt( e._numberLong() ) ) {
+                    appendPacked( b , LongByte , e._numberLong() );
+                    continue;
+                }
+                break;
+            case NumberDouble: {
+                double d = e._numberDouble();
+                if ( d >= -2147483648.0 && d <= 2147483647.0 && d == (double) (int) d && !isNegativeZero( d ) ) {
+                    appendPacked( b , DoubleByte , (int) d );
+                    continue;
+                }
+                break;
+            }
+            case String:
+                if ( e.valuestrsize() - 1 < 256 ) {
+                    int len = e.valuestrsize() - 1;
+                    b.appendChar( (char) ShortString );
+                    b.appendChar( (char) len );
+                    b.appendBuf( e.valuestr() , len );
+                    continue;
+                }
+                break;
+            default:
+                break;
+            }
+            b.appendChar( (char) e.type() );
+            b.appendBuf( e.value() , e.valuesize() );
+        }
+    }
+
+    /* size of a BSON value of the given type -- what BSONElement::valuesize() works out from the
+       element, which we haven't got */
+    int CompactKey::valueSize( int type , const char *value ) {
+        switch ( type ) {
+        case MinKey:
+        case MaxKey:
+        case EOO:
+        case Undefined:
+        case jstNULL:
+            return 0;
+        case Bool:
+            return 1;
+        case NumberInt:
+            return 4;
+        case NumberDouble:
+        case NumberLong:
+        case Date:
+        case Timestamp:
+            return 8;
+        case jstOID:
+            return 12;
+        case String:
+        case Code:
+        case Symbol:
+            return 4 + *(int*)value;
+        case Object:
+        case Array:
+        case CodeWScope:
+            return *(int*)value;
+        case BinData:
+            return 4 + 1 + *(int*)value;
+        case DBRef:
+            return 4 + *(int*)value + 12;
+        case RegEx: {
+            const char *flags = value + strlen( value ) + 1;
+            return (int) ( flags + strlen( flags ) + 1 - value );
+        }
+        default:
+            msgasserted( 13637 , (string)"bad type in compact btree key: " + BSONObjBuilder::numStr( type ) );
+        }
+        return 0;
+    }
+
+    /* the parts of the BufBuilder interface decodeTo uses, over a fixed buffer */
+    class FixedBuilder {
+    public:
+        FixedBuilder( char *buf , int size ) : _buf( buf ) , _size( size ) , _len( 0 ) {}
+        void skip( int n ) { grow( n ); }
+        void appendChar( char c ) { *grow( 1 ) = c; }
+        void appendNum( int x ) { memcpy( grow( sizeof( x ) ) , &x , sizeof( x ) ); }
+        void appendNum( long long x ) { memcpy( grow( sizeof( x ) ) , &x , sizeof( x ) ); }
+        void appendNum( double x ) { memcpy( grow( sizeof( x ) ) , &x , sizeof( x ) ); }
+        void appendBuf( const void *src , int n ) { memcpy( grow( n ) , src , n ); }
+        char* buf() { return _buf; }
+        int len() const { return _len; }
+    private:
+        char* grow( int n ) {
+            massert( 13650 , "compact btree key too large to decode" , _len + n <= _size );
+            char *p = _buf + _len;
+            _len += n;
+            return p;
+        }
+        char *_buf;
+        int _size;
+        int _len;
+    };
+
+    /* appends the object whose compact form is p[0..len) to b, which must be empty */
+    template< class Builder >
+    void CompactKey::decodeTo( const char *p , int len , Builder& b ) {
+        const char *end = p + len;
+        b.skip( 4 );
+        while ( p < end ) {
+            int tag = (unsigned char) *p++;
+            switch ( tag ) {
+            case IntByte:
+            case IntShort:
+            case IntInt:
+            case LongByte:
+            case LongShort:
+            case LongInt:
+            case DoubleByte:
+            case DoubleShort:
+            case DoubleInt: {
+                int width = ( tag - IntByte ) % 3;
+                int x;
+                if ( width == 0 ) {
+                    x = *(signed char*)p;
+                    p += 1;
+                }
+                else if ( width == 1 ) {
+                    x = *(short*)p;
+                    p += 2;
+                }
+                else {
+                    x = *(int*)p;
+                    p += 4;
+                }
+                if ( tag < LongByte ) {
+                    b.appendChar( (char) NumberInt );
+                    b.appendChar( 0 );
+                    b.appendNum( x );
+                }
+                else if ( tag < DoubleByte ) {
+                    b.appendChar( (char) NumberLong );
+                    b.appendChar( 0 );
+                    b.appendNum( (long long) x );
+                }
+                else {
+                    b.appendChar( (char) NumberDouble );
+                    b.appendChar( 0 );
+                    b.appendNum( (double) x );
+                }
+                break;
+            }
+            case ShortString: {
+                int n = (unsigned char) *p++;
+                b.appendChar( (char) String );
+                b.appendChar( 0 );
+                b.appendNum( n + 1 );
+                b.appendBuf( p , n );
+                b.appendChar( 0 );
+                p += n;
+                break;
+            }
+            default: {
+                int type = (signed char) tag;
+                int sz = valueSize( type , p );
+                b.appendChar( (char) type );
+                b.appendChar( 0 );
+                b.appendBuf( p , sz );
+                p += sz;
+            }
+            }
+        }
+        massert( 13638 , "corrupt compact btree key" , p == end );
+        b.appendChar( (char) EOO );
+        *(int*)b.buf() = b.len();
+    }
+
+    BSONObj CompactKey::decode( const char *p , int len ) {
+        BufBuilder b( len + 64 );
+        decodeTo( p , len , b );
+        char *data = b.buf();
+        b.decouple();
+        return BSONObj( data , true );
+    }
+
+    BSONObj CompactKey::decode( const char *p , int len , char *buf , int size ) {
+        FixedBuilder b( buf , size );
+        decodeTo( p , len , b );
+        return BSONObj( buf );
+    }
+
+    static void appendBigEndian( BufBuilder& b , unsigned long long x , int bytes ) {
+        for ( int i = bytes - 1; i >= 0; i-- )
+            b.appendChar( (char) ( x >> ( i * 8 ) ) );
+    }
+
+    /* appends e's value, @return false if it can't be */
+    static bool appendSortValue( BufBuilder& b , const BSONElement& e ) {
+        switch ( e.type() ) {
+        case MinKey:
+        case MaxKey:
+        case EOO:
+        case Undefined:
+        case jstNULL:
+            return true;
+        case NumberLong:
+            if ( e._numberLong() > ( 1LL << 53 ) || e._numberLong() < -( 1LL << 53 ) )
+                return false;
+            // fall through, it is exactly a double
+        case NumberInt:
+        case NumberDouble: {
+            double d = e.number();
+            if ( !( d <= numeric_limits< double >::max() && d >= -numeric_limits< double >::max() ) ) {
+                // NaN and the infinities: equal to each other and below every other number
+                appendBigEndian( b , 0 , 8 );
+                return true;
+            }
+            if ( d == 0 )
+                d = 0; // -0
+            unsigned long long bits;
+            memcpy( &bits , &d , sizeof( bits ) );
+            if ( bits >> 63 )
+                bits = ~bits;
+            else
+                bits |= 1ULL << 63;
+            appendBigEndian( b , bits , 8 );
+            return true;
+        }
+        case Bool:
+            b.appendChar( *e.value() );
+            return true;
+        case Date:
+        case Timestamp:
+            appendBigEndian( b , e.date() , 8 );
+            return true;
+        case jstOID:
+            b.appendBuf( e.value() , 12 );
+            return true;
+        case String:
+        case Symbol:
+        case Code:
+            // compared with strcmp, so only up to the first NUL
+            b.appendStr( e.valuestr() );
+            return true;
+        case BinData:
+            appendBigEndian( b , e.valuestrsize() , 4 );
+            b.appendBuf( e.value() + 4 , e.valuestrsize() + 1 );
+            return true;
+        case RegEx:
+            b.appendStr( e.regex() );
+            b.appendStr( e.regexFlags() );
+            return true;
+        case DBRef:
+            appendBigEndian( b , e.valuesize() , 4 );
+            b.appendBuf( e.value() , e.valuesize() );
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool SortKey::encode( const BSONObj& key , const Ordering& o , BufBuilder& b ) {
+        BSONObjIterator i( key );
+        unsigned mask = 1;
+        while ( i.more() ) {
+            BSONElement e = i.next();
+            int start = b.len();
+            b.appendChar( (char) ( e.canonicalType() + 2 ) );
+            if ( !appendSortValue( b , e ) )
+                return false;
+            if ( o.descending( mask ) ) {
+                for ( char *p = b.buf() + start; p < b.buf() + b.len(); p++ )
+                    *p = ~*p;
+            }
+            mask <<= 1;
+        }
+        b.appendChar( 0 );
+        return true;
+    }
+
+    int CompactKey::commonPrefix( const char *a , int alen , const char *b , int blen ) {
+        int n = min( alen , blen );
+        int i = 0;
+        while ( i < n && a[i] == b[i] )
+            i++;
+        return i;
+    }
+
+} // namespace mongo
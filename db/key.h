@@ -0,0 +1,93 @@
+// key.h
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../pch.h"
+#include "jsobj.h"
+
+namespace mongo {
+
+    /* The compact form in which v1 btree buckets (index spec { v : 1 }) store their keys.
+
+       A btree key is a BSONObj whose fields are all unnamed.  Here each element is just its type
+       byte and its value -- no field name, and no object length or EOO, the bucket keeps the
+       length.  Small numbers and short strings are packed further:
+
+         IntByte, IntShort, IntInt           NumberInt in 1, 2 or 4 bytes
+         LongByte, LongShort, LongInt        NumberLong that fits in an int, in 1, 2 or 4 bytes
+         DoubleByte, DoubleShort, DoubleInt  NumberDouble with an int value (not -0), likewise
+         ShortString                         String under 256 bytes: a length byte, then the bytes
+
+       Anything else is its BSON type byte followed by its BSON value.  Decoding gives back exactly
+       the key that was encoded, types included, so keys compare the same in either format.
+    */
+    class CompactKey {
+    public:
+        /** append the compact form of key to b */
+        static void encode( const BSONObj& key , BufBuilder& b );
+
+        /** @return the key whose compact form is p[0..len), as an owned object */
+        static BSONObj decode( const char *p , int len );
+
+        /** @return the key whose compact form is p[0..len), built in buf[0..size) -- no allocation,
+            for comparing against.  the object is valid as long as buf is. */
+        static BSONObj decode( const char *p , int len , char *buf , int size );
+
+        /** @return how many leading bytes a[0..alen) and b[0..blen) have in common */
+        static int commonPrefix( const char *a , int alen , const char *b , int blen );
+
+    private:
+        enum Packed {
+            IntByte = 0x20, IntShort, IntInt,
+            LongByte, LongShort, LongInt,
+            DoubleByte, DoubleShort, DoubleInt,
+            ShortString
+        };
+        static void appendPacked( BufBuilder& b , int tag , long long x );
+        static int valueSize( int type , const char *value );
+        template< class Builder > static void decodeTo( const char *p , int len , Builder& b );
+    };
+
+    /* An order preserving binary form of a key: memcmp() orders two SortKeys as
+       BSONObj::woCompare( other , ordering ) orders the keys, so a key that gets compared many
+       times -- by a sort, say -- can be encoded once and then compared without walking its
+       elements.  Field names aren't part of it, so only compare keys built from the same pattern.
+
+       Each element is its canonical type (offset to be nonzero) then its value in a memcmp-able
+       form: numbers as big endian doubles with the sign flipped, strings up to their first NUL
+       then a 0, lengths ahead of BinData and DBRef payloads.  Descending fields have all their
+       bytes inverted.  A 0 byte ends the key, so a key that is a prefix of another sorts first.
+
+       Some keys have no SortKey: those with objects, arrays or CodeWScope in them, which woCompare
+       orders by their BSON, and NumberLongs beyond 2^53, which it doesn't order consistently against
+       doubles.  encode() returns false for these and the caller falls back to woCompare.
+    */
+    class SortKey {
+    public:
+        /** append key's SortKey to b.  @return false if it hasn't one -- b is then left partly written */
+        static bool encode( const BSONObj& key , const Ordering& o , BufBuilder& b );
+
+        /** @return <0, 0 or >0 as woCompare would for the keys a and b are the SortKeys of */
+        static int compare( const char *a , int alen , const char *b , int blen ) {
+            int x = memcmp( a , b , min( alen , blen ) );
+            return x ? x : alen - blen;
+        }
+    };
+
+} // namespace mongo
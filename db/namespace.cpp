@@ -186,9 +186,11 @@ namespace mongo {
             // defensive code: try to make us notice if we reference a deleted record
             (unsigned&) (((Record *) d)->data) = 0xeeeeeeee;
         }
+        dur::writingPtr(d, sizeof(DeletedRecord) + sizeof(unsigned));
         dassert( dloc.drec() == d );
         DEBUGGING out() << "TEMP: add deleted rec " << dloc.toString() << ' ' << hex << d->extentOfs << endl;
         if ( capped ) {
+            dur::writing(this);
             if ( !cappedLastDelRecLastExtent().isValid() ) {
                 // Initial extent allocation.  Insert at end.
                 d->nextDeleted = DiskLoc();
@@ -197,7 +199,7 @@ namespace mongo {
                 else {
                     DiskLoc i = cappedListOfAllDeletedRecords();
                     for (; !i.drec()->nextDeleted.isNull(); i = i.drec()->nextDeleted );
-                    i.drec()->nextDeleted = dloc;
+                    dur::writingDiskLoc(i.drec()->nextDeleted) = dloc;
                 }
             } else {
                 d->nextDeleted = cappedFirstDeletedInCurExtent();
@@ -206,7 +208,7 @@ namespace mongo {
             }
         } else {
             int b = bucket(d->lengthWithHeaders);
-            DiskLoc& list = deletedList[b];
+            DiskLoc& list = dur::writingDiskLoc(deletedList[b]);
             DiskLoc oldHead = list;
             list = dloc;
             d->nextDeleted = oldHead;
@@ -242,11 +244,11 @@ namespace mongo {
         }
 
         /* split off some for further use. */
-        r->lengthWithHeaders = lenToAlloc;
+        dur::writing(r)->lengthWithHeaders = lenToAlloc;
 		DataFileMgr::grow(loc, lenToAlloc);
         DiskLoc newDelLoc = loc;
         newDelLoc.inc(lenToAlloc);
-        DeletedRecord *newDel = DataFileMgr::makeDeletedRecord(newDelLoc, left);
+        DeletedRecord *newDel = dur::writing( DataFileMgr::makeDeletedRecord(newDelLoc, left) );
         newDel->extentOfs = r->extentOfs;
         newDel->lengthWithHeaders = left;
         newDel->nextDeleted.Null();
@@ -256,6 +258,17 @@ namespace mongo {
         return loc;
     }
 
+    int NamespaceDetails::quantizeAllocationSpace(int allocSize) {
+        const int MaxPowerOf2 = bucketSizes[Buckets-2];
+        if ( allocSize > MaxPowerOf2 ) {
+            const int MB = 1024 * 1024;
+            return ( allocSize + MB - 1 ) & ~( MB - 1 );
+        }
+        for ( int i = 0; ; i++ )
+            if ( bucketSizes[i] >= allocSize )
+                return bucketSizes[i];
+    }
+
     /* for non-capped collections.
        returned item is out of the deleted list upon return
     */
@@ -267,7 +280,8 @@ namespace mongo {
         int b = bucket(len);
         DiskLoc cur = deletedList[b];
         prev = &deletedList[b];
-        int extra = 5; // look for a better fit, a little.
+        // look for a better fit, a little.  a size class needn't: any record in its bucket fits it
+        int extra = usePowerOf2Sizes() ? 0 : 5;
         int chain = 0;
         while ( 1 ) {
             {
@@ -277,7 +291,7 @@ namespace mongo {
                     " a:" << a << " b:" << b << " chain:" << chain << '\n';
                     sayDbContext();
                     if ( cur == *prev )
-                        prev->Null();
+                        dur::writingDiskLoc(*prev).Null();
                     cur.Null();
                 }
             }
@@ -324,8 +338,8 @@ namespace mongo {
         /* unlink ourself from the deleted list */
         {
             DeletedRecord *bmr = bestmatch.drec();
-            *bestprev = bmr->nextDeleted;
-            bmr->nextDeleted.setInvalid(); // defensive.
+            dur::writingDiskLoc(*bestprev) = bmr->nextDeleted;
+            dur::writingDiskLoc(bmr->nextDeleted).setInvalid(); // defensive.
             assert(bmr->extentOfs < bestmatch.getOfs());
         }
 
@@ -405,6 +419,7 @@ namespace mongo {
 
         NamespaceDetails::Extra temp;
         temp.init();
+        writingNode(extra);
         uassert( 10082 ,  "allocExtra: too many namespaces/collections", ht->put(extra, (NamespaceDetails&) temp));
         NamespaceDetails::Extra *e = (NamespaceDetails::Extra *) ht->get(extra);
         return e;
@@ -416,13 +431,14 @@ namespace mongo {
         long ofs = e->ofsFrom(this);
         if( i == 0 ) {
             assert( extraOffset == 0 );
+            dur::writing(&extraOffset);
             extraOffset = ofs;
             assert( extra() == e );
         }
         else { 
             Extra *hd = extra();
             assert( hd->next(this) == 0 );
-            hd->setNext(ofs);
+            dur::writing(hd)->setNext(ofs);
         }
         return e;
     }
@@ -440,7 +456,8 @@ namespace mongo {
             id = &idx(nIndexes,false);
         }
 
-        nIndexes++;
+        dur::writing(id);
+        dur::writingInt(nIndexes)++;
         if ( resetTransient )
             NamespaceDetailsTransient::get_w(thisns).addedIndex();
         return *id;
@@ -448,6 +465,7 @@ namespace mongo {
 
     // must be called when renaming a NS to fix up extra
     void NamespaceDetails::copyingFrom(const char *thisns, NamespaceDetails *src) { 
+        dur::writing(this);
         extraOffset = 0; // we are a copy -- the old value is wrong.  fixing it up below.
         Extra *se = src->extra();
         int n = NIndexesBase;
@@ -455,7 +473,7 @@ namespace mongo {
             Extra *e = allocExtra(thisns, n);
             while( 1 ) {
                 n += NIndexesExtra;
-                e->copy(this, *se);
+                dur::writing(e)->copy(this, *se);
                 se = se->next(src);
                 if( se == 0 ) break;
                 Extra *nxt = allocExtra(thisns, n);
@@ -503,6 +521,7 @@ namespace mongo {
 
     mongo::mutex NamespaceDetailsTransient::_qcMutex("qc");
     mongo::mutex NamespaceDetailsTransient::_isMutex("is");
+    mongo::mutex NamespaceDetailsTransient::_mapMutex("ndtmap");
     map< string, shared_ptr< NamespaceDetailsTransient > > NamespaceDetailsTransient::_map;
     typedef map< string, shared_ptr< NamespaceDetailsTransient > >::iterator ouriter;
 
@@ -511,6 +530,7 @@ namespace mongo {
         clearQueryCache();
         _keysComputed = false;
         _indexSpecs.clear();
+        _indexStats.reset();
     }
     
 /*    NamespaceDetailsTransient& NamespaceDetailsTransient::get(const char *ns) {
@@ -522,6 +542,7 @@ namespace mongo {
 */
     void NamespaceDetailsTransient::clearForPrefix(const char *prefix) {
         assertInWriteLock();
+        scoped_lock lk(_mapMutex);
         vector< string > found;
         for( ouriter i = _map.begin(); i != _map.end(); ++i )
             if ( strncmp( i->first.c_str(), prefix, strlen( prefix ) ) == 0 )
@@ -531,6 +552,31 @@ namespace mongo {
         }
     }
     
+    mongo::mutex NamespaceDetailsTransient::_cappedInsertMutex("cappedInsert");
+    map< string, shared_ptr< NotifyAll > > NamespaceDetailsTransient::_cappedInsertMap;
+
+    NotifyAll& NamespaceDetailsTransient::cappedInsertNotifier(const char *ns) {
+        scoped_lock lk(_cappedInsertMutex);
+        shared_ptr< NotifyAll > &n = _cappedInsertMap[ ns ];
+        if ( n.get() == 0 )
+            n.reset( new NotifyAll() );
+        return *n;
+    }
+
+    void NamespaceDetailsTransient::notifyCappedInsert(const char *ns) {
+        NotifyAll *n = 0;
+        {
+            scoped_lock lk(_cappedInsertMutex);
+            if ( _cappedInsertMap.empty() )
+                return;
+            map< string, shared_ptr< NotifyAll > >::iterator i = _cappedInsertMap.find( ns );
+            if ( i == _cappedInsertMap.end() )
+                return;
+            n = i->second.get();
+        }
+        n->notifyAll();
+    }
+
     void NamespaceDetailsTransient::computeIndexKeys() {
         _keysComputed = true;
         _indexKeys.clear();
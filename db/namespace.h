@@ -24,9 +24,13 @@
 #include "diskloc.h"
 #include "../util/hashtab.h"
 #include "../util/mmap.h"
+#include "dur.h"
+#include "../util/concurrency/synchronization.h"
 
 namespace mongo {
 
+    class NamespaceIndexStats;
+
 	/* in the mongo source code, "client" means "database". */
 
     const int MaxDatabaseNameLen = 256; // max str len for the db name, including null char
@@ -224,9 +228,12 @@ namespace mongo {
                  this isn't thread safe.  TODO
         */
         enum NamespaceFlags {
-            Flag_HaveIdIndex = 1 << 0 // set when we have _id index (ONLY if ensureIdIndex was called -- 0 if that has never been called)
+            Flag_HaveIdIndex = 1 << 0, // set when we have _id index (ONLY if ensureIdIndex was called -- 0 if that has never been called)
+            Flag_UsePowerOf2Sizes = 1 << 1 // records are allocated by size class, see quantizeAllocationSpace().  create option usePowerOf2Sizes
         };
 
+        bool usePowerOf2Sizes() const { return ( flags & Flag_UsePowerOf2Sizes ) != 0; }
+
         IndexDetails& idx(int idxNo, bool missingExpected = false );
 
         /** get the IndexDetails for the index currently being built in the background. (there is at most one) */
@@ -258,11 +265,13 @@ namespace mongo {
         bool isMultikey(int i) { return (multiKeyIndexBits & (((unsigned long long) 1) << i)) != 0; }
         void setIndexIsMultikey(int i) { 
             dassert( i < NIndexesMax );
-            multiKeyIndexBits |= (((unsigned long long) 1) << i);
+            unsigned long long x = ((unsigned long long) 1) << i;
+            if( multiKeyIndexBits & x ) return;
+            *dur::writing(&multiKeyIndexBits) |= x;
         }
         void clearIndexIsMultikey(int i) { 
             dassert( i < NIndexesMax );
-            multiKeyIndexBits &= ~(((unsigned long long) 1) << i);
+            *dur::writing(&multiKeyIndexBits) &= ~(((unsigned long long) 1) << i);
         }
 
         /* add a new index.  does not add to system.indexes etc. - just to NamespaceDetails.
@@ -270,20 +279,25 @@ namespace mongo {
          */
         IndexDetails& addIndex(const char *thisns, bool resetTransient=true);
 
-        void aboutToDeleteAnIndex() { flags &= ~Flag_HaveIdIndex;  }
+        void aboutToDeleteAnIndex() { *dur::writing(&flags) &= ~Flag_HaveIdIndex;  }
 
         /* returns index of the first index in which the field is present. -1 if not present. */
         int fieldIsIndexed(const char *fieldName);
 
+        /* the size class is all the padding a Flag_UsePowerOf2Sizes collection gets */
         void paddingFits() {
+            if ( usePowerOf2Sizes() )
+                return;
             double x = paddingFactor - 0.01;
             if ( x >= 1.0 )
-                paddingFactor = x;
+                *dur::writing(&paddingFactor) = x;
         }
         void paddingTooSmall() {
+            if ( usePowerOf2Sizes() )
+                return;
             double x = paddingFactor + 0.6;
             if ( x <= 2.0 )
-                paddingFactor = x;
+                *dur::writing(&paddingFactor) = x;
         }
 
         // @return offset in indexes[]
@@ -320,6 +334,12 @@ namespace mongo {
             return Buckets-1;
         }
 
+        /* the size class of a record of allocSize bytes (headers included) in a Flag_UsePowerOf2Sizes
+           collection: the next power of 2 up to 4MB, whole MBs beyond that.  a freed record then fits
+           the head of its deleted list exactly, so reuse needs no search.
+        */
+        static int quantizeAllocationSpace(int allocSize);
+
         /* allocate a new record.  lenToAlloc includes headers. */
         DiskLoc alloc(const char *ns, int lenToAlloc, DiskLoc& extentLoc);
         /* add a given record to the deleted chains for this NS */
@@ -371,6 +391,8 @@ namespace mongo {
         string _ns;
         void reset();
         static std::map< string, shared_ptr< NamespaceDetailsTransient > > _map;
+        /* guards _map itself -- with --perDbLocking several databases are written at once */
+        static mongo::mutex _mapMutex;
     public:
         NamespaceDetailsTransient(const char *ns) : _ns(ns), _keysComputed(false), _qcWriteCount(){ }
         /* _get() is not threadsafe -- see get_inlock() comments */
@@ -452,9 +474,34 @@ namespace mongo {
             _qcCache[ pattern ] = make_pair( indexKey, nScanned );
         }
 
+        /* persisted index statistics (see indexstats.h) -------------------------- */
+    private:
+        shared_ptr< const NamespaceIndexStats > _indexStats;
+    public:
+        /* you must be in the qcMutex for these.  null until loaded by indexStatsFor() */
+        shared_ptr< const NamespaceIndexStats > indexStats() const { return _indexStats; }
+        void setIndexStats( const shared_ptr< const NamespaceIndexStats > &s ) { _indexStats = s; }
+        /* the persisted stats changed: reload them, and let the optimizer pick plans afresh */
+        void indexStatsChanged() {
+            _indexStats.reset();
+            clearQueryCache();
+        }
+
+        /* capped insert notification ------------------------------------------- */
+    private:
+        static map< string, shared_ptr< NotifyAll > > _cappedInsertMap;
+        static mongo::mutex _cappedInsertMutex;
+    public:
+        /* awaitData getMores wait on this, holding no lock, for inserts into a capped collection.
+           kept apart from _map so it lives on through a drop */
+        static NotifyAll& cappedInsertNotifier(const char *ns);
+        /* call after inserting into capped collection ns.  a no-op until someone has waited */
+        static void notifyCappedInsert(const char *ns);
+
     }; /* NamespaceDetailsTransient */
 
     inline NamespaceDetailsTransient& NamespaceDetailsTransient::_get(const char *ns) {
+        scoped_lock lk(_mapMutex);
         shared_ptr< NamespaceDetailsTransient > &t = _map[ ns ];
         if ( t.get() == 0 )
             t.reset( new NamespaceDetailsTransient(ns) );
@@ -483,6 +530,7 @@ namespace mongo {
 		void add_ns( const char *ns, const NamespaceDetails &details ) {
             init();
             Namespace n(ns);
+            writingNode(n);
             uassert( 10081 , "too many namespaces/collections", ht->put(n, details));
 		}
 
@@ -507,11 +555,13 @@ namespace mongo {
             if ( !ht )
                 return;
             Namespace n(ns);
+            writingNode(n);
             ht->kill(n);
 
             for( int i = 0; i<=1; i++ ) {
                 try {
                     Namespace extra(n.extraName(i).c_str());
+                    writingNode(extra);
                     ht->kill(extra);
                 }
                 catch(DBException&) { }
@@ -539,6 +589,14 @@ namespace mongo {
 
     private:
         void maybeMkdir() const;
+
+        /** declare the hashtable node k lives in (or would be put in) as about to be written, for dur */
+        void writingNode(const Namespace& k) {
+            bool found;
+            int i = ht->_find(k, found);
+            if ( i >= 0 )
+                dur::writing( &ht->nodes(i) );
+        }
         
         MMF f;
         HashTable<Namespace,NamespaceDetails,MMF::Pointer> *ht;
@@ -22,6 +22,8 @@
 #include "repl.h"
 #include "commands.h"
 #include "repl/rs.h"
+#include "btree.h"
+#include "cmdline.h"
 
 namespace mongo {
 
@@ -288,6 +290,9 @@ namespace mongo {
     */
     void logOp(const char *opstr, const char *ns, const BSONObj& obj, BSONObj *patt, bool *b) {
         if ( replSettings.master ) {
+            // with --perDbLocking we hold just ns's database; this nests a lock on local.
+            // otherwise it is a recursive acquisition of the global lock we already hold.
+            writelock lk("local.");
             _logOp(opstr, ns, 0, obj, patt, b);
             // why? :
             //char cl[ 256 ];
@@ -466,6 +471,77 @@ namespace mongo {
         }
     }
 
+    static void touchIndexPaths(IndexDetails& idx, const BSONObj& obj) {
+        BSONObjSetDefaultOrder keys;
+        idx.getKeysFromObject(obj, keys);
+        Ordering order = Ordering::make(idx.keyPattern());
+        for( BSONObjSetDefaultOrder::iterator i = keys.begin(); i != keys.end(); i++ ) {
+            int pos;
+            bool found;
+            idx.head.btree()->locate(idx, idx.head, *i, order, pos, found, minDiskLoc);
+        }
+    }
+
+    /* Pages in what applying op will touch: the record an update or delete is of, and the btree
+       paths to its keys -- all the collection's indexes', or just the _id index's, per
+       --replIndexPrefetch.  Only read locked, so the faults don't hold up readers as they would
+       under the write lock.
+    */
+    void prefetchPagesForReplicatedOp(const BSONObj& op) {
+        if( cmdLine.replIndexPrefetch == CmdLine::PrefetchNone )
+            return;
+
+        const char *opType = op.getStringField("op");
+        const char *which = "o";
+        if( *opType == 'u' )
+            which = "o2";
+        else if( *opType != 'i' && *opType != 'd' )
+            return;
+
+        try { 
+            const char *ns = op.getStringField("ns");
+            BSONObj o = op.getObjectField(which);
+            readlock lk(ns);
+            Client::Context ctx(ns);
+            NamespaceDetails *d = nsdetails(ns);
+            if( d == 0 )
+                return;
+
+            BSONObj obj = o; // an insert's keys are those of the new object
+            if( *opType != 'i' ) {
+                BSONElement _id;
+                if( !o.getObjectID(_id) )
+                    return;
+                BSONObjBuilder b;
+                b.append(_id);
+                DiskLoc loc = Helpers::findById(d, b.done()); // the _id index path
+                if( loc.isNull() )
+                    return;
+                Record *r = loc.rec();
+                for( int ofs = 0; ofs < r->netLength(); ofs += 4096 )
+                    _dummy_z += r->data[ofs]; // touch
+                obj = BSONObj(r->data);
+            }
+
+            NamespaceDetails::IndexIterator i = d->ii();
+            while( i.more() ) {
+                IndexDetails& idx = i.next();
+                if( cmdLine.replIndexPrefetch == CmdLine::PrefetchIdOnly && !idx.isIdIndex() )
+                    continue;
+                touchIndexPaths(idx, obj);
+                /* an update replacing the whole object: the new keys' paths too */
+                if( *opType == 'u' ) {
+                    BSONObj updated = op.getObjectField("o");
+                    if( !updated.isEmpty() && updated.firstElement().fieldName()[0] != '$' && !idx.isIdIndex() )
+                        touchIndexPaths(idx, updated);
+                }
+            }
+        }
+        catch( DBException& e ) { 
+            log(2) << "ignoring assertion in prefetchPagesForReplicatedOp() " << e.toString() << endl;
+        }
+    }
+
     void applyOperation_inlock(const BSONObj& op){
         if( logLevel >= 6 ) 
             log() << "applying op: " << op << endl;
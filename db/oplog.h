@@ -64,6 +64,11 @@ namespace mongo {
     
     extern int __findingStartInitialTimeout; // configurable for testing    
 
+    /* Finds the first oplog record matching the query's ts constraint.  The extents' first records
+       are a sparse index on ts (see segmentStarts()), so a binary search over them finds the
+       segment it is in and we scan just that one -- back from the end if it's the newest, as then
+       the query is probably for recent ops, else forward from the segment's start.
+    */
     class FindingStartCursor {
     public:
         FindingStartCursor( const QueryPlan & qp ) : 
@@ -93,29 +98,15 @@ namespace mongo {
                     _findingStartCursor->c->advance();
                     RARELY {
                         if ( _findingStartTimer.seconds() >= __findingStartInitialTimeout ) {
-                            createClientCursor( startLoc( _findingStartCursor->c->currLoc() ) );
-                            _findingStartMode = FindExtent;
+                            // a long way back: scan the segment from its start instead
+                            destroyClientCursor();
+                            createClientCursor( _segmentStart );
+                            _findingStartMode = InExtent;
                             return;
                         }
                     }
                     return;
                 }
-                case FindExtent: {
-                    if ( !_matcher->matches( _findingStartCursor->c->currKey(), _findingStartCursor->c->currLoc() ) ) {
-                        _findingStartMode = InExtent;
-                        return;
-                    }
-                    DiskLoc prev = prevLoc( _findingStartCursor->c->currLoc() );
-                    if ( prev.isNull() ) { // hit beginning, so start scanning from here
-                        createClientCursor();
-                        _findingStartMode = InExtent;
-                        return;
-                    }
-                    // There might be a more efficient implementation than creating new cursor & client cursor each time,
-                    // not worrying about that for now
-                    createClientCursor( prev );
-                    return;
-                }
                 case InExtent: {
                     if ( _matcher->matches( _findingStartCursor->c->currKey(), _findingStartCursor->c->currLoc() ) ) {
                         _findingStart = false; // found first record in query range, so scan normally
@@ -145,7 +136,7 @@ namespace mongo {
             }
         }        
     private:
-        enum FindingStartMode { Initial, FindExtent, InExtent };
+        enum FindingStartMode { Initial, InExtent };
         const QueryPlan &_qp;
         bool _findingStart;
         FindingStartMode _findingStartMode;
@@ -154,33 +145,37 @@ namespace mongo {
         ClientCursor * _findingStartCursor;
         shared_ptr<Cursor> _c;
         ClientCursor::YieldData _yieldData;
-        DiskLoc startLoc( const DiskLoc &rec ) {
-            Extent *e = rec.rec()->myExtent( rec );
-            if ( !_qp.nsd()->capLooped() || ( e->myLoc != _qp.nsd()->capExtent ) )
-                return e->firstRecord;
-            // Likely we are on the fresh side of capExtent, so return first fresh record.
-            // If we are on the stale side of capExtent, then the collection is small and it
-            // doesn't matter if we start the extent scan with capFirstNewRecord.
-            return _qp.nsd()->capFirstNewRecord;
-        }
-        
-        // should never have an empty extent in the oplog, so don't worry about that case
-        DiskLoc prevLoc( const DiskLoc &rec ) {
-            Extent *e = rec.rec()->myExtent( rec );
-            if ( _qp.nsd()->capLooped() ) {
-                if ( e->xprev.isNull() )
-                    e = _qp.nsd()->lastExtent.ext();
-                else
-                    e = e->xprev.ext();
-                if ( e->myLoc != _qp.nsd()->capExtent )
-                    return e->firstRecord;
-            } else {
-                if ( !e->xprev.isNull() ) {
-                    e = e->xprev.ext();
-                    return e->firstRecord;
+        DiskLoc _segmentStart; // first record of the segment the start is in
+
+        /* The first record of each extent, oldest first.  As the oplog is in ts order these make a
+           sparse index on it.  A looped collection's capExtent holds its oldest records and, from
+           capFirstNewRecord on, its newest, so it starts two segments.  It is only extent headers,
+           so we rebuild it for each lookup rather than keep it in step with capped deletes.
+        */
+        void segmentStarts( vector<DiskLoc>& starts ) {
+            NamespaceDetails *d = _qp.nsd();
+            if ( !d->capLooped() ) {
+                for ( DiskLoc e = d->firstExtent; !e.isNull(); e = e.ext()->xnext ) {
+                    if ( !e.ext()->firstRecord.isNull() )
+                        starts.push_back( e.ext()->firstRecord );
                 }
+                return;
+            }
+            Extent *cap = d->capExtent.ext();
+            if ( !cap->firstRecord.isNull() && cap->firstRecord != d->capFirstNewRecord )
+                starts.push_back( cap->firstRecord );
+            DiskLoc e = cap->xnext;
+            while ( 1 ) {
+                if ( e.isNull() )
+                    e = d->firstExtent;
+                if ( e == d->capExtent )
+                    break;
+                if ( !e.ext()->firstRecord.isNull() )
+                    starts.push_back( e.ext()->firstRecord );
+                e = e.ext()->xnext;
             }
-            return DiskLoc(); // reached beginning of collection
+            if ( !d->capFirstNewRecord.isNull() )
+                starts.push_back( d->capFirstNewRecord );
         }
         void createClientCursor( const DiskLoc &startLoc = DiskLoc() ) {
             shared_ptr<Cursor> c = _qp.newCursor( startLoc );
@@ -193,23 +188,50 @@ namespace mongo {
             }
         }
         void init() {
-            // Use a ClientCursor here so we can release db mutex while scanning
-            // oplog (can take quite a while with large oplogs).
-            shared_ptr<Cursor> c = _qp.newReverseCursor();
-            _findingStartCursor = new ClientCursor(QueryOption_NoCursorTimeout, c, _qp.ns(), BSONObj());
-            _findingStartTimer.reset();
-            _findingStartMode = Initial;
             BSONElement tsElt = _qp.originalQuery()[ "ts" ];
             massert( 13044, "no ts field in query", !tsElt.eoo() );
             BSONObjBuilder b;
             b.append( tsElt );
             BSONObj tsQuery = b.obj();
             _matcher.reset(new CoveredIndexMatcher(tsQuery, _qp.indexKey()));
+
+            // the first segment starting in the query's range
+            vector<DiskLoc> starts;
+            segmentStarts( starts );
+            int lo = 0;
+            int hi = starts.size();
+            while ( lo < hi ) {
+                int mid = ( lo + hi ) / 2;
+                if ( _matcher->matches( starts[ mid ].obj() ) )
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            if ( lo == 0 ) {
+                _findingStart = false; // the whole collection is in range
+                _c = _qp.newCursor();
+                return;
+            }
+            _segmentStart = starts[ lo - 1 ];
+
+            // Use a ClientCursor here so we can release db mutex while scanning
+            // oplog (can take quite a while with large oplogs).
+            if ( lo == (int) starts.size() ) {
+                shared_ptr<Cursor> c = _qp.newReverseCursor();
+                _findingStartCursor = new ClientCursor(QueryOption_NoCursorTimeout, c, _qp.ns(), BSONObj());
+                _findingStartTimer.reset();
+                _findingStartMode = Initial;
+            }
+            else {
+                createClientCursor( _segmentStart );
+                _findingStartMode = InExtent;
+            }
         }
     };
 
     void pretouchOperation(const BSONObj& op);
     void pretouchN(vector<BSONObj>&, unsigned a, unsigned b);
+    void prefetchPagesForReplicatedOp(const BSONObj& op);
 
     void applyOperation_inlock(const BSONObj& op);
 }
@@ -5,6 +5,7 @@
 #include "../client/dbclient.h"
 #include "../client/constants.h"
 #include "dbhelpers.h"
+#include "cmdline.h"
 
 namespace mongo {
 
@@ -60,7 +61,8 @@ namespace mongo {
             cursor = _conn->query( ns, query, 0, 0, 0, 
                                   QueryOption_CursorTailable | QueryOption_SlaveOk | QueryOption_OplogReplay |
                                   /* TODO: slaveok maybe shouldn't use? */
-                                  QueryOption_AwaitData
+                                  QueryOption_AwaitData |
+                                  ( cmdLine.replCompress ? QueryOption_CompressReply : 0 )
                                   );
         }
 
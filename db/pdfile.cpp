@@ -41,6 +41,7 @@ _ disallow system* manipulations from the database.
 #include "extsort.h"
 #include "curop.h"
 #include "background.h"
+#include "indexstats.h"
 
 namespace mongo {
 
@@ -55,16 +56,19 @@ namespace mongo {
         }
     };
 
+    mongo::mutex BackgroundOperation::m("bgop");
     map<string, unsigned> BackgroundOperation::dbsInProg;
     set<string> BackgroundOperation::nsInProg;
 
     bool BackgroundOperation::inProgForDb(const char *db) {
         assertInWriteLock();
+        scoped_lock lk(m);
         return dbsInProg[db] != 0;
     }
 
     bool BackgroundOperation::inProgForNs(const char *ns) { 
         assertInWriteLock();
+        scoped_lock lk(m);
         return nsInProg.count(ns) != 0;
     }
 
@@ -80,6 +84,7 @@ namespace mongo {
 
     BackgroundOperation::BackgroundOperation(const char *ns) : _ns(ns) { 
         assertInWriteLock();
+        scoped_lock lk(m);
         dbsInProg[_ns.db]++;
         assert( nsInProg.count(_ns.ns()) == 0 );
         nsInProg.insert(_ns.ns());
@@ -87,11 +92,13 @@ namespace mongo {
 
     BackgroundOperation::~BackgroundOperation() { 
         assertInWriteLock();
+        scoped_lock lk(m);
         dbsInProg[_ns.db]--;
         nsInProg.erase(_ns.ns());
     }
 
     void BackgroundOperation::dump(stringstream& ss) {
+        scoped_lock lk(m);
         if( nsInProg.size() ) { 
             ss << "\n<b>Background Jobs in Progress</b>\n";
             for( set<string>::iterator i = nsInProg.begin(); i != nsInProg.end(); i++ )
@@ -105,6 +112,31 @@ namespace mongo {
 
     /* ----------------------------------------- */
 
+    static ProcessInfo recordPageCheck;
+    static bool recordPageCheckSupported = recordPageCheck.blockCheckSupported();
+
+    bool Record::likelyInPhysicalMemory() {
+        if ( !recordPageCheckSupported )
+            return true;
+        return recordPageCheck.blockInMemory( (char *) this );
+    }
+
+    void Record::touch() {
+        LockMongoFilesShared lk;
+        if ( !MemoryMappedFile::isMapped_inlock( this , HeaderSize ) )
+            return;
+        int len = lengthWithHeaders; // faults in the first page
+        if ( len < HeaderSize || !MemoryMappedFile::isMapped_inlock( this , len ) )
+            return; // deleted and reused meanwhile, so this isn't a record anymore
+        const char *p = (const char *) this;
+        volatile char x;
+        for ( int ofs = 4096; ofs < len; ofs += 4096 )
+            x = p[ofs];
+        x = p[len-1];
+    }
+
+    /* ----------------------------------------- */
+
     string dbpath = "/data/db/";
     bool directoryperdb = false;
     string repairpath;
@@ -186,6 +218,11 @@ namespace mongo {
             return false;
         }
 
+        if ( options["usePowerOf2Sizes"].trueValue() && options.getBoolField("capped") ) {
+            err = "capped collections can't use usePowerOf2Sizes";
+            return false;
+        }
+
         log(1) << "create collection " << ns << ' ' << options << '\n';
 
         /* todo: do this only when we have allocated space successfully? or we could insert with a { ok: 0 } field
@@ -263,10 +300,13 @@ namespace mongo {
         if ( mx > 0 )
             d->max = mx;
 
+        if ( options["usePowerOf2Sizes"].trueValue() )
+            *dur::writing(&d->flags) |= NamespaceDetails::Flag_UsePowerOf2Sizes;
+
         return true;
     }
 
-    /** { ..., capped: true, size: ..., max: ... }
+    /** { ..., capped: true, size: ..., max: ..., usePowerOf2Sizes: true }
         @param deferIdIndex - if not not, defers id index creation.  sets the bool value to true if we wanted to create the id index.
         @return true if successful
     */
@@ -402,17 +442,17 @@ namespace mongo {
         if ( details ) {
             assert( !details->lastExtent.isNull() );
             assert( !details->firstExtent.isNull() );
-            e->xprev = details->lastExtent;
-            details->lastExtent.ext()->xnext = eloc;
+            dur::writingDiskLoc(e->xprev) = details->lastExtent;
+            dur::writingDiskLoc(details->lastExtent.ext()->xnext) = eloc;
             assert( !eloc.isNull() );
-            details->lastExtent = eloc;
+            dur::writingDiskLoc(details->lastExtent) = eloc;
         }
         else {
             ni->add_ns(ns, eloc, capped);
             details = ni->details(ns);
         }
 
-        details->lastExtentSize = e->length;
+        dur::writingInt(details->lastExtentSize) = e->length;
         DEBUGGING out() << "temp: newextent adddelrec " << ns << endl;
         details->addDeletedRec(emptyLoc.drec(), emptyLoc);
     }
@@ -434,6 +474,7 @@ namespace mongo {
             return cc().database()->addAFile( 0, true )->createExtent(ns, approxSize, newCapped, loops+1);
         }
         int offset = header->unused.getOfs();
+        dur::writing(header);
         header->unused.set( fileNo, offset + ExtentSize );
         header->unusedLength -= ExtentSize;
         loc.set(fileNo, offset);
@@ -489,13 +530,13 @@ namespace mongo {
                 Extent *e = best;
                 // remove from the free list
                 if( !e->xprev.isNull() )
-                    e->xprev.ext()->xnext = e->xnext;
+                    dur::writingDiskLoc(e->xprev.ext()->xnext) = e->xnext;
                 if( !e->xnext.isNull() )
-                    e->xnext.ext()->xprev = e->xprev;
+                    dur::writingDiskLoc(e->xnext.ext()->xprev) = e->xprev;
                 if( f->firstExtent == e->myLoc )
-                    f->firstExtent = e->xnext;
+                    dur::writingDiskLoc(f->firstExtent) = e->xnext;
                 if( f->lastExtent == e->myLoc )
-                    f->lastExtent = e->xprev;
+                    dur::writingDiskLoc(f->lastExtent) = e->xprev;
 
                 // use it
                 OCCASIONALLY if( n > 512 ) log() << "warning: newExtent " << n << " scanned\n";
@@ -515,6 +556,7 @@ namespace mongo {
 		/*TODOMMF - work to do when extent is freed. */
         log(3) << "reset extent was:" << nsDiagnostic.toString() << " now:" << nsname << '\n';
         massert( 10360 ,  "Extent::reset bad magic value", magic == 0x41424344 );
+        dur::writing(this);
         xnext.Null();
         xprev.Null();
         nsDiagnostic = nsname;
@@ -526,7 +568,7 @@ namespace mongo {
 
         int delRecLength = length - (_extentData - (char *) this);
         //DeletedRecord *empty1 = (DeletedRecord *) extentData;
-        DeletedRecord *empty = DataFileMgr::makeDeletedRecord(emptyLoc, delRecLength);//(DeletedRecord *) getRecord(emptyLoc);
+        DeletedRecord *empty = dur::writing( DataFileMgr::makeDeletedRecord(emptyLoc, delRecLength) );//(DeletedRecord *) getRecord(emptyLoc);
         //assert( empty == empty1 );
 
         // do we want to zero the record? memset(empty, ...)
@@ -540,6 +582,7 @@ namespace mongo {
 
     /* assumes already zeroed -- insufficient for block 'reuse' perhaps */
     DiskLoc Extent::init(const char *nsname, int _length, int _fileNo, int _offset) {
+        dur::writing(this);
         magic = 0x41424344;
         myLoc.set(_fileNo, _offset);
         xnext.Null();
@@ -554,7 +597,7 @@ namespace mongo {
 
         int l = _length - (_extentData - (char *) this);
         //DeletedRecord *empty1 = (DeletedRecord *) extentData;
-        DeletedRecord *empty = DataFileMgr::makeDeletedRecord(emptyLoc, l);
+        DeletedRecord *empty = dur::writing( DataFileMgr::makeDeletedRecord(emptyLoc, l) );
         //assert( empty == empty1 );
         empty->lengthWithHeaders = l;
         empty->extentOfs = myLoc.getOfs();
@@ -709,6 +752,45 @@ namespace mongo {
         log() << "  end freelist" << endl;
     }
 
+    /* the database's .$freelist of unused extents, created if need be */
+    static NamespaceDetails* freeListDetails() {
+        string s = cc().database()->name + ".$freelist";
+        NamespaceDetails *freeExtents = nsdetails(s.c_str());
+        if( freeExtents == 0 ) { 
+            string err;
+            _userCreateNS(s.c_str(), BSONObj(), err, 0);
+            freeExtents = nsdetails(s.c_str());
+            massert( 10361 , "can't create .$freelist", freeExtents);
+        }
+        return freeExtents;
+    }
+
+    void freeExtent(NamespaceDetails *d, const DiskLoc& loc) {
+        Extent *e = loc.ext();
+        assert( e->firstRecord.isNull() );
+
+        // unlink from the collection's extents
+        if( !e->xprev.isNull() )
+            dur::writingDiskLoc(e->xprev.ext()->xnext) = e->xnext;
+        if( !e->xnext.isNull() )
+            dur::writingDiskLoc(e->xnext.ext()->xprev) = e->xprev;
+        if( d->firstExtent == loc )
+            dur::writingDiskLoc(d->firstExtent) = e->xnext;
+        if( d->lastExtent == loc )
+            dur::writingDiskLoc(d->lastExtent) = e->xprev;
+
+        // and put it at the front of the free list.  allocFromFreeList() resets it on reuse
+        NamespaceDetails *freeExtents = freeListDetails();
+        dur::writing(e);
+        e->xprev.Null();
+        e->xnext = freeExtents->firstExtent;
+        if( freeExtents->firstExtent.isNull() ) 
+            dur::writingDiskLoc(freeExtents->lastExtent) = loc;
+        else
+            dur::writingDiskLoc(freeExtents->firstExtent.ext()->xprev) = loc;
+        dur::writingDiskLoc(freeExtents->firstExtent) = loc;
+    }
+
     /* drop a collection/namespace */
     void dropNS(const string& nsToDrop) {
         NamespaceDetails* d = nsdetails(nsToDrop.c_str());
@@ -735,27 +817,20 @@ namespace mongo {
 
         // free extents
         if( !d->firstExtent.isNull() ) {
-            string s = cc().database()->name + ".$freelist";
-            NamespaceDetails *freeExtents = nsdetails(s.c_str());
-            if( freeExtents == 0 ) { 
-                string err;
-                _userCreateNS(s.c_str(), BSONObj(), err, 0);
-                freeExtents = nsdetails(s.c_str());
-                massert( 10361 , "can't create .$freelist", freeExtents);
-            }
+            NamespaceDetails *freeExtents = freeListDetails();
             if( freeExtents->firstExtent.isNull() ) { 
-                freeExtents->firstExtent = d->firstExtent;
-                freeExtents->lastExtent = d->lastExtent;
+                dur::writingDiskLoc(freeExtents->firstExtent) = d->firstExtent;
+                dur::writingDiskLoc(freeExtents->lastExtent) = d->lastExtent;
             }
             else { 
                 DiskLoc a = freeExtents->firstExtent;
                 assert( a.ext()->xprev.isNull() );
-                a.ext()->xprev = d->lastExtent;
-                d->lastExtent.ext()->xnext = a;
-                freeExtents->firstExtent = d->firstExtent;
+                dur::writingDiskLoc(a.ext()->xprev) = d->lastExtent;
+                dur::writingDiskLoc(d->lastExtent.ext()->xnext) = a;
+                dur::writingDiskLoc(freeExtents->firstExtent) = d->firstExtent;
 
-                d->firstExtent.setInvalid();
-                d->lastExtent.setInvalid();
+                dur::writingDiskLoc(d->firstExtent).setInvalid();
+                dur::writingDiskLoc(d->lastExtent).setInvalid();
             }
         }
 
@@ -784,6 +859,7 @@ namespace mongo {
             assert( d->nIndexes == 0 );
         }
         log(1) << "\t dropIndexes done" << endl;
+        removeIndexStats( name.c_str() );
         result.append("ns", name.c_str());
         ClientCursor::invalidate(name.c_str());
         Client::invalidateNS( name );
@@ -843,14 +919,16 @@ namespace mongo {
         /* remove ourself from the record next/prev chain */
         {
             if ( todelete->prevOfs != DiskLoc::NullOfs )
-                todelete->getPrev(dl).rec()->nextOfs = todelete->nextOfs;
+                dur::writingInt(todelete->getPrev(dl).rec()->nextOfs) = todelete->nextOfs;
             if ( todelete->nextOfs != DiskLoc::NullOfs )
-                todelete->getNext(dl).rec()->prevOfs = todelete->prevOfs;
+                dur::writingInt(todelete->getNext(dl).rec()->prevOfs) = todelete->prevOfs;
         }
 
         /* remove ourself from extent pointers */
         {
             Extent *e = todelete->myExtent(dl);
+            if ( e->firstRecord == dl || e->lastRecord == dl )
+                dur::writing(e);
             if ( e->firstRecord == dl ) {
                 if ( todelete->nextOfs == DiskLoc::NullOfs )
                     e->firstRecord.Null();
@@ -867,6 +945,7 @@ namespace mongo {
 
         /* add to the free list */
         {
+            dur::writing(d);
             d->nrecords--;
             d->datasize -= todelete->netLength();
             /* temp: if in system.indexes, don't reuse, and zero out: we want to be
@@ -875,11 +954,12 @@ namespace mongo {
                a lot of problems.
             */
             if ( strstr(ns, ".system.indexes") ) {
-                memset(todelete, 0, todelete->lengthWithHeaders);
+                memset(dur::writingPtr(todelete, todelete->lengthWithHeaders), 0, todelete->lengthWithHeaders);
             }
             else {
                 DEV memset(todelete->data, 0, todelete->netLength()); // attempt to notice invalid reuse.
-                d->addDeletedRec((DeletedRecord*)todelete, dl);
+                if ( !compactTakesFreedRecord(ns, dl, (DeletedRecord*)todelete) )
+                    d->addDeletedRec((DeletedRecord*)todelete, dl);
             }
         }
     }
@@ -992,7 +1072,7 @@ namespace mongo {
         }
 
         //	update in place
-        memcpy(toupdate->data, objNew.objdata(), objNew.objsize());
+        memcpy(dur::writingPtr(toupdate->data, objNew.objsize()), objNew.objdata(), objNew.objsize());
         return dl;
     }
 
@@ -1070,44 +1150,34 @@ namespace mongo {
     }
 
     // throws DBException
-    unsigned long long fastBuildIndex(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) {
+    /* build the btrees of one or more new indexes on ns from a single scan of it.  keys are
+       extracted and sorted on several threads (see ParallelKeySorter), then each btree is built
+       bottom up from a merge of the sorted runs.
+       @return number of objects in the collection */
+    unsigned long long fastBuildIndexes(const char *ns, NamespaceDetails *d, const vector<int>& idxNos) {
         assert( d->backgroundIndexBuildInProgress == 0 );
         CurOp * op = cc().curop();
 
         Timer t;
 
-        tlog(1) << "fastBuildIndex " << ns << " idxNo:" << idxNo << ' ' << idx.info.obj().toString() << endl;
-
-        bool dupsAllowed = !idx.unique();
-        bool dropDups = idx.dropDups() || inDBRepair;
-        BSONObj order = idx.keyPattern();
-
-        idx.head.Null();
+        vector<const IndexSpec*> specs;
+        for( unsigned x = 0; x < idxNos.size(); x++ ) {
+            IndexDetails& idx = d->idx(idxNos[x]);
+            tlog(1) << "fastBuildIndex " << ns << " idxNo:" << idxNos[x] << ' ' << idx.info.obj().toString() << endl;
+            dur::writingDiskLoc(idx.head).Null();
+            specs.push_back( &idx.getSpec() );
+        }
         
         if ( logLevel > 1 ) printMemInfo( "before index start" );
 
         /* get and sort all the keys ----- */
         unsigned long long n = 0;
         shared_ptr<Cursor> c = theDataFileMgr.findAll(ns);
-        BSONObjExternalSorter sorter(order);
-        sorter.hintNumObjects( d->nrecords );
-        unsigned long long nkeys = 0;
+        int nThreads = d->nrecords < 10000 ? 1 : ParallelKeySorter::defaultThreads();
+        ParallelKeySorter sorter(specs, nThreads, d->nrecords);
         ProgressMeterHolder pm( op->setMessage( "index: (1/3) external sort" , d->nrecords , 10 ) );
         while ( c->ok() ) {
-            BSONObj o = c->current();
-            DiskLoc loc = c->currLoc();
-
-            BSONObjSetDefaultOrder keys;
-            idx.getKeysFromObject(o, keys);
-            int k = 0;
-            for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ ) {
-                if( ++k == 2 )
-                    d->setIndexIsMultikey(idxNo);
-                //cout<<"SORTER ADD " << i->toString() << ' ' << loc.toString() << endl;
-                sorter.add(*i, loc);
-                nkeys++;
-            }
-            
+            sorter.add(c->current(), c->currLoc());
             c->advance();
             n++;
             pm.hit();
@@ -1119,18 +1189,25 @@ namespace mongo {
         pm.finished();
 
         if ( logLevel > 1 ) printMemInfo( "before final sort" );
-        sorter.sort();
+        sorter.finish();
         if ( logLevel > 1 ) printMemInfo( "after final sort" );
         
-        log(t.seconds() > 5 ? 0 : 1) << "\t external sort used : " << sorter.numFiles() << " files " << " in " << t.seconds() << " secs" << endl;
+        log(t.seconds() > 5 ? 0 : 1) << "\t external sort used : " << sorter.numFiles() << " files " << " in " << t.seconds() << " secs" << " on " << nThreads << " threads" << endl;
 
-        list<DiskLoc> dupsToDrop;
+        set<DiskLoc> dupsToDrop;
+
+        /* build indexes --- */ 
+        for( unsigned x = 0; x < idxNos.size(); x++ ) {
+            IndexDetails& idx = d->idx(idxNos[x]);
+            bool dupsAllowed = !idx.unique();
+            bool dropDups = idx.dropDups() || inDBRepair;
+            unsigned long long nkeys = sorter.nKeys(x);
+            if( sorter.multikey(x) )
+                d->setIndexIsMultikey(idxNos[x]);
 
-        /* build index --- */ 
-        {
             BtreeBuilder btBuilder(dupsAllowed, idx);
             BSONObj keyLast;
-            auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
+            auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator(x);
             assert( pm == op->setMessage( "index: (2/3) btree bottom up" , nkeys , 10 ) );
             while( i->more() ) { 
                 RARELY killCurrentOp.checkForInterrupt();
@@ -1154,7 +1231,7 @@ namespace mongo {
                     /* we could queue these on disk, but normally there are very few dups, so instead we 
                        keep in ram and have a limit.
                     */
-                    dupsToDrop.push_back(d.second);
+                    dupsToDrop.insert(d.second);
                     uassert( 10092 , "too may dups on index build with dropDups=true", dupsToDrop.size() < 1000000 );
                 }
                 pm.hit();
@@ -1168,12 +1245,168 @@ namespace mongo {
         
         log(1) << "\t fastBuildIndex dupsToDrop:" << dupsToDrop.size() << endl;
 
-        for( list<DiskLoc>::iterator i = dupsToDrop.begin(); i != dupsToDrop.end(); i++ )
+        // after all the indexes are built, as deleting a record unindexes it from every one
+        for( set<DiskLoc>::iterator i = dupsToDrop.begin(); i != dupsToDrop.end(); i++ ) {
             theDataFileMgr.deleteRecord( ns, i->rec(), *i, false, true );
+            dur::commitIfNeeded();
+        }
 
         return n;
     }
 
+    unsigned long long fastBuildIndex(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) {
+        return fastBuildIndexes(ns, d, vector<int>(1, idxNo));
+    }
+
+    ThreadLocalValue<MultiIndexBuild*> MultiIndexBuild::_current;
+
+    MultiIndexBuild::MultiIndexBuild() {
+        massert( 13634 , "index builds can't be nested", _current.get() == 0 );
+        _current.set(this);
+    }
+
+    MultiIndexBuild::~MultiIndexBuild() {
+        _current.set(0);
+        if( _pending.empty() )
+            return;
+        try {
+            dropPending();
+        }
+        catch( DBException& e ) {
+            log() << "couldn't drop unbuilt indexes: " << e.what() << endl;
+        }
+    }
+
+    void MultiIndexBuild::done() {
+        _current.set(0);
+        while( !_pending.empty() ) {
+            map< string , vector<int> >::iterator i = _pending.begin();
+            NamespaceDetails *d = nsdetails(i->first.c_str());
+            assert( d );
+            tlog() << "building " << i->second.size() << " new indexes for " << i->first << endl;
+            Timer t;
+            try {
+                unsigned long long n = fastBuildIndexes(i->first.c_str(), d, i->second);
+                tlog() << "done for " << n << " records " << t.millis() / 1000.0 << "secs" << endl;
+            }
+            catch( DBException& ) {
+                dropPending();
+                throw;
+            }
+            _pending.erase(i);
+        }
+    }
+
+    void MultiIndexBuild::dropPending() {
+        for( map< string , vector<int> >::iterator i = _pending.begin(); i != _pending.end(); i++ ) {
+            NamespaceDetails *d = nsdetails(i->first.c_str());
+            if( !d )
+                continue;
+            // names first: dropping shifts the idxNos of later indexes
+            vector<string> names;
+            for( unsigned j = 0; j < i->second.size(); j++ )
+                names.push_back( d->idx(i->second[j]).indexName() );
+            for( unsigned j = 0; j < names.size(); j++ ) {
+                BSONObjBuilder b;
+                string errmsg;
+                if( !dropIndexes(d, i->first.c_str(), names[j].c_str(), errmsg, b, true) )
+                    log() << "failed to drop unbuilt index " << i->first << ' ' << names[j] << ": " << errmsg << endl;
+            }
+        }
+        _pending.clear();
+    }
+
+    ThreadLocalValue<BatchInsert*> BatchInsert::_current;
+
+    BatchInsert::BatchInsert( const char *ns ) : _ns( ns ), _d( 0 ) {
+        massert( 13645 , "batch inserts can't be nested", _current.get() == 0 );
+        _current.set(this);
+    }
+
+    BatchInsert::~BatchInsert() {
+        if( _current.get() != this )
+            return;
+        try {
+            done();
+        }
+        catch( DBException& e ) {
+            log() << "couldn't index batch inserted into " << _ns << ": " << e.what() << endl;
+        }
+    }
+
+    bool BatchInsert::defers( NamespaceDetails *d , int idxNo ) {
+        if( _d == 0 )
+            _d = nsdetails( _ns.c_str() ); // the collection may be made by the batch's first insert
+        /* idxNo == nIndexes is a background build in progress, which must see each insert */
+        return d == _d && !d->capped && idxNo < d->nIndexes && !d->idx(idxNo).unique();
+    }
+
+    void BatchInsert::add( NamespaceDetails *d , const BSONObj& obj , const DiskLoc& loc ) {
+        /* every key first: getKeysFromObject may throw, and then none may be held */
+        map< int , BSONObjSetDefaultOrder > keys;
+        for( int i = 0; i < d->nIndexes; i++ ) {
+            if( defers( d , i ) )
+                d->idx(i).getKeysFromObject(obj, keys[i]);
+        }
+        _lastAdd.clear();
+        for( map< int , BSONObjSetDefaultOrder >::iterator i = keys.begin(); i != keys.end(); i++ ) {
+            if( i->second.size() > 1 )
+                d->setIndexIsMultikey(i->first);
+            Keys& k = _keys[i->first];
+            _lastAdd[i->first] = k.size();
+            for ( BSONObjSetDefaultOrder::iterator j = i->second.begin(); j != i->second.end(); j++ )
+                k.push_back( make_pair( *j , loc ) );
+        }
+    }
+
+    void BatchInsert::undoAdd() {
+        for( map< int , unsigned >::iterator i = _lastAdd.begin(); i != _lastAdd.end(); i++ )
+            _keys[i->first].resize( i->second );
+        _lastAdd.clear();
+    }
+
+    struct KeyLocLess {
+        KeyLocLess( const Ordering& o ) : _o( o ) { }
+        bool operator()( const pair<BSONObj,DiskLoc>& l , const pair<BSONObj,DiskLoc>& r ) const {
+            int c = l.first.woCompare( r.first , _o , false );
+            return c ? c < 0 : l.second < r.second;
+        }
+        const Ordering _o;
+    };
+
+    void BatchInsert::done() {
+        _current.set(0);
+        if( _keys.empty() )
+            return;
+        NamespaceDetails *d = nsdetails( _ns.c_str() );
+        massert( 13646 , "collection dropped during batch insert" , d && d == _d );
+        _lastAdd.clear();
+        /* keep adding the keys after a failure, as _indexRecord would, then report the first */
+        int code = 0;
+        string msg;
+        for( map< int , Keys >::iterator i = _keys.begin(); i != _keys.end(); i++ ) {
+            IndexDetails& idx = d->idx(i->first);
+            Ordering ordering = Ordering::make( idx.keyPattern() );
+            Keys& k = i->second;
+            sort( k.begin() , k.end() , KeyLocLess( ordering ) );
+            for( Keys::iterator j = k.begin(); j != k.end(); j++ ) {
+                try {
+                    idx.head.btree()->bt_insert(idx.head, j->second, j->first, ordering, /*dupsAllowed*/true, idx);
+                }
+                catch( AssertionException& e ) {
+                    problem() << " caught assertion BatchInsert::done " << idx.indexNamespace() << ' ' << e.toString() << endl;
+                    if( code == 0 ) {
+                        code = e.getCode();
+                        msg = e.what();
+                    }
+                }
+            }
+        }
+        _keys.clear();
+        if( code )
+            uasserted( code , "batch insert into " + _ns + " failed to index: " + msg );
+    }
+
     class BackgroundIndexBuildJob : public BackgroundOperation { 
 
         unsigned long long addExistingToIndex(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) {
@@ -1240,10 +1473,12 @@ namespace mongo {
             assertInWriteLock();
             uassert( 13130 , "can't start bg index b/c in recursive lock (db.eval?)" , dbMutex.getState() == 1 );
             bgJobsInProgress.insert(d);
+            dur::writing(d);
             d->backgroundIndexBuildInProgress = 1;
             d->nIndexes--;
         }
         void done(const char *ns, NamespaceDetails *d) {
+            dur::writing(d);
             d->nIndexes++;
             d->backgroundIndexBuildInProgress = 0;
             NamespaceDetailsTransient::get_w(ns).addedIndex(); // clear query optimizer cache
@@ -1259,7 +1494,7 @@ namespace mongo {
             prep(ns.c_str(), d);
             assert( idxNo == d->nIndexes );
             try { 
-                idx.head = BtreeBucket::addBucket(idx);
+                dur::writingDiskLoc(idx.head) = BtreeBucket::addBucket(idx);
                 n = addExistingToIndex(ns.c_str(), d, idx, idxNo);
             }
             catch(...) { 
@@ -1300,11 +1535,33 @@ namespace mongo {
         tlog() << "done for " << n << " records " << t.millis() / 1000.0 << "secs" << endl;
     }
 
+    /* link a newly allocated record in at the end of its extent's record list */
+    static void addRecordToRecListInExtent(Record *r, const DiskLoc& loc) {
+        Extent *e = dur::writing( r->myExtent(loc) );
+        if ( e->lastRecord.isNull() ) {
+            e->firstRecord = e->lastRecord = loc;
+            r->prevOfs = r->nextOfs = DiskLoc::NullOfs;
+        }
+        else {
+            Record *oldlast = e->lastRecord.rec();
+            r->prevOfs = e->lastRecord.getOfs();
+            r->nextOfs = DiskLoc::NullOfs;
+            dur::writingInt(oldlast->nextOfs) = loc.getOfs();
+            e->lastRecord = loc;
+        }
+    }
+
     /* add keys to indexes for a new record */
     static void indexRecord(NamespaceDetails *d, BSONObj obj, DiskLoc loc) {
+        BatchInsert *batch = BatchInsert::current();
+        /* before any index changes, so a throw leaves nothing to roll back */
+        if( batch )
+            batch->add(d, obj, loc);
         int n = d->nIndexesBeingBuilt();
         for ( int i = 0; i < n; i++ ) {
             try { 
+                if( batch && batch->defers(d, i) )
+                    continue;
                 bool unique = d->idx(i).unique();
                 _indexRecord(d, i, obj, loc, /*dupsAllowed*/!unique);
             }
@@ -1314,6 +1571,8 @@ namespace mongo {
                    may be multikey and require some cleanup.
                 */
                 for( int j = 0; j <= i; j++ ) { 
+                    if( batch && batch->defers(d, j) )
+                        continue;
                     try {
                         _unindexRecord(d->idx(j), obj, loc, false);
                     }
@@ -1321,6 +1580,8 @@ namespace mongo {
                         log(3) << "unindex fails on rollback after unique failure\n";
                     }
                 }
+                if( batch )
+                    batch->undoAdd();
                 throw;
             }
         }
@@ -1333,7 +1594,7 @@ namespace mongo {
         if ( d == 0 || (d->flags & NamespaceDetails::Flag_HaveIdIndex) )
             return;
 
-        d->flags |= NamespaceDetails::Flag_HaveIdIndex;
+        *dur::writing(&d->flags) |= NamespaceDetails::Flag_HaveIdIndex;
 
         {
             NamespaceDetails::IndexIterator i = d->ii();
@@ -1491,12 +1752,17 @@ namespace mongo {
 
         DiskLoc extentLoc;
         int lenWHdr = len + Record::HeaderSize;
-        lenWHdr = (int) (lenWHdr * d->paddingFactor);
-        if ( lenWHdr == 0 ) {
-            // old datafiles, backward compatible here.
-            assert( d->paddingFactor == 0 );
-            d->paddingFactor = 1.0;
-            lenWHdr = len + Record::HeaderSize;
+        if ( d->usePowerOf2Sizes() ) {
+            lenWHdr = NamespaceDetails::quantizeAllocationSpace( lenWHdr );
+        }
+        else {
+            lenWHdr = (int) (lenWHdr * d->paddingFactor);
+            if ( lenWHdr == 0 ) {
+                // old datafiles, backward compatible here.
+                assert( d->paddingFactor == 0 );
+                *dur::writing(&d->paddingFactor) = 1.0;
+                lenWHdr = len + Record::HeaderSize;
+            }
         }
         
         // If the collection is capped, check if the new object will violate a unique index
@@ -1532,6 +1798,7 @@ namespace mongo {
 
         Record *r = loc.rec();
         assert( r->lengthWithHeaders >= lenWHdr );
+        dur::writingPtr(r, lenWHdr);
         if( addID ) { 
             /* a little effort was made here to avoid a double copy when we add an ID */
             ((int&)*r->data) = *((int*) obuf) + newId->size();
@@ -1542,20 +1809,9 @@ namespace mongo {
             if( obuf )
                 memcpy(r->data, obuf, len);
         }
-        Extent *e = r->myExtent(loc);
-        if ( e->lastRecord.isNull() ) {
-            e->firstRecord = e->lastRecord = loc;
-            r->prevOfs = r->nextOfs = DiskLoc::NullOfs;
-        }
-        else {
-
-            Record *oldlast = e->lastRecord.rec();
-            r->prevOfs = e->lastRecord.getOfs();
-            r->nextOfs = DiskLoc::NullOfs;
-            oldlast->nextOfs = loc.getOfs();
-            e->lastRecord = loc;
-        }
+        addRecordToRecListInExtent(r, loc);
 
+        dur::writing(d);
         d->nrecords++;
         d->datasize += r->netLength();
 
@@ -1579,34 +1835,41 @@ namespace mongo {
             int idxNo = tableToIndex->nIndexes;
             IndexDetails& idx = tableToIndex->addIndex(tabletoidxns.c_str(), !background); // clear transient info caches so they refresh; increments nIndexes
             idx.info = loc;
-            try {
-                buildAnIndex(tabletoidxns, tableToIndex, idx, idxNo, background);
-            } catch( DBException& e ) {
-                // save our error msg string as an exception or dropIndexes will overwrite our message
-                LastError *le = lastError.get();
-                int savecode = 0;
-                string saveerrmsg;
-                if ( le ) {
-                    savecode = le->code;
-                    saveerrmsg = le->msg;
-                }
-                else {
-                    savecode = e.getCode();
-                    saveerrmsg = e.what();
-                }
+            MultiIndexBuild *multi = background ? 0 : MultiIndexBuild::current();
+            if( multi ) {
+                // built (or rolled back) along with the others when multi is done
+                multi->defer(tabletoidxns, idxNo);
+            }
+            else {
+                try {
+                    buildAnIndex(tabletoidxns, tableToIndex, idx, idxNo, background);
+                } catch( DBException& e ) {
+                    // save our error msg string as an exception or dropIndexes will overwrite our message
+                    LastError *le = lastError.get();
+                    int savecode = 0;
+                    string saveerrmsg;
+                    if ( le ) {
+                        savecode = le->code;
+                        saveerrmsg = le->msg;
+                    }
+                    else {
+                        savecode = e.getCode();
+                        saveerrmsg = e.what();
+                    }
 
-                // roll back this index
-                string name = idx.indexName();
-                BSONObjBuilder b;
-                string errmsg;
-                bool ok = dropIndexes(tableToIndex, tabletoidxns.c_str(), name.c_str(), errmsg, b, true);
-                if( !ok ) {
-                    log() << "failed to drop index after a unique key error building it: " << errmsg << ' ' << tabletoidxns << ' ' << name << endl;
-                }
+                    // roll back this index
+                    string name = idx.indexName();
+                    BSONObjBuilder b;
+                    string errmsg;
+                    bool ok = dropIndexes(tableToIndex, tabletoidxns.c_str(), name.c_str(), errmsg, b, true);
+                    if( !ok ) {
+                        log() << "failed to drop index after a unique key error building it: " << errmsg << ' ' << tabletoidxns << ' ' << name << endl;
+                    }
                 
-                assert( le && !saveerrmsg.empty() );
-                raiseError(savecode,saveerrmsg.c_str());
-                throw;
+                    assert( le && !saveerrmsg.empty() );
+                    raiseError(savecode,saveerrmsg.c_str());
+                    throw;
+                }
             }
         }
 
@@ -1633,10 +1896,51 @@ namespace mongo {
             }
         }
 
+        if ( d->capped )
+            NamespaceDetailsTransient::notifyCappedInsert( ns );
+
         //	out() << "   inserted at loc:" << hex << loc.getOfs() << " lenwhdr:" << hex << lenWHdr << dec << ' ' << ns << endl;
         return loc;
     }
 
+    DiskLoc DataFileMgr::relocateRecord(const char *ns, NamespaceDetails *d, const DiskLoc& dl) {
+        assert( !d->capped );
+        Record *old = dl.rec();
+        BSONObj obj = BSONObj(old).copy(); // freeing the old record overwrites its start
+
+        int lenWHdr = obj.objsize() + Record::HeaderSize;
+        if ( d->usePowerOf2Sizes() )
+            lenWHdr = NamespaceDetails::quantizeAllocationSpace( lenWHdr );
+        else if ( d->paddingFactor > 1.0 )
+            lenWHdr = (int) (lenWHdr * d->paddingFactor);
+
+        DiskLoc extentLoc;
+        DiskLoc loc = d->alloc(ns, lenWHdr, extentLoc);
+        if ( loc.isNull() )
+            return loc;
+
+        Record *r = loc.rec();
+        assert( r->lengthWithHeaders >= lenWHdr );
+        dur::writingPtr(r, lenWHdr); // the header too: its prev/next offsets are set below
+        memcpy(r->data, obj.objdata(), obj.objsize());
+        addRecordToRecListInExtent(r, loc);
+        dur::writing(d);
+        d->nrecords++;
+        d->datasize += r->netLength();
+
+        /* the keys are the same, only the location changes.  no new duplicates, so dupsAllowed */
+        ClientCursor::aboutToDelete(dl);
+        int n = d->nIndexesBeingBuilt();
+        for ( int i = 0; i < n; i++ ) {
+            _unindexRecord(d->idx(i), obj, dl, false);
+            _indexRecord(d, i, obj, loc, true);
+        }
+
+        _deleteRecord(d, ns, old, dl);
+        NamespaceDetailsTransient::get_w( ns ).notifyOfWriteOp();
+        return loc;
+    }
+
     /* special version of insert for transaction logging -- streamlined a bit.
        assumes ns is capped and no indexes
     */
@@ -1655,8 +1959,10 @@ namespace mongo {
 
         Record *r = loc.rec();
         assert( r->lengthWithHeaders >= lenWHdr );
+        // the caller fills in the data
+        dur::writingPtr(r, lenWHdr);
 
-        Extent *e = r->myExtent(loc);
+        Extent *e = dur::writing( r->myExtent(loc) );
         if ( e->lastRecord.isNull() ) {
             e->firstRecord = e->lastRecord = loc;
             r->prevOfs = r->nextOfs = DiskLoc::NullOfs;
@@ -1665,13 +1971,18 @@ namespace mongo {
             Record *oldlast = e->lastRecord.rec();
             r->prevOfs = e->lastRecord.getOfs();
             r->nextOfs = DiskLoc::NullOfs;
-            oldlast->nextOfs = loc.getOfs();
+            dur::writingInt(oldlast->nextOfs) = loc.getOfs();
             e->lastRecord = loc;
         }
 
+        dur::writing(d);
         d->nrecords++;
         d->datasize += r->netLength();
 
+        /* the caller fills in the data before it releases the write lock, and the waiters must get
+           the read lock before they look */
+        NamespaceDetailsTransient::notifyCappedInsert( ns );
+
         return r;
     }
 
@@ -1931,7 +2242,7 @@ namespace mongo {
     
     bool DatabaseHolder::closeAll( const string& path , BSONObjBuilder& result , bool force ){
         log() << "DatabaseHolder::closeAll path:" << path << endl;
-        dbMutex.assertWriteLocked();
+        dbMutex.assertGlobalWriteLocked();
         
         map<string,Database*>& m = _paths[path];
         _size -= m.size();
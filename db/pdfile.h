@@ -37,6 +37,7 @@ namespace mongo {
     class DataFileHeader;
     class Extent;
     class Record;
+    class DeletedRecord;
     class Cursor;
     class OpDebug;
 
@@ -45,12 +46,76 @@ namespace mongo {
 
     /* low level - only drops this ns */
     void dropNS(const string& dropNs);
+
+    /* unlink the empty extent at loc from d and put it on the database's $freelist */
+    void freeExtent(NamespaceDetails *d, const DiskLoc& loc);
+
+    /* compact.cpp: if the record at dl is in an extent of ns being compacted, compact keeps its
+       space off the deleted lists.  @return true if it took it */
+    bool compactTakesFreedRecord(const char *ns, const DiskLoc& dl, DeletedRecord *r);
     
     /* deletes this ns, indexes and cursors */
     void dropCollection( const string &name, string &errmsg, BSONObjBuilder &result ); 
     bool userCreateNS(const char *ns, BSONObj j, string& err, bool logForReplication, bool *deferIdIndex = 0);
     shared_ptr<Cursor> findTableScan(const char *ns, const BSONObj& order, const DiskLoc &startLoc=DiskLoc());
 
+    /* While one of these is in scope, foreground index builds started on this thread (by inserting
+       into system.indexes) are only registered, and done() builds them -- all those on a collection
+       from one scan of it.  Until then the new indexes are empty, so hold the write lock throughout
+       and don't write to their collections.  If done() isn't reached the pending indexes are dropped.
+    */
+    class MultiIndexBuild : boost::noncopyable {
+    public:
+        MultiIndexBuild();
+        ~MultiIndexBuild();
+
+        /** build the pending indexes.  if one fails they're all dropped. */
+        void done();
+
+        /** @return the build in scope on this thread, if any */
+        static MultiIndexBuild* current() { return _current.get(); }
+        void defer( const string& ns , int idxNo ) { _pending[ns].push_back( idxNo ); }
+    private:
+        void dropPending();
+        map< string , vector<int> > _pending;
+        static ThreadLocalValue<MultiIndexBuild*> _current;
+    };
+
+    /* While one of these is in scope, inserts on this thread into its collection leave their keys
+       for the collection's non-unique indexes here, and done() adds them to each index in key order
+       -- so successive inserts descend through the same few buckets.  Unique indexes are still
+       updated by each insert, so a duplicate fails just that insert.  Until done() those indexes lack
+       the new documents, so hold the write lock throughout.  Not used for capped collections, whose
+       inserts may delete the records just inserted.
+    */
+    class BatchInsert : boost::noncopyable {
+    public:
+        BatchInsert( const char *ns );
+        /** does done() if it hasn't been */
+        ~BatchInsert();
+
+        /** add the held keys to their indexes.  if any can't be added the rest still are, and then
+            the first error is thrown */
+        void done();
+
+        /** @return the batch in scope on this thread, if any */
+        static BatchInsert* current() { return _current.get(); }
+
+        /** @return true if index idxNo of d is one whose keys are held here */
+        bool defers( NamespaceDetails *d , int idxNo );
+        /** hold obj's keys for the deferred indexes.  if they can't all be had, throws holding none */
+        void add( NamespaceDetails *d , const BSONObj& obj , const DiskLoc& loc );
+        /** drop the keys of the last add(), as its insert is being rolled back */
+        void undoAdd();
+    private:
+        typedef vector< pair<BSONObj,DiskLoc> > Keys;
+        const string _ns;
+        NamespaceDetails *_d;
+        map< int , Keys > _keys; // by idxNo
+        map< int , unsigned > _lastAdd; // idxNo -> its key count before the last add()
+        static ThreadLocalValue<BatchInsert*> _current;
+    };
+
 // -1 if library unavailable.
     boost::intmax_t freeSpace( const string &path = dbpath );
 
@@ -124,6 +189,14 @@ namespace mongo {
 
         DiskLoc insert(const char *ns, const void *buf, int len, bool god = false, const BSONElement &writeId = BSONElement(), bool mayAddIndex = true);
         void deleteRecord(const char *ns, Record *todelete, const DiskLoc& dl, bool cappedOK = false, bool noWarn = false);
+
+        /** move the record at dl into free space from d's deleted lists, for compact.  its index entries
+            and any cursors on it follow it; the old space is freed like any delete's.
+            never adds an extent.
+            @return the new location, or null if no free space was big enough
+        */
+        DiskLoc relocateRecord(const char *ns, NamespaceDetails *d, const DiskLoc& dl);
+
         static shared_ptr<Cursor> findAll(const char *ns, const DiskLoc &startLoc = DiskLoc());
 
         /* special version of insert for transaction logging -- streamlined a bit.
@@ -182,6 +255,15 @@ namespace mongo {
         }
         //void setNewLength(int netlen) { lengthWithHeaders = netlen + HeaderSize; }
 
+        /** @return false if the start of this record is (probably) not in physical memory, i.e.
+            reading it would page fault.  true if we can't tell on this platform.  doesn't touch the record. */
+        bool likelyInPhysicalMemory();
+
+        /** fault in this record's pages.  for use without the db lock (see ClientCursor::staticYield):
+            the record may have been deleted meanwhile, which is harmless as we only read, and if its
+            file was closed we do nothing. */
+        void touch();
+
         /* use this when a record is deleted. basically a union with next/prev fields */
         DeletedRecord& asDeleted() {
             return *((DeletedRecord*) this);
@@ -307,6 +389,7 @@ namespace mongo {
             if ( uninitialized() ) {
                 assert(filelength > 32768 );
                 assert( HeaderSize == 8192 );
+                dur::writingPtr(this, HeaderSize);
                 fileLength = filelength;
                 version = VERSION;
                 versionMinor = VERSION_MINOR;
@@ -36,6 +36,7 @@
 #include "lasterror.h"
 #include "../s/d_logic.h"
 #include "repl_block.h"
+#include "../util/compress.h"
 
 namespace mongo {
 
@@ -75,6 +76,9 @@ namespace mongo {
                 massert( 13340, "cursor dropped during delete", false );
             }
         }
+        virtual Record* recordToLoad() {
+            return c_.get() ? c_->recordToLoad() : 0;
+        }
         virtual long long nscanned() {
             assert( c_.get() );
             return c_->nscanned();
@@ -281,6 +285,34 @@ namespace mongo {
         return qr;
     }
 
+    /* for QueryOption_CompressReply.  returns qr, or a new reply with qr's documents compressed
+       after their uncompressed length, freeing qr unless its owner will.  small or incompressible
+       batches go as they are.
+    */
+    static QueryResult* compressReply( QueryResult *qr , bool freeOld = true ) {
+        const int MinCompressBytes = 1024;
+        int dataLen = qr->len - sizeof(QueryResult);
+        if ( dataLen < MinCompressBytes )
+            return qr;
+
+        string z;
+        compress::block( qr->data() , dataLen , z );
+        if ( (int) z.size() + 4 >= dataLen )
+            return qr;
+
+        BufBuilder b( sizeof(QueryResult) + 4 + z.size() );
+        b.appendBuf( qr , sizeof(QueryResult) );
+        b.appendNum( dataLen );
+        b.appendBuf( z.data() , z.size() );
+        QueryResult *c = (QueryResult *) b.buf();
+        c->len = b.len();
+        c->_resultFlags() |= ResultFlag_Compressed;
+        b.decouple();
+        if ( freeOld )
+            free( qr );
+        return c;
+    }
+
     QueryResult* processGetMore(const char *ns, int ntoreturn, long long cursorid , CurOp& curop, int pass, bool& exhaust ) {
 //        log() << "TEMP GETMORE " << ns << ' ' << cursorid << ' ' << pass << endl;
         exhaust = false;
@@ -298,6 +330,7 @@ namespace mongo {
         b.skip(sizeof(QueryResult));
         
         int resultFlags = ResultFlag_AwaitCapable;
+        int queryOptions = 0;
         int start = 0;
         int n = 0;
 
@@ -310,7 +343,7 @@ namespace mongo {
             if ( pass == 0 )
                 cc->updateSlaveLocation( curop );
 
-            int queryOptions = cc->_queryOptions;
+            queryOptions = cc->_queryOptions;
 
             if( pass == 0 ) {
                 StringBuilder& ss = curop.debug().str;
@@ -393,6 +426,8 @@ namespace mongo {
         qr->nReturned = n;
         b.decouple();
 
+        if ( queryOptions & QueryOption_CompressReply )
+            qr = compressReply( qr );
         return qr;
     }
 
@@ -436,6 +471,10 @@ namespace mongo {
             }
         }
         
+        virtual Record* recordToLoad() {
+            return c_.get() ? c_->recordToLoad() : 0;
+        }
+        
         virtual void next() {
             if ( !c_->ok() ) {
                 setComplete();
@@ -664,6 +703,12 @@ namespace mongo {
             }
         }
         
+        virtual Record* recordToLoad() {
+            if ( _findingStartCursor.get() || !_c.get() )
+                return 0;
+            return _c->recordToLoad();
+        }
+        
         virtual void recoverFromYield() {
             ++_nYields;
             if ( _findingStartCursor.get() ) {
@@ -972,7 +1017,7 @@ namespace mongo {
             
         /* --- read lock --- */
 
-        mongolock lk(false);
+        mongolock lk(false, ns);
 
         Client::Context ctx( ns , dbpath , &lk );
 
@@ -1112,6 +1157,17 @@ namespace mongo {
         qr->startingFrom = 0;
         qr->nReturned = n;
 
+        if ( queryOptions & QueryOption_CompressReply ) {
+            result.concat();
+            // result still owns the uncompressed buffer, reset() frees it
+            QueryResult *c = compressReply( qr = (QueryResult *) result.singleData() , false );
+            if ( c != qr ) {
+                result.reset();
+                result.setData( c , true );
+                ss << " compressed:" << c->len;
+            }
+        }
+
         int duration = curop.elapsedMillis();
         bool dbprofile = curop.shouldDBProfile( duration );
         if ( dbprofile || duration >= cmdLine.slowMS ) {
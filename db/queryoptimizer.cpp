@@ -24,6 +24,7 @@
 #include "queryoptimizer.h"
 #include "cmdline.h"
 #include "clientcursor.h"
+#include "indexstats.h"
 #include <queue>
 
 //#define DEBUGQO(x) cout << x << endl;
@@ -67,7 +68,8 @@ namespace mongo {
     unhelpful_( false ),
     _special( special ),
     _type(0),
-    _startOrEndSpec( !startKey.isEmpty() || !endKey.isEmpty() ){
+    _startOrEndSpec( !startKey.isEmpty() || !endKey.isEmpty() ),
+    _nscannedEstimate( -1 ){
 
         if ( !fbs_.matchPossible() ) {
             unhelpful_ = true;
@@ -230,6 +232,20 @@ namespace mongo {
         return index_->keyPattern();
     }
     
+    void QueryPlan::estimateNScanned( const NamespaceIndexStats &stats ) {
+        if ( !fbs_.matchPossible() ) {
+            _nscannedEstimate = 0;
+        }
+        else if ( !index_ ) {
+            _nscannedEstimate = d->nrecords;
+        }
+        else if ( !_type && !_startOrEndSpec ) {
+            const IndexStats *s = stats.get( *index_ );
+            if ( s )
+                _nscannedEstimate = s->estimateKeys( fbs_.range( index_->keyPattern().firstElement().fieldName() ) );
+        }
+    }
+
     void QueryPlan::registerSelf( long long nScanned ) const {
         if ( fbs_.matchPossible() ) {
             scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
@@ -442,11 +458,69 @@ namespace mongo {
                 plans.push_back( p );
             }
         }
+        // Table scan plan
+        plans.push_back( PlanPtr( new QueryPlan( d, -1, *fbs_, *_originalFrs, _originalQuery, order_ ) ) );
+
+        // when a recorded plan went bad we want every alternative, so only prune up front
+        if ( !checkFirst && normalQuery )
+            pruneByEstimate( plans );
+
         for( PlanSet::iterator i = plans.begin(); i != plans.end(); ++i )
             addPlan( *i, checkFirst );
+    }
 
-        // Table scan plan
-        addPlan( PlanPtr( new QueryPlan( d, -1, *fbs_, *_originalFrs, _originalQuery, order_ ) ), checkFirst );
+    /* plans estimated to scan more than this many times as much as the best one are not raced */
+    static const long long PruneRatio = 10;
+    /* ...nor are plans estimated to scan fewer than this, there's little to save */
+    static const long long PruneMin = 1000;
+
+    /* table scan last, then index plans without estimates */
+    static int estimateRank( const QueryPlanSet::PlanPtr &p ) {
+        if ( p->willScanTable() )
+            return 2;
+        return p->nscannedEstimate() < 0 ? 1 : 0;
+    }
+
+    static bool estimateLess( const QueryPlanSet::PlanPtr &a, const QueryPlanSet::PlanPtr &b ) {
+        int ra = estimateRank( a ), rb = estimateRank( b );
+        if ( ra != rb )
+            return ra < rb;
+        return ra == 0 && a->nscannedEstimate() < b->nscannedEstimate();
+    }
+
+    /* With statistics we can tell a plan that will read a sliver of the collection from one that
+       will read most of it, without racing them -- which matters most on a cold query cache, e.g.
+       after a restart.  Plans estimated to scan far more than the best are dropped, unless they
+       return the requested order (with a limit those may still win).  What's left is ordered
+       cheapest first, which is also what getBestGuess() picks from. */
+    void QueryPlanSet::pruneByEstimate( PlanSet &plans ) const {
+        if ( plans.size() < 2 )
+            return;
+        shared_ptr< const NamespaceIndexStats > stats = indexStatsFor( fbs_->ns() );
+        if ( stats->byName.empty() )
+            return;
+
+        long long best = -1;
+        for( PlanSet::iterator i = plans.begin(); i != plans.end(); ++i ) {
+            (*i)->estimateNScanned( *stats );
+            long long e = (*i)->nscannedEstimate();
+            if ( e >= 0 && ( best < 0 || e < best ) )
+                best = e;
+        }
+        if ( best < 0 )
+            return;
+
+        long long limit = max( best * PruneRatio, PruneMin );
+        PlanSet keep;
+        for( PlanSet::iterator i = plans.begin(); i != plans.end(); ++i ) {
+            if ( (*i)->nscannedEstimate() > limit && ( order_.isEmpty() || (*i)->scanAndOrderRequired() ) ) {
+                DEBUGQO( "\t pruning " << (*i)->indexKey() << " estimate " << (*i)->nscannedEstimate() );
+                continue;
+            }
+            keep.push_back( *i );
+        }
+        stable_sort( keep.begin(), keep.end(), estimateLess );
+        plans.swap( keep );
     }
     
     shared_ptr< QueryOp > QueryPlanSet::runOp( QueryOp &op ) {
@@ -473,6 +547,8 @@ namespace mongo {
             BSONObjBuilder explain;
             explain.append( "cursor", c->toString() );
             explain.append( "indexBounds", c->prettyIndexBounds() );
+            if ( (*i)->nscannedEstimate() >= 0 )
+                explain.append( "nscannedEstimate", (*i)->nscannedEstimate() );
             arr.push_back( explain.obj() );
         }
         BSONObjBuilder b;
@@ -509,22 +585,36 @@ namespace mongo {
     }
     
     void QueryPlanSet::Runner::mayYield( const vector< shared_ptr< QueryOp > > &ops ) {
-        if ( plans_._mayYield ) {
-            if ( plans_._yieldSometimesTracker.ping() ) {
-                int micros = ClientCursor::yieldSuggest();
-                if ( micros > 0 ) {
-                    for( vector< shared_ptr< QueryOp > >::const_iterator i = ops.begin(); i != ops.end(); ++i ) {
-                        if ( !prepareToYield( **i ) ) {
-                            return;
-                        }
-                    }
-                    ClientCursor::staticYield( micros );
-                    for( vector< shared_ptr< QueryOp > >::const_iterator i = ops.begin(); i != ops.end(); ++i ) {
-                        recoverFromYield( **i );
-                    }                        
-                }
+        if ( !plans_._mayYield )
+            return;
+
+        if ( !plans_._yieldSometimesTracker.ping() )
+            return;
+
+        // if an op is about to page fault, yield now and take the fault outside the lock.
+        // checked only here, when a yield is due, as each check is a system call.
+        Record *rec = 0;
+        for( vector< shared_ptr< QueryOp > >::const_iterator i = ops.begin(); i != ops.end() && !rec; ++i ) {
+            if ( !(*i)->error() && !(*i)->complete() )
+                rec = (*i)->recordToLoad();
+        }
+
+        int micros = 0;
+        if ( !rec ) {
+            micros = ClientCursor::yieldSuggest();
+            if ( micros <= 0 )
+                return;
+        }
+
+        for( vector< shared_ptr< QueryOp > >::const_iterator i = ops.begin(); i != ops.end(); ++i ) {
+            if ( !prepareToYield( **i ) ) {
+                return;
             }
-        }        
+        }
+        ClientCursor::staticYield( micros , rec );
+        for( vector< shared_ptr< QueryOp > >::const_iterator i = ops.begin(); i != ops.end(); ++i ) {
+            recoverFromYield( **i );
+        }                        
     }
     
     struct OpHolder {
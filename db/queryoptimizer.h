@@ -28,6 +28,7 @@ namespace mongo {
     
     class IndexDetails;
     class IndexType;
+    class NamespaceIndexStats;
 
     class QueryPlan : boost::noncopyable {
     public:
@@ -63,6 +64,10 @@ namespace mongo {
         BSONObj simplifiedQuery( const BSONObj& fields = BSONObj() ) const { return fbs_.simplifiedQuery( fields ); }
         const FieldRange &range( const char *fieldName ) const { return fbs_.range( fieldName ); }
         void registerSelf( long long nScanned ) const;
+        /* Estimated number of keys (or documents, for a table scan) this plan will scan, from the
+           persisted index statistics.  -1 if unknown. */
+        long long nscannedEstimate() const { return _nscannedEstimate; }
+        void estimateNScanned( const NamespaceIndexStats &stats );
         shared_ptr< FieldRangeVector > originalFrv() const { return _originalFrv; }
         // just for testing
         shared_ptr< FieldRangeVector > frv() const { return _frv; }
@@ -86,6 +91,7 @@ namespace mongo {
         string _special;
         IndexType * _type;
         bool _startOrEndSpec;
+        long long _nscannedEstimate;
     };
 
     // Inherit from this interface to implement a new query operation.
@@ -117,6 +123,10 @@ namespace mongo {
         
         virtual bool prepareToYield() { massert( 13335, "yield not supported", false ); return false; }
         virtual void recoverFromYield() { massert( 13336, "yield not supported", false ); }
+
+        /** @return the record next() will read if that is likely to page fault, else 0 -- so the
+            runner can yield and take the fault outside the lock.  see Cursor::recordToLoad() */
+        virtual Record* recordToLoad() { return 0; }
         
         virtual long long nscanned() = 0;
         
@@ -211,6 +221,7 @@ namespace mongo {
         }
         void init();
         void addHint( IndexDetails &id );
+        void pruneByEstimate( PlanSet &plans ) const;
         struct Runner {
             Runner( QueryPlanSet &plans, QueryOp &op );
             shared_ptr< QueryOp > run();
@@ -242,14 +253,14 @@ namespace mongo {
     };
 
     // Handles $or type queries by generating a QueryPlanSet for each $or clause
-    // NOTE on our $or implementation: In our current qo implementation we don't
-    // keep statistics on our data, but we can conceptualize the problem of
+    // NOTE on our $or implementation: We only keep coarse statistics on our data
+    // (see indexstats.h), but we can conceptualize the problem of
     // selecting an index when statistics exist for all index ranges.  The
     // d-hitting set problem on k sets and n elements can be reduced to the
     // problem of index selection on k $or clauses and n index ranges (where
     // d is the max number of indexes, and the number of ranges n is unbounded).
-    // In light of the fact that d-hitting set is np complete, and we don't even
-    // track statistics (so cost calculations are expensive) our first
+    // In light of the fact that d-hitting set is np complete, and our statistics
+    // only describe the first field of each index, our
     // implementation uses the following greedy approach: We take one $or clause
     // at a time and treat each as a separate query for index selection purposes.
     // But if an index range is scanned for a particular $or clause, we eliminate
@@ -263,7 +274,9 @@ namespace mongo {
     // and it can often do better.  In the first cut we are intentionally using
     // QueryPattern tracking to record successful plans on $or clauses for use by
     // subsequent $or clauses, even though there may be a significant aggregate
-    // $nor component that would not be represented in QueryPattern.
+    // $nor component that would not be represented in QueryPattern.  Where an
+    // index has statistics, each clause's QueryPlanSet uses them to skip plans
+    // that would scan far more than the best candidate.
     class MultiPlanScanner {
     public:
         MultiPlanScanner( const char *ns,
@@ -39,6 +39,8 @@ namespace mongo {
 
 NamespaceDetails* nsdetails_notinline(const char *ns);
 
+const int BucketSize = 8192;
+
 class MongoMemMapped_RecStore : public RecStoreInterface { 
 public:
     VIRT char* get(DiskLoc d, unsigned len) { return d.rec()->data; }
@@ -51,7 +53,10 @@ public:
         theDataFileMgr._deleteRecord(nsdetails_notinline(ns), ns, d.rec(), d);
     }
 
-    VIRT void modified(DiskLoc d) { }
+    /* btree buckets are written in place after this is called (see DiskLoc::btreemod()) */
+    VIRT void modified(DiskLoc d) { 
+        dur::writingPtr(d.rec()->data, BucketSize);
+    }
 
     VIRT void drop(const char *ns) { 
         dropNS(ns);
@@ -120,8 +125,6 @@ typedef MongoMemMapped_RecStore StoreToUse;
 
 extern StoreToUse *btreeStore;
 
-const int BucketSize = 8192;
-
 inline BtreeBucket* DiskLoc::btree() const {
     assert( _a != -1 );
     return (BtreeBucket*) btreeStore->get(*this, BucketSize);
@@ -380,6 +380,16 @@ namespace mongo {
         b.appendTimeT("date", time(0));
         b.append("myState", box.getState().s);
         b.append("members", v);
+        {
+            BSONObjBuilder sb(b.subobjStart("syncBuffer"));
+            appendSyncBufferStats(sb);
+            sb.done();
+        }
+        if( box.getState().rollback() ) {
+            BSONObjBuilder rb(b.subobjStart("rollback"));
+            appendRollbackStats(rb);
+            rb.done();
+        }
     }
 
     static struct Test : public UnitTest { 
@@ -55,6 +55,7 @@ namespace mongo {
 
     void ReplSetImpl::assumePrimary() { 
         assert( iAmPotentiallyHot() );
+        scoped_lock applying(_syncApplyMutex); // not partway through a sync batch
         writelock lk("admin."); // so we are synchronized with _logOp()
         box.setSelfPrimary(_self);
         //log() << "replSet PRIMARY" << rsLog; // self (" << _self->id() << ") is now primary" << rsLog;
@@ -34,6 +34,12 @@ namespace mongo {
     struct Target;
     class DBClientConnection;
     class ReplSetImpl;
+    struct SyncApplyErrors;
+
+    /* the secondary's read ahead of the primary's oplog, for replSetGetStatus.  see rs_sync.cpp */
+    void appendSyncBufferStats(BSONObjBuilder& b);
+    /* progress of a rollback in progress.  see rs_rollback.cpp */
+    void appendRollbackStats(BSONObjBuilder& b);
     class OplogReader;
     extern bool replSet; // true if using repl sets
     extern class ReplSet *theReplSet; // null until initialized
@@ -337,6 +343,10 @@ namespace mongo {
         bool tryToGoLiveAsASecondary(OpTime&); // readlocks
         void syncTail();
         void syncApply(const BSONObj &o);
+        bool syncApplyBatch(const vector<BSONObj>& ops, const Member *primary);
+        void syncApplyPart(const vector<BSONObj> *ops, SyncApplyErrors *errors);
+        /* held while a batch is applied and logged, so we don't become primary between the two */
+        static mongo::mutex _syncApplyMutex;
         unsigned _syncRollback(OplogReader& r);
         void syncRollback(OplogReader& r);
         void syncFixUp(HowToFixUp& h, OplogReader& r);
@@ -54,15 +54,10 @@ namespace mongo {
         }
     }
 
-    bool cloneFrom(const char *masterHost, string& errmsg, const string& fromdb, bool logForReplication, 
-				   bool slaveOk, bool useReplAuth, bool snapshot);
-
-    /* todo : progress metering to sethbmsg. */
-    static bool clone(const char *master, string db) {
-        string err;
-        return cloneFrom(master, err, db, false, 
-            /*slaveok later can be true*/ false, true, false);
-    }
+    bool cloneParallel(const string& masterHost, const list<string>& dbs, int nConns, string& errmsg);
+
+    /* connections, and threads, cloning at once */
+    const int InitialSyncConns = 4;
 
     void _logOpObjRS(const BSONObj& op);
 
@@ -100,6 +95,98 @@ namespace mongo {
         */
     }
 
+    static void dropInitialSyncOplog() {
+        writelock lk(rsInitialSyncOplog);
+        Client::Context ctx(rsInitialSyncOplog);
+        if( nsdetails(rsInitialSyncOplog) == 0 )
+            return;
+        string errmsg;
+        bob res;
+        dropCollection(rsInitialSyncOplog, errmsg, res);
+    }
+
+    /* While the databases are cloned, copies the primary's oplog from where the clone began into
+       rsInitialSyncOplog.  Then the primary's oplog need only keep the ops we are to apply after
+       the clone until we have fetched them, not until the clone is done.
+       initialSyncOplogApplication() applies what is buffered first.
+    */
+    class InitialSyncOplogFetcher : boost::noncopyable {
+    public:
+        InitialSyncOplogFetcher(const string& host, OpTime start) : _host(host), _start(start), _stop(false), _n(0) {
+            _thread.reset( new boost::thread( boost::bind(&InitialSyncOplogFetcher::run, this) ) );
+        }
+        ~InitialSyncOplogFetcher() { stop(); }
+
+        /* @return the number of ops buffered */
+        long long stop() {
+            _stop = true;
+            if( _thread.get() ) {
+                _thread->join();
+                _thread.reset();
+            }
+            return _n;
+        }
+
+    private:
+        void run();
+        void fetch();
+        const string _host;
+        const OpTime _start;
+        volatile bool _stop;
+        long long _n;
+        auto_ptr<boost::thread> _thread;
+    };
+
+    void InitialSyncOplogFetcher::run() {
+        Client::initThread("rsInitialSyncFetch");
+        try {
+            fetch();
+        }
+        catch(DBException& e) {
+            log() << "replSet initial sync oplog fetch stopped: " << e.toString() << rsLog;
+        }
+        cc().shutdown();
+    }
+
+    /* if we stop early -- whatever the reason -- the rest comes from the primary's oplog after the
+       clone, as it would have without us */
+    void InitialSyncOplogFetcher::fetch() {
+        OplogReader r;
+        if( !r.connect(_host) ) {
+            log() << "replSet initial sync oplog fetch couldn't connect to " << _host << rsLog;
+            return;
+        }
+        r.tailingQueryGTE(rsoplog, _start);
+        if( !r.haveCursor() )
+            return;
+
+        vector<BSONObj> ops;
+        while( !_stop ) {
+            if( !r.more() ) {
+                r.tailCheck();
+                if( !r.haveCursor() )
+                    return;
+                continue;
+            }
+            ops.clear();
+            while( ops.size() < 1000 && r.moreInCurrentBatch() )
+                ops.push_back( r.nextSafe().getOwned() );
+
+            if( _n == 0 && ops[0]["ts"]._opTime() != _start ) {
+                log() << "replSet initial sync oplog fetch: " << _host << " oplog wrapped" << rsLog;
+                return;
+            }
+
+            writelock lk(rsInitialSyncOplog);
+            Client::Context ctx(rsInitialSyncOplog);
+            for( unsigned i = 0; i < ops.size(); i++ ) {
+                BSONObj o = BSON( "_id" << _n << "op" << ops[i] );
+                theDataFileMgr.insertWithObjMod(rsInitialSyncOplog, o);
+                _n++;
+            }
+        }
+    }
+
     void ReplSetImpl::_syncDoInitialSync() { 
         sethbmsg("initial sync pending",0);
 
@@ -139,27 +226,26 @@ namespace mongo {
 
         sethbmsg("initial sync drop all databases", 0);
         dropAllDatabasesExceptLocal();
+        dropInitialSyncOplog();
 
 //        sethbmsg("initial sync drop oplog", 0);
 //        emptyOplog();
 
         list<string> dbs = r.conn()->getDatabaseNames();
-        for( list<string>::iterator i = dbs.begin(); i != dbs.end(); i++ ) {
-            string db = *i;
-            if( db != "local" ) {
-                sethbmsg( str::stream() << "initial sync cloning db: " << db , 0);
-                bool ok;
-                {
-                    writelock lk(db);
-                    Client::Context ctx(db);
-                    ok = clone(masterHostname.c_str(), db);
-                }
-                if( !ok ) { 
-                    sethbmsg( str::stream() << "initial sync error clone of " << db << " failed sleeping 5 minutes" ,0);
-                    sleepsecs(300);
-                    return;
-                }
+        dbs.remove("local");
+        {
+            InitialSyncOplogFetcher fetcher(masterHostname, startingTS);
+
+            sethbmsg( str::stream() << "initial sync cloning " << dbs.size() << " dbs" , 0);
+            string errmsg;
+            if( !cloneParallel(masterHostname, dbs, InitialSyncConns, errmsg) ) {
+                sethbmsg( str::stream() << "initial sync error clone failed: " << errmsg << " sleeping 5 minutes" ,0);
+                sleepsecs(300);
+                return;
             }
+
+            long long n = fetcher.stop();
+            log() << "replSet initial sync " << n << " oplog ops fetched during the clone" << rsLog;
         }
 
         sethbmsg("initial sync query minValid",0);
@@ -207,6 +293,7 @@ namespace mongo {
             Helpers::putSingleton("local.replset.minvalid", minValid);
             cx.db()->flushFiles(true);
         }
+        dropInitialSyncOplog();
 
         sethbmsg("initial sync done",0);
     }
@@ -24,6 +24,9 @@ namespace mongo {
 
     const char rsoplog[] = "local.oplog.rs";
 
+    /* the primary's ops, fetched during an initial sync's clone, as { _id : <n>, op : <op> } */
+    const char rsInitialSyncOplog[] = "local.replset.initialSyncOplog";
+
     /*
     class RSOpTime : public OpTime { 
     public:
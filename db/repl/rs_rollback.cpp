@@ -64,6 +64,7 @@ namespace mongo {
 
     bool copyCollectionFromRemote(const string& host, const string& ns, const BSONObj& query, string& errmsg, bool logforrepl);
     void incRBID();
+    bool replAuthenticate(DBClientBase *conn);
 
     class rsfatal : public std::exception { 
     public:
@@ -303,6 +304,165 @@ namespace mongo {
         bson::bo goodVersionOfObject;
     };
 
+    /* rollback's progress, for replSetGetStatus */
+    static struct RollbackStats {
+        RollbackStats() : m("rollbackStats"), toRefetch(0), refetched(0), applied(0) { }
+        mongo::mutex m;
+        long long toRefetch;
+        long long refetched;
+        long long applied;
+    } rollbackStats;
+
+    void appendRollbackStats(BSONObjBuilder& b) {
+        RollbackStats& s = rollbackStats;
+        scoped_lock lk(s.m);
+        b.appendNumber("toRefetch", s.toRefetch);
+        b.appendNumber("refetched", s.refetched);
+        b.appendNumber("applied", s.applied);
+    }
+
+    /* Gets the source's current version of each document to roll back.  The documents of a collection
+       are asked for RefetchBatchSize at a time with { _id : { $in : [...] } }, and the batches are
+       spread over up to RefetchConns connections, each on its own thread.  A document the source
+       doesn't return no longer exists there.
+    */
+    class Refetcher : boost::noncopyable {
+    public:
+        Refetcher(const set<DocID>& toRefetch);
+        /* appends the good versions in toRefetch's order */
+        void go(DBClientConnection *them, list< pair<DocID,bo> >& goodVersions);
+    private:
+        enum { RefetchBatchSize = 1000, RefetchConns = 4 };
+        struct Batch { 
+            vector<DocID> ids;
+            vector<bo> good;
+        };
+        void fetch(DBClientBase *conn);
+        void fetchBatch(DBClientBase *conn, Batch& b);
+
+        vector<Batch> _batches;
+
+        mongo::mutex _m; // protects below
+        unsigned _next;  // the next of _batches to fetch
+        unsigned long long _totSize;
+        string _error;   // the first fetch() failure
+    };
+
+    Refetcher::Refetcher(const set<DocID>& toRefetch) : _m("rollbackRefetcher"), _next(0), _totSize(0) {
+        /* toRefetch is ordered by ns, so a collection's documents are adjacent */
+        int bytes = 0;
+        for( set<DocID>::const_iterator i = toRefetch.begin(); i != toRefetch.end(); i++ ) { 
+            assert( !i->_id.eoo() );
+            if( _batches.empty() || _batches.back().ids.size() >= RefetchBatchSize || 
+                bytes > 1024 * 1024 || strcmp(_batches.back().ids[0].ns, i->ns) != 0 ) {
+                _batches.push_back(Batch());
+                bytes = 0;
+            }
+            _batches.back().ids.push_back(*i);
+            bytes += i->_id.size();
+        }
+    }
+
+    void Refetcher::fetchBatch(DBClientBase *conn, Batch& b) { 
+        const char *ns = b.ids[0].ns;
+        BSONObjBuilder q;
+        {
+            BSONObjBuilder id(q.subobjStart("_id"));
+            BSONArrayBuilder in(id.subarrayStart("$in"));
+            for( unsigned i = 0; i < b.ids.size(); i++ )
+                in.append(b.ids[i]._id);
+            in.done();
+            id.done();
+        }
+        auto_ptr<DBClientCursor> c = conn->query(ns, q.obj());
+        uassert(13643, str::stream() << "replSet rollback refetch query failed " << ns, c.get());
+
+        map<bo,bo,BSONObjCmp> found;
+        unsigned long long size = 0;
+        while( c->more() ) { 
+            bo o = c->nextSafe().getOwned();
+            size += o.objsize();
+            found[o["_id"].wrap()] = o;
+        }
+        {
+            scoped_lock lk(_m);
+            _totSize += size;
+            uassert( 13410, "replSet too much data to roll back", _totSize < 300 * 1024 * 1024 );
+        }
+
+        // note a missing one is left empty, indicating we should delete it
+        b.good.resize(b.ids.size());
+        for( unsigned i = 0; i < b.ids.size(); i++ ) { 
+            map<bo,bo,BSONObjCmp>::iterator f = found.find(b.ids[i]._id.wrap());
+            if( f != found.end() )
+                b.good[i] = f->second;
+        }
+
+        scoped_lock lk(rollbackStats.m);
+        rollbackStats.refetched += b.ids.size();
+    }
+
+    /* on each connection's thread: fetch batches until there are none left */
+    void Refetcher::fetch(DBClientBase *conn) { 
+        try {
+            while( 1 ) { 
+                Batch *b;
+                {
+                    scoped_lock lk(_m);
+                    if( _next == _batches.size() || !_error.empty() )
+                        break;
+                    b = &_batches[_next++];
+                }
+                fetchBatch(conn, *b);
+            }
+        }
+        catch(DBException& e) { 
+            scoped_lock lk(_m);
+            if( _error.empty() )
+                _error = e.toString();
+        }
+    }
+
+    void Refetcher::go(DBClientConnection *them, list< pair<DocID,bo> >& goodVersions) { 
+        {
+            scoped_lock lk(rollbackStats.m);
+            rollbackStats.toRefetch = 0;
+            for( unsigned i = 0; i < _batches.size(); i++ )
+                rollbackStats.toRefetch += _batches[i].ids.size();
+            rollbackStats.refetched = 0;
+            rollbackStats.applied = 0;
+        }
+
+        /* more connections, authenticated here as we hold the write lock replAuthenticate wants */
+        vector< shared_ptr<DBClientConnection> > conns;
+        unsigned nConns = _batches.size() < (unsigned) RefetchConns ? _batches.size() : RefetchConns;
+        for( unsigned i = 1; i < nConns; i++ ) { 
+            shared_ptr<DBClientConnection> c(new DBClientConnection(false, 0, 0));
+            string errmsg;
+            if( !c->connect(them->getServerAddress(), errmsg) || !replAuthenticate(c.get()) ) { 
+                log() << "replSet rollback refetching on fewer connections, couldn't connect: " << errmsg << rsLog;
+                break;
+            }
+            conns.push_back(c);
+        }
+
+        {
+            boost::thread_group threads;
+            for( unsigned i = 0; i < conns.size(); i++ )
+                threads.create_thread( boost::bind( &Refetcher::fetch , this , conns[i].get() ) );
+            fetch(them);
+            threads.join_all();
+        }
+        if( !_error.empty() )
+            uasserted(13644, "replSet rollback refetch failed: " + _error);
+
+        for( unsigned i = 0; i < _batches.size(); i++ ) { 
+            Batch& b = _batches[i];
+            for( unsigned j = 0; j < b.ids.size(); j++ )
+                goodVersions.push_back(pair<DocID,bo>(b.ids[j], b.good[j]));
+        }
+    }
+
     static void setMinValid(bo newMinValid) { 
        try {
            log() << "replSet minvalid=" << newMinValid["ts"]._opTime().toStringLong() << rsLog;
@@ -320,32 +480,13 @@ namespace mongo {
 
        // fetch all first so we needn't handle interruption in a fancy way
 
-       unsigned long long totSize = 0;
-
        list< pair<DocID,bo> > goodVersions;
 
        bo newMinValid;
 
        /* fetch all the goodVersions of each document from current primary */
-       DocID d;
-       unsigned long long n = 0;
        try {
-           for( set<DocID>::iterator i = h.toRefetch.begin(); i != h.toRefetch.end(); i++ ) { 
-               d = *i;
-
-               assert( !d._id.eoo() );
-
-               {
-                   /* TODO : slow.  lots of round trips. */
-                   n++;
-                   bo good= them->findOne(d.ns, d._id.wrap()).getOwned();
-                   totSize += good.objsize();
-                   uassert( 13410, "replSet too much data to roll back", totSize < 300 * 1024 * 1024 );
-
-                   // note good might be eoo, indicating we should delete it
-                   goodVersions.push_back(pair<DocID,bo>(d,good));
-               }
-           }
+           Refetcher(h.toRefetch).go(them, goodVersions);
            newMinValid = r.getLastOp(rsoplog);
            if( newMinValid.isEmpty() ) { 
                sethbmsg("rollback error newMinValid empty?");
@@ -354,7 +495,7 @@ namespace mongo {
        }
        catch(DBException& e) {
            sethbmsg(str::stream() << "rollback re-get objects: " << e.toString(),0);
-           log() << "rollback couldn't re-get ns:" << d.ns << " _id:" << d._id << ' ' << n << '/' << h.toRefetch.size() << rsLog;
+           log() << "rollback couldn't re-get the " << h.toRefetch.size() << " objects to roll back" << rsLog;
            throw e;
        }
 
@@ -461,9 +602,15 @@ namespace mongo {
        map<string,shared_ptr<RemoveSaver> > removeSavers;
 
        unsigned deletes = 0, updates = 0;
+       auto_ptr<Client::Context> ctx; // goodVersions is ordered by ns, so one per collection
+       string ctxNs;
        for( list<pair<DocID,bo> >::iterator i = goodVersions.begin(); i != goodVersions.end(); i++ ) {
            const DocID& d = i->first;
            bo pattern = d._id.wrap(); // { _id : ... }
+           {
+               scoped_lock lk(rollbackStats.m);
+               rollbackStats.applied++;
+           }
            try { 
                assert( d.ns && *d.ns );
                if( h.collectionsToResync.count(d.ns) ) {
@@ -476,8 +623,12 @@ namespace mongo {
                if ( ! rs )
                    rs.reset( new RemoveSaver( "rollback" , "" , d.ns ) );
 
-               // todo: lots of overhead in context, this can be faster
-               Client::Context c(d.ns, dbpath, 0, /*doauth*/false);
+               if( ctxNs != d.ns ) { 
+                   ctx.reset(); // first, as contexts nest
+                   ctxNs.clear();
+                   ctx.reset( new Client::Context(d.ns, dbpath, 0, /*doauth*/false) );
+                   ctxNs = d.ns;
+               }
                if( i->second.isEmpty() ) {
                    // wasn't on the primary; delete.
                    /* TODO1.6 : can't delete from a capped collection.  need to handle that here. */
@@ -560,6 +711,7 @@ namespace mongo {
            }
        }
 
+       ctx.reset();
        removeSavers.clear(); // this effectively closes all of them
 
        sethbmsg(str::stream() << "rollback 5 d:" << deletes << " u:" << updates);
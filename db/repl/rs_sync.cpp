@@ -19,6 +19,10 @@
 #include "../../client/dbclient.h"
 #include "rs.h"
 #include "../repl.h"
+#include "../cmdline.h"
+#include "../dbhelpers.h"
+#include "../instance.h"
+#include "rs_optime.h"
 
 namespace mongo {
 
@@ -70,12 +74,41 @@ namespace mongo {
                 return false;
             }
 
-            r.query(rsoplog, bo());
-            assert( r.haveCursor() );
-
             /* we lock outside the loop to avoid the overhead of locking on every operation.  server isn't usable yet anyway! */
             writelock lk("");
 
+            /* first the ops fetched during the clone (see InitialSyncOplogFetcher), then the
+               primary's from the last of those on */
+            unsigned long long n = 0;
+            OpTime buffered;
+            {
+                DBDirectClient c;
+                auto_ptr<DBClientCursor> i = c.query(rsInitialSyncOplog, Query().sort(BSON("_id" << 1)));
+                while( i.get() && i->more() ) {
+                    BSONObj o = i->nextSafe().getObjectField("op");
+                    ts = o["ts"]._opTime();
+                    if( box.getPrimary() != primary )
+                        throw DBException("primary changed",0);
+                    if( ts >= applyGTE )
+                        syncApply(o);
+                    _logOpObjRS(o);
+                    buffered = ts;
+                    if( ++n % 100000 == 0 )
+                        log() << "replSet initialSyncOplogApplication " << n << rsLog;
+                }
+            }
+
+            {
+                BSONObjBuilder q;
+                if( !buffered.isNull() ) {
+                    BSONObjBuilder gte;
+                    gte.appendDate("$gte", buffered.asDate());
+                    q.append("ts", gte.done());
+                }
+                r.query(rsoplog, q.done());
+            }
+            assert( r.haveCursor() );
+
             {
                 if( !r.more() ) { 
                     sethbmsg("replSet initial sync error reading remote oplog");
@@ -83,16 +116,16 @@ namespace mongo {
                 }
                 bo op = r.next();
                 OpTime t = op["ts"]._opTime();
-                r.putBack(op);
                 assert( !t.isNull() );
-                if( t > applyGTE ) {
+                if( buffered.isNull() ? t > applyGTE : t != buffered ) {
                     sethbmsg(str::stream() << "error " << hn << " oplog wrapped during initial sync");
                     return false;
                 }
+                if( buffered.isNull() )
+                    r.putBack(op); // else we have it already
             }
 
             // todo : use exhaust
-            unsigned long long n = 0;
             while( 1 ) { 
 
                 if( !r.more() )
@@ -165,6 +198,304 @@ namespace mongo {
         return golive;
     }
 
+    mongo::mutex ReplSetImpl::_syncApplyMutex("rsSyncApply");
+
+    const unsigned MaxSyncBatch = 1000;
+
+    /* must this op be a sync batch of its own?  commands must, and with --perDbLocking so must ops
+       on the databases it doesn't lock separately */
+    static bool syncBatchable(const BSONObj& op) {
+        const char *opType = op.getStringField("op");
+        if( *opType == 'n' )
+            return true;
+        if( *opType == 'c' )
+            return false;
+        return !cmdLine.perDbLocking || MongoMutex::usesDBLock(op.getStringField("ns"));
+    }
+
+    /* for replSetGetStatus.  outlives each syncTail pass's SyncFetcher */
+    static struct SyncBufferStats {
+        SyncBufferStats() : m("syncBufferStats"), ops(0), bytes(0), fetched(0), fetcherWaitMillis(0), applierWaitMillis(0) { }
+        mongo::mutex m;
+        long long ops;               // in the buffer now
+        long long bytes;
+        long long fetched;           // ever
+        long long fetcherWaitMillis; // waiting for room in the buffer
+        long long applierWaitMillis; // waiting for an op to apply
+    } syncBufferStats;
+
+    void appendSyncBufferStats(BSONObjBuilder& b) {
+        SyncBufferStats& s = syncBufferStats;
+        scoped_lock lk(s.m);
+        b.appendNumber("ops", s.ops);
+        b.appendNumber("bytes", s.bytes);
+        b.appendNumber("fetched", s.fetched);
+        b.appendNumber("fetcherWaitMillis", s.fetcherWaitMillis);
+        b.appendNumber("applierWaitMillis", s.applierWaitMillis);
+    }
+
+    /* Reads the primary's oplog on its own thread into a buffer syncTail applies from, so waiting
+       on the network overlaps applying.  Up to MaxBytes are read ahead.
+    */
+    class SyncFetcher : boost::noncopyable {
+    public:
+        static const long long MaxBytes = 64 * 1024 * 1024;
+
+        /* r has its cursor positioned; we read it until we're destroyed */
+        SyncFetcher(OplogReader& r) : _r(r), _m("syncFetcher"), _bytes(0), _stop(false), _done(false) {
+            _thread.reset( new boost::thread( boost::bind(&SyncFetcher::run, this) ) );
+        }
+        ~SyncFetcher() {
+            {
+                scoped_lock lk(_m);
+                _stop = true;
+                _changed.notify_all();
+            }
+            _thread->join(); // at most an awaitData wait
+            noteBuffer(0, 0);
+        }
+
+        /* the next op, then those following it that are already fetched -- but an op that isn't
+           syncBatchable() is a batch of its own.  waits a second at most.  @return false if none */
+        bool getBatch(vector<BSONObj>& ops, unsigned max);
+
+        /* the cursor is done or failed, and all it returned has been taken */
+        bool finished() {
+            scoped_lock lk(_m);
+            return _done && _q.empty();
+        }
+
+    private:
+        void run();
+        void noteBuffer(long long ops, long long bytes) {
+            scoped_lock lk(syncBufferStats.m);
+            syncBufferStats.ops = ops;
+            syncBufferStats.bytes = bytes;
+        }
+
+        OplogReader& _r;
+        mongo::mutex _m; // protects below
+        boost::condition _changed;
+        deque<BSONObj> _q;
+        long long _bytes;
+        bool _stop;
+        bool _done;
+        auto_ptr<boost::thread> _thread;
+    };
+
+    void SyncFetcher::run() {
+        try {
+            vector<BSONObj> got;
+            while( 1 ) {
+                {
+                    Timer waited;
+                    scoped_lock lk(_m);
+                    while( _bytes >= MaxBytes && !_stop )
+                        _changed.wait(lk.boost());
+                    if( _stop )
+                        break;
+                    scoped_lock s(syncBufferStats.m);
+                    syncBufferStats.fetcherWaitMillis += waited.millis();
+                }
+
+                if( !_r.more() ) { // waits a while on the primary for more, as we are tailing
+                    _r.tailCheck();
+                    if( !_r.haveCursor() )
+                        break;
+                    continue;
+                }
+                got.clear();
+                long long bytes = 0;
+                while( _r.moreInCurrentBatch() ) {
+                    got.push_back( _r.nextSafe().getOwned() ); /* note we might get "not master" at some point */
+                    bytes += got.back().objsize();
+                }
+
+                scoped_lock lk(_m);
+                _q.insert(_q.end(), got.begin(), got.end());
+                _bytes += bytes;
+                _changed.notify_all();
+                noteBuffer(_q.size(), _bytes);
+                scoped_lock s(syncBufferStats.m);
+                syncBufferStats.fetched += got.size();
+            }
+        }
+        catch(DBException& e) {
+            log() << "replSet sync fetcher stopping: " << e.toString() << rsLog;
+        }
+        scoped_lock lk(_m);
+        _done = true;
+        _changed.notify_all();
+    }
+
+    bool SyncFetcher::getBatch(vector<BSONObj>& ops, unsigned max) {
+        Timer waited;
+        scoped_lock lk(_m);
+        if( _q.empty() && !_done ) {
+            boost::xtime xt;
+            boost::xtime_get(&xt, boost::TIME_UTC);
+            xt.sec += 1;
+            while( _q.empty() && !_done ) {
+                if( !_changed.timed_wait(lk.boost(), xt) )
+                    break;
+            }
+            scoped_lock s(syncBufferStats.m);
+            syncBufferStats.applierWaitMillis += waited.millis();
+        }
+        if( _q.empty() )
+            return false;
+
+        do {
+            const BSONObj& o = _q.front();
+            if( !ops.empty() && !syncBatchable(o) )
+                break;
+            ops.push_back(o);
+            _bytes -= o.objsize();
+            _q.pop_front();
+        } while( ops.size() < max && !_q.empty() && syncBatchable(ops.back()) );
+        _changed.notify_all();
+        noteBuffer(_q.size(), _bytes);
+        return true;
+    }
+
+    static int syncApplyThreads() {
+        int n = cmdLine.replApplyThreads;
+        if( n == 0 ) {
+            n = boost::thread::hardware_concurrency();
+            n = n < 1 ? 1 : min(n, 8);
+        }
+        return n;
+    }
+
+    /* the workers applying a batch's parts, see syncApplyBatch() */
+    static ThreadPool& syncApplyPool() {
+        static ThreadPool *pool = 0; // only the sync thread gets here
+        if( pool == 0 )
+            pool = new ThreadPool(syncApplyThreads());
+        return *pool;
+    }
+
+    /* syncApplyPool() threads act for the sync thread */
+    static void initSyncApplyThread() {
+        if( !haveClient() ) {
+            Client::initThread("rsSyncApply");
+            cc().iAmSyncThread();
+        }
+    }
+
+    static void prefetchSyncOps(const vector<BSONObj> *ops, unsigned a, unsigned b) {
+        initSyncApplyThread();
+        for( unsigned i = a; i < b; i++ )
+            prefetchPagesForReplicatedOp((*ops)[i]);
+    }
+
+    /* page in what a batch will touch before we write lock to apply it, a part per
+       syncApplyPool() thread so the faults overlap */
+    static void prefetchSyncBatch(const vector<BSONObj>& ops) {
+        if( cmdLine.replIndexPrefetch == CmdLine::PrefetchNone )
+            return;
+        if( ops.size() == 1 ) {
+            prefetchPagesForReplicatedOp(ops[0]);
+            return;
+        }
+        ThreadPool& pool = syncApplyPool();
+        unsigned n = syncApplyThreads();
+        unsigned per = ( ops.size() + n - 1 ) / n;
+        for( unsigned a = 0; a < ops.size(); a += per )
+            pool.schedule(prefetchSyncOps, &ops, a, min<unsigned>(a + per, ops.size()));
+        pool.join();
+    }
+
+    struct SyncApplyErrors {
+        SyncApplyErrors() : m("syncApplyErrors"), failed(false) { }
+        mongo::mutex m;
+        bool failed;
+        ExceptionInfo first;
+    };
+
+    /* on a syncApplyPool() thread: one database's ops from a batch, under that database's lock */
+    void ReplSetImpl::syncApplyPart(const vector<BSONObj> *ops, SyncApplyErrors *errors) {
+        initSyncApplyThread();
+        try {
+            writelock lk((*ops)[0].getStringField("ns"));
+            for( unsigned i = 0; i < ops->size(); i++ )
+                syncApply((*ops)[i]);
+        }
+        catch( DBException& e ) {
+            scoped_lock lk(errors->m);
+            if( !errors->failed ) {
+                errors->failed = true;
+                errors->first = e.getInfo();
+            }
+        }
+    }
+
+    /* apply a batch from SyncFetcher::getBatch() and write it to our oplog.
+
+       With --perDbLocking a batch that touches several databases is split by database and the parts
+       applied at once on syncApplyPool(), each under its own database's lock.  A database's ops --
+       and so each document's -- stay in oplog order.  Writers to one database can't share it, so
+       that is as fine as the split goes.  Otherwise the batch is applied in order under one lock.
+
+       Either way the ops are logged only after the whole batch is applied, so after a crash we
+       resume from the start of the batch.  Ops are idempotent, so reapplying is fine; but a split
+       batch can leave some databases ahead of others, so minvalid is first moved to the batch's
+       end, and until we get back there we are not a usable secondary.
+
+       @return false if we have become primary, in which case nothing was applied
+    */
+    bool ReplSetImpl::syncApplyBatch(const vector<BSONObj>& ops, const Member *primary) {
+        prefetchSyncBatch(ops);
+
+        scoped_lock applying(_syncApplyMutex); // assumePrimary() waits for us
+
+        map< string, vector<BSONObj> > parts; // by database
+        if( cmdLine.perDbLocking && ops.size() > 1 ) {
+            for( unsigned i = 0; i < ops.size(); i++ ) {
+                if( *ops[i].getStringField("op") == 'n' )
+                    continue;
+                parts[ nsToDatabase(ops[i].getStringField("ns")) ].push_back(ops[i]);
+            }
+        }
+
+        if( parts.size() > 1 ) {
+            if( box.getPrimary() != primary )
+                return false;
+            {
+                writelock lk("local.");
+                Client::Context cx("local.");
+                Helpers::putSingleton("local.replset.minvalid", ops.back());
+            }
+
+            SyncApplyErrors errors;
+            ThreadPool& pool = syncApplyPool();
+            for( map< string, vector<BSONObj> >::iterator i = parts.begin(); i != parts.end(); ++i )
+                pool.schedule(boost::bind(&ReplSetImpl::syncApplyPart, this, &i->second, &errors));
+            pool.join();
+            if( errors.failed )
+                uasserted(errors.first.code, errors.first.msg);
+
+            writelock lk("");
+            for( unsigned i = 0; i < ops.size(); i++ )
+                _logOpObjRS(ops[i]);
+            return true;
+        }
+
+        writelock lk("");
+
+        /* if we have become primary, we dont' want to apply things from elsewhere
+           anymore. assumePrimary is in the db lock so we are safe as long as 
+           we check after we locked above. */
+        if( box.getPrimary() != primary )
+            return false;
+
+        for( unsigned i = 0; i < ops.size(); i++ ) {
+            syncApply(ops[i]);
+            _logOpObjRS(ops[i]);   /* with repl sets we write the ops to our oplog too: */
+        }
+        return true;
+    }
+
     /* tail the primary's oplog.  ok to return, will be re-called. */
     void ReplSetImpl::syncTail() { 
         // todo : locking vis a vis the mgr...
@@ -259,89 +590,79 @@ namespace mongo {
             tryToGoLiveAsASecondary(minvalid);
         }
 
+        /* from here on only the fetcher reads r */
+        SyncFetcher fetcher(r);
         while( 1 ) {
-            while( 1 ) {
-                if( !r.moreInCurrentBatch() ) { 
-                    /* we need to occasionally check some things. between 
-                       batches is probably a good time. */
-
-                    /* perhaps we should check this earlier? but not before the rollback checks. */
-                    if( state().recovering() ) { 
-                        /* can we go to RS_SECONDARY state?  we can if not too old and if minvalid achieved */
-                        OpTime minvalid;
-                        bool golive = ReplSetImpl::tryToGoLiveAsASecondary(minvalid);
-                        if( golive ) {
-                            ;
-                        }
-                        else { 
-                            sethbmsg(str::stream() << "still syncing, not yet to minValid optime" << minvalid.toString());
-                        }
-
-                        /* todo: too stale capability */
+            { 
+                /* we need to occasionally check some things. between 
+                   batches is probably a good time. */
+
+                /* perhaps we should check this earlier? but not before the rollback checks. */
+                if( state().recovering() ) { 
+                    /* can we go to RS_SECONDARY state?  we can if not too old and if minvalid achieved */
+                    OpTime minvalid;
+                    bool golive = ReplSetImpl::tryToGoLiveAsASecondary(minvalid);
+                    if( golive ) {
+                        ;
+                    }
+                    else { 
+                        sethbmsg(str::stream() << "still syncing, not yet to minValid optime" << minvalid.toString());
                     }
 
-                    if( box.getPrimary() != primary ) 
-                        return;
+                    /* todo: too stale capability */
                 }
-                if( !r.more() )
-                    break;
-                { 
-                    BSONObj o = r.nextSafe(); /* note we might get "not master" at some point */
-                    {
-                        writelock lk("");
-
-                        /* if we have become primary, we dont' want to apply things from elsewhere
-                           anymore. assumePrimary is in the db lock so we are safe as long as 
-                           we check after we locked above. */
-                        if( box.getPrimary() != primary ) {
-                            if( box.getState().primary() )
-                                log(0) << "replSet stopping syncTail we are now primary" << rsLog;
-                            return;
-                        }
 
-                        syncApply(o);
-                        _logOpObjRS(o);   /* with repl sets we write the ops to our oplog too: */                   
-                    }
-                    int sd = myConfig().slaveDelay;
-                    if( sd ) { 
-                        const OpTime ts = o["ts"]._opTime();
-                        long long a = ts.getSecs();
-                        long long b = time(0);
-                        long long lag = b - a;
-                        long long sleeptime = sd - lag;
-                        if( sleeptime > 0 ) {
-                            uassert(12000, "rs slaveDelay differential too big check clocks and systems", sleeptime < 0x40000000);
-                            log() << "replSet temp slavedelay sleep:" << sleeptime << rsLog;
-                            if( sleeptime < 60 ) {
-                                sleepsecs((int) sleeptime);
-                            }
-                            else {
-                                // sleep(hours) would prevent reconfigs from taking effect & such!
-                                long long waitUntil = b + sleeptime;
-                                while( 1 ) {
-                                    sleepsecs(6);
-                                    if( time(0) >= waitUntil )
-                                        break;
-                                    if( box.getPrimary() != primary )
-                                        break;
-                                    if( myConfig().slaveDelay != sd ) // reconf
-                                        break;
-                                }
+                if( box.getPrimary() != primary ) 
+                    return;
+            }
+            { 
+                /* with a slaveDelay we sleep between ops, so take them one at a time */
+                vector<BSONObj> ops;
+                if( !fetcher.getBatch(ops, myConfig().slaveDelay ? 1 : MaxSyncBatch) ) {
+                    if( fetcher.finished() )
+                        break;
+                    continue;
+                }
+                if( !syncApplyBatch(ops, primary) ) {
+                    if( box.getState().primary() )
+                        log(0) << "replSet stopping syncTail we are now primary" << rsLog;
+                    return;
+                }
+                BSONObj o = ops.back();
+                int sd = myConfig().slaveDelay;
+                if( sd ) { 
+                    const OpTime ts = o["ts"]._opTime();
+                    long long a = ts.getSecs();
+                    long long b = time(0);
+                    long long lag = b - a;
+                    long long sleeptime = sd - lag;
+                    if( sleeptime > 0 ) {
+                        uassert(12000, "rs slaveDelay differential too big check clocks and systems", sleeptime < 0x40000000);
+                        log() << "replSet temp slavedelay sleep:" << sleeptime << rsLog;
+                        if( sleeptime < 60 ) {
+                            sleepsecs((int) sleeptime);
+                        }
+                        else {
+                            // sleep(hours) would prevent reconfigs from taking effect & such!
+                            long long waitUntil = b + sleeptime;
+                            while( 1 ) {
+                                sleepsecs(6);
+                                if( time(0) >= waitUntil )
+                                    break;
+                                if( box.getPrimary() != primary )
+                                    break;
+                                if( myConfig().slaveDelay != sd ) // reconf
+                                    break;
                             }
                         }
                     }
                 }
             }
-            r.tailCheck();
-            if( !r.haveCursor() ) {
-                log(1) << "replSet end syncTail pass with " << hn << rsLog;
-                // TODO : reuse our connection to the primary.
-                return;
-            }
-            if( box.getPrimary() != primary )
-                return;
-            // looping back is ok because this is a tailable cursor
         }
+
+        /* the fetcher finished: its cursor died, or it failed */
+        log(1) << "replSet end syncTail pass with " << hn << rsLog;
+        // TODO : reuse our connection to the primary.
     }
 
     void ReplSetImpl::_syncThread() {
@@ -0,0 +1,155 @@
+/* scanandorder.cpp
+   Order results (that aren't already indexes and in order.)
+*/
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "jsobj.h"
+#include "diskloc.h"
+#include "queryutil.h"
+#include "scanandorder.h"
+#include "extsort.h"
+
+namespace mongo {
+
+    ScanAndOrder::ScanAndOrder(int startFrom, int limit, BSONObj order, unsigned maxInMemory) :
+        _startFrom(startFrom), _order(order), _maxInMemory(maxInMemory), _approxSize(0), _spilledSize(0), _seq(0), _nKept(0) {
+        _limit = limit > 0 ? limit + startFrom : 0x7fffffff;
+    }
+
+    ScanAndOrder::~ScanAndOrder() { }
+
+    static const int MaxReplySize = 4000000; // appserver limit
+
+    static const char *tooMuchData = "too much data for sort() with no index.  add an index or specify a smaller limit";
+
+    bool ScanAndOrder::replyFits(long long keptSize) const {
+        // all but those skipped go in the reply, at about the average size of those kept
+        return _nKept <= _startFrom || ( _nKept - _startFrom ) * ( keptSize / _nKept ) <= MaxReplySize;
+    }
+
+    void ScanAndOrder::add(BSONObj o, DiskLoc* loc) {
+        assert( o.isValid() );
+        Item i;
+        i.key = _order.getKeyFromObject(o);
+        if ( (int) _best.size() >= _limit ) {
+            // full: only a strictly better key displaces the worst kept
+            if ( _best.front().key.woCompare(i.key, _order.pattern) <= 0 )
+                return;
+            pop_heap(_best.begin(), _best.end(), ItemLess(_order.pattern));
+            _approxSize -= _best.back().key.objsize() + _best.back().obj.objsize();
+            _best.pop_back();
+            _nKept--;
+        }
+
+        i.key = i.key.getOwned();
+        if ( !loc ) {
+            i.obj = o.getOwned();
+        }
+        else {
+            BSONObjBuilder b;
+            b.appendElements(o);
+            b.append("$diskLoc", loc->toBSONObj());
+            i.obj = b.obj();
+        }
+        i.seq = _seq++;
+        _nKept++;
+
+        if ( _sorter.get() ) {
+            spill(i);
+            if ( _limit == 0x7fffffff ) {
+                _spilledSize += i.obj.objsize();
+                uassert( 10128 , tooMuchData , replyFits( _spilledSize ) );
+                return;
+            }
+            // the sorter can't drop what it has, so the heap goes on choosing the best by key
+            i.obj = BSONObj();
+        }
+        _best.push_back(i);
+        push_heap(_best.begin(), _best.end(), ItemLess(_order.pattern));
+        _approxSize += i.key.objsize() + i.obj.objsize();
+        if ( !_sorter.get() && _approxSize > _maxInMemory )
+            spill();
+    }
+
+    /* the sorter orders by its keys alone, so each key carries its document after the fields
+       sorted on, with seq between them to keep it stable */
+    void ScanAndOrder::spill(const Item& i) {
+        BSONObjBuilder b( i.key.objsize() + i.obj.objsize() + 32 );
+        b.appendElements( i.key );
+        b.append( "$seq" , i.seq );
+        b.append( "$obj" , i.obj );
+        _sorter->add( b.obj() , DiskLoc() );
+    }
+
+    void ScanAndOrder::spill() {
+        // no sense sorting on disk what the reply can't hold
+        uassert( 10128 , tooMuchData , replyFits( _approxSize ) );
+        log(1) << "scanAndOrder: " << _nKept << " documents, about " << _approxSize << " bytes, going to an external sort" << endl;
+        _sorter.reset( new BSONObjExternalSorter( _order.pattern , _maxInMemory ) );
+        for ( vector<Item>::iterator i = _best.begin(); i != _best.end(); i++ )
+            spill( *i );
+        _spilledSize = _approxSize;
+        _approxSize = 0;
+        if ( _limit == 0x7fffffff ) {
+            vector<Item>().swap( _best );
+            return;
+        }
+        // with a limit just the keys stay, to tell which later documents are among the best
+        for ( vector<Item>::iterator i = _best.begin(); i != _best.end(); i++ ) {
+            i->obj = BSONObj();
+            _approxSize += i->key.objsize();
+        }
+    }
+
+    bool ScanAndOrder::put(BufBuilder& b, FieldMatcher *filter, BSONObj& o, int& nout) {
+        fillQueryResultFromObj(b, filter, o);
+        nout++;
+        if ( nout >= _limit - _startFrom )
+            return false;
+        uassert( 10129 ,  "too much data for sort() with no index", b.len() < MaxReplySize );
+        return true;
+    }
+
+    void ScanAndOrder::fill(BufBuilder& b, FieldMatcher *filter, int& nout) {
+        nout = 0;
+        int n = 0;
+        if ( !_sorter.get() ) {
+            sort_heap(_best.begin(), _best.end(), ItemLess(_order.pattern));
+            for ( vector<Item>::iterator i = _best.begin(); i != _best.end(); i++ ) {
+                if ( ++n <= _startFrom )
+                    continue;
+                if ( !put(b, filter, i->obj, nout) )
+                    break;
+            }
+            return;
+        }
+
+        _sorter->sort();
+        auto_ptr<BSONObjExternalSorter::Iterator> i = _sorter->iterator();
+        while ( i->more() ) {
+            BSONObj e = i->next().first;
+            if ( ++n <= _startFrom )
+                continue;
+            BSONObj o = e["$obj"].embeddedObject();
+            if ( !put(b, filter, o, nout) )
+                break;
+        }
+    }
+
+}
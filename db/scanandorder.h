@@ -44,12 +44,6 @@ namespace mongo {
         }
     };
 
-    /* todo:
-       _ respect limit
-       _ check for excess mem usage
-       _ response size limit from runquery; push it up a bit.
-    */
-
     inline void fillQueryResultFromObj(BufBuilder& bb, FieldMatcher *filter, BSONObj& js, DiskLoc* loc=NULL) {
         if ( filter ) {
             BSONObjBuilder b( bb );
@@ -78,90 +72,72 @@ namespace mongo {
         }
     }
     
-    typedef multimap<BSONObj,BSONObj,BSONObjCmp> BestMap;
-    class ScanAndOrder {
-        BestMap best; // key -> full object
-        int startFrom;
-        int limit;   // max to send back.
-        KeyType order;
-        unsigned approxSize;
-
-        void _add(BSONObj& k, BSONObj o, DiskLoc* loc) {
-            if (!loc){
-                best.insert(make_pair(k.getOwned(),o.getOwned()));
-            } else {
-                BSONObjBuilder b;
-                b.appendElements(o);
-                b.append("$diskLoc", loc->toBSONObj());
-                best.insert(make_pair(k.getOwned(), b.obj().getOwned()));
-            }
-        }
-
-        void _addIfBetter(BSONObj& k, BSONObj o, BestMap::iterator i, DiskLoc* loc) {
-            /* todo : we don't correct approxSize here. */
-            const BSONObj& worstBestKey = i->first;
-            int c = worstBestKey.woCompare(k, order.pattern);
-            if ( c > 0 ) {
-                // k is better, 'upgrade'
-                best.erase(i);
-                _add(k, o, loc);
-            }
-        }
-
+    class BSONObjExternalSorter;
+
+    /* Orders the documents a query matched when no index gives the order.  With a limit only the
+       best startFrom+limit are kept, in a heap with the worst on top.  If what is kept outgrows
+       maxInMemory bytes it all goes to an external sort, which spills to files under dbpath/_tmp,
+       and so does everything added after -- with a limit, only if the heap, now of keys alone,
+       says it is among the best.
+
+       The sorted result is not streamed across getMore: an in-memory sort leaves no cursor, so
+       all of it must fit in one reply (MaxReplySize).  Spilling therefore only bounds memory for
+       sorts that return a small part of what they order -- a large skip, or a limit whose best
+       outgrow maxInMemory.  A sort whose result exceeds one reply fails with 10128 as before,
+       and rather than spill or go on spilling when its result plainly can't fit, add() fails
+       early.  Such queries still need an index on the sort fields.
+    */
+    class ScanAndOrder : boost::noncopyable {
     public:
-        ScanAndOrder(int _startFrom, int _limit, BSONObj _order) :
-                best( BSONObjCmp( _order ) ),
-                startFrom(_startFrom), order(_order) {
-            limit = _limit > 0 ? _limit + startFrom : 0x7fffffff;
-            approxSize = 0;
-        }
-
-        int size() const {
-            return best.size();
-        }
+        enum { DefaultMaxInMemory = 32 * 1024 * 1024 };
 
-        void add(BSONObj o, DiskLoc* loc) {
-            assert( o.isValid() );
-            BSONObj k = order.getKeyFromObject(o);
-            if ( (int) best.size() < limit ) {
-                approxSize += k.objsize();
-                approxSize += o.objsize();
+        ScanAndOrder(int startFrom, int limit, BSONObj order, unsigned maxInMemory = DefaultMaxInMemory);
+        ~ScanAndOrder();
 
-                /* note : adjust when bson return limit adjusts. note this limit should be a bit higher. */
-                uassert( 10128 ,  "too much data for sort() with no index.  add an index or specify a smaller limit", approxSize < 32 * 1024 * 1024 );
+        /* number of documents kept */
+        int size() const { return _nKept; }
 
-                _add(k, o, loc);
-                return;
-            }
-            BestMap::iterator i;
-            assert( best.end() != best.begin() );
-            i = best.end();
-            i--;
-            _addIfBetter(k, o, i, loc);
-        }
-
-        void _fill(BufBuilder& b, FieldMatcher *filter, int& nout, BestMap::iterator begin, BestMap::iterator end) {
-            int n = 0;
-            int nFilled = 0;
-            for ( BestMap::iterator i = begin; i != end; i++ ) {
-                n++;
-                if ( n <= startFrom )
-                    continue;
-                BSONObj& o = i->second;
-                fillQueryResultFromObj(b, filter, o);
-                nFilled++;
-                if ( nFilled >= limit )
-                    break;
-                uassert( 10129 ,  "too much data for sort() with no index", b.len() < 4000000 ); // appserver limit
-            }
-            nout = nFilled;
-        }
+        void add(BSONObj o, DiskLoc* loc);
 
         /* scanning complete. stick the query result in b for n objects. */
-        void fill(BufBuilder& b, FieldMatcher *filter, int& nout) {
-            _fill(b, filter, nout, best.begin(), best.end());
-        }
-
+        void fill(BufBuilder& b, FieldMatcher *filter, int& nout);
+
+        bool spilled() const { return _sorter.get() != 0; }
+
+    private:
+        struct Item {
+            BSONObj key;
+            BSONObj obj;
+            long long seq; // equal keys keep the order they were added in
+        };
+        class ItemLess {
+        public:
+            ItemLess( const BSONObj& order ) : _order( order ) { }
+            bool operator()( const Item& l , const Item& r ) const {
+                int c = l.key.woCompare( r.key , _order );
+                return c ? c < 0 : l.seq < r.seq;
+            }
+        private:
+            BSONObj _order;
+        };
+
+        void spill();
+        void spill(const Item& i);
+        /* @return false if what's kept, keptSize bytes in all, looks too big for one reply */
+        bool replyFits(long long keptSize) const;
+        /* @return false when no more are wanted */
+        bool put(BufBuilder& b, FieldMatcher *filter, BSONObj& o, int& nout);
+
+        vector<Item> _best; // a heap, the worst kept on top
+        int _startFrom;
+        int _limit;   // max to keep, including those skipped
+        KeyType _order;
+        unsigned _maxInMemory;
+        unsigned _approxSize;
+        long long _spilledSize; // bytes sent to the sorter, kept up only with no limit
+        long long _seq;
+        int _nKept;
+        auto_ptr<BSONObjExternalSorter> _sorter;
     };
 
 } // namespace mongo
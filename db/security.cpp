@@ -23,6 +23,7 @@
 #include "curop.h"
 #include "db.h"
 #include "dbhelpers.h"
+#include "cmdline.h"
 
 namespace mongo {
 
@@ -39,23 +40,42 @@ namespace mongo {
     }
 
 
+    bool AuthenticationInfo::_noUsers() {
+        atleastreadlock l(""); 
+        Client::GodScope gs;
+        Client::Context c("admin.system.users");
+        BSONObj result;
+        if( Helpers::getSingleton("admin.system.users", result) )
+            return false;
+        if( warned == 0 ) {
+            warned++;
+            log() << "note: no users configured in admin.system.users, allowing localhost access" << endl;
+        }
+        return true;
+    }
+
+    void AuthenticationInfo::startRequest() {
+        _localHostNoUsers = false;
+        if ( noauth || !isLocalHost || !cmdLine.perDbLocking || dbMutex.atLeastReadLocked() )
+            return;
+        {
+            scoped_lock lk(_lock);
+            if ( m["admin"].level >= 2 )
+                return; // never gets to the special checks
+        }
+        _localHostNoUsers = _noUsers();
+    }
+
     bool AuthenticationInfo::_isAuthorizedSpecialChecks( const string& dbname ) {
         if ( cc().isGod() ){
             return true;
         }
         
         if ( isLocalHost ){
-            atleastreadlock l(""); 
-            Client::GodScope gs;
-            Client::Context c("admin.system.users");
-            BSONObj result;
-            if( ! Helpers::getSingleton("admin.system.users", result) ){
-                if( warned == 0 ) {
-                    warned++;
-                    log() << "note: no users configured in admin.system.users, allowing localhost access" << endl;
-                }
-                return true;
-            }
+            // admin can't be locked under another database's lock: use what startRequest() found
+            if ( dbMutex.lockedDB() )
+                return _localHostNoUsers;
+            return _noUsers();
         }
         return false;
     }
@@ -38,7 +38,7 @@ namespace mongo {
 		static int warned;
     public:
 		bool isLocalHost;
-        AuthenticationInfo() : _lock("AuthenticationInfo") { isLocalHost = false; }
+        AuthenticationInfo() : _lock("AuthenticationInfo") { isLocalHost = false; _localHostNoUsers = false; _haveNonce = false; }
         ~AuthenticationInfo() {
         }
         void logout(const string& dbname ) { 
@@ -59,6 +59,22 @@ namespace mongo {
         
         void print();
 
+        /** the nonce from this connection's last getnonce, for its next authenticate.  here rather
+            than in a thread local as with --workers a connection's requests run on any thread. */
+        void setNonce( nonce n ) { _nonce = n; _haveNonce = true; }
+        /** @return false if there was none.  either way, authenticate can't use it again. */
+        bool takeNonce( nonce& n ) {
+            bool had = _haveNonce;
+            n = _nonce;
+            _haveNonce = false;
+            return had;
+        }
+
+        /** call at the start of each request, before any lock is taken.  with --perDbLocking the
+            localhost check can't read admin.system.users once a database lock is held, so it is
+            done here instead and the answer used for the rest of the request. */
+        void startRequest();
+
     protected:
         bool _isAuthorized(const string& dbname, int level) { 
             if( m[dbname].level >= level ) return true;
@@ -69,6 +85,13 @@ namespace mongo {
         }
 
         bool _isAuthorizedSpecialChecks( const string& dbname );
+
+        /** @return true if admin.system.users is empty.  must not hold a database lock. */
+        bool _noUsers();
+
+        bool _localHostNoUsers; // set by startRequest()
+        nonce _nonce;
+        bool _haveNonce;
     };
 
 } // namespace mongo
@@ -44,8 +44,6 @@ namespace mongo {
    where <key> is md5(<nonce_str><username><pwd_digest_str>) as a string
 */
 
-    boost::thread_specific_ptr<nonce> lastNonce;
-
     class CmdGetNonce : public Command {
     public:
         virtual bool requiresAuth() { return false; }
@@ -57,11 +55,11 @@ namespace mongo {
         virtual LockType locktype() const { return NONE; }
         CmdGetNonce() : Command("getnonce") {}
         bool run(const string&, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl) {
-            nonce *n = new nonce(security.getNonce());
+            nonce n = security.getNonce();
             stringstream ss;
-            ss << hex << *n;
+            ss << hex << n;
             result.append("nonce", ss.str() );
-            lastNonce.reset(n);
+            cc().getAuthenticationInfo()->setNonce(n);
             return true;
         }
     } cmdGetNonce;
@@ -116,12 +114,12 @@ namespace mongo {
 
             {
                 bool reject = false;
-                nonce *ln = lastNonce.release();
-                if ( ln == 0 ) {
+                nonce ln;
+                if ( ! cc().getAuthenticationInfo()->takeNonce(ln) ) {
                     reject = true;
                     log(1) << "auth: no lastNonce" << endl;
                 } else {
-                    digestBuilder << hex << *ln;
+                    digestBuilder << hex << ln;
                     reject = digestBuilder.str() != received_nonce;
                     if ( reject ) log(1) << "auth: different lastNonce" << endl;
                 }
@@ -762,6 +762,9 @@ namespace mongo {
                 massert( 13339, "cursor dropped during update", false );
             }
         }     
+        virtual Record* recordToLoad() {
+            return _c.get() ? _c->recordToLoad() : 0;
+        }
         virtual long long nscanned() {
             assert( _c.get() );
             return _c->nscanned();
@@ -830,6 +833,7 @@ namespace mongo {
             auto_ptr<ModSetState> mss = mods->prepare( onDisk );
                     
             if( mss->canApplyInPlace() ) {
+                dur::writingPtr( (void*) onDisk.objdata() , onDisk.objsize() );
                 mss->applyModsInPlace();                    
                 DEBUGUPDATE( "\t\t\t updateById doing in place update" );
                 /*if ( profile )
@@ -934,7 +938,23 @@ namespace mongo {
             nscanned++;
 
             bool atomic = c->matcher()->docMatcher().atomic();
-                
+
+            if ( multi && ! atomic ){
+                // don't hold the write lock while the next document comes in from disk.  not worth
+                // registering a ClientCursor for a single document update.
+                if ( cc.get() == 0 ) {
+                    shared_ptr< Cursor > cPtr = c;
+                    cc.reset( new ClientCursor( QueryOption_NoCursorTimeout , cPtr , ns ) );
+                }
+                if ( ! cc->yieldIfPageFaultLikely() ){
+                    cc.release();
+                    break;
+                }
+                if ( !c->ok() ) {
+                    break;
+                }
+            }
+
             // May have already matched in UpdateOp, but do again to get details set correctly
             if ( ! c->matcher()->matches( c->currKey(), c->currLoc(), &details ) ){
                 c->advance();
@@ -1022,6 +1042,7 @@ namespace mongo {
                 }
                     
                 if ( modsIsIndexed <= 0 && mss->canApplyInPlace() ){
+                    dur::writingPtr( (void*) onDisk.objdata() , onDisk.objsize() );
                     mss->applyModsInPlace();// const_cast<BSONObj&>(onDisk) );
                     
                     DEBUGUPDATE( "\t\t\t doing in place update" );
@@ -24,6 +24,7 @@
 #include "../util/array.h"
 #include "../util/text.h"
 #include "../util/queue.h"
+#include "../util/compress.h"
 
 namespace BasicTests {
 
@@ -527,6 +528,50 @@ namespace BasicTests {
         }
     };
 
+    class CompressTests {
+    public:
+        void roundTrip( const string& s ){
+            string z;
+            compress::block( s.data() , s.size() , z );
+            vector<char> out( s.size() + 1 );
+            ASSERT( compress::unblock( z.data() , z.size() , &out[0] , s.size() ) );
+            ASSERT_EQUALS( s , string( &out[0] , s.size() ) );
+            // the length must match exactly
+            ASSERT( s.empty() || !compress::unblock( z.data() , z.size() , &out[0] , s.size() - 1 ) );
+        }
+
+        void run(){
+            roundTrip( "" );
+            roundTrip( "e" );
+            roundTrip( "eliot" );
+            roundTrip( string( 1000 , 'a' ) );
+
+            // oplog entries repeat field names and namespaces
+            BufBuilder b;
+            for ( int i=0; i<500; i++ ){
+                BSONObj o = BSON( "ts" << i << "h" << (long long) i * 7919 << "op" << "u" << "ns" << "test.foo"
+                                  << "o2" << BSON( "_id" << i ) << "o" << BSON( "$set" << BSON( "count" << i ) ) );
+                b.appendBuf( o.objdata() , o.objsize() );
+            }
+            string ops( b.buf() , b.len() );
+            roundTrip( ops );
+            string z;
+            compress::block( ops.data() , ops.size() , z );
+            ASSERT( z.size() * 3 < ops.size() );
+
+            string random;
+            for ( int i=0; i<10000; i++ )
+                random += (char) rand();
+            roundTrip( random );
+
+            // truncated input is refused
+            z.clear();
+            compress::block( ops.data() , ops.size() , z );
+            vector<char> out( ops.size() );
+            ASSERT( !compress::unblock( z.data() , z.size() - 1 , &out[0] , ops.size() ) );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "basic" ){
@@ -556,6 +601,8 @@ namespace BasicTests {
             add< IsValidUTF8Test >();
 
             add< QueueTest >();
+
+            add< CompressTests >();
         }
     } myall;
     
@@ -21,6 +21,7 @@
 
 #include "../db/db.h"
 #include "../db/btree.h"
+#include "../db/key.h"
 
 #include "dbtests.h"
 
@@ -32,8 +33,11 @@ namespace BtreeTests {
     
     class Ensure {
     public:
-        Ensure() {
-            _c.ensureIndex( ns(), BSON( "a" << 1 ), false, "testIndex" );
+        Ensure( int version = 0 ) {
+            if ( version == 0 )
+                _c.ensureIndex( ns(), BSON( "a" << 1 ), false, "testIndex" );
+            else
+                _c.insert( "unittests.system.indexes", BSON( "ns" << ns() << "key" << BSON( "a" << 1 ) << "name" << "testIndex" << "v" << version ) );
         }
         ~Ensure() {
             _c.dropIndexes( ns() );
@@ -44,7 +48,8 @@ namespace BtreeTests {
     
     class Base : public Ensure {
     public:
-        Base() : 
+        Base( int version = 0 ) : 
+            Ensure( version ),
             _context( ns() ) {            
             {
                 bool f = false;
@@ -367,6 +372,123 @@ namespace BtreeTests {
         }
     };
     
+    class CompactKeyRoundTrip {
+    public:
+        void run() {
+            BSONObjBuilder b;
+            b.append( "", 5 );
+            b.append( "", -70000 );
+            b.append( "", 12LL );
+            b.append( "", -3000000000LL );
+            b.append( "", 3.0 );
+            b.append( "", 2.5 );
+            b.append( "", -0.0 );
+            b.append( "", "short" );
+            b.append( "", string( 300, 'z' ) );
+            b.appendMinKey( "" );
+            b.appendMaxKey( "" );
+            b.appendNull( "" );
+            b.appendBool( "", true );
+            b.appendOID( "", 0, true );
+            b.appendDate( "", 1234567 );
+            b.append( "", BSON( "x" << 1 ) );
+            b.appendRegex( "", "^a", "i" );
+            BSONObj k = b.obj();
+
+            BufBuilder c;
+            CompactKey::encode( k, c );
+            ASSERT( c.len() < k.objsize() );
+            BSONObj d = CompactKey::decode( c.buf(), c.len() );
+            ASSERT_EQUALS( k.objsize(), d.objsize() );
+            ASSERT( memcmp( k.objdata(), d.objdata(), k.objsize() ) == 0 );
+        }
+    };
+
+    class CompactKeyDecodeInPlace {
+    public:
+        void run() {
+            BSONObj k = BSON( "" << 7 << "" << "abc" << "" << 2.5 );
+            BufBuilder c;
+            CompactKey::encode( k, c );
+            char buf[64];
+            BSONObj d = CompactKey::decode( c.buf(), c.len(), buf, sizeof( buf ) );
+            ASSERT( d.objdata() == buf );
+            ASSERT_EQUALS( k.objsize(), d.objsize() );
+            ASSERT( memcmp( k.objdata(), d.objdata(), k.objsize() ) == 0 );
+            // too small a buffer asserts rather than overrunning it
+            ASSERT_EXCEPTION( CompactKey::decode( c.buf(), c.len(), buf, k.objsize() - 1 ), MsgAssertionException );
+        }
+    };
+
+    /* an index with { v : 1 }, so compact keys sharing prefixes */
+    class CompactBase : public Base {
+    public:
+        CompactBase() : Base( 1 ) {}
+    protected:
+        static BSONObj key( int i ) {
+            stringstream ss;
+            ss << string( 60, 'p' ) << setw( 4 ) << setfill( '0' ) << i;
+            BSONObjBuilder b;
+            b.append( "", ss.str() );
+            return b.obj();
+        }
+        void insertKey( int i ) {
+            BSONObj k = key( i );
+            insert( k );
+        }
+        void unindexKey( int i ) {
+            BSONObj k = key( i );
+            unindex( k );
+        }
+        int buckets() {
+            stringstream ss;
+            bt()->shape( ss );
+            string s = ss.str();
+            return count( s.begin(), s.end(), '*' );
+        }
+    };
+
+    class CompactInsertDelete : public CompactBase {
+    public:
+        void run() {
+            // ~90 bytes a key in v0, so these would need a split there
+            for ( int i = 0; i < 150; ++i )
+                insertKey( i );
+            checkValid( 150 );
+            ASSERT_EQUALS( 1, buckets() );
+            for ( int i = 0; i < 150; ++i ) {
+                BSONObj k = key( i );
+                locate( k, i, true, dl() );
+            }
+
+            // the keys sharing their prefix with these stay readable, and pack() keeps it for them
+            for ( int i = 0; i < 150; i += 2 )
+                unindexKey( i );
+            checkValid( 75 );
+            for ( int i = 0; i < 150; i += 2 )
+                insertKey( i );
+            checkValid( 150 );
+            for ( int i = 0; i < 150; ++i ) {
+                BSONObj k = key( i );
+                locate( k, i, true, dl() );
+            }
+        }
+    };
+
+    class CompactSplit : public CompactBase {
+    public:
+        void run() {
+            for ( int i = 0; i < 2000; ++i )
+                insertKey( i );
+            checkValid( 2000 );
+            ASSERT( buckets() > 1 );
+            for ( int i = 0; i < 2000; i += 3 )
+                unindexKey( i );
+            int unused = 0;
+            ASSERT_EQUALS( 2000 - 667, bt()->fullValidate( dl(), order(), &unused ) );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "btree" ){
@@ -383,6 +505,10 @@ namespace BtreeTests {
             add< ReuseUnused >();
             add< PackUnused >();
             add< DontDropReferenceKey >();
+            add< CompactKeyRoundTrip >();
+            add< CompactKeyDecodeInPlace >();
+            add< CompactInsertDelete >();
+            add< CompactSplit >();
         }
     } myall;
 }
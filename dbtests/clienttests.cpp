@@ -62,6 +62,31 @@ namespace ClientTests {
         }
     };
     
+    /** several index specs in one insert are built together, and all fail together */
+    class BatchedIndexes : public Base {
+    public:
+        BatchedIndexes() : Base( "batchedindexes" ){}
+        void run(){
+            for ( int i = 0; i < 1000; i++ )
+                db.insert( ns() , BSON( "x" << i << "y" << i % 10 << "z" << -i ) );
+            
+            vector<BSONObj> specs;
+            specs.push_back( BSON( "ns" << ns() << "key" << BSON( "x" << 1 ) << "name" << "x_1" ) );
+            specs.push_back( BSON( "ns" << ns() << "key" << BSON( "z" << 1 ) << "name" << "z_1" ) );
+            db.insert( "test.system.indexes" , specs );
+            ASSERT( db.getLastError().empty() );
+            ASSERT_EQUALS( 3 , db.getIndexes( ns() )->itcount() );
+            ASSERT_EQUALS( 1000 , db.query( ns() , Query().hint( BSON( "z" << 1 ) ) )->itcount() );
+            
+            specs.clear();
+            specs.push_back( BSON( "ns" << ns() << "key" << BSON( "x" << 1 << "y" << 1 ) << "name" << "x_1_y_1" ) );
+            specs.push_back( BSON( "ns" << ns() << "key" << BSON( "y" << 1 ) << "name" << "y_1" << "unique" << true ) );
+            db.insert( "test.system.indexes" , specs );
+            ASSERT( ! db.getLastError().empty() );
+            ASSERT_EQUALS( 3 , db.getIndexes( ns() )->itcount() );
+        }
+    };
+    
     class ReIndex : public Base {
     public:
         ReIndex() : Base( "reindex" ){}
@@ -169,6 +194,7 @@ namespace ClientTests {
 
         void setupTests(){
             add<DropIndex>();
+            add<BatchedIndexes>();
             add<ReIndex>();
             add<ReIndex2>();
             add<CS_10>();
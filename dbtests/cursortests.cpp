@@ -247,6 +247,80 @@ namespace CursorTests {
         };        
         
     } // namespace BtreeCursorTests
+
+    namespace ClientCursorTests {
+
+        /** counts the page fault checks made on it, and reports every record as resident */
+        class CheckCountingCursor : public BasicCursor {
+        public:
+            CheckCountingCursor( DiskLoc dl ) : BasicCursor( dl ), _checks() {}
+            virtual Record* recordToLoad() { ++_checks; return 0; }
+            int checks() const { return _checks; }
+        private:
+            int _checks;
+        };
+
+        class Base {
+        public:
+            Base() : _ns( "unittests.cursortests.ClientCursorTests" ) {
+                dblock lk;
+                Client::Context ctx( _ns );
+                DBDirectClient c;
+                c.dropCollection( _ns );
+                for( int i = 0; i < 300; ++i )
+                    c.insert( _ns, BSON( "a" << i ) );
+            }
+            ~Base() {
+                dblock lk;
+                Client::Context ctx( _ns );
+                DBDirectClient c;
+                c.dropCollection( _ns );
+            }
+        protected:
+            const char *ns() const { return _ns.c_str(); }
+        private:
+            string _ns;
+        };
+
+        /** the residency check is a system call, so it is made only when a yield is due */
+        class ResidencyCheckedOnlyWhenYieldDue : public Base {
+        public:
+            void run() {
+                dblock lk;
+                Client::Context ctx( ns() );
+                CheckCountingCursor *counting = new CheckCountingCursor( theDataFileMgr.findAll( ns() )->currLoc() );
+                shared_ptr<Cursor> c( counting );
+                auto_ptr<ClientCursor> cc( new ClientCursor( QueryOption_NoCursorTimeout, c, ns() ) );
+                for( int i = 0; i < 256; ++i ) {
+                    ASSERT( cc->yieldSometimes() );
+                    c->advance();
+                }
+                // the tracker fires every 128 hits; the elapsed time trigger is off in unit tests
+                ASSERT_EQUALS( 2, counting->checks() );
+                for( int i = 0; i < 128; ++i )
+                    ASSERT( cc->yieldIfPageFaultLikely() );
+                ASSERT_EQUALS( 3, counting->checks() );
+            }
+        };
+
+        /** single and multi updates, with and without a yield cursor, leave none registered */
+        class UpdatesLeaveNoCursor : public Base {
+        public:
+            void run() {
+                dblock lk;
+                Client::Context ctx( ns() );
+                unsigned before = ClientCursor::numCursors();
+                DBDirectClient c;
+                c.update( ns(), BSON( "a" << 150 ), BSON( "$set" << BSON( "b" << 1 ) ) );
+                ASSERT_EQUALS( before, ClientCursor::numCursors() );
+                ASSERT_EQUALS( 1, c.count( ns(), BSON( "b" << 1 ) ) );
+                c.update( ns(), BSONObj(), BSON( "$set" << BSON( "b" << 2 ) ), false, true );
+                ASSERT_EQUALS( before, ClientCursor::numCursors() );
+                ASSERT_EQUALS( 300, c.count( ns(), BSON( "b" << 2 ) ) );
+            }
+        };
+
+    } // namespace ClientCursorTests
     
     class All : public Suite {
     public:
@@ -261,6 +335,8 @@ namespace CursorTests {
             add< BtreeCursorTests::EqIn >();
             add< BtreeCursorTests::RangeEq >();
             add< BtreeCursorTests::RangeIn >();
+            add< ClientCursorTests::ResidencyCheckedOnlyWhenYieldDue >();
+            add< ClientCursorTests::UpdatesLeaveNoCursor >();
         }
     } myall;
 } // namespace CursorTests
@@ -1279,6 +1279,102 @@ namespace JsobjTests {
                 }
             }
         };
+
+        /* the output of several sorters, one spilled to disk and one not, merged */
+        class Merge {
+        public:
+            void run(){
+                BSONObjExternalSorter a( BSONObj() , 2000 );
+                BSONObjExternalSorter b;
+                for ( int i=0; i<5000; i++ ){
+                    a.add( BSON( "x" << rand() % 1000 ) , 5 , i );
+                    b.add( BSON( "x" << rand() % 1000 ) , 6 , i );
+                }
+                a.sort();
+                b.sort();
+                ASSERT( a.numFiles() > 1 );
+                ASSERT_EQUALS( 0 , b.numFiles() );
+
+                vector<BSONObjExternalSorter*> sorters;
+                sorters.push_back( &a );
+                sorters.push_back( &b );
+                BSONObjExternalSorter::Iterator i( sorters );
+                int num=0;
+                double prev = 0;
+                while ( i.more() ){
+                    pair<BSONObj,DiskLoc> p = i.next();
+                    num++;
+                    double cur = p.first["x"].number();
+                    ASSERT( cur >= prev );
+                    prev = cur;
+                }
+                ASSERT_EQUALS( 10000 , num );
+            }
+        };
+
+        /* SortKeys order mixed types, ascending and descending, as woCompare does */
+        class SortKeyOrder {
+        public:
+            void run(){
+                BSONObjBuilder b;
+                b.appendMinKey( "" );
+                b.appendNull( "" );
+                b.append( "" , -1.5 );
+                b.append( "" , -1 );
+                b.append( "" , 0.0 );
+                b.append( "" , -0.0 );
+                b.append( "" , 1 );
+                b.append( "" , 1LL );
+                b.append( "" , 2.5 );
+                b.append( "" , 1LL << 40 );
+                b.append( "" , numeric_limits<double>::quiet_NaN() );
+                b.append( "" , "" );
+                b.append( "" , "a" );
+                b.append( "" , "ab" );
+                b.append( "" , "b" );
+                OID x , y;
+                x.init( "4c1a7bd7e4b5ee4b3e0c0a01" );
+                y.init( "4c1a7bd7e4b5ee4b3e0c0b00" );
+                b.append( "" , x );
+                b.append( "" , y );
+                b.appendBool( "" , false );
+                b.appendBool( "" , true );
+                b.appendDate( "" , 5 );
+                b.appendMaxKey( "" );
+                BSONObj all = b.obj();
+
+                vector<BSONObj> keys;
+                BSONObjIterator i( all );
+                while ( i.more() ){
+                    BSONElement e = i.next();
+                    BSONObjIterator j( all );
+                    while ( j.more() )
+                        keys.push_back( BSON( "" << e << "" << j.next() ) );
+                }
+
+                check( keys , BSON( "a" << 1 << "b" << 1 ) );
+                check( keys , BSON( "a" << 1 << "b" << -1 ) );
+                check( keys , BSON( "a" << -1 << "b" << 1 ) );
+
+                BufBuilder bb;
+                ASSERT( ! SortKey::encode( BSON( "" << BSON( "x" << 1 ) ) , Ordering::make( BSONObj() ) , bb ) );
+            }
+        private:
+            static int sign( int x ){ return x < 0 ? -1 : ( x > 0 ? 1 : 0 ); }
+            void check( const vector<BSONObj>& keys , const BSONObj& order ){
+                Ordering o = Ordering::make( order );
+                for ( unsigned i=0; i<keys.size(); i++ ){
+                    BufBuilder a;
+                    ASSERT( SortKey::encode( keys[i] , o , a ) );
+                    for ( unsigned j=0; j<keys.size(); j++ ){
+                        BufBuilder b;
+                        ASSERT( SortKey::encode( keys[j] , o , b ) );
+                        ASSERT_EQUALS( sign( keys[i].woCompare( keys[j] , o ) ) ,
+                                       sign( SortKey::compare( a.buf() , a.len() , b.buf() , b.len() ) ) );
+                    }
+                }
+            }
+        };
     }
     
     class CompatBSON {
@@ -1791,6 +1887,8 @@ namespace JsobjTests {
             add< external_sort::Big1 >();
             add< external_sort::Big2 >();
             add< external_sort::D1 >();
+            add< external_sort::Merge >();
+            add< external_sort::SortKeyOrder >();
             add< CompatBSON >();
             add< CompareDottedFieldNamesTest >();
             add< NestedDottedConversions >();
@@ -23,6 +23,74 @@
 
 namespace MMapTests {
 
+    class FileContaining {
+    public:
+        void run() {
+            string fn = "/tmp/filecontainingtest.map";
+            boost::filesystem::remove(fn);
+            unsigned long long ofs = 0;
+            {
+                MemoryMappedFile f;
+                char *p = (char *) f.create(fn, 64 * 1024, true);
+                ASSERT( p );
+                ASSERT( MemoryMappedFile::fileContaining(p, ofs) == &f );
+                ASSERT_EQUALS( 0ULL , ofs );
+                ASSERT( MemoryMappedFile::fileContaining(p + 1000, ofs) == &f );
+                ASSERT_EQUALS( 1000ULL , ofs );
+                ASSERT( MemoryMappedFile::fileContaining(p + 64 * 1024 - 1, ofs) == &f );
+                ASSERT( MemoryMappedFile::fileContaining(p + 64 * 1024, ofs) != &f );
+                ASSERT( MemoryMappedFile::fileContaining(&ofs, ofs) == 0 );
+                f.close();
+                ASSERT( MemoryMappedFile::fileContaining(p, ofs) == 0 );
+            }
+            boost::filesystem::remove(fn);
+        }
+    };
+
+    /** what dur relies on: writes to the private view stay out of the file until copied to the shared
+        view, and a remap shows the shared view again */
+    class PrivateView {
+    public:
+        void run() {
+            string fn = "/tmp/privateviewtest.map";
+            boost::filesystem::remove(fn);
+            MemoryMappedFile::usePrivateViews(true);
+            {
+                MemoryMappedFile f;
+                char *p = (char *) f.create(fn, 64 * 1024, true);
+                ASSERT( p );
+                char *shared = f.sharedView();
+                ASSERT( shared != p );
+                unsigned long long ofs = 0;
+                ASSERT( MemoryMappedFile::fileContaining(p + 100, ofs) == &f );
+                ASSERT_EQUALS( 100ULL , ofs );
+
+                strcpy(p, "hello");
+                strcpy(p + 8192, "world");
+                ASSERT_EQUALS( 0 , shared[0] );
+
+                memcpy(shared, p, 6);
+                MemoryMappedFile::remapPrivateViews();
+                ASSERT( MemoryMappedFile::fileContaining(p, ofs) == &f );
+                ASSERT_EQUALS( string("hello") , string(p) );
+                // never copied to the shared view, so gone
+                ASSERT_EQUALS( 0 , p[8192] );
+                f.close();
+            }
+            MemoryMappedFile::usePrivateViews(false);
+            boost::filesystem::remove(fn);
+        }
+    };
+
+    class All : public Suite {
+    public:
+        All() : Suite( "mmap" ){}
+        void setupTests(){
+            add< FileContaining >();
+            add< PrivateView >();
+        }
+    } myall;
+
 #if 0
 
     class CopyOnWriteSpeedTest {
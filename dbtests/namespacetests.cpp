@@ -814,6 +814,40 @@ namespace NamespaceTests {
         //            }
         //        };
 
+        class PowerOf2Sizes : public Base {
+        public:
+            void run() {
+                ASSERT_EQUALS( 32, NamespaceDetails::quantizeAllocationSpace( 1 ) );
+                ASSERT_EQUALS( 256, NamespaceDetails::quantizeAllocationSpace( 256 ) );
+                ASSERT_EQUALS( 512, NamespaceDetails::quantizeAllocationSpace( 257 ) );
+                ASSERT_EQUALS( 5 * 1024 * 1024, NamespaceDetails::quantizeAllocationSpace( 4 * 1024 * 1024 + 1 ) );
+
+                create();
+                ASSERT( nsd()->usePowerOf2Sizes() );
+                DiskLoc l[ 20 ];
+                for ( int i = 0; i < 20; ++i ) {
+                    BSONObj o = obj( 10 * i );
+                    l[ i ] = theDataFileMgr.insert( ns(), o.objdata(), o.objsize() );
+                    int len = l[ i ].rec()->lengthWithHeaders;
+                    ASSERT_EQUALS( len, NamespaceDetails::quantizeAllocationSpace( len ) );
+                }
+
+                // a freed record is reused by anything of its size class
+                int len = l[ 10 ].rec()->lengthWithHeaders;
+                theDataFileMgr.deleteRecord( ns(), l[ 10 ].rec(), l[ 10 ] );
+                BSONObj o = obj( 101 );
+                ASSERT_EQUALS( len, NamespaceDetails::quantizeAllocationSpace( o.objsize() + Record::HeaderSize ) );
+                ASSERT( l[ 10 ] == theDataFileMgr.insert( ns(), o.objdata(), o.objsize() ) );
+            }
+        private:
+            virtual string spec() const {
+                return "{\"usePowerOf2Sizes\":true}";
+            }
+            static BSONObj obj( int n ) {
+                return BSON( "_id" << n << "a" << string( n, 'a' ) );
+            }
+        };
+
         class Size {
         public:
             void run() {
@@ -857,6 +891,7 @@ namespace NamespaceTests {
             add< NamespaceDetailsTests::TruncateCapped >();
             add< NamespaceDetailsTests::Migrate >();
             //            add< NamespaceDetailsTests::BigCollection >();
+            add< NamespaceDetailsTests::PowerOf2Sizes >();
             add< NamespaceDetailsTests::Size >();
         }
     } myall;
@@ -22,6 +22,8 @@
 
 #include "../db/db.h"
 #include "../db/json.h"
+#include "../db/instance.h"
+#include "../db/clientcursor.h"
 
 #include "dbtests.h"
 
@@ -300,7 +302,175 @@ namespace PdfileTests {
                 ASSERT( 0 != o.getField( "a" ).date() );
             }
         };
+
+        /* a batch's keys for non-unique indexes go in at done(); a duplicate _id fails just its own insert */
+        class Batch : public Base {
+        public:
+            void run() {
+                DBDirectClient client;
+                client.ensureIndex( ns(), BSON( "a" << 1 ) );
+                {
+                    BatchInsert batch( ns() );
+                    for ( int i = 0; i < 100; ++i ) {
+                        BSONObj o = BSON( "_id" << i << "a" << ( 7 * i ) % 10 );
+                        theDataFileMgr.insertWithObjMod( ns(), o );
+                    }
+                    BSONObj dup = BSON( "_id" << 5 << "a" << 3 );
+                    bool threw = false;
+                    try {
+                        theDataFileMgr.insertWithObjMod( ns(), dup );
+                    }
+                    catch ( DBException& ) {
+                        threw = true;
+                    }
+                    ASSERT( threw );
+                    batch.done();
+                }
+                ASSERT_EQUALS( 100, nsd()->nrecords );
+                for ( int a = 0; a < 10; ++a ) {
+                    int n = 0;
+                    auto_ptr< DBClientCursor > c = client.query( ns(), QUERY( "a" << a ).hint( BSON( "a" << 1 ) ) );
+                    while ( c->more() ) {
+                        ASSERT_EQUALS( a, c->next()[ "a" ].numberInt() );
+                        ++n;
+                    }
+                    ASSERT_EQUALS( 10, n );
+                }
+            }
+        };
+
+        /* a document whose keys can't be made for a deferred index leaves no _id entry behind */
+        class BatchKeysFail : public Base {
+        public:
+            void run() {
+                DBDirectClient client;
+                client.ensureIndex( ns(), BSON( "a" << 1 << "b" << 1 ) );
+                {
+                    BatchInsert batch( ns() );
+                    // parallel arrays, so no keys for { a : 1 , b : 1 }
+                    BSONObj bad = BSON( "_id" << 1 << "a" << BSON_ARRAY( 1 << 2 ) << "b" << BSON_ARRAY( 1 << 2 ) );
+                    bool threw = false;
+                    try {
+                        theDataFileMgr.insertWithObjMod( ns(), bad );
+                    }
+                    catch ( DBException& ) {
+                        threw = true;
+                    }
+                    ASSERT( threw );
+                    BSONObj o = BSON( "_id" << 1 << "a" << 2 << "b" << 3 );
+                    theDataFileMgr.insertWithObjMod( ns(), o );
+                    batch.done();
+                }
+                ASSERT_EQUALS( 1, nsd()->nrecords );
+                ASSERT_EQUALS( 1, client.query( ns(), QUERY( "a" << 2 ).hint( BSON( "a" << 1 << "b" << 1 ) ) )->itcount() );
+            }
+        };
     } // namespace Insert
+
+    namespace Compact {
+        class Base {
+        public:
+            virtual ~Base() {
+                client_.dropCollection( ns() );
+            }
+        protected:
+            static const char *ns() {
+                return "unittests.pdfiletests.Compact";
+            }
+            static NamespaceDetails *nsd() {
+                return nsdetails( ns() );
+            }
+            static int nExtents() {
+                int n = 0;
+                for ( DiskLoc i = nsd()->firstExtent; !i.isNull(); i = i.ext()->xnext )
+                    ++n;
+                return n;
+            }
+            /* two extents, the first emptied.  @return how many records are left, all in the second */
+            long long emptyFirstExtent() {
+                {
+                    dblock lk;
+                    Client::Context ctx( ns() );
+                    string err;
+                    ASSERT( userCreateNS( ns(), fromjson( "{\"size\":8192,\"$nExtents\":2}" ), err, false ) );
+                }
+                for ( int i = 0; i < 150; ++i )
+                    client_.insert( ns(), BSON( "_id" << i << "a" << string( 40, 'a' ) ) );
+                {
+                    dblock lk;
+                    Client::Context ctx( ns() );
+                    ASSERT_EQUALS( 2, nExtents() );
+                    ASSERT( !nsd()->lastExtent.ext()->firstRecord.isNull() );
+                    Extent *e = nsd()->firstExtent.ext();
+                    while ( !e->firstRecord.isNull() ) {
+                        DiskLoc dl = e->firstRecord;
+                        theDataFileMgr.deleteRecord( ns(), dl.rec(), dl );
+                    }
+                }
+                long long n = client_.count( ns() );
+                ASSERT( n > 0 );
+                return n;
+            }
+            DBDirectClient client_;
+        };
+
+        /* empty the first of two extents: compact moves the second's records into it and frees the second */
+        class FreesLastExtent : public Base {
+        public:
+            void run() {
+                long long n = emptyFirstExtent();
+
+                BSONObj info;
+                ASSERT( client_.runCommand( "unittests", BSON( "compact" << "pdfiletests.Compact" ), info ) );
+                ASSERT_EQUALS( 1, info[ "extentsFreed" ].numberInt() );
+                ASSERT_EQUALS( n, info[ "recordsMoved" ].numberLong() );
+                {
+                    dblock lk;
+                    Client::Context ctx( ns() );
+                    ASSERT_EQUALS( 1, nExtents() );
+                }
+
+                // every record is still found through the _id index at its new location
+                ASSERT_EQUALS( n, client_.count( ns() ) );
+                auto_ptr< DBClientCursor > c = client_.query( ns(), Query() );
+                while ( c->more() ) {
+                    BSONObj o = c->next();
+                    ASSERT_EQUALS( o, client_.findOne( ns(), QUERY( "_id" << o[ "_id" ] ) ) );
+                }
+            }
+        };
+
+        /* records moved behind an open natural order scan would be missed by it, so none are moved */
+        class StopsForNaturalScan : public Base {
+        public:
+            void run() {
+                long long n = emptyFirstExtent();
+                ClientCursor *cc;
+                {
+                    dblock lk;
+                    Client::Context ctx( ns() );
+                    shared_ptr< Cursor > c = theDataFileMgr.findAll( ns() );
+                    cc = new ClientCursor( QueryOption_NoCursorTimeout, c, ns() );
+                }
+
+                BSONObj info;
+                ASSERT( client_.runCommand( "unittests", BSON( "compact" << "pdfiletests.Compact" ), info ) );
+                ASSERT_EQUALS( 0, info[ "recordsMoved" ].numberLong() );
+                ASSERT_EQUALS( 0, info[ "extentsFreed" ].numberInt() );
+                ASSERT( info.hasField( "note" ) );
+                {
+                    dblock lk;
+                    Client::Context ctx( ns() );
+                    delete cc;
+                }
+
+                // with the scan done, compact can go ahead
+                ASSERT( client_.runCommand( "unittests", BSON( "compact" << "pdfiletests.Compact" ), info ) );
+                ASSERT_EQUALS( 1, info[ "extentsFreed" ].numberInt() );
+                ASSERT_EQUALS( n, client_.count( ns() ) );
+            }
+        };
+    } // namespace Compact
     
     class All : public Suite {
     public:
@@ -321,6 +491,10 @@ namespace PdfileTests {
             add< ScanCapped::FirstInExtent >();
             add< ScanCapped::LastInExtent >();
             add< Insert::UpdateDate >();
+            add< Insert::Batch >();
+            add< Insert::BatchKeysFail >();
+            add< Compact::FreesLastExtent >();
+            add< Compact::StopsForNaturalScan >();
         }
     } myall;
 
@@ -23,6 +23,7 @@
 #include "../../db/instance.h"
 #include "../../db/query.h"
 #include "../../db/queryoptimizer.h"
+#include "../../db/key.h"
 #include "../../util/file_allocator.h"
 
 #include "../framework.h"
@@ -687,6 +688,130 @@ namespace Plan {
 
 } // namespace Plan
 
+namespace KeyCompare {
+
+    /* compares every adjacent pair of N keys Rounds times: first with woCompare, as a sort or a
+       bucket search does, then by SortKeys built once per key up front */
+    const int N = 1000;
+    const int Rounds = 1000;
+
+    int sink; // so the compares aren't optimized away
+
+    typedef BSONObj (*MakeKey)( int i );
+
+    BSONObj intKey( int i ) {
+        BSONObjBuilder b;
+        b.append( "", i * 7919 % N );
+        return b.obj();
+    }
+
+    BSONObj oidKey( int i ) {
+        OID id;
+        id.init();
+        BSONObjBuilder b;
+        b.append( "", id );
+        return b.obj();
+    }
+
+    BSONObj stringKey( int i ) {
+        stringstream ss;
+        ss << "user:" << i * 7919 % N << ":profile";
+        BSONObjBuilder b;
+        b.append( "", ss.str() );
+        return b.obj();
+    }
+
+    class WoCompare {
+    public:
+        WoCompare( MakeKey f ) : o_( Ordering::make( BSONObj() ) ) {
+            for( int i = 0; i < N; ++i )
+                keys_.push_back( f( i ) );
+        }
+        void run() {
+            int x = 0;
+            for( int r = 0; r < Rounds; ++r )
+                for( int i = 1; i < N; ++i )
+                    x += keys_[ i - 1 ].woCompare( keys_[ i ], o_ ) < 0;
+            sink = x;
+        }
+    private:
+        vector< BSONObj > keys_;
+        Ordering o_;
+    };
+
+    class BySortKey {
+    public:
+        BySortKey( MakeKey f ) : o_( Ordering::make( BSONObj() ) ) {
+            for( int i = 0; i < N; ++i )
+                keys_.push_back( f( i ) );
+        }
+        void run() {
+            BufBuilder b;
+            vector< int > ofs;
+            for( int i = 0; i < N; ++i ) {
+                ofs.push_back( b.len() );
+                bool ok = SortKey::encode( keys_[ i ], o_, b );
+                assert( ok );
+            }
+            ofs.push_back( b.len() );
+            const char *p = b.buf();
+            int x = 0;
+            for( int r = 0; r < Rounds; ++r )
+                for( int i = 1; i < N; ++i )
+                    x += SortKey::compare( p + ofs[ i - 1 ], ofs[ i ] - ofs[ i - 1 ],
+                                           p + ofs[ i ], ofs[ i + 1 ] - ofs[ i ] ) < 0;
+            sink = x;
+        }
+    private:
+        vector< BSONObj > keys_;
+        Ordering o_;
+    };
+
+    class IntWoCompare : public WoCompare {
+    public:
+        IntWoCompare() : WoCompare( intKey ) {}
+    };
+
+    class IntSortKey : public BySortKey {
+    public:
+        IntSortKey() : BySortKey( intKey ) {}
+    };
+
+    class ObjectIdWoCompare : public WoCompare {
+    public:
+        ObjectIdWoCompare() : WoCompare( oidKey ) {}
+    };
+
+    class ObjectIdSortKey : public BySortKey {
+    public:
+        ObjectIdSortKey() : BySortKey( oidKey ) {}
+    };
+
+    class StringWoCompare : public WoCompare {
+    public:
+        StringWoCompare() : WoCompare( stringKey ) {}
+    };
+
+    class StringSortKey : public BySortKey {
+    public:
+        StringSortKey() : BySortKey( stringKey ) {}
+    };
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "keycompare" ){}
+        void setupTests(){
+            add< IntWoCompare >();
+            add< IntSortKey >();
+            add< ObjectIdWoCompare >();
+            add< ObjectIdSortKey >();
+            add< StringWoCompare >();
+            add< StringSortKey >();
+        }
+    } all;
+
+} // namespace KeyCompare
+
 int main( int argc, char **argv ) {
     logLevel = -1;
     client_ = new DBDirectClient();
@@ -23,6 +23,7 @@
 #include "../db/dbhelpers.h"
 #include "../db/instance.h"
 #include "../db/query.h"
+#include "../db/indexstats.h"
 #include "dbtests.h"
 
 namespace mongo {
@@ -1593,6 +1594,48 @@ namespace QueryOptimizerTests {
             }
         };
 
+        class PruneByEstimate : public Base {
+        public:
+            void run() {
+                Helpers::ensureIndex( ns(), BSON( "a" << 1 ), false, "a_1" );
+                Helpers::ensureIndex( ns(), BSON( "b" << 1 ), false, "b_1" );
+                for( int i = 0; i < 5000; ++i ) {
+                    BSONObj temp = BSON( "a" << i << "b" << i % 2 );
+                    theDataFileMgr.insertWithObjMod( ns(), temp );
+                }
+                BSONObj query = BSON( "a" << 7 << "b" << 1 );
+                {
+                    auto_ptr< FieldRangeSet > frs( new FieldRangeSet( ns(), query ) );
+                    auto_ptr< FieldRangeSet > frsOrig( new FieldRangeSet( *frs ) );
+                    QueryPlanSet s( ns(), frs, frsOrig, query, BSONObj() );
+                    ASSERT_EQUALS( 3, s.nPlans() );
+                }
+
+                BSONObjBuilder result;
+                analyzeIndexes( ns(), result );
+                shared_ptr< const NamespaceIndexStats > stats = indexStatsFor( ns() );
+                const IndexStats *a = stats->get( nsd()->idx( 1 ) );
+                const IndexStats *b = stats->get( nsd()->idx( 2 ) );
+                ASSERT( a );
+                ASSERT( b );
+                ASSERT( a->nKeys() > 2500 && a->nKeys() < 10000 );
+                ASSERT( a->nDistinct() > 2500 );
+                ASSERT( b->nDistinct() < 10 );
+                FieldRangeSet range( ns(), BSON( "a" << GTE << 1000 << LT << 2000 ) );
+                long long est = a->estimateKeys( range.range( "a" ) );
+                ASSERT( est > 500 && est < 2000 );
+
+                {
+                    auto_ptr< FieldRangeSet > frs( new FieldRangeSet( ns(), query ) );
+                    auto_ptr< FieldRangeSet > frsOrig( new FieldRangeSet( *frs ) );
+                    QueryPlanSet s( ns(), frs, frsOrig, query, BSONObj() );
+                    ASSERT_EQUALS( 1, s.nPlans() );
+                    ASSERT( s.getBestGuess()->indexKey().woCompare( BSON( "a" << 1 ) ) == 0 );
+                }
+                removeIndexStats( ns() );
+            }
+        };
+
     } // namespace QueryPlanSetTests
     
     class Base {
@@ -1777,6 +1820,7 @@ namespace QueryOptimizerTests {
             add< QueryPlanSetTests::InQueryIntervals >();
             add< QueryPlanSetTests::EqualityThenIn >();
             add< QueryPlanSetTests::NotEqualityThenIn >();
+            add< QueryPlanSetTests::PruneByEstimate >();
             add< BestGuess >();
         }
     } myall;
@@ -21,9 +21,11 @@
 #include "../db/query.h"
 
 #include "../db/db.h"
+#include "../db/dbhelpers.h"
 #include "../db/instance.h"
 #include "../db/json.h"
 #include "../db/lasterror.h"
+#include "../db/scanandorder.h"
 
 #include "../util/timer.h"
 
@@ -31,6 +33,7 @@
 
 namespace mongo {
     extern int __findingStartInitialTimeout;
+    void assembleRequest( const string &ns, BSONObj query, int nToReturn, int nToSkip, const BSONObj *fieldsToReturn, int queryOptions, Message &toSend );
 }
 
 namespace QueryTests {
@@ -398,6 +401,42 @@ namespace QueryTests {
         }
     };
 
+    class CompressReply : public ClientBase {
+    public:
+        ~CompressReply() {
+            client().dropCollection( ns() );
+        }
+        void run() {
+            for( int i = 0; i < 500; ++i )
+                insert( ns(), BSON( "i" << i << "name" << "the same string in every document" ) );
+
+            // the first batch as it comes off the wire
+            Message toSend;
+            assembleRequest( ns(), BSONObj(), 0, 0, 0, QueryOption_CompressReply, toSend );
+            Message response;
+            ASSERT( client().call( toSend, response ) );
+            QueryResult *qr = (QueryResult *) response.singleData();
+            ASSERT( qr->resultFlags() & ResultFlag_Compressed );
+            ASSERT( qr->nReturned > 0 );
+            ASSERT( qr->len < (int) sizeof( QueryResult ) + qr->nReturned * 40 );
+            if ( qr->cursorId )
+                client().killCursor( qr->cursorId );
+
+            // and expanded by the cursor, first batch and getMores
+            auto_ptr< DBClientCursor > c = client().query( ns(), BSONObj(), 0, 0, 0, QueryOption_CompressReply );
+            int n = 0;
+            while( c->more() ) {
+                BSONObj o = c->next();
+                ASSERT_EQUALS( n, o.getIntField( "i" ) );
+                ASSERT_EQUALS( string( "the same string in every document" ), o.getStringField( "name" ) );
+                ++n;
+            }
+            ASSERT_EQUALS( 500, n );
+        }
+    private:
+        const char *ns() const { return "unittests.querytests.CompressReply"; }
+    };
+
     class BasicCount : public ClientBase {
     public:
         ~BasicCount() {
@@ -1052,6 +1091,29 @@ namespace QueryTests {
         int _old;
     };
         
+    /* binary search over many extents, without the initial scan timing out */
+    class FindingStartManyExtents : public CollectionBase {
+    public:
+        FindingStartManyExtents() : CollectionBase( "findingstart" ) {}
+        
+        void run() {
+            BSONObj info;
+            ASSERT( client().runCommand( "unittests", BSON( "create" << "querytests.findingstart" << "capped" << true << "size" << 4000 << "$nExtents" << 20 << "autoIndexId" << false ), info ) );
+            
+            int i = 0;
+            for( ; i < 100; client().insert( ns(), BSON( "ts" << i++ ) ) );
+            for( int k = 0; k < 3; ++k ) {
+                for( int l = 0; l < 37; ++l )
+                    client().insert( ns(), BSON( "ts" << i++ ) );
+                int min = client().query( ns(), Query().sort( BSON( "$natural" << 1 ) ) )->next()[ "ts" ].numberInt();            
+                for( int j = -1; j < i; ++j ) {
+                    auto_ptr< DBClientCursor > c = client().query( ns(), QUERY( "ts" << GTE << j ), 0, 0, 0, QueryOption_OplogReplay );
+                    ASSERT( c->more() );
+                    ASSERT_EQUALS( ( j > min ? j : min ), c->next()[ "ts" ].numberInt() );
+                }
+            }
+        }
+    };
     
     class WhatsMyUri : public CollectionBase {
     public:
@@ -1128,6 +1190,93 @@ namespace QueryTests {
         }
     };
 
+    /* the best of a limit are kept in a heap; past its memory, everything goes to an external sort */
+    class ScanAndOrderTest {
+    public:
+        void run(){
+            check( 5 , 10 , 1000000 , false );
+            check( 5 , 10 , 300 , true );
+            check( 0 , 0 , 1000000 , false );
+            check( 0 , 0 , 2000 , true );
+            check( 290 , 0 , 2000 , true );
+            tooBig( 5 , 1000 * 1000 );
+            tooBig( 0 , 4500 * 1000 );
+        }
+    private:
+        void check( int skip , int limit , unsigned maxInMemory , bool spills ) {
+            ScanAndOrder so( skip , limit , BSON( "a" << -1 << "b" << 1 ) , maxInMemory );
+            // each a from 0 to 99 three times
+            for ( int i = 0; i < 300; ++i )
+                so.add( BSON( "a" << ( i * 37 ) % 100 << "b" << i ) , 0 );
+            ASSERT_EQUALS( spills , so.spilled() );
+            // spilled or not, a limit keeps just the best
+            ASSERT_EQUALS( limit ? skip + limit : 300 , so.size() );
+
+            BufBuilder b;
+            int n;
+            so.fill( b , 0 , n );
+            ASSERT_EQUALS( limit ? limit : 300 - skip , n );
+
+            const char *p = b.buf();
+            BSONObj prev;
+            for ( int i = 0; i < n; ++i ) {
+                BSONObj o( p );
+                p += o.objsize();
+                if ( i == 0 )
+                    ASSERT_EQUALS( 99 - skip / 3 , o[ "a" ].numberInt() );
+                else
+                    ASSERT( prev[ "a" ].numberInt() > o[ "a" ].numberInt() ||
+                            ( prev[ "a" ].numberInt() == o[ "a" ].numberInt() && prev[ "b" ].numberInt() < o[ "b" ].numberInt() ) );
+                prev = o;
+            }
+            ASSERT_EQUALS( b.len() , p - b.buf() );
+        }
+        /* 50 documents of 100KB with no limit: more than a reply holds */
+        void tooBig( int skip , unsigned maxInMemory ) {
+            ScanAndOrder so( skip , 0 , BSON( "a" << 1 ) , maxInMemory );
+            string big( 100 * 1000 , 'x' );
+            bool threw = false;
+            int i = 0;
+            try {
+                for ( ; i < 50; ++i )
+                    so.add( BSON( "a" << i << "s" << big ) , 0 );
+            }
+            catch ( UserException& e ) {
+                ASSERT_EQUALS( 10128 , e.getCode() );
+                threw = true;
+            }
+            ASSERT( threw );
+            // before any spill when it could tell then, else as soon as the spill showed it
+            if ( maxInMemory > 4000000 )
+                ASSERT( !so.spilled() );
+            else
+                ASSERT( so.spilled() && i < 50 );
+        }
+    };
+
+    /* a range removed a batch at a time, as the range deleter does */
+    class RemoveRangeBatches : public Base {
+    public:
+        void run() {
+            // two of each a from 0 to 49
+            for ( int i = 0; i < 100; ++i )
+                insert( BSON( "_id" << i << "a" << i / 2 ) );
+
+            BSONObj from = BSON( "a" << 10 );
+            long long total = 0;
+            int batches = 0;
+            while ( ! from.isEmpty() ) {
+                long long n = Helpers::removeRange( ns(), from, BSON( "a" << 40 ), false, false, 0, 7, &from );
+                ASSERT( n <= 7 );
+                total += n;
+                ++batches;
+            }
+            ASSERT_EQUALS( 60, total );
+            ASSERT_EQUALS( 9, batches );
+            ASSERT_EQUALS( 40, nsdetails( ns() )->nrecords );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "query" ) {
@@ -1151,6 +1300,7 @@ namespace QueryTests {
             add< TailCappedOnly >();
             add< TailableQueryOnId >();
             add< OplogReplayMode >();
+            add< CompressReply >();
             add< ArrayId >();
             add< UnderscoreNs >();
             add< EmptyFieldSpec >();
@@ -1177,6 +1327,7 @@ namespace QueryTests {
             add< HelperByIdTest >();
             add< FindingStart >();
             add< FindingStartPartiallyFull >();
+            add< FindingStartManyExtents >();
             add< WhatsMyUri >();
             
             add< parsedtests::basic1 >();
@@ -1184,6 +1335,8 @@ namespace QueryTests {
             add< queryobjecttests::names1 >();
 
             add< OrderingTest >();
+            add< ScanAndOrderTest >();
+            add< RemoveRangeBatches >();
         }
     } myall;
     
@@ -21,6 +21,8 @@
 #include "dbtests.h"
 
 #include "../client/parallel.h"
+#include "../s/chunk.h"
+#include "../s/config.h"
 
 namespace ShardingTests {
 
@@ -43,6 +45,162 @@ namespace ShardingTests {
         };
     }
 
+    namespace ChunkManagerTests {
+
+        /* the managers read their chunks from this process's own config db, given them as their
+           config server connection.  there is no real config server: the shards are known up front */
+        class Base {
+        public:
+            Base() : _db( "test" ) {
+                ASSERT( configServer.init( "localhost" ) );
+                Shard( "shard0000" , "shard0000:1" ).setAddress( "shard0000:1" , true );
+                Shard( "shard0001" , "shard0001:1" ).setAddress( "shard0001:1" , true );
+                _client.dropCollection( "config.chunks" );
+                _client.dropCollection( "config.collections" );
+            }
+            ~Base() {
+                _client.dropCollection( "config.chunks" );
+                _client.dropCollection( "config.collections" );
+            }
+        protected:
+            static const char *ns() { return "test.foo"; }
+            BSONObj minKey() const { return ShardKeyPattern( BSON( "a" << 1 ) ).globalMin(); }
+            BSONObj maxKey() const { return ShardKeyPattern( BSON( "a" << 1 ) ).globalMax(); }
+            /* writes the chunk [min,max) as the config server would */
+            void chunk( const BSONObj& min , const BSONObj& max , const string& shard , ShardChunkVersion v ) {
+                BSONObjBuilder b;
+                b.append( "_id" , Chunk::genID( ns() , min ) );
+                b.append( "ns" , ns() );
+                b.append( "min" , min );
+                b.append( "max" , max );
+                b.append( "shard" , shard );
+                b.appendTimestamp( "lastmod" , v );
+                _client.update( "config.chunks" , BSON( "_id" << Chunk::genID( ns() , min ) ) , b.obj() , true );
+            }
+            /* writes the collection's document as sharding or dropping it would */
+            void collection( unsigned long long lastmod ) {
+                BSONObjBuilder b;
+                b.append( "_id" , ns() );
+                b.appendDate( "lastmod" , lastmod );
+                b.appendBool( "dropped" , false );
+                b.append( "key" , BSON( "a" << 1 ) );
+                b.appendBool( "unique" , false );
+                _client.update( "config.collections" , BSON( "_id" << ns() ) , b.obj() , true );
+            }
+            static string shardFor( ChunkManager& m , const BSONObj& query ) {
+                set<Shard> shards;
+                m.getShardsForQuery( shards , query );
+                ASSERT_EQUALS( 1U , shards.size() );
+                return shards.begin()->getName();
+            }
+            DBDirectClient _client;
+            DBConfig _db;
+        };
+
+        /* splits and moves are read as just the chunks that changed */
+        class IncrementalSplitAndMove : public Base {
+        public:
+            void run() {
+                chunk( minKey() , BSON( "a" << 0 ) , "shard0000" , ShardChunkVersion( 1 , 0 ) );
+                chunk( BSON( "a" << 0 ) , maxKey() , "shard0000" , ShardChunkVersion( 1 , 1 ) );
+                ChunkManager m( &_db , ns() , ShardKeyPattern( BSON( "a" << 1 ) ) , false , &_client );
+                ASSERT_EQUALS( 2 , m.numChunks() );
+                ChunkPtr first = m.findChunk( BSON( "a" << -5 ) );
+                unsigned long long seq = m.getSequenceNumber();
+
+                // split [0,max) at 10
+                chunk( BSON( "a" << 0 ) , BSON( "a" << 10 ) , "shard0000" , ShardChunkVersion( 1 , 2 ) );
+                chunk( BSON( "a" << 10 ) , maxKey() , "shard0000" , ShardChunkVersion( 1 , 3 ) );
+                m.reload();
+                ASSERT_EQUALS( 3 , m.numChunks() );
+                ASSERT( m.getSequenceNumber() > seq );
+                ASSERT_EQUALS( BSON( "a" << 10 ) , m.findChunk( BSON( "a" << 5 ) )->getMax() );
+                ASSERT_EQUALS( BSON( "a" << 10 ) , m.findChunk( BSON( "a" << 20 ) )->getMin() );
+                // the unchanged chunk was kept, not read again
+                ASSERT( first == m.findChunk( BSON( "a" << -5 ) ) );
+
+                // move [10,max) to the other shard
+                chunk( BSON( "a" << 10 ) , maxKey() , "shard0001" , ShardChunkVersion( 2 , 0 ) );
+                m.reload();
+                ASSERT_EQUALS( 3 , m.numChunks() );
+                ASSERT_EQUALS( "shard0001" , m.findChunk( BSON( "a" << 20 ) )->getShard().getName() );
+                ASSERT_EQUALS( "shard0001" , shardFor( m , BSON( "a" << 20 ) ) );
+                ASSERT_EQUALS( "shard0000" , shardFor( m , BSON( "a" << 5 ) ) );
+                ASSERT( ShardChunkVersion( 2 , 0 ) == m.getVersion( Shard( "shard0001" ) ) );
+                ASSERT( ShardChunkVersion( 2 , 0 ) == m.getVersion() );
+                ASSERT( first == m.findChunk( BSON( "a" << -5 ) ) );
+
+                // nothing new: the map stays as it is
+                seq = m.getSequenceNumber();
+                m.reload();
+                ASSERT( m.getSequenceNumber() > seq );
+                ASSERT_EQUALS( 3 , m.numChunks() );
+                ASSERT( first == m.findChunk( BSON( "a" << -5 ) ) );
+            }
+        };
+
+        /* a change the newer chunks alone don't account for is read in full */
+        class FullReloadOnGap : public Base {
+        public:
+            void run() {
+                chunk( minKey() , BSON( "a" << 0 ) , "shard0000" , ShardChunkVersion( 1 , 0 ) );
+                chunk( BSON( "a" << 0 ) , maxKey() , "shard0000" , ShardChunkVersion( 1 , 1 ) );
+                ChunkManager m( &_db , ns() , ShardKeyPattern( BSON( "a" << 1 ) ) , false , &_client );
+                ChunkPtr first = m.findChunk( BSON( "a" << -5 ) );
+
+                // [0,max) split at 10, but only the lower half has a version past ours
+                chunk( BSON( "a" << 0 ) , BSON( "a" << 10 ) , "shard0000" , ShardChunkVersion( 2 , 0 ) );
+                chunk( BSON( "a" << 10 ) , maxKey() , "shard0000" , ShardChunkVersion( 1 , 1 ) );
+                m.reload();
+                ASSERT_EQUALS( 3 , m.numChunks() );
+                ASSERT_EQUALS( BSON( "a" << 10 ) , m.findChunk( BSON( "a" << 20 ) )->getMin() );
+                ASSERT( first != m.findChunk( BSON( "a" << -5 ) ) );
+            }
+        };
+
+        /* the collection was dropped and sharded again: every chunk is older than what we hold */
+        class FullReloadAfterReshard : public Base {
+        public:
+            void run() {
+                chunk( minKey() , BSON( "a" << 0 ) , "shard0000" , ShardChunkVersion( 1 , 0 ) );
+                chunk( BSON( "a" << 0 ) , maxKey() , "shard0001" , ShardChunkVersion( 2 , 0 ) );
+                ChunkManager m( &_db , ns() , ShardKeyPattern( BSON( "a" << 1 ) ) , false , &_client );
+                ASSERT_EQUALS( 2 , m.numChunks() );
+
+                _client.remove( "config.chunks" , BSONObj() );
+                chunk( minKey() , maxKey() , "shard0001" , ShardChunkVersion( 1 , 0 ) );
+                m.reload();
+                ASSERT_EQUALS( 1 , m.numChunks() );
+                ASSERT_EQUALS( "shard0001" , shardFor( m , BSON( "a" << -5 ) ) );
+                ASSERT( ShardChunkVersion( 1 , 0 ) == m.getVersion() );
+            }
+        };
+
+        /* dropped and sharded again, split at the same point, with a chunk newer than any of ours */
+        class FullReloadAfterReshardNewer : public Base {
+        public:
+            void run() {
+                collection( 1000 );
+                chunk( minKey() , BSON( "a" << 0 ) , "shard0000" , ShardChunkVersion( 1 , 0 ) );
+                chunk( BSON( "a" << 0 ) , maxKey() , "shard0001" , ShardChunkVersion( 2 , 0 ) );
+                ChunkManager m( &_db , ns() , ShardKeyPattern( BSON( "a" << 1 ) ) , false , &_client );
+                ASSERT_EQUALS( 1000ULL , m.getCollectionLastmod() );
+
+                _client.remove( "config.chunks" , BSONObj() );
+                collection( 2000 );
+                chunk( minKey() , BSON( "a" << 0 ) , "shard0001" , ShardChunkVersion( 1 , 0 ) );
+                chunk( BSON( "a" << 0 ) , maxKey() , "shard0000" , ShardChunkVersion( 3 , 0 ) );
+                m.reload();
+                ASSERT_EQUALS( 2000ULL , m.getCollectionLastmod() );
+                ASSERT_EQUALS( 2 , m.numChunks() );
+                // read incrementally, [min,0) would have been left on shard0000
+                ASSERT_EQUALS( "shard0001" , shardFor( m , BSON( "a" << -5 ) ) );
+                ASSERT_EQUALS( "shard0000" , shardFor( m , BSON( "a" << 5 ) ) );
+            }
+        };
+
+    } // namespace ChunkManagerTests
+
     class All : public Suite {
     public:
         All() : Suite( "sharding" ){
@@ -50,6 +208,10 @@ namespace ShardingTests {
 
         void setupTests(){
             add< serverandquerytests::test1 >();
+            add< ChunkManagerTests::IncrementalSplitAndMove >();
+            add< ChunkManagerTests::FullReloadOnGap >();
+            add< ChunkManagerTests::FullReloadAfterReshard >();
+            add< ChunkManagerTests::FullReloadAfterReshardNewer >();
         }
     } myall;
         
@@ -21,6 +21,9 @@
 #include "../bson/util/atomic_int.h"
 #include "../util/concurrency/mvar.h"
 #include "../util/concurrency/thread_pool.h"
+#include "../util/concurrency/qlock.h"
+#include "../util/concurrency/synchronization.h"
+#include "../db/cmdline.h"
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
 
@@ -129,6 +132,34 @@ namespace ThreadedTests {
         }
     };
 
+    class NotifyAllTest {
+        NotifyAll _n;
+        NotifyAll::When _ticket;
+        AtomicUInt _woken;
+
+        void waiter(){
+            if ( _n.timedWaitFor( _ticket , 60 * 1000 ) )
+                _woken++;
+        }
+
+        public:
+        void run(){
+            _ticket = _n.now();
+            ASSERT( ! _n.timedWaitFor( _ticket , 10 ) );
+
+            boost::thread a( boost::bind( &NotifyAllTest::waiter , this ) );
+            boost::thread b( boost::bind( &NotifyAllTest::waiter , this ) );
+            // the waiters may not be waiting yet: their ticket is from before, so they still wake
+            _n.notifyAll();
+            a.join();
+            b.join();
+
+            ASSERT( _woken == 2u );
+            ASSERT( _n.timedWaitFor( _ticket , 0 ) );
+            ASSERT( _n.now() != _ticket );
+        }
+    };
+
     class LockTest {
     public:
         void run(){
@@ -143,6 +174,79 @@ namespace ThreadedTests {
         }
     };
 
+    class QLockTest : public ThreadedTest<> {
+        static const int iterations = 5000;
+        QLock q;
+        AtomicUInt nW, nR, nw, bad;
+
+        void subthread(){
+            for( int i = 0; i < iterations; i++ ) {
+                switch( i % 8 ) {
+                case 0:
+                    q.lock_W();
+                    nW++;
+                    if( nW != 1 || nR != 0 || nw != 0 ) bad++;
+                    nW--;
+                    q.unlock_W();
+                    break;
+                case 1:
+                    q.lock_R();
+                    nR++;
+                    if( nW != 0 || nw != 0 ) bad++;
+                    nR--;
+                    q.unlock_R();
+                    break;
+                case 2: case 3: case 4:
+                    q.lock_w();
+                    nw++;
+                    if( nW != 0 || nR != 0 ) bad++;
+                    nw--;
+                    q.unlock_w();
+                    break;
+                default:
+                    q.lock_r();
+                    if( nW != 0 ) bad++;
+                    q.unlock_r();
+                }
+            }
+        }
+        void validate(){
+            ASSERT_EQUALS( 0u , (unsigned) bad );
+            ASSERT( q.lock_W_try(0) );
+            q.unlock_W();
+        }
+    };
+
+    class PerDbLockTest {
+    public:
+        void run(){
+            bool old = cmdLine.perDbLocking;
+            cmdLine.perDbLocking = true;
+            {
+                writelock lk( "perdblocktest.foo" );
+                ASSERT( dbMutex.lockedDB() );
+                ASSERT_EQUALS( "perdblocktest" , dbMutex.lockedDB()->name() );
+                ASSERT( dbMutex.isWriteLocked() );
+                ASSERT( !dbMutex.isGlobalWriteLocked() );
+                {
+                    readlock again( "perdblocktest.bar" );
+                    writelock oplog( "local.oplog.$main" );
+                    ASSERT( dbMutex.inNestedDBLock() );
+                }
+                ASSERT( !dbMutex.inNestedDBLock() );
+                ASSERT_EXCEPTION( writelock other( "perdblocktestother.foo" ) , MsgAssertionException );
+                ASSERT_EXCEPTION( writelock global( "" ) , MsgAssertionException );
+            }
+            ASSERT( !dbMutex.atLeastReadLocked() );
+            {
+                // admin always takes the global lock
+                writelock lk( "admin.foo" );
+                ASSERT( dbMutex.isGlobalWriteLocked() );
+            }
+            cmdLine.perDbLocking = old;
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "threading" ){
@@ -152,7 +256,10 @@ namespace ThreadedTests {
             add< IsAtomicUIntAtomic >();
             add< MVarTest >();
             add< ThreadPoolTest >();
+            add< NotifyAllTest >();
             add< LockTest >();
+            add< QLockTest >();
+            add< PerDbLockTest >();
         }
     } myall;
 }
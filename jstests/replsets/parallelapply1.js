@@ -0,0 +1,65 @@
+// with --perDbLocking a secondary applies a batch touching several databases a part per database,
+// at once.  each document's ops must still land in oplog order, and minvalid must be back behind
+// the oplog's end once the secondary has caught up.
+
+doTest = function( signal ) {
+
+    var replTest = new ReplSetTest( { name : 'parallelApply', nodes : 2, oplogSize : 20 } );
+    var nodes = replTest.startSet( { replApplyThreads : 4 , perDbLocking : null } );
+    replTest.initiate();
+
+    var master = replTest.getMaster();
+    var nDbs = 4;
+    var nDocs = 200;
+    function coll( conn , c ){
+        return conn.getDB( "parallelapply" + c ).foo;
+    }
+
+    for ( var c = 0; c < nDbs; c++ )
+        coll( master , c ).insert( { _id : -1 } );
+    replTest.awaitReplication();
+
+    var slave = replTest.liveNodes.slaves[ 0 ];
+    slave.setSlaveOk();
+
+    // hold the secondary's writes so what follows reaches it as big batches
+    assert.commandWorked( slave.getDB( "admin" ).runCommand( { fsync : 1 , lock : 1 } ) );
+
+    // interleaved across the databases: insert, a run of updates, then for some a delete and a
+    // re-insert -- applied out of order any of these would leave a different result
+    for ( var i = 0; i < nDocs; i++ ) {
+        for ( var c = 0; c < nDbs; c++ ) {
+            var t = coll( master , c );
+            t.insert( { _id : i , v : 0 , a : [] } );
+            for ( var j = 1; j <= 3; j++ )
+                t.update( { _id : i } , { $set : { v : j } , $push : { a : j } } );
+            if ( i % 5 == c ) {
+                t.remove( { _id : i } );
+                t.insert( { _id : i , v : "again" } );
+            }
+        }
+    }
+    assert.isnull( master.getDB( "parallelapply0" ).getLastError() );
+
+    slave.getDB( "admin" ).$cmd.sys.unlock.findOne();
+    replTest.awaitReplication();
+
+    for ( var c = 0; c < nDbs; c++ ) {
+        var expected = coll( master , c ).find().sort( { _id : 1 } ).toArray();
+        var got = coll( slave , c ).find().sort( { _id : 1 } ).toArray();
+        assert.eq( nDocs + 1, got.length, "db " + c + " count" );
+        assert.eq( tojson( expected ), tojson( got ), "db " + c + " contents" );
+    }
+
+    // minvalid was moved ahead of each split batch, and we have got back past it
+    var minvalid = slave.getDB( "local" ).replset.minvalid.findOne();
+    assert( minvalid, "no minvalid" );
+    var last = slave.getDB( "local" ).oplog.rs.find().sort( { $natural : -1 } ).limit( 1 ).next();
+    assert( minvalid.ts.t < last.ts.t || ( minvalid.ts.t == last.ts.t && minvalid.ts.i <= last.ts.i ),
+            "minvalid " + tojson( minvalid.ts ) + " past the oplog's end " + tojson( last.ts ) );
+    assert.eq( 2, slave.getDB( "admin" ).runCommand( { replSetGetStatus : 1 } ).myState, "not secondary" );
+
+    replTest.stopSet( signal );
+}
+
+doTest( 15 );
@@ -0,0 +1,66 @@
+// initial sync clones collections over several connections at once, then builds each collection's
+// indexes from one scan.  a new member must end up with the same documents and indexes.
+
+doTest = function( signal ) {
+
+    var replTest = new ReplSetTest( { name : 'parallelClone', nodes : 1, oplogSize : 20 } );
+    replTest.startSet();
+    replTest.initiate();
+
+    var master = replTest.getMaster();
+    var dbs = [ "parallelclone_a", "parallelclone_b" ];
+    var nColls = 6;
+    var nDocs = 500;
+
+    dbs.forEach( function( name ) {
+        var mdb = master.getDB( name );
+        for ( var c = 0; c < nColls; c++ ) {
+            var t = mdb[ "c" + c ];
+            for ( var i = 0; i < nDocs; i++ )
+                t.insert( { _id : i , x : i % 17 , y : "y" + i , z : [ i , -i ] , loc : [ i % 90 , i % 45 ] } );
+            t.ensureIndex( { x : 1 } );
+            t.ensureIndex( { y : 1 } , { unique : true } );
+            t.ensureIndex( { z : 1 , x : -1 } );
+            if ( c == 0 )
+                t.ensureIndex( { loc : "2d" } );
+        }
+        mdb.createCollection( "capped" , { capped : true , size : 10000 } );
+        for ( var i = 0; i < 200; i++ )
+            mdb.capped.insert( { i : i } );
+        assert.isnull( mdb.getLastError() );
+    } );
+
+    // a new member, which must clone all of the above
+    var slave = replTest.add();
+    replTest.reInitiate();
+    replTest.awaitSecondaryNodes();
+    replTest.awaitReplication();
+    slave.setSlaveOk();
+
+    var indexKeys = function( t ) {
+        return t.getIndexes().map( function( z ) { return tojson( z.key ) + ( z.unique ? " unique" : "" ); } ).sort();
+    }
+
+    dbs.forEach( function( name ) {
+        var mdb = master.getDB( name );
+        var sdb = slave.getDB( name );
+        for ( var c = 0; c < nColls; c++ ) {
+            var m = mdb[ "c" + c ];
+            var s = sdb[ "c" + c ];
+            assert.eq( nDocs , s.count() , name + ".c" + c + " count" );
+            assert.eq( indexKeys( m ) , indexKeys( s ) , name + ".c" + c + " indexes" );
+            assert.eq( tojson( m.find().sort( { _id : 1 } ).toArray() ) , tojson( s.find().sort( { _id : 1 } ).toArray() ) ,
+                       name + ".c" + c + " contents" );
+            // the indexes were built from the cloned data
+            assert.eq( m.find( { x : 3 } ).hint( { x : 1 } ).itcount() , s.find( { x : 3 } ).hint( { x : 1 } ).itcount() , name + ".c" + c + " x" );
+            assert.eq( 1 , s.find( { y : "y7" } ).hint( { y : 1 } ).itcount() , name + ".c" + c + " y" );
+        }
+        assert.eq( nDocs , sdb.c0.find( { loc : { $near : [ 0 , 0 ] } } ).limit( nDocs ).itcount() , name + " 2d" );
+        assert.eq( mdb.capped.count() , sdb.capped.count() , name + ".capped count" );
+        assert( sdb.capped.isCapped() , name + ".capped not capped" );
+    } );
+
+    replTest.stopSet( signal );
+}
+
+doTest( 15 );
@@ -0,0 +1,50 @@
+// insert1.js - a batch insert through mongos goes to each shard as one message per shard
+
+s = new ShardingTest( "insert1" , 2 , 1 , 2 );
+s2 = s._mongos[1];
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { num : 1 } } );
+
+db = s.getDB( "test" );
+a = db.foo;
+b = s2.getDB( "test" ).foo;
+
+primary = s.getServer( "test" ).getDB( "test" ).foo;
+secondary = s.getOther( primary.name ).getDB( "test" ).foo;
+
+// the second mongos loads the config now, so it is stale after the move
+assert.eq( 0 , b.find().itcount() , "b empty" );
+
+s.adminCommand( { split : "test.foo" , middle : { num : 50 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { num : 50 } , to : s.getOther( s.getServer( "test" ) ).name } );
+
+// ---- stale config: the part for the moved chunk is routed again ----
+
+var docs = [];
+for ( var i = 0; i < 100; i++ )
+    docs.push( { _id : i , num : i } );
+b.insert( docs );
+assert.isnull( s2.getDB( "test" ).getLastError() , "stale gle" );
+
+assert.eq( 100 , a.find().itcount() , "stale all" );
+assert.eq( 50 , primary.count() , "stale primary" );
+assert.eq( 50 , secondary.count() , "stale secondary" );
+assert.eq( 0 , primary.find( { num : { $gte : 50 } } ).itcount() , "stale none misplaced" );
+
+// ---- duplicate key: that shard's part stops there, the other shard's part all goes in ----
+
+a.insert( [ { _id : 200 , num : 10.5 } ,
+            { _id : 2 , num : 2 } ,     // dup
+            { _id : 201 , num : 20.5 } ,
+            { _id : 300 , num : 60.5 } ,
+            { _id : 301 , num : 70.5 } ] );
+var gle = db.getLastError();
+assert( gle && gle.match( /E11000/ ) , "dup gle: " + gle );
+
+assert.eq( 1 , a.find( { _id : 200 } ).itcount() , "before the dup" );
+assert.eq( 0 , a.find( { _id : 201 } ).itcount() , "after the dup, same shard" );
+assert.eq( 2 , a.find( { _id : { $in : [ 300 , 301 ] } } ).itcount() , "other shard" );
+assert.eq( 103 , a.find().itcount() , "dup all" );
+
+s.stop();
@@ -0,0 +1,48 @@
+// migrate_back1.js - a chunk moved away and straight back.  with a cursor open the old shard deletes
+// its copy in the background, so it refuses the chunk until that is done rather than clone it into
+// a range the deleter would then empty
+
+s = new ShardingTest( "migrate_back1" , 2 , 0 , 1 , { shardOptions : { rangeDeleteRate : 200 } } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { _id : 1 } } );
+
+db = s.getDB( "test" );
+
+var N = 2000;
+for ( var i = 0; i < N; i++ )
+    db.foo.insert( { _id : i , i : i } );
+assert.isnull( db.getLastError() );
+
+var primary = s.getServer( "test" );
+var other = s.getOther( primary );
+
+// with no cursors open the old copy would be deleted before movechunk returns
+var cursor = primary.getDB( "test" ).foo.find().batchSize( 2 );
+cursor.next();
+
+s.adminCommand( { movechunk : "test.foo" , find : { _id : 0 } , to : other.name } );
+assert.eq( N , other.getDB( "test" ).foo.count() , "moved" );
+
+// the range waits on the cursor, then takes about 10s to delete at 200 a second
+var res = s.admin.runCommand( { movechunk : "test.foo" , find : { _id : 0 } , to : primary.name } );
+printjson( res );
+assert( ! res.ok , "moved back while the range was being deleted" );
+assert( tojson( res ).match( /still being deleted/ ) , "wrong error: " + tojson( res ) );
+assert.eq( N , db.foo.find().itcount() , "count after refused move" );
+
+// once the cursor is done and the old copy is gone it can come back
+cursor.itcount();
+assert.soon( function(){
+    var r = s.admin.runCommand( { movechunk : "test.foo" , find : { _id : 0 } , to : primary.name } );
+    if ( ! r.ok )
+        print( "migrate_back1: waiting to move back: " + r.errmsg );
+    return r.ok;
+} , "never moved back" , 60000 , 1000 );
+
+assert.eq( N , primary.getDB( "test" ).foo.count() , "all back" );
+assert.eq( N , db.foo.find().itcount() , "count through mongos" );
+for ( var i = 0; i < N; i += 97 )
+    assert.eq( i , db.foo.findOne( { _id : i } ).i , "doc " + i );
+
+s.stop();
@@ -0,0 +1,44 @@
+// migrate_bandwidth1.js - a chunk's initial clone is pipelined in batches of about 1MB, and the
+// donor holds to --moveBandwidth over a sliding window while sending them
+
+s = new ShardingTest( "migrate_bandwidth1" , 2 , 0 , 1 , { shardOptions : { moveBandwidth : 1 } } );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { _id : 1 } } );
+
+db = s.getDB( "test" );
+
+var big = "";
+while ( big.length < 10000 )
+    big += "0123456789abcdefghijklmnopqrstuvwxyz";
+
+// about 8MB, so eight batches
+var N = 800;
+for ( var i = 0; i < N; i++ )
+    db.foo.insert( { _id : i , s : big , i : i } );
+assert.isnull( db.getLastError() );
+assert.eq( 1 , s.config.chunks.count() , "one chunk" );
+
+var from = s.getServer( "test" ).getDB( "test" ).foo;
+var to = s.getOther( s.getServer( "test" ) ).getDB( "test" ).foo;
+
+var start = new Date();
+assert( s.adminCommand( { movechunk : "test.foo" , find : { _id : 0 } , to : s.getOther( s.getServer( "test" ) ).name } ) , "move" );
+var millis = new Date() - start;
+print( "migrate_bandwidth1: moved about 8MB at 1MB/s in " + millis + "ms" );
+
+// the first batch goes at once, and a batch fills the window, so each later one waits a second for
+// the one before it to leave: 7s at least.  letting a batch go while the window had any room left
+// would send two a second and take about 4s
+assert.lt( 6500 , millis , "moved faster than --moveBandwidth" );
+
+assert.eq( N , to.count() , "all on the new shard" );
+assert.soon( function(){ return from.count() == 0; } , "old copy deleted" );
+assert.eq( N , db.foo.find().itcount() , "count through mongos" );
+for ( var i = 0; i < N; i += 37 ){
+    var o = db.foo.findOne( { _id : i } );
+    assert.eq( i , o.i , "doc " + i );
+    assert.eq( big , o.s , "doc " + i + " contents" );
+}
+
+s.stop();
@@ -0,0 +1,89 @@
+// prefetch1.js - a sorted query reads each shard's batches ahead on worker threads that outlive
+// the query.  the workers keep their shard connections, so later queries don't set the shard
+// version on them again, nor unset it
+
+s = new ShardingTest( "prefetch1" , 2 , 0 , 1 );
+
+// nothing but the queries below should run commands on the shards
+s.config.settings.update( { _id : "balancer" } , { $set : { stopped : true } } , true );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { num : 1 } } );
+
+db = s.getDB( "test" );
+
+var N = 2000;
+for ( var i = 0; i < N; i++ )
+    db.foo.insert( { num : i , x : i % 7 } );
+assert.isnull( db.getLastError() );
+
+s.adminCommand( { split : "test.foo" , middle : { num : N / 2 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { num : N - 1 } , to : s.getOther( s.getServer( "test" ) ).name } );
+assert.eq( 2 , s.onNumShards( "foo" ) , "on 2 shards" );
+
+function check( name ){
+    var a = db.foo.find().sort( { x : 1 , num : 1 } ).batchSize( 50 ).toArray();
+    assert.eq( N , a.length , name + " count" );
+    for ( var i = 1; i < a.length; i++ )
+        assert( a[i-1].x < a[i].x || ( a[i-1].x == a[i].x && a[i-1].num < a[i].num ) , name + " order at " + i );
+}
+
+// the shard that isn't also the config server
+var shard = s._connections[1];
+function commands(){
+    return shard.getDB( "admin" ).serverStatus().opcounters.command;
+}
+
+// every worker has seen the collection by the end of these
+for ( var i = 0; i < 20; i++ )
+    check( "warm " + i );
+
+var before = commands();
+var queries = 20;
+for ( var i = 0; i < queries; i++ )
+    check( "query " + i );
+var n = commands() - before;
+print( "prefetch1: " + n + " commands on the shard for " + queries + " sorted queries" );
+// a thread per batch set and unset the shard version for each: hundreds of commands
+assert.lt( n , queries , "shard version set or unset again" );
+
+// ---- sorted queries busy on both shards don't hold up others ----
+
+s.adminCommand( { shardcollection : "test.slow" , key : { num : 1 } } );
+s.adminCommand( { split : "test.slow" , middle : { num : 1 } } );
+s.adminCommand( { movechunk : "test.slow" , find : { num : 1 } , to : s.getOther( s.getServer( "test" ) ).name } );
+db.slow.insert( { num : 0 } );
+db.slow.insert( { num : 1 } );
+assert.isnull( db.getLastError() );
+assert.eq( 2 , s.onNumShards( "slow" ) , "slow on 2 shards" );
+
+// each reads both shards at once, so this is more reads than a fixed pool of 16 threads would run
+var nSlow = 20;
+var joins = [];
+for ( var i = 0; i < nSlow; i++ )
+    joins.push( startParallelShell( "db.slow.find( { $where : function(){ var d = new Date(); while ( new Date() - d < 15000 ); return true; } } ).sort( { num : 1 } ).itcount()" ) );
+
+function slowOnShard(){
+    var inprog = shard.getDB( "admin" ).currentOp().inprog;
+    var n = 0;
+    for ( var i = 0; i < inprog.length; i++ )
+        if ( inprog[i].ns == "test.slow" && inprog[i].query && inprog[i].query.$where )
+            n++;
+    return n;
+}
+assert.soon( function(){ return slowOnShard() == nSlow; } , "slow queries running" , 30000 );
+
+var start = new Date();
+check( "while slow" );
+var millis = new Date() - start;
+print( "prefetch1: sorted query took " + millis + "ms with " + nSlow + " slow ones running" );
+assert.gt( 4000 , millis , "sorted query waited for the slow ones" );
+assert.lt( 0 , slowOnShard() , "slow queries done first, the check proves nothing" );
+
+joins.forEach( function( join ){ join(); } );
+
+var e = db.foo.find().sort( { x : 1 , num : 1 } ).batchSize( 50 ).explain();
+printjson( e.parallel );
+assert( e.parallel , "no parallel stats" );
+
+s.stop();
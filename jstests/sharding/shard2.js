@@ -218,9 +218,13 @@ assert.eq( 2 , s.onNumShards( "foo" ) , "on 2 shards" );
 secondary.foo.insert( { num : -3 } );
 
 s.adminCommand( { movechunk : "test.foo" , find : { num : -2 } , to : secondary.getMongo().name } );
-assert.eq( 1 , s.onNumShards( "foo" ) , "on 1 shards" );
+// with a cursor open on the old shard, its copy is deleted in the background
+assert.soon( function(){ return s.onNumShards( "foo" ) == 1; } , "on 1 shards" );
 
-s.adminCommand( { movechunk : "test.foo" , find : { num : -2 } , to : primary.getMongo().name } );
+// and until it is gone the chunk can't come back
+assert.soon( function(){
+    return s.admin.runCommand( { movechunk : "test.foo" , find : { num : -2 } , to : primary.getMongo().name } ).ok;
+} , "move back" );
 assert.eq( 2 , s.onNumShards( "foo" ) , "on 2 shards again" );
 assert.eq( 3 , s.config.chunks.count() , "only 3 chunks" );
 
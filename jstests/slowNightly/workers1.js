@@ -0,0 +1,54 @@
+// mongod --workers: many connections served by a few worker threads, each keeping its own state
+
+var port = allocatePorts( 1 )[ 0 ];
+var baseName = "jstests_workers1";
+
+var m = startMongod( "--port", port, "--dbpath", "/data/db/" + baseName, "--workers", "4", "--auth", "--nohttpinterface", "--bind_ip", "127.0.0.1" );
+
+// no users yet, so localhost may add one
+m.getDB( "admin" ).addUser( "admin", "pwd" );
+assert( m.getDB( "admin" ).auth( "admin", "pwd" ) );
+
+var nConns = 500;
+var conns = [];
+for ( var i = 0; i < nConns; i++ ) {
+    var c = new Mongo( "127.0.0.1:" + port );
+    // getnonce and authenticate must pair up even though they may run on different workers
+    assert( c.getDB( "admin" ).auth( "admin", "pwd" ), "auth " + i );
+    conns.push( c );
+}
+
+var t = m.getDB( baseName ).foo;
+t.ensureIndex( { x : 1 }, true );
+
+for ( var i = 0; i < nConns; i++ ) {
+    conns[ i ].getDB( baseName ).foo.insert( { x : i } );
+}
+assert.eq( nConns, t.count() );
+
+// a dup key on every other connection: each getLastError reports only its own connection's error
+for ( var i = 0; i < nConns; i += 2 ) {
+    conns[ i ].getDB( baseName ).foo.insert( { x : i } );
+}
+for ( var i = 0; i < nConns; i++ ) {
+    var e = conns[ i ].getDB( baseName ).getLastError();
+    if ( i % 2 == 0 )
+        assert( e && e.match( /E11000/ ), "expected dup key on " + i + ": " + e );
+    else
+        assert.isnull( e, "unexpected error on " + i );
+}
+
+// requests from all the connections at once
+db = m.getDB( baseName );
+var s = startParallelShell( "db.getSisterDB( 'admin' ).auth( 'admin', 'pwd' ); " +
+                            "for ( var i = 0; i < 1000; i++ ) db.getSisterDB( '" + baseName + "' ).foo.find( { x : i % " + nConns + " } ).toArray();" );
+for ( var j = 0; j < 5; j++ ) {
+    for ( var i = 0; i < nConns; i++ ) {
+        assert.eq( 1, conns[ i ].getDB( baseName ).foo.find( { x : ( i + j ) % nConns } ).itcount() );
+    }
+}
+s();
+
+assert.gte( m.getDB( "admin" ).serverStatus().connections.current, nConns );
+
+stopMongod( port );
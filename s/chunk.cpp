@@ -608,9 +608,10 @@ namespace mongo {
 
     AtomicUInt ChunkManager::NextSequenceNumber = 1;
 
-    ChunkManager::ChunkManager( DBConfig * config , string ns , ShardKeyPattern pattern , bool unique ) : 
-        _config( config ) , _ns( ns ) , 
+    ChunkManager::ChunkManager( DBConfig * config , string ns , ShardKeyPattern pattern , bool unique , DBClientBase * configConn ) : 
+        _config( config ) , _configConn( configConn ) , _ns( ns ) , 
         _key( pattern ) , _unique( unique ) , 
+        _collectionLastmod( 0 ) ,
         _sequenceNumber(  ++NextSequenceNumber ), 
         _lock("rw:ChunkManager"), _nsLock( ConnectionString( configServer.modelServer() , ConnectionString::SYNC ) , ns )
     {
@@ -637,8 +638,152 @@ namespace mongo {
     }
     
     void ChunkManager::_reload(){
+        if ( _reloadIncremental() )
+            return;
+
         rwlock lk( _lock , true );
         _reload_inlock();
+        _sequenceNumber = ++NextSequenceNumber;
+    }
+
+    /* the connection a ChunkManager reads its chunks over: the config server's, unless the manager
+       was given one */
+    class ChunkReadConnection : boost::noncopyable {
+    public:
+        ChunkReadConnection( DBClientBase * given ) : _given( given ){
+            if ( ! _given )
+                _scoped.reset( new ScopedDbConnection( Chunk(0).modelServer() ) );
+        }
+        DBClientBase* get(){ return _given ? _given : _scoped->get(); }
+        DBClientBase* operator->(){ return get(); }
+        void done(){
+            if ( _scoped.get() )
+                _scoped->done();
+        }
+    private:
+        DBClientBase * _given;
+        scoped_ptr<ScopedDbConnection> _scoped;
+    };
+
+    /* when ns was last sharded or dropped, from its config.collections document */
+    static unsigned long long collectionLastmod( DBClientBase* conn , const string& ns ){
+        BSONObj o = conn->findOne( ShardNS::collection , BSON( "_id" << ns ) );
+        BSONElement e = o["lastmod"];
+        return e.type() == Date ? e.date().millis : 0;
+    }
+
+    unsigned long long ChunkManager::getCollectionLastmod() const {
+        rwlock lk( _lock , false );
+        return _collectionLastmod;
+    }
+
+    bool ChunkManager::_reloadIncremental(){
+        static Chunk temp(0);
+
+        // work on copies so requests keep routing on the current map until the swap below
+        ChunkMap chunkMap;
+        ShardChunkVersion maxVersion;
+        unsigned long long lastmod;
+        {
+            rwlock lk( _lock , false );
+            if ( _chunkMap.empty() )
+                return false;
+            chunkMap = _chunkMap;
+            maxVersion = getVersion_inlock();
+            lastmod = _collectionLastmod;
+        }
+
+        ChunkReadConnection conn( _configConn );
+
+        // dropped and sharded again since we read it: the new chunks can have versions past ours,
+        // and patched over our old ones would leave those that didn't on the old shards
+        if ( collectionLastmod( conn.get() , _ns ) != lastmod ){
+            conn.done();
+            log() << "ChunkManager: " << _ns << " was dropped or sharded again, doing a full reload" << endl;
+            return false;
+        }
+
+        BSONObjBuilder q;
+        q.append( "ns" , _ns );
+        {
+            BSONObjBuilder gt( q.subobjStart( "lastmod" ) );
+            gt.appendTimestamp( "$gt" , maxVersion );
+            gt.done();
+        }
+
+        auto_ptr<DBClientCursor> cursor = conn->query( temp.getNS() , Query( q.obj() ).sort( "lastmod" , 1 ) );
+        assert( cursor.get() );
+
+        vector<ChunkPtr> changed;
+        bool sameBoundaries = true;
+        while ( cursor->more() ){
+            BSONObj d = cursor->next();
+            if ( d["isMaxMarker"].trueValue() ){
+                continue;
+            }
+
+            ChunkPtr c( new Chunk( this ) );
+            c->unserialize( d );
+
+            // a changed chunk replaces every chunk we hold in its range
+            ChunkMap::iterator i = chunkMap.upper_bound( c->getMin() );
+            while ( i != chunkMap.end() && i->second->getMin().woCompare( c->getMax() ) < 0 ){
+                if ( i->second->getMin().woCompare( c->getMin() ) < 0 || i->second->getMax().woCompare( c->getMax() ) > 0 )
+                    sameBoundaries = false;
+                chunkMap.erase( i++ );
+            }
+            chunkMap[c->getMax()] = c;
+            changed.push_back( c );
+        }
+
+        if ( changed.empty() ){
+            // nothing newer than what we have.  if the config server's newest chunk is older than
+            // ours, the collection was dropped and sharded again and only a full reload will do
+            BSONObj newest = conn->findOne( temp.getNS() , Query( BSON( "ns" << _ns ) ).sort( "lastmod" , -1 ) );
+            conn.done();
+
+            if ( ShardChunkVersion( newest["lastmod"] ) < maxVersion )
+                return false;
+
+            rwlock lk( _lock , true );
+            _sequenceNumber = ++NextSequenceNumber;
+            return true;
+        }
+        conn.done();
+
+        if ( ! _isValid( chunkMap ) ){
+            log() << "ChunkManager: incremental reload of " << _ns << " left gaps, doing a full reload" << endl;
+            return false;
+        }
+
+        set<Shard> shards;
+        for ( ChunkMap::const_iterator i=chunkMap.begin(); i!=chunkMap.end(); ++i )
+            shards.insert( i->second->getShard() );
+
+        {
+            rwlock lk( _lock , true );
+            if ( getVersion_inlock() != maxVersion ){
+                // someone else reloaded while we were reading
+                _sequenceNumber = ++NextSequenceNumber;
+                return true;
+            }
+
+            _chunkMap.swap( chunkMap );
+            _shards.swap( shards );
+
+            if ( sameBoundaries ){
+                for ( unsigned i=0; i<changed.size(); i++ )
+                    _chunkRanges.reloadRange( _chunkMap , changed[i]->getMin() , changed[i]->getMax() );
+            }
+            else {
+                _chunkRanges.reloadAll( _chunkMap );
+            }
+
+            _sequenceNumber = ++NextSequenceNumber;
+        }
+
+        log(1) << "ChunkManager: reloaded " << changed.size() << " changed chunks of " << _ns << endl;
+        return true;
     }
 
     void ChunkManager::_reload_inlock(){
@@ -649,7 +794,7 @@ namespace mongo {
             _shards.clear();
             _load();
 
-            if (_isValid()){
+            if (_isValid(_chunkMap)){
                 _chunkRanges.reloadAll(_chunkMap);
                 return;
             }
@@ -669,7 +814,10 @@ namespace mongo {
     void ChunkManager::_load(){
         static Chunk temp(0);
         
-        ScopedDbConnection conn( temp.modelServer() );
+        ChunkReadConnection conn( _configConn );
+
+        // first, so a drop and reshard after this is noticed by the next reload
+        _collectionLastmod = collectionLastmod( conn.get() , _ns );
 
         // TODO really need the sort?
         auto_ptr<DBClientCursor> cursor = conn->query(temp.getNS(), QUERY("ns" << _ns).sort("lastmod",1), 0, 0, 0, 0,
@@ -691,18 +839,18 @@ namespace mongo {
         conn.done();
     }
 
-    bool ChunkManager::_isValid() const {
+    bool ChunkManager::_isValid( const ChunkMap& chunkMap ) {
 #define ENSURE(x) do { if(!(x)) { log() << "ChunkManager::_isValid failed: " #x << endl; return false; } } while(0)
 
-        if (_chunkMap.empty())
+        if (chunkMap.empty())
             return true;
 
         // Check endpoints
-        ENSURE(allOfType(MinKey, _chunkMap.begin()->second->getMin()));
-        ENSURE(allOfType(MaxKey, prior(_chunkMap.end())->second->getMax()));
+        ENSURE(allOfType(MinKey, chunkMap.begin()->second->getMin()));
+        ENSURE(allOfType(MaxKey, prior(chunkMap.end())->second->getMax()));
 
         // Make sure there are no gaps or overlaps
-        for (ChunkMap::const_iterator it=boost::next(_chunkMap.begin()), end=_chunkMap.end(); it != end; ++it){
+        for (ChunkMap::const_iterator it=boost::next(chunkMap.begin()), end=chunkMap.end(); it != end; ++it){
             ChunkMap::const_iterator last = prior(it);
 
             if (!(it->second->getMin() == last->second->getMax())){
@@ -261,7 +261,10 @@ namespace mongo {
     class ChunkManager {
     public:
 
-        ChunkManager( DBConfig * config , string ns , ShardKeyPattern pattern , bool unique );
+        /**
+         * @param configConn where to read the chunks from instead of the config server, for dbtests
+         */
+        ChunkManager( DBConfig * config , string ns , ShardKeyPattern pattern , bool unique , DBClientBase * configConn = 0 );
         virtual ~ChunkManager();
 
         string getns() const { return _ns; }
@@ -299,6 +302,18 @@ namespace mongo {
          */
         unsigned long long getSequenceNumber() const { return _sequenceNumber; }
         
+        /**
+         * brings this manager up to date with the config server
+         * only chunks changed since getVersion() are read
+         */
+        void reload(){ _reload(); }
+
+        /**
+         * when the collection was last sharded or dropped, from its config.collections document
+         * as of the last full reload
+         */
+        unsigned long long getCollectionLastmod() const;
+
         void getInfo( BSONObjBuilder& b ){
             b.append( "key" , _key.key() );
             b.appendBool( "unique" , _unique );
@@ -318,11 +333,19 @@ namespace mongo {
         void _reload_inlock();
         void _load();
 
+        /**
+         * reads only the chunks whose lastmod is past the highest version we hold and patches them
+         * into a copy of the map, which is swapped in at the end
+         * @return false if a full reload is needed instead
+         */
+        bool _reloadIncremental();
+
         void save_inlock( bool major );
         ShardChunkVersion getVersion_inlock() const;
         void ensureIndex_inlock();
         
         DBConfig * _config;
+        DBClientBase * _configConn; // see the constructor
         string _ns;
         ShardKeyPattern _key;
         bool _unique;
@@ -334,6 +357,9 @@ namespace mongo {
 
         set<Shard> _shards;
 
+        // config.collections' lastmod for _ns when the chunks were last read in full
+        unsigned long long _collectionLastmod;
+
         unsigned long long _sequenceNumber;
         
         mutable RWLock _lock;
@@ -346,7 +372,7 @@ namespace mongo {
         friend class ChunkRangeManager; // only needed for CRM::assertValid()
         static AtomicUInt NextSequenceNumber;
 
-        bool _isValid() const;
+        static bool _isValid( const ChunkMap& chunkMap );
     };
 
     // like BSONObjCmp. for use as an STL comparison functor
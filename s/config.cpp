@@ -75,7 +75,7 @@ namespace mongo {
         
         BSONObjBuilder val;
         val.append( "_id" , ns );
-        val.appendDate( "lastmod" , time(0) );
+        val.appendDate( "lastmod" , jsTime() );
         val.appendBool( "dropped" , _dropped );
         if ( _cm )
             _cm->getInfo( val );
@@ -233,7 +233,20 @@ namespace mongo {
         assert( cursor.get() );
         while ( cursor->more() ){
             BSONObj o = cursor->next();
-            _collections[o["_id"].String()] = CollectionInfo( this , o );
+            string ns = o["_id"].String();
+
+            // still sharded the same way, and not dropped and sharded again since: keep the
+            // ChunkManager and only read what changed
+            Collections::iterator i = _collections.find( ns );
+            if ( i != _collections.end() && i->second.isSharded() && ! o["dropped"].trueValue() &&
+                 o["lastmod"].type() == Date && i->second.getCM()->getCollectionLastmod() == o["lastmod"].date().millis &&
+                 o["key"].isABSONObj() && i->second.getCM()->getShardKey().key() == o["key"].Obj() &&
+                 i->second.getCM()->isUnique() == o["unique"].trueValue() ){
+                i->second.getCM()->reload();
+                continue;
+            }
+
+            _collections[ns] = CollectionInfo( this , o );
         }
         
         conn.done();        
@@ -109,6 +109,11 @@ namespace mongo {
         
         static ShardedConnectionInfo* get( bool create );
         static void reset();
+
+        /** for moving a connection's info between threads: take it out of this thread without deleting it */
+        static ShardedConnectionInfo* release();
+        /** make info (may be 0) this thread's, which must have none */
+        static void set( ShardedConnectionInfo* info );
         
         bool inForceVersionOkMode() const { 
             return _forceVersionOk;
@@ -33,6 +33,7 @@
 #include "../db/cmdline.h"
 #include "../db/queryoptimizer.h"
 #include "../db/btree.h"
+#include "../db/oplog.h"
 
 #include "../client/connpool.h"
 #include "../client/distlock.h"
@@ -42,6 +43,7 @@
 
 #include "shard.h"
 #include "d_logic.h"
+#include "d_rangedeleter.h"
 #include "config.h"
 #include "chunk.h"
 
@@ -104,73 +106,6 @@ namespace mongo {
 
     };
 
-    struct OldDataCleanup {
-        string ns;
-        BSONObj min;
-        BSONObj max;
-        set<CursorId> initial;
-        void doRemove(){
-            ShardForceVersionOkModeBlock sf;
-            writelock lk(ns);
-            RemoveSaver rs("moveChunk",ns,"post-cleanup");
-            long long num = Helpers::removeRange( ns , min , max , true , false , cmdLine.moveParanoia ? &rs : 0 );
-            log() << "moveChunk deleted: " << num << endl;
-        }
-    };
-    
-    void _cleanupOldData( OldDataCleanup cleanup ){
-        Client::initThread( "cleanupOldData");
-        log() << " (start) waiting to cleanup " << cleanup.ns << " from " << cleanup.min << " -> " << cleanup.max << "  # cursors:" << cleanup.initial.size() << endl;
-
-        int loops = 0;
-        Timer t;
-        while ( t.seconds() < 900 ){ // 15 minutes
-            assert( dbMutex.getState() == 0 );
-            sleepmillis( 20 );
-            
-            set<CursorId> now;
-            ClientCursor::find( cleanup.ns , now );            
-            
-            set<CursorId> left;
-            for ( set<CursorId>::iterator i=cleanup.initial.begin(); i!=cleanup.initial.end(); ++i ){
-                CursorId id = *i;
-                if ( now.count(id) )
-                    left.insert( id );
-            }
-            
-            if ( left.size() == 0 )
-                break;
-            cleanup.initial = left;
-            
-            if ( ( loops++ % 200 ) == 0 ){
-                log() << " (looping " << loops << ") waiting to cleanup " << cleanup.ns << " from " << cleanup.min << " -> " << cleanup.max << "  # cursors:" << cleanup.initial.size() << endl;
-                
-                stringstream ss;
-                for ( set<CursorId>::iterator i=cleanup.initial.begin(); i!=cleanup.initial.end(); ++i ){
-                    CursorId id = *i;
-                    ss << id << " ";
-                }
-                log() << " cursors: " << ss.str() << endl;
-            }
-        }
-        
-        cleanup.doRemove();
-
-        cc().shutdown();
-    }
-
-    void cleanupOldData( OldDataCleanup cleanup ){
-        try {
-            _cleanupOldData( cleanup );
-        }
-        catch ( std::exception& e ){
-            log() << " error cleaning old data:" << e.what() << endl;
-        }
-        catch ( ... ){
-            log() << " unknown error cleaning old data" << endl;
-        }
-    }
-
     class ChunkCommandHelper : public Command {
     public:
         ChunkCommandHelper( const char * name ) 
@@ -218,6 +153,10 @@ namespace mongo {
             assert( _reload.size() == 0 );
             assert( _memoryUsed == 0 );
 
+            _sent.clear();
+            _sentInWindow = 0;
+            _cloneTimer.reset();
+
             _active = true;
         }
         
@@ -308,6 +247,7 @@ namespace mongo {
                 }
                 i = l->erase( i );
                 size += t.objsize();
+                _memoryUsed -= t.objsize();
             }
             
             arr.done();
@@ -377,29 +317,78 @@ namespace mongo {
                 return false;
             }
 
-            readlock l( _ns ); 
-            Client::Context ctx( _ns );
+            int bytesSoFar = 0;
+            {
+                readlock l( _ns ); 
+                Client::Context ctx( _ns );
             
-            BSONArrayBuilder a( result.subarrayStart( "objects" ) );
+                BSONArrayBuilder a( result.subarrayStart( "objects" ) );
             
-            int bytesSoFar = 0;
+                // small batches keep the read lock short.  the recipient asks for the next batch
+                // while it inserts this one, so they don't cost a round trip each
+                static const int maxBytes = 1024 * 1024;
             
-            set<DiskLoc>::iterator i = _cloneLocs.begin();
-            for ( ; i!=_cloneLocs.end(); ++i ){
-                DiskLoc dl = *i;
-                BSONObj o = dl.obj();
-                if ( ( o.objsize() + bytesSoFar ) > ( 4 * 1024 * 1024 ) ){
-                    i--;
-                    break;
+                set<DiskLoc>::iterator i = _cloneLocs.begin();
+                for ( ; i!=_cloneLocs.end(); ++i ){
+                    DiskLoc dl = *i;
+                    BSONObj o = dl.obj();
+                    if ( bytesSoFar && ( o.objsize() + bytesSoFar ) > maxBytes )
+                        break;
+                    a.append( o );
+                    bytesSoFar += o.objsize();
                 }
-                a.append( o );
+                a.done();
+
+                _cloneLocs.erase( _cloneLocs.begin() , i );
             }
-            a.done();
 
-            _cloneLocs.erase( _cloneLocs.begin() , i );
+            // after unlocking, so a throttled migrate doesn't hold up writes
+            throttle( bytesSoFar );
+            _sent.push_back( make_pair( (long long)_cloneTimer.micros() , (long long)bytesSoFar ) );
+            _sentInWindow += bytesSoFar;
             return true;
         }
 
+        /**
+         * sleeps until a batch of bytes can go without taking the clone over --moveBandwidth in
+         * the last ThrottleWindow, so a stall doesn't earn a burst after it
+         */
+        void throttle( long long bytes ){
+            if ( cmdLine.moveBandwidth <= 0 || bytes == 0 )
+                return;
+
+            static const long long ThrottleWindow = 1000000; // micros
+            const long long allowed = cmdLine.moveBandwidth * 1024LL * 1024 * ThrottleWindow / 1000000;
+
+            long long now = _cloneTimer.micros();
+            ageSent( now - ThrottleWindow );
+
+            // the oldest batches that have to leave the window for this one to fit, all of them
+            // if it is bigger than allowed on its own
+            long long left = _sentInWindow;
+            list< pair<long long,long long> >::iterator i = _sent.begin();
+            while ( i != _sent.end() && left + bytes > allowed ){
+                left -= i->second;
+                ++i;
+            }
+            if ( i == _sent.begin() )
+                return;
+
+            --i;
+            long long wait = i->first + ThrottleWindow - now;
+            if ( wait > 0 )
+                sleepmicros( wait );
+            ageSent( i->first );
+        }
+
+        /** forgets the batches sent at or before micros */
+        void ageSent( long long micros ){
+            while ( ! _sent.empty() && _sent.front().first <= micros ){
+                _sentInWindow -= _sent.front().second;
+                _sent.pop_front();
+            }
+        }
+
         void aboutToDelete( const Database* db , const DiskLoc& dl ){
             dbMutex.assertWriteLocked();
 
@@ -414,6 +403,9 @@ namespace mongo {
             
         long long mbUsed() const { return _memoryUsed / ( 1024 * 1024 ); }
 
+        /** @return bytes of ids logged and not yet sent to the recipient */
+        long long bytesPending() const { return _memoryUsed; }
+
         bool _inCriticalSection;
 
     private:
@@ -435,6 +427,10 @@ namespace mongo {
         list<BSONObj> _deleted;
         long long _memoryUsed; // bytes in _reload + _deleted
 
+        Timer _cloneTimer;
+        list< pair<long long,long long> > _sent; // ( _cloneTimer micros , bytes ) of recent clone() batches
+        long long _sentInWindow; // bytes in _sent
+
     } migrateFromStatus;
     
     struct MigrateStatusHolder {
@@ -490,7 +486,9 @@ namespace mongo {
         virtual bool slaveOk() const { return false; }
         virtual bool adminOnly() const { return true; }
         virtual LockType locktype() const { return NONE; } 
-        
+
+        // ids of pending mods we'll leave for the critical section to transfer
+        static const long long MaxCriticalSectionBytes = 16 * 1024;
         
         bool run(const string& , BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool){
             // 1. parse options
@@ -504,8 +502,7 @@ namespace mongo {
             //    b) finish migrate
             //    c) update config server
             //    d) logChange to config server
-            // 6. wait for all current cursors to expire
-            // 7. remove data locally
+            // 6. remove the range locally now, or queue it if there are cursors that may still read it
             
             // -------------------------------
             
@@ -637,16 +634,22 @@ namespace mongo {
             timing.done( 3 );
             
             // 4. 
-            for ( int i=0; i<86400; i++ ){ // don't want a single chunk move to take more than a day
+            Timer waiting;
+            int steadyPolls = 0;
+            while ( waiting.seconds() < 86400 ){ // don't want a single chunk move to take more than a day
                 assert( dbMutex.getState() == 0 );
-                sleepsecs( 1 ); 
+                // once steady, look often so the critical section starts as soon as the mods are drained
+                if ( steadyPolls )
+                    sleepmillis( 10 );
+                else
+                    sleepsecs( 1 ); 
                 ScopedDbConnection conn( to );
                 BSONObj res;
                 bool ok = conn->runCommand( "admin" , BSON( "_recvChunkStatus" << 1 ) , res );
                 res = res.getOwned();
                 conn.done();
                 
-                log(0) << "_recvChunkStatus : " << res << " my mem used: " << migrateFromStatus.mbUsed() << endl;
+                log( steadyPolls ? 1 : 0 ) << "_recvChunkStatus : " << res << " my mem used: " << migrateFromStatus.mbUsed() << endl;
                 
                 if ( ! ok || res["state"].String() == "fail" ){
                     log( LL_ERROR ) << "_recvChunkStatus error : " << res << endl;
@@ -655,10 +658,15 @@ namespace mongo {
                     return false;
                 }
 
-                if ( res["state"].String() == "steady" )
-                    break;
+                if ( res["state"].String() == "steady" ){
+                    // the mods still pending are applied inside the critical section, so wait for
+                    // them to drain -- but not forever under a steady stream of writes
+                    if ( migrateFromStatus.bytesPending() < MaxCriticalSectionBytes || steadyPolls >= 100 )
+                        break;
+                    steadyPolls++;
+                }
 
-                if ( migrateFromStatus.mbUsed() > (500 * 1024 * 1024) ){
+                if ( migrateFromStatus.mbUsed() > 500 ){
                     // this is too much memory for us to use for this
                     // so we're going to abort the migrate
                     ScopedDbConnection conn( to );
@@ -754,22 +762,17 @@ namespace mongo {
 
             
             { // 6.
-                OldDataCleanup c;
-                c.ns = ns;
-                c.min = min.getOwned();
-                c.max = max.getOwned();
-                ClientCursor::find( ns , c.initial );
-                if ( c.initial.size() ){
-                    log() << "forking for cleaning up chunk data" << endl;
-                    boost::thread t( boost::bind( &cleanupOldData , c ) );
+                set<CursorId> cursors;
+                ClientCursor::find( ns , cursors );
+                if ( cursors.size() ){
+                    // the range deleter waits for the cursors open now to finish before deleting
+                    log() << "moveChunk queueing the range for deletion, # cursors:" << cursors.size() << endl;
+                    rangeDeleter.queue( ns , min , max , cursors );
                 }
                 else {
-                    log() << "doing delete inline" << endl;
-                    // 7.
-                    c.doRemove();
+                    log() << "moveChunk doing delete inline" << endl;
+                    rangeDeleter.deleteNow( ns , min , max );
                 }
-                    
-                
             }
             timing.done(6);            
 
@@ -877,9 +880,10 @@ namespace mongo {
             { // 3. initial bulk clone
                 state = CLONE;
                 
+                BSONObj res;
+                bool ok = fetchClone( conn.get() , &res );
                 while ( true ){
-                    BSONObj res;
-                    if ( ! conn->runCommand( "admin" , BSON( "_migrateClone" << 1 ) , res ) ){
+                    if ( ! ok ){
                         state = FAIL;
                         errmsg = "_migrateClone failed: ";
                         errmsg += res.toString();
@@ -889,21 +893,25 @@ namespace mongo {
                     }
                     
                     BSONObj arr = res["objects"].Obj();
-                    int thisTime = 0;
-
-                    writelock lk( ns );
+                    if ( arr.isEmpty() )
+                        break;
 
-                    BSONObjIterator i( arr );
-                    while( i.more() ){
-                        BSONObj o = i.next().Obj();
-                        Helpers::upsert( ns , o );
-                        thisTime++;
-                        numCloned++;
-                        clonedBytes += o.objsize();
+                    // the next batch is requested before inserting this one, so the donor reads
+                    // while we write
+                    BSONObj next;
+                    bool nextOk = false;
+                    boost::thread fetcher( boost::bind( &MigrateStatus::fetchCloneInto , conn.get() , &next , &nextOk ) );
+                    try {
+                        insertCloned( arr );
                     }
-                    
-                    if ( thisTime == 0 )
-                        break;
+                    catch ( ... ){
+                        fetcher.join();
+                        throw;
+                    }
+                    fetcher.join();
+
+                    res = next;
+                    ok = nextOk;
                 }
 
                 timing.done(3);
@@ -976,6 +984,54 @@ namespace mongo {
             conn.done();
         }
 
+        static bool fetchClone( DBClientBase * conn , BSONObj * res ){
+            try {
+                return conn->runCommand( "admin" , BSON( "_migrateClone" << 1 ) , *res );
+            }
+            catch ( std::exception& e ){
+                *res = BSON( "errmsg" << e.what() );
+                return false;
+            }
+        }
+
+        static void fetchCloneInto( DBClientBase * conn , BSONObj * res , bool * ok ){
+            *ok = fetchClone( conn , res );
+        }
+
+        /**
+         * inserts a batch of the initial clone.  the range was emptied beforehand, so these are plain
+         * inserts, and secondary index keys are added in key order at the end of the batch.
+         */
+        void insertCloned( const BSONObj& arr ){
+            writelock lk( ns );
+            Client::Context ctx( ns );
+
+            vector<BSONObj> existing;
+            {
+                BatchInsert batch( ns.c_str() );
+                BSONObjIterator i( arr );
+                while( i.more() ){
+                    BSONObj o = i.next().Obj();
+                    try {
+                        theDataFileMgr.insertWithObjMod( ns.c_str() , o );
+                        logOp( "i" , ns.c_str() , o );
+                    }
+                    catch ( UserException& e ){
+                        if ( e.getCode() != ASSERT_ID_DUPKEY )
+                            throw;
+                        existing.push_back( o );
+                    }
+                    numCloned++;
+                    clonedBytes += o.objsize();
+                }
+                batch.done();
+            }
+
+            // shouldn't happen, but an update must not run while the batch holds keys back
+            for ( unsigned i=0; i<existing.size(); i++ )
+                Helpers::upsert( ns , existing[i] );
+        }
+
         void status( BSONObjBuilder& b ){
             b.appendBool( "active" , active );
 
@@ -1102,15 +1158,25 @@ namespace mongo {
                 return false;
             }
             
+            string ns = cmdObj.firstElement().String();
+            BSONObj min = cmdObj["min"].Obj().getOwned();
+            BSONObj max = cmdObj["max"].Obj().getOwned();
+
+            // the deleter would remove what we clone in
+            if ( rangeDeleter.overlaps( ns , min , max ) ){
+                errmsg = "documents in this range are still being deleted from an earlier migrate";
+                return false;
+            }
+
             if ( ! configServer.ok() )
                 configServer.init( cmdObj["configServer"].String() );
 
             migrateStatus.prepare();
 
-            migrateStatus.ns = cmdObj.firstElement().String();
+            migrateStatus.ns = ns;
             migrateStatus.from = cmdObj["from"].String();
-            migrateStatus.min = cmdObj["min"].Obj().getOwned();
-            migrateStatus.max = cmdObj["max"].Obj().getOwned();
+            migrateStatus.min = min;
+            migrateStatus.max = max;
             
             boost::thread m( migrateThread );
             
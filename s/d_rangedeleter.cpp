@@ -0,0 +1,216 @@
+// d_rangedeleter.cpp
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "../db/dbhelpers.h"
+#include "../db/cmdline.h"
+#include "../db/instance.h"
+#include "../util/timer.h"
+
+#include "d_logic.h"
+#include "d_rangedeleter.h"
+
+using namespace std;
+
+namespace mongo {
+
+    RangeDeleter rangeDeleter;
+
+    RangeDeleter::RangeDeleter()
+        : _mutex( "RangeDeleter" ) , _started( false ) ,
+          _docsDeleted( 0 ) , _rangesDeleted( 0 ) , _microsDeleting( 0 ){
+    }
+
+    void RangeDeleter::queue( const string& ns , const BSONObj& min , const BSONObj& max , const set<CursorId>& cursors ){
+        Task t;
+        t.ns = ns;
+        t.min = min.getOwned();
+        t.max = max.getOwned();
+        t.cursors = cursors;
+        t.queued = time(0);
+
+        scoped_lock lk( _mutex );
+        _tasks.push_back( t );
+        if ( ! _started ){
+            _started = true;
+            boost::thread thr( boost::bind( &RangeDeleter::_run , this ) );
+        }
+        _queuedCond.notify_one();
+    }
+
+    void RangeDeleter::deleteNow( const string& ns , const BSONObj& min , const BSONObj& max ){
+        assert( dbMutex.getState() == 0 );
+        Task t;
+        t.ns = ns;
+        t.min = min;
+        t.max = max;
+        t.queued = time(0);
+        _delete( t );
+    }
+
+    static bool overlap( const string& ns , const BSONObj& min , const BSONObj& max ,
+                         const string& tns , const BSONObj& tmin , const BSONObj& tmax ){
+        return ns == tns && min.woCompare( tmax ) < 0 && tmin.woCompare( max ) < 0;
+    }
+
+    bool RangeDeleter::overlaps( const string& ns , const BSONObj& min , const BSONObj& max ) const {
+        scoped_lock lk( _mutex );
+        if ( overlap( ns , min , max , _current.ns , _current.min , _current.max ) )
+            return true;
+        for ( list<Task>::const_iterator i=_tasks.begin(); i!=_tasks.end(); ++i )
+            if ( overlap( ns , min , max , i->ns , i->min , i->max ) )
+                return true;
+        return false;
+    }
+
+    void RangeDeleter::appendStats( BSONObjBuilder& b ) const {
+        scoped_lock lk( _mutex );
+
+        int waiting = 0;
+        for ( list<Task>::const_iterator i=_tasks.begin(); i!=_tasks.end(); ++i )
+            if ( i->cursors.size() )
+                waiting++;
+
+        b.append( "pending" , (int)_tasks.size() );
+        b.append( "waitingOnCursors" , waiting );
+        if ( _current.ns.size() ){
+            BSONObjBuilder bb( b.subobjStart( "current" ) );
+            bb.append( "ns" , _current.ns );
+            bb.append( "min" , _current.min );
+            bb.append( "max" , _current.max );
+            bb.done();
+        }
+        b.appendNumber( "rangesDeleted" , _rangesDeleted );
+        b.appendNumber( "docsDeleted" , _docsDeleted );
+        b.appendNumber( "millisDeleting" , _microsDeleting / 1000 );
+        // while holding the lock, so it doesn't count --rangeDeleteRate's sleeps
+        b.append( "docsPerSec" , _microsDeleting ? (int)( _docsDeleted * 1000000 / _microsDeleting ) : 0 );
+    }
+
+    void RangeDeleter::_run(){
+        Client::initThread( "rangeDeleter" );
+
+        while ( ! inShutdown() ){
+            assert( dbMutex.getState() == 0 );
+
+            Task t;
+            if ( ! _next( t ) ){
+                sleepmillis( 20 );
+                continue;
+            }
+
+            try {
+                _delete( t );
+            }
+            catch ( std::exception& e ){
+                log() << "rangeDeleter: error deleting " << t.ns << " from " << t.min << " -> " << t.max << " : " << e.what() << endl;
+            }
+
+            scoped_lock lk( _mutex );
+            _current = Task();
+        }
+
+        cc().shutdown();
+    }
+
+    bool RangeDeleter::_next( Task& t ){
+        scoped_lock lk( _mutex );
+        while ( _tasks.empty() ){
+            // wake now and then so _run notices shutdown
+            boost::xtime xt;
+            boost::xtime_get( &xt , boost::TIME_UTC );
+            xt.sec += 1;
+            _queuedCond.timed_wait( lk.boost() , xt );
+            if ( inShutdown() )
+                return false;
+        }
+
+        for ( list<Task>::iterator i=_tasks.begin(); i!=_tasks.end(); ++i ){
+            if ( i->cursors.size() ){
+                set<CursorId> now;
+                ClientCursor::find( i->ns , now );
+
+                set<CursorId> left;
+                for ( set<CursorId>::iterator j=i->cursors.begin(); j!=i->cursors.end(); ++j ){
+                    if ( now.count( *j ) )
+                        left.insert( *j );
+                }
+                i->cursors = left;
+            }
+
+            if ( i->cursors.size() ){
+                if ( time(0) - i->queued < 900 ) // 15 minutes
+                    continue;
+                log() << "rangeDeleter: done waiting on " << i->cursors.size() << " cursors to cleanup "
+                      << i->ns << " from " << i->min << " -> " << i->max << endl;
+            }
+
+            t = *i;
+            _tasks.erase( i );
+            _current = t;
+            return true;
+        }
+
+        return false;
+    }
+
+    void RangeDeleter::_delete( const Task& t ){
+        // small enough that writers queued behind a batch barely notice it
+        static const int BatchSize = 128;
+
+        log() << "rangeDeleter: deleting " << t.ns << " from " << t.min << " -> " << t.max << endl;
+
+        RemoveSaver rs( "moveChunk" , t.ns , "post-cleanup" );
+
+        Timer elapsed;
+        long long num = 0;
+        BSONObj from = t.min;
+        while ( ! from.isEmpty() && ! inShutdown() ){
+            Timer batch;
+            long long n = 0;
+            {
+                ShardForceVersionOkModeBlock sf;
+                writelock lk( t.ns );
+                n = Helpers::removeRange( t.ns , from , t.max , false , false , cmdLine.moveParanoia ? &rs : 0 , BatchSize , &from );
+            }
+            num += n;
+
+            {
+                scoped_lock lk( _mutex );
+                _docsDeleted += n;
+                _microsDeleting += batch.micros();
+            }
+
+            if ( cmdLine.rangeDeleteRate > 0 ){
+                long long due = num * 1000000 / cmdLine.rangeDeleteRate;
+                long long ahead = due - (long long)elapsed.micros();
+                if ( ahead > 0 )
+                    sleepmicros( ahead );
+            }
+        }
+
+        {
+            scoped_lock lk( _mutex );
+            _rangesDeleted++;
+        }
+
+        log() << "moveChunk deleted: " << num << " from " << t.ns << " in " << elapsed.millis() << "ms" << endl;
+    }
+
+} // namespace mongo
@@ -0,0 +1,98 @@
+// @file d_rangedeleter.h
+
+/**
+*    Copyright (C) 2010 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../pch.h"
+
+#include "../db/clientcursor.h"
+
+namespace mongo {
+
+    /*
+     * The RangeDeleter removes the documents of chunks that have migrated off this shard. When no
+     * cursors are open on the collection as its migration commits, moveChunk deletes the range
+     * itself before returning. Otherwise the range is queued, and waits until the cursors open at
+     * that time are gone; one background thread then deletes the queued ranges in turn. Either way
+     * a range goes a small batch at a time along the shard key index, taking the write lock for
+     * each batch and holding to --rangeDeleteRate.
+     *
+     * The class is thread safe.
+     */
+    class RangeDeleter {
+    public:
+        RangeDeleter();
+
+        /*
+         * @param cursors the cursors on ns open when the chunk left, which may still be reading it
+         *
+         * Queues [min,max) of ns for deletion, starting the worker thread if need be.
+         */
+        void queue( const string& ns , const BSONObj& min , const BSONObj& max , const set<CursorId>& cursors );
+
+        /*
+         * Deletes [min,max) of ns on this thread, which must hold no lock. Not seen by overlaps():
+         * the caller still holds the collection's distributed lock, so no chunk can come back yet.
+         */
+        void deleteNow( const string& ns , const BSONObj& min , const BSONObj& max );
+
+        /*
+         * @return true if [min,max) of ns overlaps a range queued or being deleted, which a chunk
+         *         migrating back in must not be cloned into
+         */
+        bool overlaps( const string& ns , const BSONObj& min , const BSONObj& max ) const;
+
+        /*
+         * backlog and throughput, for serverStatus
+         */
+        void appendStats( BSONObjBuilder& b ) const;
+
+    private:
+        struct Task {
+            string ns;
+            BSONObj min;
+            BSONObj max;
+            set<CursorId> cursors;
+            time_t queued;
+        };
+
+        void _run();
+
+        // @return false if no queued range is ready to delete yet, or we are shutting down
+        bool _next( Task& t );
+
+        void _delete( const Task& t );
+
+        // protects everything below
+        mutable mongo::mutex _mutex;
+        boost::condition _queuedCond;
+
+        list<Task> _tasks;
+        bool _started;
+
+        // range being deleted, empty ns if none
+        Task _current;
+
+        long long _docsDeleted;
+        long long _rangesDeleted;
+        long long _microsDeleting;
+    };
+
+    extern RangeDeleter rangeDeleter;
+
+} // namespace mongo
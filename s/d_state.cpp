@@ -262,6 +262,15 @@ namespace mongo {
         _tl.reset();
     }
 
+    ShardedConnectionInfo* ShardedConnectionInfo::release(){
+        return _tl.release();
+    }
+
+    void ShardedConnectionInfo::set( ShardedConnectionInfo* info ){
+        assert( _tl.get() == 0 );
+        _tl.reset( info );
+    }
+
     ConfigVersion& ShardedConnectionInfo::getVersion( const string& ns ){
         return _versions[ns];
     }
@@ -186,6 +186,7 @@ int main(int argc, char* argv[], char *envp[] ) {
         ( "chunkSize" , po::value<int>(), "maximum amount of data per chunk" )
         ( "ipv6", "enable IPv6 support (disabled by default)" )
         ( "jsonp","allow JSONP access via http (has security implications)" )
+        ( "workers" , po::value<int>() , "serve connections with an event loop and this many worker threads, rather than a thread per connection (linux only)" )
         ;
 
     options.add(sharding_options);
@@ -303,6 +304,13 @@ int main(int argc, char* argv[], char *envp[] ) {
     MessageServer::Options opts;
     opts.port = cmdLine.port;
     opts.ipList = cmdLine.bind_ip;
+    if ( params.count( "workers" ) ){
+        opts.workerThreads = params["workers"].as<int>();
+        if ( opts.workerThreads < 1 || opts.workerThreads > 10000 ){
+            out() << "--workers must be between 1 and 10000" << endl;
+            return 11;
+        }
+    }
     start(opts);
 
     dbexit( EXIT_CLEAN );
@@ -79,6 +79,16 @@ namespace mongo {
         dbcon.done();
     }
 
+    void Strategy::insert( const Shard& shard , const char * ns , const vector<BSONObj>& v ){
+        ShardConnection dbcon( shard , ns );
+        if ( dbcon.setVersion() ){
+            dbcon.done();
+            throw StaleConfigException( ns , "for insert" );
+        }
+        dbcon->insert( ns , v );
+        dbcon.done();
+    }
+
     class WriteBackListener : public BackgroundJob {
     protected:
         string name() { return "WriteBackListener"; }
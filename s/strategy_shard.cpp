@@ -123,13 +123,21 @@ namespace mongo {
             cursorCache.remove( id );
         }
         
+        /* a shard's part of an insert batch */
+        struct ShardInserts {
+            vector<BSONObj> objs;
+            map<ChunkPtr,long> written; // bytes, by chunk
+        };
+
         void _insert( Request& r , DbMessage& d, ChunkManagerPtr manager ){
             
+            vector<BSONObj> toInsert;
+            bool bad = false;
             while ( d.moreJSObjs() ){
                 BSONObj o = d.nextJsObj();
                 if ( ! manager->hasShardKey( o ) ){
 
-                    bool bad = true;
+                    bad = true;
 
                     if ( manager->getShardKey().partOfShardKey( "_id" ) ){
                         BSONObjBuilder b;
@@ -141,37 +149,66 @@ namespace mongo {
                     
                     if ( bad ){
                         log() << "tried to insert object without shard key: " << r.getns() << "  " << o << endl;
-                        throw UserException( 8011 , "tried to insert object without shard key" );
+                        break; // those before it still go in
                     }
                     
                 }
 
                 // Many operations benefit from having the shard key early in the object
-                o = manager->getShardKey().moveToFront(o);
+                toInsert.push_back( manager->getShardKey().moveToFront(o) );
+            }
+
+            /* each shard gets its part of the batch in one message.  if a shard's version is stale
+               only its part is routed again.  as with a batch sent to one mongod, a shard stops at
+               the first insert that fails -- a duplicate key, say -- so the rest of its part isn't
+               inserted, while the other shards' parts are.  getLastError reports the failure */
+            for ( int i=0; i<10 && ! toInsert.empty(); i++ ){
+                map<Shard,ShardInserts> byShard;
+                for ( unsigned j=0; j<toInsert.size(); j++ ){
+                    BSONObj& o = toInsert[j];
+                    ChunkPtr c = manager->findChunk( o );
+                    log(4) << "  server:" << c->getShard().toString() << " " << o << endl;
+                    ShardInserts& s = byShard[ c->getShard() ];
+                    s.objs.push_back( o );
+                    s.written[c] += o.objsize();
+                }
 
-                bool gotThrough = false;
-                for ( int i=0; i<10; i++ ){
+                vector<BSONObj> stale;
+                vector<ChunkPtr> toSplitCheck;
+                vector<long> toSplitBytes;
+                for ( map<Shard,ShardInserts>::iterator j = byShard.begin(); j != byShard.end(); ++j ){
+                    ShardInserts& s = j->second;
                     try {
-                        ChunkPtr c = manager->findChunk( o );
-                        log(4) << "  server:" << c->getShard().toString() << " " << o << endl;
-                        insert( c->getShard() , r.getns() , o );
-                        
-                        r.gotInsert();
-                        c->splitIfShould( o.objsize() );
-                        gotThrough = true;
-                        break;
+                        insert( j->first , r.getns() , s.objs );
                     }
                     catch ( StaleConfigException& ){
-                        log(1) << "retrying insert because of StaleConfigException: " << o << endl;
-                        r.reset();
-                        manager = r.getChunkManager();
+                        log(1) << "retrying " << s.objs.size() << " inserts for " << j->first.toString() << " because of StaleConfigException" << endl;
+                        stale.insert( stale.end() , s.objs.begin() , s.objs.end() );
+                        continue;
+                    }
+                    for ( unsigned k=0; k<s.objs.size(); k++ )
+                        r.gotInsert();
+                    for ( map<ChunkPtr,long>::iterator k = s.written.begin(); k != s.written.end(); ++k ){
+                        toSplitCheck.push_back( k->first );
+                        toSplitBytes.push_back( k->second );
                     }
-                    sleepmillis( i * 200 );
                 }
 
-                assert( gotThrough );
+                for ( unsigned j=0; j<toSplitCheck.size(); j++ )
+                    toSplitCheck[j]->splitIfShould( toSplitBytes[j] );
+
+                toInsert.swap( stale );
+                if ( toInsert.empty() )
+                    break;
+                r.reset();
+                manager = r.getChunkManager();
+                sleepmillis( i * 200 );
+            }
+
+            assert( toInsert.empty() );
 
-            }            
+            if ( bad )
+                throw UserException( 8011 , "tried to insert object without shard key" );
         }
 
         void _update( Request& r , DbMessage& d, ChunkManagerPtr manager ){
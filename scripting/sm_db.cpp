@@ -309,6 +309,18 @@ namespace mongo {
         // TODO: add _id
         
         try {
+            if ( JS_IsArrayObject( cx , JSVAL_TO_OBJECT( argv[1] ) ) ){
+                // several documents in one message
+                vector<BSONObj> v;
+                BSONObjIterator i( o );
+                while ( i.more() ){
+                    BSONElement e = i.next();
+                    smuassert( cx , "can only insert objects" , e.isABSONObj() );
+                    v.push_back( e.embeddedObject() );
+                }
+                conn->insert( ns , v );
+                return JS_TRUE;
+            }
             conn->insert( ns , o );
             return JS_TRUE;
         }
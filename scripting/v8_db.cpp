@@ -292,6 +292,25 @@ namespace mongo {
         GETNS;
     
         v8::Handle<v8::Object> in = args[1]->ToObject();
+
+        if ( args[1]->IsArray() ){
+            // several documents in one message; DBCollection.insert has given each an _id
+            vector<BSONObj> v;
+            BSONObjIterator i( v8ToMongo( in ) );
+            while ( i.more() ){
+                BSONElement e = i.next();
+                jsassert( e.isABSONObj() , "have to insert objects" );
+                v.push_back( e.embeddedObject() );
+            }
+            try {
+                V8Unlock u;
+                conn->insert( ns , v );
+            }
+            catch ( ... ){
+                return v8::ThrowException( v8::String::New( "socket error on insert" ) );
+            }
+            return v8::Undefined();
+        }
     
         if ( ! in->Has( v8::String::New( "_id" ) ) ){
             v8::Handle<v8::Value> argv[1];
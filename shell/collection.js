@@ -159,6 +159,22 @@ DBCollection.prototype.findOne = function( query , fields ){
 DBCollection.prototype.insert = function( obj , _allow_dot ){
     if ( ! obj )
         throw "no object passed to insert!";
+    if ( obj instanceof Array ){
+        // one message; the server stops at the first that fails
+        var objs = [];
+        for ( var i = 0; i < obj.length; i++ )
+            objs.push( this._prepareInsert( obj[i] , _allow_dot ) );
+        this._mongo.insert( this._fullName , objs );
+        if ( objs.length )
+            this._lastID = objs[ objs.length - 1 ]._id;
+        return;
+    }
+    obj = this._prepareInsert( obj , _allow_dot );
+    this._mongo.insert( this._fullName , obj );
+    this._lastID = obj._id;
+}
+
+DBCollection.prototype._prepareInsert = function( obj , _allow_dot ){
     if ( ! _allow_dot ) {
         this._validateForStorage( obj );
     }
@@ -169,8 +185,7 @@ DBCollection.prototype.insert = function( obj , _allow_dot ){
             obj[key] = tmp[key];
         }
     }
-    this._mongo.insert( this._fullName , obj );
-    this._lastID = obj._id;
+    return obj;
 }
 
 DBCollection.prototype.remove = function( t , justOne ){
@@ -2779,6 +2779,22 @@ const StringData _jscode_raw_collection =
 "DBCollection.prototype.insert = function( obj , _allow_dot ){\n" 
 "if ( ! obj )\n" 
 "throw \"no object passed to insert!\";\n" 
+"if ( obj instanceof Array ){\n" 
+"// one message; the server stops at the first that fails\n" 
+"var objs = [];\n" 
+"for ( var i = 0; i < obj.length; i++ )\n" 
+"objs.push( this._prepareInsert( obj[i] , _allow_dot ) );\n" 
+"this._mongo.insert( this._fullName , objs );\n" 
+"if ( objs.length )\n" 
+"this._lastID = objs[ objs.length - 1 ]._id;\n" 
+"return;\n" 
+"}\n" 
+"obj = this._prepareInsert( obj , _allow_dot );\n" 
+"this._mongo.insert( this._fullName , obj );\n" 
+"this._lastID = obj._id;\n" 
+"}\n" 
+"\n" 
+"DBCollection.prototype._prepareInsert = function( obj , _allow_dot ){\n" 
 "if ( ! _allow_dot ) {\n" 
 "this._validateForStorage( obj );\n" 
 "}\n" 
@@ -2789,8 +2805,7 @@ const StringData _jscode_raw_collection =
 "obj[key] = tmp[key];\n" 
 "}\n" 
 "}\n" 
-"this._mongo.insert( this._fullName , obj );\n" 
-"this._lastID = obj._id;\n" 
+"return obj;\n" 
 "}\n" 
 "\n" 
 "DBCollection.prototype.remove = function( t , justOne ){\n" 
@@ -0,0 +1,126 @@
+// util/compress.cpp
+
+/*    Copyright 2010 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "pch.h"
+#include "compress.h"
+
+namespace mongo {
+    namespace compress {
+
+        /* the stream is a sequence of
+             000LLLLL <L+1 literal bytes>                    L+1 in 1..32
+             LLLooooo oooooooo                               back reference of length L+2, L in 1..6
+             111ooooo LLLLLLLL oooooooo                      back reference of length L+9
+           where the 13 bit o is the distance back from the current output position, minus one.
+        */
+        const int HashLog = 13;
+        const int MaxLiteral = 32;
+        const int MaxOffset = 1 << 13;
+        const int MaxMatch = 7 + 255 + 2;
+
+        inline unsigned hash( const unsigned char *p ) {
+            unsigned v = ( p[0] << 16 ) | ( p[1] << 8 ) | p[2];
+            return ( ( v * 2654435761U ) >> ( 32 - HashLog ) ) & ( ( 1 << HashLog ) - 1 );
+        }
+
+        static void literals( const unsigned char *from , int n , string& out ) {
+            while ( n > 0 ) {
+                int k = n < MaxLiteral ? n : MaxLiteral;
+                out += (char) ( k - 1 );
+                out.append( (const char *) from , k );
+                from += k;
+                n -= k;
+            }
+        }
+
+        void block( const char *in_ , int len , string& out ) {
+            const unsigned char *in = (const unsigned char *) in_;
+            vector<int> table( 1 << HashLog , -1 );
+            out.reserve( out.size() + len + len / MaxLiteral + 16 );
+
+            int ip = 0;
+            int litStart = 0;
+            while ( ip + 2 < len ) {
+                unsigned h = hash( in + ip );
+                int ref = table[h];
+                table[h] = ip;
+                int off = ip - ref - 1;
+                if ( ref < 0 || off >= MaxOffset ||
+                     in[ref] != in[ip] || in[ref+1] != in[ip+1] || in[ref+2] != in[ip+2] ) {
+                    ip++;
+                    continue;
+                }
+
+                int maxLen = len - ip < MaxMatch ? len - ip : MaxMatch;
+                int l = 3;
+                while ( l < maxLen && in[ref+l] == in[ip+l] )
+                    l++;
+
+                literals( in + litStart , ip - litStart , out );
+                int code = l - 2;
+                if ( code < 7 ) {
+                    out += (char) ( ( code << 5 ) | ( off >> 8 ) );
+                }
+                else {
+                    out += (char) ( ( 7 << 5 ) | ( off >> 8 ) );
+                    out += (char) ( code - 7 );
+                }
+                out += (char) ( off & 0xff );
+
+                ip += l;
+                litStart = ip;
+            }
+            literals( in + litStart , len - litStart , out );
+        }
+
+        bool unblock( const char *in_ , int len , char *out , int outLen ) {
+            const unsigned char *in = (const unsigned char *) in_;
+            int ip = 0;
+            int op = 0;
+            while ( ip < len ) {
+                unsigned ctrl = in[ip++];
+                if ( ctrl < (unsigned) MaxLiteral ) {
+                    int n = ctrl + 1;
+                    if ( ip + n > len || op + n > outLen )
+                        return false;
+                    memcpy( out + op , in + ip , n );
+                    ip += n;
+                    op += n;
+                    continue;
+                }
+
+                int l = ctrl >> 5;
+                if ( l == 7 ) {
+                    if ( ip >= len )
+                        return false;
+                    l += in[ip++];
+                }
+                l += 2;
+                if ( ip >= len )
+                    return false;
+                int ref = op - ( ( ctrl & 0x1f ) << 8 ) - in[ip++] - 1;
+                if ( ref < 0 || op + l > outLen )
+                    return false;
+                // byte at a time: the reference may overlap what it produces
+                for ( int i = 0; i < l; i++ )
+                    out[op++] = out[ref++];
+            }
+            return op == outLen;
+        }
+
+    }
+}
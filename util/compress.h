@@ -0,0 +1,37 @@
+// util/compress.h
+
+/*    Copyright 2010 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+namespace mongo {
+
+    /* LZF-format block compression.  Built for speed over ratio: it is used on query replies
+       (QueryOption_CompressReply), where the repeated field names and namespaces of oplog
+       entries compress well and the cpu cost must stay small next to the network.
+    */
+    namespace compress {
+
+        /* appends the compressed form of in[0..len) to out */
+        void block( const char *in , int len , string& out );
+
+        /* decompresses in[0..len) into out, which must be exactly outLen bytes long once
+           decompressed.  returns false if the input is malformed.
+        */
+        bool unblock( const char *in , int len , char *out , int outLen );
+
+    }
+}
@@ -0,0 +1,142 @@
+// @file qlock.h
+
+/*
+ *    Copyright (C) 2010 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "mutex.h"
+#include <boost/thread/condition.hpp>
+
+namespace mongo {
+
+    /** a reader/writer lock with two extra "intent" modes, for hierarchical locking.
+
+          W  exclusive                            (e.g. global write lock)
+          R  shared, excludes intent writers      (e.g. global read lock)
+          w  intent to write some part            (e.g. write lock on one database)
+          r  intent to read some part             (e.g. read lock on one database)
+
+        compatibility:
+               W  R  w  r
+           W   -  -  -  -
+           R   -  +  -  +
+           w   -  -  +  +
+           r   -  +  +  +
+
+        a waiting W blocks new acquisitions of everything, and a waiting R blocks new w's, so
+        neither is starved by a stream of intent lockers.
+
+        not recursive -- the caller tracks nesting.
+    */
+    class QLock : boost::noncopyable {
+        mongo::mutex _m;
+        boost::condition _c;
+        int _nW, _nR, _nw, _nr;
+        int _wantW, _wantR;
+
+        bool okW() const { return _nW == 0 && _nR == 0 && _nw == 0 && _nr == 0; }
+        bool okR() const { return _nW == 0 && _nw == 0 && _wantW == 0; }
+        bool okw() const { return _nW == 0 && _nR == 0 && _wantW == 0 && _wantR == 0; }
+        bool okr() const { return _nW == 0 && _wantW == 0; }
+
+        static boost::xtime deadline(int millis) {
+            boost::xtime xt;
+            boost::xtime_get(&xt, boost::TIME_UTC);
+            xt.sec += millis / 1000;
+            xt.nsec += (millis % 1000) * 1000000;
+            if ( xt.nsec >= 1000000000 ) {
+                xt.nsec -= 1000000000;
+                xt.sec++;
+            }
+            return xt;
+        }
+
+    public:
+        QLock() : _m("qlock"), _nW(0), _nR(0), _nw(0), _nr(0), _wantW(0), _wantR(0) { }
+
+        void lock_W() {
+            scoped_lock lk(_m);
+            _wantW++;
+            while ( !okW() )
+                _c.wait( lk.boost() );
+            _wantW--;
+            _nW++;
+        }
+
+        /** @return false if we timed out */
+        bool lock_W_try(int millis) {
+            scoped_lock lk(_m);
+            boost::xtime xt = deadline(millis);
+            _wantW++;
+            while ( !okW() ) {
+                if ( !_c.timed_wait( lk.boost() , xt ) && !okW() ) {
+                    _wantW--;
+                    _c.notify_all(); // we may have been holding others back
+                    return false;
+                }
+            }
+            _wantW--;
+            _nW++;
+            return true;
+        }
+
+        void lock_R() {
+            scoped_lock lk(_m);
+            _wantR++;
+            while ( !okR() )
+                _c.wait( lk.boost() );
+            _wantR--;
+            _nR++;
+        }
+
+        bool lock_R_try(int millis) {
+            scoped_lock lk(_m);
+            boost::xtime xt = deadline(millis);
+            _wantR++;
+            while ( !okR() ) {
+                if ( !_c.timed_wait( lk.boost() , xt ) && !okR() ) {
+                    _wantR--;
+                    _c.notify_all();
+                    return false;
+                }
+            }
+            _wantR--;
+            _nR++;
+            return true;
+        }
+
+        void lock_w() {
+            scoped_lock lk(_m);
+            while ( !okw() )
+                _c.wait( lk.boost() );
+            _nw++;
+        }
+
+        void lock_r() {
+            scoped_lock lk(_m);
+            while ( !okr() )
+                _c.wait( lk.boost() );
+            _nr++;
+        }
+
+        void unlock_W() { scoped_lock lk(_m); _nW--; _c.notify_all(); }
+        void unlock_R() { scoped_lock lk(_m); if ( --_nR == 0 ) _c.notify_all(); }
+        void unlock_w() { scoped_lock lk(_m); if ( --_nw == 0 ) _c.notify_all(); }
+        void unlock_r() { scoped_lock lk(_m); if ( --_nr == 0 ) _c.notify_all(); }
+    };
+
+}
@@ -38,4 +38,35 @@ namespace mongo {
         _condition.notify_one();
     }
 
+    NotifyAll::NotifyAll() : _mutex( "NotifyAll" ) , _last( 0 ) { }
+
+    NotifyAll::When NotifyAll::now() {
+        scoped_lock lock( _mutex );
+        return _last;
+    }
+
+    bool NotifyAll::timedWaitFor( When e , int millis ) {
+        boost::xtime xt;
+        boost::xtime_get( &xt , boost::TIME_UTC );
+        xt.sec += millis / 1000;
+        xt.nsec += ( millis % 1000 ) * 1000000;
+        if ( xt.nsec >= 1000000000 ) {
+            xt.nsec -= 1000000000;
+            xt.sec++;
+        }
+
+        scoped_lock lock( _mutex );
+        while ( _last == e ) {
+            if ( ! _condition.timed_wait( lock.boost() , xt ) )
+                return _last != e;
+        }
+        return true;
+    }
+
+    void NotifyAll::notifyAll() {
+        scoped_lock lock( _mutex );
+        _last++;
+        _condition.notify_all();
+    }
+
 } // namespace mongo
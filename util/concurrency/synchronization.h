@@ -50,4 +50,33 @@ namespace mongo {
         boost::condition _condition;  // cond over _notified being true
     };
 
+    /*
+     * Wakes every waiter on each notifyAll().  To not miss a notification that lands between checking
+     * for the event and waiting, a waiter takes now() before checking and waits for a notification
+     * after that.
+     *
+     * This class is thread-safe.
+     */
+    class NotifyAll : boost::noncopyable {
+    public:
+        NotifyAll();
+
+        typedef unsigned long long When;
+
+        When now();
+
+        /*
+         * Blocks until a notifyAll() after 'e', or until 'millis' pass.
+         * @return false on timeout
+         */
+        bool timedWaitFor( When e , int millis );
+
+        void notifyAll();
+
+    private:
+        mongo::mutex _mutex;          // protects state below
+        When _last;                   // count of notifyAll() calls
+        boost::condition _condition;  // cond over _last passing a waiter's When
+    };
+
 } // namespace mongo
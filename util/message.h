@@ -128,6 +128,9 @@ namespace mongo {
         void recv( char * data , int len );
         
         int unsafe_recv( char *buf, int max );
+
+        /** for event driven servers, which poll the socket themselves */
+        int getSocket() const { return sock; }
     private:
         int sock;
         PiggyBackData * piggyBackData;
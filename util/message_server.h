@@ -38,8 +38,9 @@ namespace mongo {
         struct Options {
             int port;                   // port to bind to
             string ipList;             // addresses to bind to
+            int workerThreads;          // > 0: an event loop plus this many workers rather than a thread per connection (linux only)
 
-            Options() : port(0), ipList(""){} 
+            Options() : port(0), ipList(""), workerThreads(0){} 
         };
 
         virtual ~MessageServer(){}
@@ -49,4 +50,9 @@ namespace mongo {
 
     // TODO use a factory here to decide between port and asio variations 
     MessageServer * createServer( const MessageServer::Options& opts , MessageHandler * handler );
+
+#if defined(__linux__)
+    /** epoll based, see message_server_epoll.cpp.  createServer() uses it when opts.workerThreads > 0 */
+    MessageServer * createEventServer( const MessageServer::Options& opts , MessageHandler * handler );
+#endif
 }
@@ -0,0 +1,304 @@
+// message_server_epoll.cpp
+
+/*    Copyright 2010 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/* an event driven MessageServer.
+
+   One thread waits on epoll for all client sockets and reads whatever has arrived without
+   blocking.  When a connection has a complete message it is handed to a fixed size pool of worker
+   threads which run the MessageHandler and send the reply.  So an idle connection costs a socket
+   and a small struct rather than a thread and its stack.
+
+   Each socket is registered EPOLLONESHOT: after a complete message the event thread leaves the
+   connection alone until the worker is done with it and re-arms it.  Thus only one thread touches
+   a connection at a time, messages from a client are processed in order, and the socket itself
+   can stay blocking for the (unchanged) reply path.
+
+   A request which blocks for a long time (e.g. awaitData) ties up a worker, so size the pool for
+   the number of concurrently *active* clients, not connected ones.
+*/
+
+#include "pch.h"
+
+#if defined(__linux__) && !defined(USE_ASIO)
+
+#include "message.h"
+#include "message_server.h"
+#include "concurrency/thread_pool.h"
+#include "../db/cmdline.h"
+
+#include <sys/epoll.h>
+
+namespace mongo {
+
+    namespace eventms {
+
+        /* a client connection and its partially read message */
+        class Conn : boost::noncopyable {
+        public:
+            Conn( MessagingPort * p ) : port( p ) , ticket( &connTicketHolder ) , lenHave( 0 ) , md( 0 ) , have( 0 ) {
+                otherSide = p->farEnd.toString();
+            }
+            ~Conn() {
+                if ( md )
+                    free( md );
+            }
+
+            enum ReadResult { NeedMore , Ready , Endian , Closed };
+
+            /** read what's available without blocking.  stops after one complete message, or at an
+                endian check, whose reply is left to the caller so this never blocks on a send. */
+            ReadResult readSome() {
+                int fd = port->getSocket();
+                while ( 1 ) {
+                    if ( lenHave < 4 ) {
+                        int n = ::recv( fd , lenbuf + lenHave , 4 - lenHave , MSG_DONTWAIT | MSG_NOSIGNAL );
+                        if ( n <= 0 )
+                            return recvFailed( n );
+                        lenHave += n;
+                        if ( lenHave < 4 )
+                            continue;
+
+                        int len = *((int *) lenbuf);
+                        if ( len == -1 ) {
+                            // Endian check from the client, after connecting, to see what mode server is running in.
+                            lenHave = 0;
+                            return Endian;
+                        }
+                        if ( len < 16 || len > 48000000 ) { // messages must be large enough for headers
+                            log() << "recv(): message len " << len << " is invalid, closing " << otherSide << endl;
+                            return Closed;
+                        }
+
+                        int z = (len+1023)&0xfffffc00;
+                        assert(z>=len);
+                        md = (MsgData *) malloc(z);
+                        assert(md);
+                        md->len = len;
+                        have = 4;
+                    }
+
+                    int n = ::recv( fd , ((char *) md) + have , md->len - have , MSG_DONTWAIT | MSG_NOSIGNAL );
+                    if ( n <= 0 )
+                        return recvFailed( n );
+                    have += n;
+                    if ( have == md->len )
+                        return Ready;
+                }
+            }
+
+            /** the message readSome() returned Ready for.  resets for the next one. */
+            void takeMessage( Message& m ) {
+                assert( md && have == md->len );
+                m.setData( md , true );
+                md = 0;
+                have = 0;
+                lenHave = 0;
+            }
+
+            auto_ptr<MessagingPort> port;
+            string otherSide;
+
+        private:
+            ReadResult recvFailed( int n ) {
+                if ( n == 0 ) {
+                    if( !cmdLine.quiet )
+                        log() << "end connection " << otherSide << endl;
+                    return Closed;
+                }
+                int x = errno;
+                if ( x == EAGAIN || x == EWOULDBLOCK || x == EINTR )
+                    return NeedMore;
+                log(1) << "recv() error on " << otherSide << ": " << errnoWithDescription(x) << endl;
+                return Closed;
+            }
+
+            TicketHolderReleaser ticket;
+            char lenbuf[4];
+            int lenHave;
+            MsgData *md;
+            int have;
+        };
+
+    }
+
+    using namespace eventms;
+
+    class EventMessageServer : public MessageServer , public Listener {
+    public:
+        EventMessageServer( const MessageServer::Options& opts, MessageHandler * handler ) :
+            Listener( opts.ipList, opts.port ) , _handler( handler ) , 
+            _nWorkers( opts.workerThreads ) , _workers( opts.workerThreads ) , _stop( false ) {
+            _epfd = epoll_create( 1024 );
+            massert( 13631 , "epoll_create failed: " + errnoWithDescription() , _epfd >= 0 );
+        }
+
+        ~EventMessageServer() {
+            _stop = true;
+            if ( _events.get() )
+                _events->join();
+            _workers.join();
+            ::close( _epfd );
+        }
+
+        virtual void accepted(MessagingPort * p) {
+            if ( ! connTicketHolder.tryAcquire() ){
+                log() << "connection refused because too many open connections: " << connTicketHolder.used() << endl;
+
+                // TODO: would be nice if we notified them...
+                p->shutdown();
+                delete p;
+
+                sleepmillis(2); // otherwise we'll hard loop
+                return;
+            }
+
+            Conn * c = new Conn( p );
+            struct epoll_event ev;
+            memset( &ev , 0 , sizeof(ev) );
+            ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            ev.data.ptr = c;
+            if ( epoll_ctl( _epfd , EPOLL_CTL_ADD , p->getSocket() , &ev ) != 0 ) {
+                log() << "epoll_ctl add failed, closing connection: " << errnoWithDescription() << endl;
+                close( c , false );
+            }
+        }
+
+        virtual void setAsTimeTracker(){
+            Listener::setAsTimeTracker();
+        }
+
+        void run(){
+            log() << "serving connections with an event loop and " << _nWorkers << " worker threads" << endl;
+            _events.reset( new boost::thread( boost::bind( &EventMessageServer::eventLoop , this ) ) );
+            initAndListen();
+        }
+
+    private:
+        void eventLoop() {
+            setThreadName( "connEvents" );
+            const int MaxEvents = 256;
+            struct epoll_event events[MaxEvents];
+            while ( ! _stop && ! inShutdown() ) {
+                int n = epoll_wait( _epfd , events , MaxEvents , 100 );
+                if ( n < 0 ) {
+                    if ( errno == EINTR )
+                        continue;
+                    log() << "epoll_wait failed: " << errnoWithDescription() << endl;
+                    sleepmillis(10);
+                    continue;
+                }
+                for ( int i = 0; i < n; i++ )
+                    ready( (Conn *) events[i].data.ptr );
+            }
+        }
+
+        /** on the event thread: the socket is readable (or hung up) */
+        void ready( Conn * c ) {
+            Conn::ReadResult r;
+            try {
+                r = c->readSome();
+            }
+            catch ( const SocketException& ) {
+                r = Conn::Closed;
+            }
+
+            if ( r == Conn::Ready )
+                _workers.schedule( &EventMessageServer::process , this , c );
+            else if ( r == Conn::Endian )
+                _workers.schedule( &EventMessageServer::endian , this , c );
+            else if ( r == Conn::NeedMore )
+                rearm( c );
+            else
+                close( c , true );
+        }
+
+        /** on a worker thread: run the handler for the message c has buffered */
+        void process( Conn * c ) {
+            setThreadName( "conn" );
+            Message m;
+            c->takeMessage( m );
+            try {
+                _handler->process( m , c->port.get() );
+            }
+            catch ( const SocketException& ){
+                log() << "unclean socket shutdown from: " << c->otherSide << endl;
+                close( c , true );
+                return;
+            }
+            catch ( const std::exception& e ){
+                problem() << "uncaught exception (" << e.what() << ")(" << demangleName( typeid(e) ) <<") in EventMessageServer::process, closing connection" << endl;
+                close( c , true );
+                return;
+            }
+            catch ( ... ){
+                problem() << "uncaught exception in EventMessageServer::process, closing connection" << endl;
+                close( c , true );
+                return;
+            }
+            // level triggered, so if the client pipelined another message we get an event right away
+            rearm( c );
+        }
+
+        /** on a worker thread: answer an endian check, which may block if the client isn't reading */
+        void endian( Conn * c ) {
+            setThreadName( "conn" );
+            try {
+                unsigned foo = 0x10203040;
+                c->port->send( (char *) &foo, 4, "endian" );
+            }
+            catch ( const SocketException& ){
+                close( c , true );
+                return;
+            }
+            rearm( c );
+        }
+
+        void rearm( Conn * c ) {
+            struct epoll_event ev;
+            memset( &ev , 0 , sizeof(ev) );
+            ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            ev.data.ptr = c;
+            if ( epoll_ctl( _epfd , EPOLL_CTL_MOD , c->port->getSocket() , &ev ) != 0 ) {
+                log() << "epoll_ctl mod failed, closing connection: " << errnoWithDescription() << endl;
+                close( c , true );
+            }
+        }
+
+        /** the caller must be the only thread with c -- true for whoever last got it from epoll */
+        void close( Conn * c , bool registered ) {
+            if ( registered )
+                epoll_ctl( _epfd , EPOLL_CTL_DEL , c->port->getSocket() , 0 );
+            c->port->shutdown();
+            _handler->disconnected( c->port.get() );
+            delete c;
+        }
+
+        MessageHandler * _handler;
+        int _epfd;
+        const int _nWorkers;
+        ThreadPool _workers;
+        scoped_ptr<boost::thread> _events;
+        volatile bool _stop; // tells eventLoop to return, so _epfd can be closed
+    };
+
+    MessageServer * createEventServer( const MessageServer::Options& opts , MessageHandler * handler ){
+        return new EventMessageServer( opts , handler );
+    }
+
+}
+
+#endif
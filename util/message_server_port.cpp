@@ -119,6 +119,13 @@ namespace mongo {
 
 
     MessageServer * createServer( const MessageServer::Options& opts , MessageHandler * handler ){
+#if defined(__linux__)
+        if ( opts.workerThreads > 0 )
+            return createEventServer( opts , handler );
+#else
+        if ( opts.workerThreads > 0 )
+            log() << "warning: worker threads are only supported on linux, using a thread per connection" << endl;
+#endif
         return new PortMessageServer( opts , handler );
     }    
 
@@ -22,6 +22,8 @@
 
 namespace mongo {
 
+    bool MemoryMappedFile::_usePrivateViews = false;
+
     /* Create. Must not exist. 
     @param zero fill file with zeros when true
     */
@@ -31,7 +33,8 @@ namespace mongo {
         if( p ) {
             size_t sz = (size_t) len;
             assert( len == sz );
-            memset(p, 0, sz);
+            // through the shared view so that the zeros reach the file even with private views on
+            memset(view, 0, sz);
         }
         return p;
     }
@@ -148,6 +151,72 @@ namespace mongo {
         return seen.size();
     }
 
+    /* view start address -> file.  protected by mmmutex. */
+    static map<const char*, MemoryMappedFile*> viewsByAddress;
+
+    /* keyed by the view handed out by map(), as that is what write intents point into */
+    void MemoryMappedFile::viewMapped() {
+        const char *v = (const char *) ( _privateView ? _privateView : view );
+        if ( v == 0 )
+            return;
+        rwlock lk( mmmutex , true );
+        viewsByAddress[v] = this;
+    }
+
+    void MemoryMappedFile::viewUnmapping() {
+        const char *v = (const char *) ( _privateView ? _privateView : view );
+        if ( v == 0 )
+            return;
+        rwlock lk( mmmutex , true );
+        viewsByAddress.erase(v);
+    }
+
+    /*static*/ void MemoryMappedFile::remapPrivateViews() {
+        if ( !_usePrivateViews )
+            return;
+        // exclusive: Record::touch() readers hold LockMongoFilesShared without the db lock
+        rwlock lk( mmmutex , true );
+        for ( std::map<const char*, MemoryMappedFile*>::iterator i = viewsByAddress.begin(); i != viewsByAddress.end(); ++i ) {
+            MemoryMappedFile *f = i->second;
+            if ( f->_privateView == 0 )
+                continue;
+            void *p = f->mapPrivateView();
+            massert( 13648 , string("couldn't remap private view of ") + f->_filename , p == i->first );
+        }
+    }
+
+    /*static*/ MemoryMappedFile* MemoryMappedFile::fileContaining(const void *p, unsigned long long& ofs) {
+        const char *x = (const char *) p;
+        rwlock lk( mmmutex , false );
+        std::map<const char*, MemoryMappedFile*>::iterator i = viewsByAddress.upper_bound(x);
+        if ( i == viewsByAddress.begin() )
+            return 0;
+        --i;
+        MemoryMappedFile *f = i->second;
+        unsigned long long o = x - i->first;
+        if ( o >= f->len )
+            return 0;
+        ofs = o;
+        return f;
+    }
+
+    /*static*/ bool MemoryMappedFile::isMapped_inlock(const void *p, unsigned len) {
+        const char *x = (const char *) p;
+        std::map<const char*, MemoryMappedFile*>::iterator i = viewsByAddress.upper_bound(x);
+        if ( i == viewsByAddress.begin() )
+            return false;
+        --i;
+        return (unsigned long long) (x - i->first) + len <= i->second->len;
+    }
+
+    LockMongoFilesShared::LockMongoFilesShared() { 
+        mmmutex.lock_shared();
+    }
+
+    LockMongoFilesShared::~LockMongoFilesShared() { 
+        mmmutex.unlock_shared();
+    }
+
     void MongoFile::created(){
         rwlock lk( mmmutex , true );
         mmfiles.insert(this);
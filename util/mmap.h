@@ -72,6 +72,15 @@ namespace mongo {
     inline void MongoFile::unlockAll() {}
 #endif
 
+    /** while in scope no file can be unmapped (or closed).  for touching mapped memory without the
+        db lock -- see Record::touch().  don't take the db lock while holding this.
+    */
+    class LockMongoFilesShared : boost::noncopyable {
+    public:
+        LockMongoFilesShared();
+        ~LockMongoFilesShared();
+    };
+
     struct MongoFileAllowWrites {
         MongoFileAllowWrites(){
             MongoFile::lockAll();
@@ -180,12 +189,49 @@ namespace mongo {
 
         string filename() const { return _filename; }
 
+        /** find the mapped file whose view contains p.  used by the journal (see db/dur.cpp) to 
+            translate a write intent into a file and offset.
+            @param ofs set to the offset of p within the file
+            @return 0 if p is not within any view
+        */
+        static MemoryMappedFile* fileContaining(const void *p, unsigned long long& ofs);
+
+        /** @return true if all of [p, p+len) is within a mapped view.  caller must hold a 
+            LockMongoFilesShared, which keeps it mapped until released. */
+        static bool isMapped_inlock(const void *p, unsigned len);
+
+        /** with private views on, map() returns a copy-on-write view of the file: writes to it never
+            reach the file on their own.  the journal (db/dur.cpp) copies committed bytes into the
+            shared view, which is the one flushed to disk.  call before any file is mapped. */
+        static void usePrivateViews(bool b) { _usePrivateViews = b; }
+        static bool privateViews() { return _usePrivateViews; }
+
+        /** the view that is written back to the file.  the same as the view map() returned unless
+            private views are on. */
+        char* sharedView() const { return (char *) view; }
+
+        /** discard the pages written in every private view, so they show the shared view again and
+            stop holding memory.  everything written must already be in the shared views, so call in
+            the write lock right after a commit. */
+        static void remapPrivateViews();
+
     private:
         static void updateLength( const char *filename, unsigned long long &length );
+
+        /* maintain the view -> file map used by fileContaining().  call after mapping and before unmapping. */
+        void viewMapped();
+        void viewUnmapping();
+
+        /** map _privateView copy-on-write over the file, at the same address if it was mapped before */
+        void* mapPrivateView();
+        void unmapPrivateView();
+
+        static bool _usePrivateViews;
         
         HANDLE fd;
         HANDLE maphandle;
-        void *view;
+        void *view;         // MAP_SHARED
+        void *_privateView; // copy-on-write view handed out when _usePrivateViews, else 0
         unsigned long long len;
         string _filename;
 
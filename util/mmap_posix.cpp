@@ -32,11 +32,14 @@ namespace mongo {
         fd = 0;
         maphandle = 0;
         view = 0;
+        _privateView = 0;
         len = 0;
         created();
     }
 
     void MemoryMappedFile::close() {
+        viewUnmapping();
+        unmapPrivateView();
         if ( view )
             munmap(view, len);
         view = 0;
@@ -93,11 +96,37 @@ namespace mongo {
         }
 #endif
 
+        if ( _usePrivateViews && mapPrivateView() == 0 ) {
+            munmap(view, length);
+            view = 0;
+            return 0;
+        }
+
         DEV if (! dbMutex.info().isLocked()){
             _unlock();
         }
 
-        return view;
+        viewMapped();
+        return _privateView ? _privateView : view;
+    }
+
+    void* MemoryMappedFile::mapPrivateView() {
+        int flags = MAP_PRIVATE;
+        if ( _privateView )
+            flags |= MAP_FIXED; // replaces the old mapping, dropping its copied pages
+        void *p = mmap(_privateView, len, PROT_READ|PROT_WRITE, flags, fd, 0);
+        if ( p == MAP_FAILED ) {
+            out() << "  mmap() failed for private view of " << _filename << " len:" << len << " " << errnoWithDescription() << endl;
+            return 0;
+        }
+        _privateView = p;
+        return p;
+    }
+
+    void MemoryMappedFile::unmapPrivateView() {
+        if ( _privateView )
+            munmap(_privateView, len);
+        _privateView = 0;
     }
     
     void* MemoryMappedFile::testGetCopyOnWriteView(){
@@ -139,12 +168,15 @@ namespace mongo {
         return new PosixFlushable( view , fd , len );
     }
 
+    /* with private views the shared view is left alone: the journal writes to it outside the db lock */
     void MemoryMappedFile::_lock() {
-        if (view) assert(mprotect(view, len, PROT_READ | PROT_WRITE) == 0);
+        void *v = _privateView ? _privateView : view;
+        if (v) assert(mprotect(v, len, PROT_READ | PROT_WRITE) == 0);
     }
 
     void MemoryMappedFile::_unlock() {
-        if (view) assert(mprotect(view, len, PROT_READ) == 0);
+        void *v = _privateView ? _privateView : view;
+        if (v) assert(mprotect(v, len, PROT_READ) == 0);
     }
 
 } // namespace mongo
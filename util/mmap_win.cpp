@@ -28,11 +28,14 @@ namespace mongo {
         fd = 0;
         maphandle = 0;
         view = 0;
+        _privateView = 0;
         len = 0;
         created();
     }
 
     void MemoryMappedFile::close() {
+        viewUnmapping();
+        unmapPrivateView();
         if ( view )
             UnmapViewOfFile(view);
         view = 0;
@@ -122,7 +125,35 @@ namespace mongo {
             log() << "MapViewOfFile failed " << filename << " " << errnoWithDescription(e) << endl;
         }
         len = length;
-        return view;
+        if ( view && _usePrivateViews && mapPrivateView() == 0 )
+            return 0;
+        viewMapped();
+        return _privateView ? _privateView : view;
+    }
+
+    void* MemoryMappedFile::mapPrivateView() {
+        assert( maphandle );
+        void *at = _privateView;
+        if ( at ) {
+            // no equivalent of MAP_FIXED: unmap and map again at the same address.  we hold the
+            // write lock and nothing else maps files then, so the range should still be free.
+            UnmapViewOfFile(at);
+            _privateView = 0;
+        }
+        void *p = MapViewOfFileEx(maphandle, FILE_MAP_COPY, /*f ofs hi*/0, /*f ofs lo*/ 0, /*dwNumberOfBytesToMap 0 means to eof*/0, at);
+        if ( p == 0 ) {
+            DWORD e = GetLastError();
+            log() << "FILE_MAP_COPY MapViewOfFileEx failed " << _filename << " " << errnoWithDescription(e) << endl;
+            return 0;
+        }
+        _privateView = p;
+        return p;
+    }
+
+    void MemoryMappedFile::unmapPrivateView() {
+        if ( _privateView )
+            UnmapViewOfFile(_privateView);
+        _privateView = 0;
     }
 
     class WindowsFlushable : public MemoryMappedFile::Flushable {
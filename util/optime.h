@@ -39,8 +39,11 @@ namespace mongo {
         unsigned i;
         unsigned secs;
         static OpTime last;
+        /* with --perDbLocking writers to different databases can ask for one at once */
+        static mongo::mutex _mutex;
     public:
         static void setLast(const Date_t &date) {
+            scoped_lock lk(_mutex);
             last = OpTime(date);
         }
         unsigned getSecs() const {
@@ -61,6 +64,7 @@ namespace mongo {
             i = 0;
         }
         static OpTime now() {
+            scoped_lock lk(_mutex);
             unsigned t = (unsigned) time(0);
 //            DEV assertInWriteLock();
             if ( t < last.secs ){
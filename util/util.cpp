@@ -161,6 +161,7 @@ namespace mongo {
     FileAllocator &theFileAllocator() { return theFileAllocator_; }
     
     OpTime OpTime::last(0, 0);
+    mongo::mutex OpTime::_mutex("optime");
     
     /* this is a good place to set a breakpoint when debugging, as lots of warning things
        (assert, wassert) call it.